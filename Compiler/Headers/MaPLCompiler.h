@@ -9,11 +9,31 @@
 #define MaPLCompiler_h
 
 #include <filesystem>
+#include <functional>
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 #include <stdint.h>
 
+#include "MaPLTypedefs.h"
+
+/**
+ * Identifies a statement by the line and column of its first character. Lines start at 1 and columns start at 0.
+ */
+typedef std::pair<MaPLLineNumber, MaPLLineNumber> MaPLProfileLocation;
+
+/**
+ * How often the branches and host calls within each statement of a script executed, as recorded by the runtime via @c MaPLExecutionProfile.
+ */
+struct MaPLScriptProfile {
+    /// Keyed by statement location. The number of times that the condition of each statement's branch was true and false.
+    std::map<MaPLProfileLocation, std::pair<uint64_t, uint64_t>> branchCounts;
+    
+    /// Keyed by statement location. The number of times that host functions and properties were invoked within each statement.
+    std::map<MaPLProfileLocation, uint64_t> callCounts;
+};
+
 struct MaPLCompileOptions {
     /// If true, the resulting bytecode will include debug information about what
     /// line number is being evaluated and the values of variables as they change.
@@ -22,6 +42,84 @@ struct MaPLCompileOptions {
     
     /// The name that is prepended to all symbols in the symbol table.
     std::string symbolsPrefix = "MaPLSymbols";
+    
+    /// If true, a script is linked against the bytecode of the imported script that all of its other imports stem from,
+    /// instead of copying the bytecode of every dependency into the script. Scripts with imports that are independent of
+    /// each other fail to compile. Linked dependencies are included in the compiled files, and must be run via
+    /// @c executeMaPLDependency before the scripts that link against them.
+    bool linkDependencies = false;
+    
+    /// If true, variables that are initialized with a compile-time constant and never reassigned are
+    /// substituted with that constant wherever they're read. This allows constant folding and dead code
+    /// stripping to apply to expressions that reference those variables.
+    bool propagateConstants = false;
+    
+    /// Controls how aggressively the finished bytecode is rewritten by the peephole optimizer.
+    /// A value of 0 disables the peephole optimizer, and 1 enables all currently implemented rewrites.
+    /// Levels of 1 and higher also place primitive variables at naturally-aligned memory addresses.
+    /// Levels of 2 and higher also unroll "for" loops with a constant trip count (see @c unrollBudget).
+    uint8_t optimizationLevel = 0;
+    
+    /// Symbol descriptors (the symbol table names without the @c symbolsPrefix, for example "Array_count") of host
+    /// properties and functions whose values never change while a script executes, and which have no side effects.
+    /// Invariant expressions built from these APIs are hoisted out of loop conditions into hidden variables, so that
+    /// the host is queried once per loop instead of once per iteration.
+    std::set<std::string> invariantSymbols;
+    
+    /// If true, memory addresses, symbols, cursor moves, line numbers, and integer literals in the bytecode are stored
+    /// as variable-length integers rather than at their full width. Most scripts use small values for all of these,
+    /// so the bytecode is considerably smaller. The runtime detects this encoding from the first byte of the bytecode.
+    bool compactEncoding = false;
+    
+    /// If true, every compiled file is also packed into a single bundle, which is output via @c MaPLCompileResult::bundle.
+    /// Bundled scripts share one pool of deduplicated string literals, and are found at runtime via @c findMaPLBundleScript.
+    bool bundleScripts = false;
+    
+    /// If true, the line number of each statement is recorded in a separate table that is output via
+    /// @c MaPLCompileResult::debugLineTables, without adding any debug info to the bytecode itself. Hosts
+    /// can use this table to report line numbers for errors while running scripts at full speed. The name, type,
+    /// location and scope of each variable is likewise output via @c MaPLCompileResult::debugVariableTables.
+    bool debugLineTable = false;
+    
+    /// Symbol values assigned by previous compilations, keyed by symbol descriptor (the symbol table names without the
+    /// @c symbolsPrefix). Symbols keep these values rather than being renumbered, so that bytecode and host dispatch tables
+    /// built against an earlier symbol table remain valid as APIs are added. Typically populated from the
+    /// @c MaPLCompileResult::persistedSymbols of the previous compilation.
+    std::map<std::string, MaPLSymbol> persistedSymbols;
+    
+    /// If true, ANTLR profiles every decision made while parsing each file, and the results are output via
+    /// @c MaPLCompileResult::parserProfiles. Useful for finding grammar rules that are expensive to parse. Slows parsing.
+    bool profileParser = false;
+    
+    /// If true, metadata statements are compiled so that interpolated values keep their types rather than being typecast to strings.
+    /// The runtime formats them without allocating, and passes each metadata statement to the host in a single callback. Integers are
+    /// formatted the same as typecasts, but floating point values use the fewest digits that preserve their exact value, rather than "%g".
+    bool typedMetadata = false;
+    
+    /// The maximum number of bytes that an unrolled "for" loop may occupy at an @c optimizationLevel of 2 or higher. A loop whose
+    /// trip count is known at compile time is fully unrolled if every iteration fits in this budget, with the loop variable replaced
+    /// by its value in each iteration. Otherwise, it's partially unrolled by the largest factor (up to 8) that divides the trip count
+    /// and fits in the budget. A value of 0 disables unrolling.
+    uint16_t unrollBudget = 256;
+    
+    /// If true, stores whose values are never read are removed, along with any variable that is never read. This covers variables
+    /// declared within a scope that are never read, and assignments that are overwritten before they're read. A store is only removed
+    /// if its expression doesn't call the host, so host side effects are preserved. Global variables are always kept, because scripts
+    /// that import this one can read them. Each removal is reported via @c MaPLCompileResult::warningMessages. Has no effect on
+    /// scripts compiled with @c includeDebugBytes.
+    bool eliminateDeadStores = false;
+    
+    /// Execution profiles recorded by the runtime, keyed by the normalized absolute path of each script (see @c parseMaPLExecutionProfile).
+    /// A profiled script is laid out for the paths that it took most often: conditionals are inverted so that the more frequent branch
+    /// doesn't end in a cursor move, chains of conditionals that compare one variable to constants are reordered to test the most frequent
+    /// case first, loops that never ran aren't unrolled, and loops that made at least half of the script's host calls are unrolled with
+    /// twice the @c unrollBudget. Profiles should be recorded from scripts compiled without profiles and with an @c unrollBudget of 0,
+    /// so that every branch is recorded in its original form.
+    std::map<std::filesystem::path, MaPLScriptProfile> scriptProfiles;
+    
+    /// If true, a JSON report that estimates the cost of running each compiled file is output via @c MaPLCompileResult::costReports.
+    /// Doesn't affect the bytecode.
+    bool costReport = false;
 };
 
 struct MaPLCompileResult {
@@ -29,11 +127,117 @@ struct MaPLCompileResult {
     /// The header contains the symbols that the script uses to query the host app.
     std::string symbolTable;
     
+    /// Every symbol value assigned so far: the contents of @c MaPLCompileOptions::persistedSymbols, plus the values assigned
+    /// to any new symbols in this compilation. Should be saved and passed to subsequent compilations.
+    std::map<std::string, MaPLSymbol> persistedSymbols;
+    
     /// A mapping of file paths to the resulting bytecode. If compilation failed, this mapping will be empty.
     std::map<std::filesystem::path, std::vector<uint8_t>> compiledFiles;
     
+    /// All compiled files packed into a single bundle. Each script is named by its path relative to the deepest directory
+    /// that contains all of the compiled files. Only populated when compiled with the @c bundleScripts option.
+    std::vector<uint8_t> bundle;
+    
+    /// A mapping of file paths to the debug line table for each file's bytecode in @c compiledFiles. Each table is an array of
+    /// @c MaPLDebugLineEntry, and can be searched via @c findMaPLDebugLine. Only populated when compiled with the @c debugLineTable option.
+    std::map<std::filesystem::path, std::vector<uint8_t>> debugLineTables;
+    
+    /// A mapping of file paths to the debug variable table for each file's bytecode in @c compiledFiles (see @c MaPLDebugVariableEntry).
+    /// Variables can be found via @c findMaPLDebugVariable. Only populated when compiled with the @c debugLineTable option.
+    std::map<std::filesystem::path, std::vector<uint8_t>> debugVariableTables;
+    
+    /// A mapping of file paths to the path of the dependency that the file's bytecode is linked against.
+    /// Only populated for scripts that were linked when compiled with the @c linkDependencies option.
+    std::map<std::filesystem::path, std::filesystem::path> linkedDependencies;
+    
+    /// A mapping of file paths to the number of bytes that the peephole optimizer removed from the file's bytecode.
+    /// Only populated when compiled with an @c optimizationLevel greater than 0.
+    std::map<std::filesystem::path, size_t> peepholeBytesSaved;
+    
+    /// A mapping of file paths to a tab-separated report of the time spent in each parser decision, sorted from slowest to fastest.
+    /// Includes all imported files. Only populated when compiled with the @c profileParser option.
+    std::map<std::filesystem::path, std::string> parserProfiles;
+    
+    /// A mapping of file paths to a JSON object that describes the static cost of each file's bytecode in @c compiledFiles:
+    ///   "bytecodeSize" - The total byte size of the bytecode.
+    ///   "primitiveMemorySize" - The byte size of the primitive variable table that the runtime allocates for the script.
+    ///   "allocatedMemorySize" - The number of entries in the string variable table that the runtime allocates for the script.
+    ///   "bytesPerLine" - The number of bytes compiled from each line. Bytes from imported scripts and the bytecode header are under line 0.
+    ///   "hostCallSitesPerSymbol" - The number of places in the bytecode that call each host function or property, keyed by symbol descriptor.
+    ///   "hostCalls" - Each place in the bytecode that calls the host, with its symbol descriptor, line, and the number of loops it's nested in.
+    ///   "stringAllocationsPerLine" - The number of concatenations and typecasts on each line that allocate a string when evaluated.
+    /// Sizes and nesting reflect the bytecode after all optimizations, so a fully unrolled loop doesn't count toward nesting.
+    /// Only populated when compiled with the @c costReport option.
+    std::map<std::filesystem::path, std::string> costReports;
+    
     /// A list of error messages. This list is only populated if compilation fails.
     std::vector<std::string> errorMessages;
+    
+    /// A list of warning messages, which describe code that compiled successfully but was removed by the compiler.
+    /// Includes warnings for all imported files. Only populated when compiled with the @c eliminateDeadStores option.
+    std::vector<std::string> warningMessages;
+};
+
+/**
+ * Supplies the source text of a script that was not provided directly to the compiler (typically a script referenced
+ * by an #import statement). Receives the normalized absolute path of the script.
+ *
+ * @return @c true if the script was found and its text was written into @c sourceText.
+ */
+typedef std::function<bool(const std::filesystem::path &normalizedPath, std::string &sourceText)> MaPLImportResolver;
+
+class MaPLFileCache;
+
+/**
+ * A long-lived compilation context for hosts that compile scripts repeatedly. Files parsed and compiled by a session are
+ * retained between calls to @c compile, so that dependencies shared by many scripts are only compiled once. Retained files
+ * are recompiled when their contents change on disk, along with every file that depends on them.
+ */
+class MaPLCompileSession {
+public:
+    
+    /**
+     * @param options Allows the caller to configure some details of the compilation. Applies to every compilation in this session.
+     */
+    MaPLCompileSession(const MaPLCompileOptions &options);
+    
+    /**
+     * @param options Allows the caller to configure some details of the compilation. Applies to every compilation in this session.
+     * @param importResolver Supplies the text of any script whose source was not passed to @c compileSources, instead of reading
+     *                       it from the filesystem. Each script is resolved at most once per call to @c compile or
+     *                       @c compileSources, and is recompiled (along with its dependents) if the resolved text changes.
+     */
+    MaPLCompileSession(const MaPLCompileOptions &options, const MaPLImportResolver &importResolver);
+    ~MaPLCompileSession();
+    
+    MaPLCompileSession(const MaPLCompileSession &) = delete;
+    MaPLCompileSession &operator=(const MaPLCompileSession &) = delete;
+    
+    /**
+     * Compiles a list of MaPL scripts, reusing any unmodified files compiled previously by this session.
+     *
+     * @param scriptPaths A list of paths to all script files that will be compiled. Paths must be absolute.
+     *
+     * @return The results of the compilation. If compilation fails, only the @c errorMessages list will be populated.
+     */
+    MaPLCompileResult compile(const std::vector<std::filesystem::path> &scriptPaths);
+    
+    /**
+     * Compiles a list of MaPL scripts from source text held in memory. Any imported script that isn't included in
+     * @c scriptSources is supplied by the session's import resolver. Sources passed to this method are retained by
+     * the session, and are recompiled (along with their dependents) when different text is passed for the same path.
+     *
+     * @param scriptSources A mapping of script paths to the text of each script. Paths must be absolute, and are used
+     *                      to resolve relative #import statements.
+     *
+     * @return The results of the compilation. If compilation fails, only the @c errorMessages list will be populated.
+     */
+    MaPLCompileResult compileSources(const std::map<std::filesystem::path, std::string> &scriptSources);
+    
+private:
+    
+    MaPLCompileOptions _options;
+    MaPLFileCache *_fileCache;
 };
 
 /**
@@ -46,4 +250,31 @@ struct MaPLCompileResult {
  */
 MaPLCompileResult compileMaPL(const std::vector<std::filesystem::path> &scriptPaths, const MaPLCompileOptions &options);
 
+/**
+ * Compiles a list of MaPL scripts from source text held in memory.
+ *
+ * @param scriptSources A mapping of absolute script paths to the text of each script.
+ * @param importResolver Supplies the text of imported scripts that aren't included in @c scriptSources. If empty, imports are read from the filesystem.
+ * @param options Allows the caller to configure some details of the compilation.
+ *
+ * @return The results of the compilation. If compilation fails, only the @c errorMessages list will be populated.
+ */
+MaPLCompileResult compileMaPLSources(const std::map<std::filesystem::path, std::string> &scriptSources,
+                                     const MaPLImportResolver &importResolver,
+                                     const MaPLCompileOptions &options);
+
+/**
+ * Parses a profile file written by the runtime's @c writeMaPLExecutionProfile. The counts for each script are added to any counts
+ * already in @c profiles, so that profiles recorded by separate runs can be combined.
+ *
+ * @param profileText The contents of the profile file.
+ * @param profileDirectory The directory that relative script paths in the profile are resolved against, typically the one containing the profile file.
+ * @param profiles Receives the profile of each script, keyed by normalized absolute path. Typically @c MaPLCompileOptions::scriptProfiles.
+ *
+ * @return @c false if the profile is malformed, in which case @c profiles is left unchanged.
+ */
+bool parseMaPLExecutionProfile(const std::string &profileText,
+                               const std::filesystem::path &profileDirectory,
+                               std::map<std::filesystem::path, MaPLScriptProfile> &profiles);
+
 #endif /* MaPLCompiler_h */
@@ -6,6 +6,7 @@
 //
 
 #include "MaPLAPI.h"
+#include <algorithm>
 #include "MaPLFile.h"
 
 MaPLGenericType genericTypeForTypeContext(MaPLParser::TypeContext *typeContext, const std::vector<std::string> &generics, MaPLFile *file);
@@ -25,7 +26,7 @@ MaPLGenericType MaPLGenericType::genericWithSubstitutedGenerics(const std::vecto
     if (primitiveType == MaPLPrimitiveType_Uninitialized) {
         return genericsSubstitutions[genericIndex];
     }
-    MaPLGenericType returnType{ file, token, primitiveType, pointerType };
+    MaPLGenericType returnType{ file, location, primitiveType, pointerType };
     for (const MaPLGenericType &genericType : generics) {
         returnType.generics.push_back(genericType.genericWithSubstitutedGenerics(genericsSubstitutions));
     }
@@ -67,16 +68,28 @@ bool MaPLGenericType::operator!= (const MaPLGenericType &otherType) const {
     return !(*this == otherType);
 }
 
+bool MaPLFunctionIndexKey::operator== (const MaPLFunctionIndexKey &otherKey) const {
+    return parameterCount == otherKey.parameterCount &&
+           functionName == otherKey.functionName &&
+           typeName == otherKey.typeName;
+}
+
+size_t MaPLFunctionIndexKeyHash::operator() (const MaPLFunctionIndexKey &key) const {
+    size_t hash = std::hash<std::string>{}(key.typeName);
+    hash = hash*31 + std::hash<std::string>{}(key.functionName);
+    return hash*31 + key.parameterCount;
+}
+
 void performErrorCheckingForGeneric(const MaPLGenericType &genericType, const MaPLAPI *api) {
     if (genericType.primitiveType == MaPLPrimitiveType_Pointer) {
         const MaPLTypeAPI *typeAPI = api->findType(genericType.pointerType);
         if (typeAPI) {
             // Check that the supertype's generics count matches the number of generics on the referenced type.
             if (genericType.generics.size() != typeAPI->generics.size()) {
-                genericType.file->logError(genericType.token, "The number of generics specified for '"+genericType.pointerType+"' doesn't match the number of generics in the type declaration.");
+                genericType.file->logError(genericType.location, "The number of generics specified for '"+genericType.pointerType+"' doesn't match the number of generics in the type declaration.");
             }
         } else {
-            genericType.file->logMissingTypeError(genericType.token, genericType.pointerType);
+            genericType.file->logMissingTypeError(genericType.location, genericType.pointerType);
         }
         for (const MaPLGenericType &childGenericType : genericType.generics) {
             performErrorCheckingForGeneric(childGenericType, api);
@@ -85,13 +98,13 @@ void performErrorCheckingForGeneric(const MaPLGenericType &genericType, const Ma
 }
 
 MaPLGenericType genericTypeForPointerType(MaPLParser::PointerTypeContext *pointerTypeContext, const std::vector<std::string> &generics, MaPLFile *file) {
-    MaPLGenericType genericType{ file, pointerTypeContext->start, MaPLPrimitiveType_Pointer, pointerTypeContext->identifier()->getText() };
+    MaPLGenericType genericType{ file, sourceLocationForToken(pointerTypeContext->start), MaPLPrimitiveType_Pointer, pointerTypeContext->identifier()->getText() };
     for (size_t i = 0; i < generics.size(); i++) {
         if (genericType.pointerType == generics[i]) {
             genericType.genericIndex = i;
             genericType.primitiveType = MaPLPrimitiveType_Uninitialized;
             if (pointerTypeContext->type().size() != 0) {
-                file->logError(genericType.token, "Generic specifiers like '"+genericType.pointerType+"' cannot have their own generics.");
+                file->logError(genericType.location, "Generic specifiers like '"+genericType.pointerType+"' cannot have their own generics.");
             }
             return genericType;
         }
@@ -108,19 +121,19 @@ MaPLGenericType genericTypeForTypeContext(MaPLParser::TypeContext *typeContext,
     if (primitive == MaPLPrimitiveType_Pointer) {
         return genericTypeForPointerType(typeContext->pointerType(), generics, file);
     }
-     return { file, typeContext->start, primitive };
+     return { file, sourceLocationForToken(typeContext->start), primitive };
 }
 
 MaPLFunctionAPI functionAPIForNode(MaPLParser::ApiFunctionContext *node, const std::vector<std::string> &generics, MaPLFile *file) {
     MaPLParser::ApiTypeContext *apiTypeContext = dynamic_cast<MaPLParser::ApiTypeContext *>(node->parent);
     MaPLFunctionAPI functionAPI{
         file,
-        node,
+        sourceLocationForToken(node->start),
         node->identifier()->getText(),
         apiTypeContext ? apiTypeContext->typeName->getText() : "",
     };
     if (node->API_VOID()) {
-        functionAPI.returnType = { file, node->API_VOID()->getSymbol(), MaPLPrimitiveType_Void };
+        functionAPI.returnType = { file, sourceLocationForToken(node->API_VOID()->getSymbol()), MaPLPrimitiveType_Void };
     } else {
         functionAPI.returnType = genericTypeForTypeContext(node->type(), generics, file);
     }
@@ -138,7 +151,7 @@ MaPLPropertyAPI propertyAPIForNode(MaPLParser::ApiPropertyContext *node, const s
     MaPLParser::ApiTypeContext *apiTypeContext = dynamic_cast<MaPLParser::ApiTypeContext *>(node->parent);
     return {
         file,
-        node,
+        sourceLocationForToken(node->start),
         node->identifier()->getText(),
         apiTypeContext ? apiTypeContext->typeName->getText() : "",
         genericTypeForTypeContext(node->type(), generics, file),
@@ -150,7 +163,7 @@ MaPLSubscriptAPI subscriptAPIForNode(MaPLParser::ApiSubscriptContext *node, cons
     MaPLParser::ApiTypeContext *apiTypeContext = dynamic_cast<MaPLParser::ApiTypeContext *>(node->parent);
     return {
         file,
-        node,
+        sourceLocationForToken(node->start),
         apiTypeContext ? apiTypeContext->typeName->getText() : "",
         genericTypeForTypeContext(node->type(0), generics, file),
         genericTypeForTypeContext(node->type(1), generics, file),
@@ -159,9 +172,9 @@ MaPLSubscriptAPI subscriptAPIForNode(MaPLParser::ApiSubscriptContext *node, cons
 }
 
 MaPLTypeAPI typeAPIForNode(MaPLParser::ApiTypeContext *node, MaPLFile *file) {
-    MaPLTypeAPI typeAPI{ file, node, node->typeName->getText() };
+    MaPLTypeAPI typeAPI{ file, sourceLocationForToken(node->start), sourceLocationForToken(node->typeName->start), node->typeName->getText() };
     if (typeNameMatchesPrimitiveType(typeAPI.name)) {
-        file->logError(node->typeName->start, "Type name '"+typeAPI.name+"' conflicts with a primitive type.");
+        file->logError(typeAPI.nameLocation, "Type name '"+typeAPI.name+"' conflicts with a primitive type.");
     }
     for (MaPLParser::IdentifierContext *identifier : node->generics) {
         typeAPI.generics.push_back(identifier->getText());
@@ -241,8 +254,8 @@ void MaPLTypeAPI::assimilate(const MaPLFunctionAPI &function) {
 }
 
 void logPropertyCollision(const MaPLPropertyAPI &newProperty, const MaPLPropertyAPI &existingProperty) {
-    newProperty.file->logError(newProperty.node->start, "Property '"+newProperty.name+"' in type '"+newProperty.typeAPIName+"' conflicts with a property of the same name in type '"+existingProperty.typeAPIName+"'.");
-    existingProperty.file->logError(existingProperty.node->start, "Property '"+existingProperty.name+"' in type '"+existingProperty.typeAPIName+"' conflicts with a property of the same name in type '"+newProperty.typeAPIName+"'.");
+    newProperty.file->logError(newProperty.location, "Property '"+newProperty.name+"' in type '"+newProperty.typeAPIName+"' conflicts with a property of the same name in type '"+existingProperty.typeAPIName+"'.");
+    existingProperty.file->logError(existingProperty.location, "Property '"+existingProperty.name+"' in type '"+existingProperty.typeAPIName+"' conflicts with a property of the same name in type '"+newProperty.typeAPIName+"'.");
 }
 
 void MaPLTypeAPI::assimilate(const MaPLPropertyAPI &property) {
@@ -262,23 +275,24 @@ void MaPLAPI::assimilate(const MaPLFunctionAPI &globalFunction) {
 
 void MaPLAPI::assimilate(const MaPLPropertyAPI &globalProperty) {
     if (globalProperties.count(globalProperty.name)) {
-        globalProperty.file->logError(globalProperty.node->start, "Global property '"+globalProperty.name+"' is in conflict with a previously declared global property of the same name.");
+        globalProperty.file->logError(globalProperty.location, "Global property '"+globalProperty.name+"' is in conflict with a previously declared global property of the same name.");
         MaPLPropertyAPI &conflictingProperty = globalProperties[globalProperty.name];
-        conflictingProperty.file->logError(conflictingProperty.node->start, "Global property '"+conflictingProperty.name+"' later comes into conflict with a global property of the same name.");
+        conflictingProperty.file->logError(conflictingProperty.location, "Global property '"+conflictingProperty.name+"' later comes into conflict with a global property of the same name.");
     }
     globalProperties[globalProperty.name] = globalProperty;
 }
 
 void MaPLAPI::assimilate(const MaPLTypeAPI &type) {
     if (types.count(type.name)) {
-        type.file->logError(type.node->typeName->start, "Type '"+type.name+"' conflicts with another type of the same name.");
+        type.file->logError(type.nameLocation, "Type '"+type.name+"' conflicts with another type of the same name.");
         MaPLTypeAPI &conflictingType = types[type.name];
-        conflictingType.file->logError(conflictingType.node->typeName->start, "Type '"+type.name+"' later comes into conflict with a type of the same name.");
+        conflictingType.file->logError(conflictingType.nameLocation, "Type '"+type.name+"' later comes into conflict with a type of the same name.");
     }
     types[type.name] = type;
 }
 
 void MaPLAPI::assimilate(const MaPLAPI *otherAPI) {
+    invalidateIndices();
     for (const MaPLFunctionAPI &functionAPI : otherAPI->globalFunctions) {
         if (functionAPI.declaredInDependency) { continue; }
         assimilate(functionAPI);
@@ -294,6 +308,7 @@ void MaPLAPI::assimilate(const MaPLAPI *otherAPI) {
 }
 
 void MaPLAPI::assimilate(MaPLParser::ProgramContext *program, MaPLFile *file) {
+    invalidateIndices();
     for(MaPLParser::StatementContext *statement : program->statement()) {
         MaPLParser::ApiTypeContext *typeContext = statement->apiType();
         if (typeContext) {
@@ -341,7 +356,7 @@ void checkForFunctionCollisionsInList(const MaPLFunctionAPI *originalFunction, c
             }
         }
         if (parametersAreEquivalent) {
-            originalFunction->file->logError(originalFunction->node->start, "Function '"+originalFunction->signatureDescriptor()+"' is in conflict with function '"+functionAPI.signatureDescriptor()+"'.");
+            originalFunction->file->logError(originalFunction->location, "Function '"+originalFunction->signatureDescriptor()+"' is in conflict with function '"+functionAPI.signatureDescriptor()+"'.");
         }
     }
 }
@@ -373,7 +388,7 @@ void checkForSubscriptCollisions(const MaPLAPI *api, const MaPLSubscriptAPI *ori
         if (subscriptAPI.indexType.genericWithSubstitutedGenerics(substitutedGenerics) == originalSubscript->indexType) {
             std::string originalDescriptor = descriptorForType(originalSubscript->indexType.typeWithoutSubstitutedGenerics());
             std::string subscriptAPIDescriptor = descriptorForType(subscriptAPI.indexType.typeWithoutSubstitutedGenerics());
-            originalSubscript->file->logError(originalSubscript->node->start, "Subscript with index type '"+originalDescriptor+"' on type '"+originalSubscript->typeAPIName+"' is in conflict with subscript with index type '"+subscriptAPIDescriptor+"' on type '"+subscriptAPI.typeAPIName+"'.");
+            originalSubscript->file->logError(originalSubscript->location, "Subscript with index type '"+originalDescriptor+"' on type '"+originalSubscript->typeAPIName+"' is in conflict with subscript with index type '"+subscriptAPIDescriptor+"' on type '"+subscriptAPI.typeAPIName+"'.");
         }
     }
     for (const MaPLGenericType &supertype : foundType->supertypes) {
@@ -390,9 +405,9 @@ void MaPLAPI::performErrorChecking() {
         for (const std::string &genericDescriptor : type.generics) {
             // Log an error if a generic descriptor conflicts with a type name.
             if (types.count(genericDescriptor)) {
-                type.file->logError(type.node->start, "Generic descriptor '"+genericDescriptor+"' conflicts with a type of the same name.");
+                type.file->logError(type.location, "Generic descriptor '"+genericDescriptor+"' conflicts with a type of the same name.");
                 MaPLTypeAPI &conflictingType = types[genericDescriptor];
-                conflictingType.file->logError(conflictingType.node->typeName->start, "Type '"+genericDescriptor+"' conflicts with a generic descriptor of the same name.");
+                conflictingType.file->logError(conflictingType.nameLocation, "Type '"+genericDescriptor+"' conflicts with a generic descriptor of the same name.");
             }
         }
         for (const MaPLGenericType& supertype : type.supertypes) {
@@ -400,7 +415,7 @@ void MaPLAPI::performErrorChecking() {
         }
         std::vector<MaPLGenericType> mappedGenerics;
         for (size_t i = 0; i < type.generics.size(); i++) {
-            mappedGenerics.push_back({ type.file, type.node->start, MaPLPrimitiveType_Uninitialized, type.generics[i], i });
+            mappedGenerics.push_back({ type.file, type.location, MaPLPrimitiveType_Uninitialized, type.generics[i], i });
         }
         for (const MaPLFunctionAPI &functionAPI : type.functions) {
             performErrorCheckingForGeneric(functionAPI.returnType, this);
@@ -442,34 +457,173 @@ const MaPLTypeAPI *MaPLAPI::findType(const std::string &typeName) const {
     return &(types.at(typeName));
 }
 
-const MaPLFunctionAPI *findFunctionInList(const MaPLAPI *api,
-                                          const std::vector<MaPLFunctionAPI> &functionList,
-                                          const std::string &functionName,
-                                          const std::vector<MaPLType> &expressionParameterTypes,
-                                          const std::vector<MaPLType> &substitutedGenerics,
-                                          const MaPLFunctionAPI *excludingFunction) {
-    for (const MaPLFunctionAPI &functionAPI : functionList) {
-        // Confirm matching function name.
-        if (excludingFunction == &functionAPI || functionName != functionAPI.name) {
+bool referencesGenerics(const MaPLGenericType &genericType) {
+    if (genericType.primitiveType == MaPLPrimitiveType_Uninitialized) {
+        return true;
+    }
+    for (const MaPLGenericType &nestedGeneric : genericType.generics) {
+        if (referencesGenerics(nestedGeneric)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+MaPLIndexedFunctionAPI indexedFunctionAPI(const MaPLFunctionAPI *functionAPI, size_t ancestorIndex) {
+    MaPLIndexedFunctionAPI indexedFunction{ functionAPI, ancestorIndex, false };
+    for (const MaPLGenericType &parameterType : functionAPI->parameterTypes) {
+        if (referencesGenerics(parameterType)) {
+            indexedFunction.referencesGenerics = true;
+            indexedFunction.parameterTypes.clear();
+            break;
+        }
+        indexedFunction.parameterTypes.push_back(parameterType.typeWithSubstitutedGenerics({}));
+    }
+    return indexedFunction;
+}
+
+void appendAncestorsToIndex(const MaPLAPI *api,
+                            const MaPLTypeAPI *type,
+                            const std::vector<MaPLGenericType> *substitutedGenerics,
+                            MaPLTypeIndex &index) {
+    for (const MaPLGenericType &supertype : type->supertypes) {
+        const MaPLTypeAPI *supertypeAPI = api->findType(supertype.pointerType);
+        if (!supertypeAPI || std::find(index.ancestors.begin(), index.ancestors.end(), supertypeAPI) != index.ancestors.end()) {
+            // Inheritance cycles are reported as errors elsewhere, but must not recurse forever here.
             continue;
         }
+        std::vector<MaPLGenericType> remappedGenerics;
+        for (const MaPLGenericType &supertypeGeneric : supertype.generics) {
+            remappedGenerics.push_back(substitutedGenerics ? supertypeGeneric.genericWithSubstitutedGenerics(*substitutedGenerics) : supertypeGeneric);
+        }
+        index.ancestors.push_back(supertypeAPI);
+        index.ancestorGenerics.push_back(remappedGenerics);
+        appendAncestorsToIndex(api, supertypeAPI, &remappedGenerics, index);
+    }
+}
+
+const MaPLTypeIndex *MaPLAPI::typeIndex(const std::string &typeName) const {
+    auto foundIndex = typeIndices.find(typeName);
+    if (foundIndex != typeIndices.end()) {
+        return &(foundIndex->second);
+    }
+    MaPLTypeIndex index;
+    if (typeName.empty()) {
+        index.ancestors.push_back(NULL);
+        index.ancestorGenerics.push_back({});
+        for (const MaPLFunctionAPI &functionAPI : globalFunctions) {
+            index.functionsByName[functionAPI.name].push_back(indexedFunctionAPI(&functionAPI, 0));
+        }
+    } else {
+        const MaPLTypeAPI *foundType = findType(typeName);
+        if (!foundType) {
+            return NULL;
+        }
+        index.ancestors.push_back(foundType);
+        index.ancestorGenerics.push_back({});
+        appendAncestorsToIndex(this, foundType, NULL, index);
         
-        // It's possible to match longer parameter lists, but only if this function has variadic params.
-        if ((!functionAPI.isVariadic && functionAPI.parameterTypes.size() != expressionParameterTypes.size()) ||
-            (functionAPI.isVariadic && functionAPI.parameterTypes.size() > expressionParameterTypes.size())) {
+        // Each list preserves the order in which a depth-first walk of the supertypes would encounter its contents.
+        for (size_t i = 0; i < index.ancestors.size(); i++) {
+            for (const MaPLFunctionAPI &functionAPI : index.ancestors[i]->functions) {
+                index.functionsByName[functionAPI.name].push_back(indexedFunctionAPI(&functionAPI, i));
+            }
+            for (const MaPLSubscriptAPI &subscriptAPI : index.ancestors[i]->subscripts) {
+                MaPLIndexedSubscriptAPI indexedSubscript{ &subscriptAPI, i, referencesGenerics(subscriptAPI.indexType) };
+                if (!indexedSubscript.referencesGenerics) {
+                    indexedSubscript.indexType = subscriptAPI.indexType.typeWithSubstitutedGenerics({});
+                }
+                index.subscripts.push_back(indexedSubscript);
+            }
+        }
+    }
+    return &(typeIndices[typeName] = std::move(index));
+}
+
+const std::vector<const MaPLIndexedFunctionAPI *> &MaPLAPI::indexedFunctions(const std::string &typeName,
+                                                                             const std::string &functionName,
+                                                                             size_t parameterCount) const {
+    MaPLFunctionIndexKey key{ typeName, functionName, parameterCount };
+    auto foundFunctions = functionIndices.find(key);
+    if (foundFunctions != functionIndices.end()) {
+        return foundFunctions->second;
+    }
+    std::vector<const MaPLIndexedFunctionAPI *> &indexedFunctions = functionIndices[key];
+    const MaPLTypeIndex *index = typeIndex(typeName);
+    if (index && index->functionsByName.count(functionName)) {
+        for (const MaPLIndexedFunctionAPI &indexedFunction : index->functionsByName.at(functionName)) {
+            // It's possible to match longer parameter lists, but only if this function has variadic params.
+            size_t declaredParameterCount = indexedFunction.function->parameterTypes.size();
+            if (declaredParameterCount == parameterCount ||
+                (indexedFunction.function->isVariadic && declaredParameterCount < parameterCount)) {
+                indexedFunctions.push_back(&indexedFunction);
+            }
+        }
+    }
+    return indexedFunctions;
+}
+
+void MaPLAPI::invalidateIndices() {
+    functionIndices.clear();
+    typeIndices.clear();
+}
+
+/**
+ * @return The generics of the ancestor at @c ancestorIndex, given the generics that were substituted into the indexed type. Each ancestor's generics are substituted at most once per lookup, and cached in @c remappedGenerics.
+ */
+const std::vector<MaPLType> &substitutedGenericsForAncestor(const MaPLTypeIndex *index,
+                                                            size_t ancestorIndex,
+                                                            const std::vector<MaPLType> &substitutedGenerics,
+                                                            std::vector<std::vector<MaPLType>> &remappedGenerics) {
+    if (ancestorIndex == 0) {
+        return substitutedGenerics;
+    }
+    if (remappedGenerics.empty()) {
+        remappedGenerics.resize(index->ancestors.size());
+    }
+    std::vector<MaPLType> &ancestorGenerics = remappedGenerics[ancestorIndex];
+    const std::vector<MaPLGenericType> &indexedGenerics = index->ancestorGenerics[ancestorIndex];
+    if (ancestorGenerics.size() != indexedGenerics.size()) {
+        for (const MaPLGenericType &indexedGeneric : indexedGenerics) {
+            ancestorGenerics.push_back(indexedGeneric.typeWithSubstitutedGenerics(substitutedGenerics));
+        }
+    }
+    return ancestorGenerics;
+}
+
+const MaPLFunctionAPI *findFunctionInIndex(const MaPLAPI *api,
+                                           const MaPLTypeIndex *index,
+                                           const std::vector<const MaPLIndexedFunctionAPI *> &indexedFunctions,
+                                           const std::vector<MaPLType> &expressionParameterTypes,
+                                           const std::vector<MaPLType> &substitutedGenerics,
+                                           const MaPLFunctionAPI *excludingFunction) {
+    std::vector<std::vector<MaPLType>> remappedGenerics;
+    for (const MaPLIndexedFunctionAPI *indexedFunction : indexedFunctions) {
+        const MaPLFunctionAPI *functionAPI = indexedFunction->function;
+        if (excludingFunction == functionAPI) {
             continue;
         }
         
         // Confirm assignable types for all params.
         bool parametersAreCompatible = true;
-        for (size_t i = 0; i < functionAPI.parameterTypes.size(); i++) {
-            if (!api->isAssignable(expressionParameterTypes[i], functionAPI.parameterTypes[i].typeWithSubstitutedGenerics(substitutedGenerics))) {
-                parametersAreCompatible = false;
-                break;
+        if (indexedFunction->referencesGenerics) {
+            const std::vector<MaPLType> &ancestorGenerics = substitutedGenericsForAncestor(index, indexedFunction->ancestorIndex, substitutedGenerics, remappedGenerics);
+            for (size_t i = 0; i < functionAPI->parameterTypes.size(); i++) {
+                if (!api->isAssignable(expressionParameterTypes[i], functionAPI->parameterTypes[i].typeWithSubstitutedGenerics(ancestorGenerics))) {
+                    parametersAreCompatible = false;
+                    break;
+                }
+            }
+        } else {
+            for (size_t i = 0; i < indexedFunction->parameterTypes.size(); i++) {
+                if (!api->isAssignable(expressionParameterTypes[i], indexedFunction->parameterTypes[i])) {
+                    parametersAreCompatible = false;
+                    break;
+                }
             }
         }
         if (parametersAreCompatible) {
-            return &functionAPI;
+            return functionAPI;
         }
     }
     return NULL;
@@ -480,39 +634,30 @@ const MaPLFunctionAPI *MaPLAPI::findTypeFunction(const std::string &typeName,
                                                  const std::vector<MaPLType> &parameterTypes,
                                                  const std::vector<MaPLType> &substitutedGenerics,
                                                  const MaPLFunctionAPI *excludingFunction) const {
-    const MaPLTypeAPI *foundType = findType(typeName);
-    if (foundType) {
-        const MaPLFunctionAPI *foundFunction = findFunctionInList(this,
-                                                                  foundType->functions,
-                                                                  functionName,
-                                                                  parameterTypes,
-                                                                  substitutedGenerics,
-                                                                  excludingFunction);
-        if (foundFunction) {
-            return foundFunction;
-        }
-        for (const MaPLGenericType &genericType : foundType->supertypes) {
-            std::vector<MaPLType> remappedGenerics;
-            for (const MaPLGenericType &supertypeGeneric : genericType.generics) {
-                remappedGenerics.push_back(supertypeGeneric.typeWithSubstitutedGenerics(substitutedGenerics));
-            }
-            foundFunction = findTypeFunction(genericType.pointerType,
-                                             functionName,
-                                             parameterTypes,
-                                             remappedGenerics,
-                                             excludingFunction);
-            if (foundFunction) {
-                return foundFunction;
-            }
-        }
+    if (typeName.empty()) {
+        // The empty type name is reserved for the index of global functions.
+        return NULL;
     }
-    return NULL;
+    const std::vector<const MaPLIndexedFunctionAPI *> &foundFunctions = indexedFunctions(typeName, functionName, parameterTypes.size());
+    if (foundFunctions.empty()) {
+        return NULL;
+    }
+    return findFunctionInIndex(this,
+                               typeIndex(typeName),
+                               foundFunctions,
+                               parameterTypes,
+                               substitutedGenerics,
+                               excludingFunction);
 }
 
 const MaPLFunctionAPI *MaPLAPI::findGlobalFunction(const std::string &functionName,
                                                    const std::vector<MaPLType> &parameterTypes,
                                                    const MaPLFunctionAPI *excludingFunction) const {
-    return findFunctionInList(this, globalFunctions, functionName, parameterTypes, {}, excludingFunction);
+    const std::vector<const MaPLIndexedFunctionAPI *> &foundFunctions = indexedFunctions("", functionName, parameterTypes.size());
+    if (foundFunctions.empty()) {
+        return NULL;
+    }
+    return findFunctionInIndex(this, typeIndex(""), foundFunctions, parameterTypes, {}, excludingFunction);
 }
 
 const MaPLPropertyAPI *MaPLAPI::findTypeProperty(const std::string &typeName,
@@ -549,29 +694,22 @@ const MaPLSubscriptAPI *MaPLAPI::findSubscript(const std::string &typeName,
                                                const MaPLType &indexType,
                                                const std::vector<MaPLType> &substitutedGenerics,
                                                const MaPLSubscriptAPI *excludingSubscript) const {
-    const MaPLTypeAPI *foundType = findType(typeName);
-    if (foundType) {
-        for (const MaPLSubscriptAPI &subscript : foundType->subscripts) {
-            if (excludingSubscript == &subscript) {
-                continue;
-            }
-            MaPLType subscriptIndexType = subscript.indexType.typeWithSubstitutedGenerics(substitutedGenerics);
-            if (isAssignable(indexType, subscriptIndexType)) {
-                return &subscript;
-            }
+    const MaPLTypeIndex *index = typeName.empty() ? NULL : typeIndex(typeName);
+    if (!index) {
+        return NULL;
+    }
+    std::vector<std::vector<MaPLType>> remappedGenerics;
+    for (const MaPLIndexedSubscriptAPI &indexedSubscript : index->subscripts) {
+        if (excludingSubscript == indexedSubscript.subscript) {
+            continue;
         }
-        for (const MaPLGenericType &genericType : foundType->supertypes) {
-            std::vector<MaPLType> remappedGenerics;
-            for (const MaPLGenericType &supertypeGeneric : genericType.generics) {
-                remappedGenerics.push_back(supertypeGeneric.typeWithSubstitutedGenerics(substitutedGenerics));
-            }
-            const MaPLSubscriptAPI *foundSubscript = findSubscript(genericType.pointerType,
-                                                                   indexType,
-                                                                   remappedGenerics,
-                                                                   excludingSubscript);
-            if (foundSubscript) {
-                return foundSubscript;
+        if (indexedSubscript.referencesGenerics) {
+            const std::vector<MaPLType> &ancestorGenerics = substitutedGenericsForAncestor(index, indexedSubscript.ancestorIndex, substitutedGenerics, remappedGenerics);
+            if (isAssignable(indexType, indexedSubscript.subscript->indexType.typeWithSubstitutedGenerics(ancestorGenerics))) {
+                return indexedSubscript.subscript;
             }
+        } else if (isAssignable(indexType, indexedSubscript.indexType)) {
+            return indexedSubscript.subscript;
         }
     }
     return NULL;
@@ -660,7 +798,7 @@ std::vector<std::string> findInheritanceCyclesAndDiamonds(const MaPLAPI *api,
     }
     if (diamondTypes.count(type->name) > 0) {
         // This graph contains a diamond.
-        type->file->logError(type->node->start, "The type '"+type->name+"' is inherited more than once by the same type, forming an 'inheritance diamond'.");
+        type->file->logError(type->location, "The type '"+type->name+"' is inherited more than once by the same type, forming an 'inheritance diamond'.");
         return cycleVector;
     }
     diamondTypes.insert(type->name);
@@ -697,7 +835,7 @@ void MaPLAPI::findInheritanceCyclesAndDiamonds() {
                 }
             }
             cycleDescriptor += ".";
-            type.file->logError(type.node->start, "Type inheritance forms a cycle: "+cycleDescriptor);
+            type.file->logError(type.location, "Type inheritance forms a cycle: "+cycleDescriptor);
             return;
         }
         cycleTypes.clear();
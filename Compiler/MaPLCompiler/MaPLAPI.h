@@ -18,7 +18,7 @@
  */
 struct MaPLGenericType {
     MaPLFile *file;
-    antlr4::Token *token;
+    MaPLSourceLocation location;
     MaPLPrimitiveType primitiveType;
     std::string pointerType;
     size_t genericIndex;
@@ -45,7 +45,7 @@ struct MaPLGenericType {
 
 struct MaPLFunctionAPI {
     MaPLFile *file;
-    MaPLParser::ApiFunctionContext *node;
+    MaPLSourceLocation location;
     std::string name;
     std::string typeAPIName;
     MaPLGenericType returnType;
@@ -66,7 +66,7 @@ struct MaPLFunctionAPI {
 
 struct MaPLPropertyAPI {
     MaPLFile *file;
-    MaPLParser::ApiPropertyContext *node;
+    MaPLSourceLocation location;
     std::string name;
     std::string typeAPIName;
     MaPLGenericType returnType;
@@ -81,7 +81,7 @@ struct MaPLPropertyAPI {
 
 struct MaPLSubscriptAPI {
     MaPLFile *file;
-    MaPLParser::ApiSubscriptContext *node;
+    MaPLSourceLocation location;
     std::string typeAPIName;
     MaPLGenericType returnType;
     MaPLGenericType indexType;
@@ -94,7 +94,8 @@ struct MaPLTypeAPI {
     void assimilate(const MaPLSubscriptAPI &subscript);
     
     MaPLFile *file;
-    MaPLParser::ApiTypeContext *node;
+    MaPLSourceLocation location;
+    MaPLSourceLocation nameLocation;
     std::string name;
     std::vector<std::string> generics;
     std::vector<MaPLGenericType> supertypes;
@@ -104,6 +105,52 @@ struct MaPLTypeAPI {
     bool declaredInDependency = false;
 };
 
+/**
+ * A function found in the lookup index of a type, along with the inherited type that declares it.
+ */
+struct MaPLIndexedFunctionAPI {
+    const MaPLFunctionAPI *function;
+    size_t ancestorIndex;
+    bool referencesGenerics;
+    // Parameter types are resolved up front, but only when none of them reference a generic.
+    std::vector<MaPLType> parameterTypes;
+};
+
+/**
+ * A subscript found in the lookup index of a type, along with the inherited type that declares it.
+ */
+struct MaPLIndexedSubscriptAPI {
+    const MaPLSubscriptAPI *subscript;
+    size_t ancestorIndex;
+    bool referencesGenerics;
+    // The index type is resolved up front, but only when it doesn't reference a generic.
+    MaPLType indexType;
+};
+
+/**
+ * A type and all of its ancestors, flattened into the order in which lookups search them.
+ */
+struct MaPLTypeIndex {
+    // The first element is always the indexed type itself, or NULL when indexing the global scope.
+    std::vector<const MaPLTypeAPI *> ancestors;
+    // The generics of each ancestor, expressed in terms of the indexed type's generics. Empty for the indexed type itself.
+    std::vector<std::vector<MaPLGenericType>> ancestorGenerics;
+    std::unordered_map<std::string, std::vector<MaPLIndexedFunctionAPI>> functionsByName;
+    std::vector<MaPLIndexedSubscriptAPI> subscripts;
+};
+
+struct MaPLFunctionIndexKey {
+    std::string typeName;
+    std::string functionName;
+    size_t parameterCount;
+    
+    bool operator== (const MaPLFunctionIndexKey &otherKey) const;
+};
+
+struct MaPLFunctionIndexKeyHash {
+    size_t operator() (const MaPLFunctionIndexKey &key) const;
+};
+
 class MaPLAPI {
 public:
     const MaPLTypeAPI *findType(const std::string &typeName) const;
@@ -180,9 +227,30 @@ private:
     void assimilate(const MaPLPropertyAPI &globalProperty);
     void assimilate(const MaPLTypeAPI &type);
     
+    /**
+     * @return The lookup index for @c typeName, building it if needed. @c NULL if the type doesn't exist. The global scope is indexed under an empty type name.
+     */
+    const MaPLTypeIndex *typeIndex(const std::string &typeName) const;
+    
+    /**
+     * @return All functions named @c functionName which accept @c parameterCount parameters, in the order they would be found by walking @c typeName and its ancestors.
+     */
+    const std::vector<const MaPLIndexedFunctionAPI *> &indexedFunctions(const std::string &typeName,
+                                                                        const std::string &functionName,
+                                                                        size_t parameterCount) const;
+    
+    /**
+     * Discards all lookup indices. Call this whenever the contents of this API change.
+     */
+    void invalidateIndices();
+    
     std::vector<MaPLFunctionAPI> globalFunctions;
     std::unordered_map<std::string, MaPLPropertyAPI> globalProperties;
     std::unordered_map<std::string, MaPLTypeAPI> types;
+    
+    // Lookup indices are built lazily during compilation, which only performs const lookups.
+    mutable std::unordered_map<std::string, MaPLTypeIndex> typeIndices;
+    mutable std::unordered_map<MaPLFunctionIndexKey, std::vector<const MaPLIndexedFunctionAPI *>, MaPLFunctionIndexKeyHash> functionIndices;
 };
 
 MaPLFunctionAPI functionAPIForNode(MaPLParser::ApiFunctionContext *node, const std::vector<std::string> &generics, MaPLFile *file);
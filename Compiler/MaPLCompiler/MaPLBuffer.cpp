@@ -8,8 +8,11 @@
 #include "MaPLBuffer.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <string>
 #include <regex>
+#include <algorithm>
+#include <unordered_map>
 
 #include "MaPLFile.h"
 #include "MaPLVariableStack.h"
@@ -32,6 +35,9 @@ void MaPLBuffer::appendBytes(const void *bytes, size_t byteSize) {
 void MaPLBuffer::prependBytes(const void *bytes, size_t byteSize) {
     _bytes.insert(_bytes.begin(), byteSize, 0);
     overwriteBytes(bytes, byteSize, 0);
+    for (MaPLBufferAnnotation &annotation : _annotations) {
+        annotation.byteLocation += byteSize;
+    }
 }
 
 void MaPLBuffer::overwriteBytes(const void *bytes, size_t byteSize, size_t overwriteLocation) {
@@ -42,6 +48,10 @@ void MaPLBuffer::appendInstruction(MaPLInstruction instruction) {
     if (instruction == MaPLInstruction_error) {
         _parentFile->logError(NULL, "Internal compiler error. Encountered error instruction.");
     }
+    if (instruction == MaPLInstruction_string_concat || instruction == MaPLInstruction_string_typecast) {
+        // The runtime allocates a new string each time these instructions are evaluated.
+        addAnnotation(MaPLBufferAnnotationType_StringAllocation);
+    }
     appendBytes(&instruction, sizeof(instruction));
 }
 
@@ -72,7 +82,8 @@ MaPLMemoryAddress MaPLBuffer::calculateMemoryAddressOffset(MaPLBufferAnnotationT
 }
 
 MaPLMemoryAddress MaPLBuffer::calculatePrimitiveMemoryAddressOffset(MaPLVariableStack *variableStack, MaPLMemoryAddress endOfDependencies) {
-    return variableStack->getMaximumPrimitiveMemoryUsed() - calculateMemoryAddressOffset(MaPLBufferAnnotationType_PrimitiveVariableAddressDeclaration, endOfDependencies);
+    MaPLMemoryAddress offset = variableStack->getMaximumPrimitiveMemoryUsed() - calculateMemoryAddressOffset(MaPLBufferAnnotationType_PrimitiveVariableAddressDeclaration, endOfDependencies);
+    return variableStack->alignedPrimitiveMemoryAddressOffset(offset);
 }
 
 MaPLMemoryAddress MaPLBuffer::calculateAllocatedMemoryAddressOffset(MaPLVariableStack *variableStack, MaPLMemoryAddress endOfDependencies) {
@@ -118,18 +129,22 @@ void MaPLBuffer::appendLiteral(const MaPLLiteral &literal, MaPLFile *file, antlr
             break;
         case MaPLPrimitiveType_Int32:
             appendInstruction(MaPLInstruction_int32_literal);
+            addAnnotation(MaPLBufferAnnotationType_IntegerLiteral);
             appendBytes(&(literal.int32Value), sizeof(literal.int32Value));
             break;
         case MaPLPrimitiveType_Int64:
             appendInstruction(MaPLInstruction_int64_literal);
+            addAnnotation(MaPLBufferAnnotationType_IntegerLiteral);
             appendBytes(&(literal.int64Value), sizeof(literal.int64Value));
             break;
         case MaPLPrimitiveType_UInt32:
             appendInstruction(MaPLInstruction_uint32_literal);
+            addAnnotation(MaPLBufferAnnotationType_IntegerLiteral);
             appendBytes(&(literal.uInt32Value), sizeof(literal.uInt32Value));
             break;
         case MaPLPrimitiveType_UInt64:
             appendInstruction(MaPLInstruction_uint64_literal);
+            addAnnotation(MaPLBufferAnnotationType_IntegerLiteral);
             appendBytes(&(literal.uInt64Value), sizeof(literal.uInt64Value));
             break;
         case MaPLPrimitiveType_Float32:
@@ -142,6 +157,7 @@ void MaPLBuffer::appendLiteral(const MaPLLiteral &literal, MaPLFile *file, antlr
             break;
         case MaPLPrimitiveType_String:
             appendInstruction(MaPLInstruction_string_literal);
+            addAnnotation(MaPLBufferAnnotationType_StringLiteral);
             appendString(literal.stringValue, file, errToken);
             break;
         case MaPLPrimitiveType_Boolean:
@@ -155,7 +171,19 @@ void MaPLBuffer::appendLiteral(const MaPLLiteral &literal, MaPLFile *file, antlr
 }
 
 void MaPLBuffer::appendString(std::string string, MaPLFile *file, antlr4::Token *errToken) {
-    // Replace escaped chars.
+    if (!resolveEscapeSequences(string, file, errToken)) {
+        return;
+    }
+    appendResolvedString(string);
+}
+
+void MaPLBuffer::appendResolvedString(const std::string &string) {
+    const char* cString = string.c_str();
+    size_t length = strlen(cString);
+    appendBytes(cString, length+1);
+}
+
+bool resolveEscapeSequences(std::string &string, MaPLFile *file, antlr4::Token *errToken) {
     std::smatch match;
     std::regex escapeChars("\\\\(.)");
     auto searchStart = cbegin(string);
@@ -194,15 +222,12 @@ void MaPLBuffer::appendString(std::string string, MaPLFile *file, antlr4::Token
                 break;
             default:
                 file->logError(errToken, "Invalid escape sequence '"+match[0].str()+"' specified in string. Accepted escape sequences are: \\a, \\b, \\e, \\f, \\n, \\r, \\t, \\v, \\\", \\\\.");
-                return;
+                return false;
         }
         string.replace(match[0].first, match[0].second, replaceString);
         searchStart = match[0].first+1;
     }
-    
-    const char* cString = string.c_str();
-    size_t length = strlen(cString);
-    return appendBytes(cString, length+1);
+    return true;
 }
 
 std::vector<uint8_t> MaPLBuffer::getBytes() {
@@ -217,6 +242,17 @@ void MaPLBuffer::addAnnotation(MaPLBufferAnnotationType annotationType, const st
     _annotations.push_back({ (MaPLMemoryAddress)_bytes.size(), annotationType, text });
 }
 
+void MaPLBuffer::addDebugLineTableEntry(antlr4::Token *token) {
+    MaPLSourceLocation location = sourceLocationForToken(token);
+    addAnnotation(MaPLBufferAnnotationType_DebugLineTableEntry, std::to_string(location.line)+":"+std::to_string(location.column));
+}
+
+void MaPLBuffer::addDebugVariableTableMarker(bool isStart, const std::string &variableName, MaPLPrimitiveType type, MaPLMemoryAddress memoryAddress) {
+    // Every marker for the same declaration has the same text, so that the start and end of each scope can be paired up.
+    addAnnotation(isStart ? MaPLBufferAnnotationType_DebugVariableStart : MaPLBufferAnnotationType_DebugVariableEnd,
+                  std::to_string(memoryAddress)+":"+std::to_string(type)+":"+variableName);
+}
+
 void MaPLBuffer::resolveControlFlowAnnotations(MaPLBufferAnnotationType type, bool jumpToEnd) {
     if (_annotations.size() == 0) {
         return;
@@ -240,7 +276,10 @@ void MaPLBuffer::resolveControlFlowAnnotations(MaPLBufferAnnotationType type, bo
                 cursorMove = byteEndLocation;
             }
             overwriteBytes(&cursorMove, sizeof(cursorMove), annotation.byteLocation+sizeof(MaPLInstruction));
-            _annotations.erase(_annotations.begin()+i);
+            _annotations[i] = {
+                (MaPLMemoryAddress)(annotation.byteLocation+sizeof(MaPLInstruction)),
+                jumpToEnd ? MaPLBufferAnnotationType_ForwardCursorMove : MaPLBufferAnnotationType_BackwardCursorMove
+            };
         }
         
         if (i == 0) {
@@ -273,21 +312,572 @@ void MaPLBuffer::resolveSymbolsWithTable(const std::map<std::string, MaPLSymbol>
 }
 
 void MaPLBuffer::zeroDebugLines() {
-    if (_annotations.size() == 0) {
-        return;
-    }
-    // Iterate backwards through the list so we can remove annotations without adjusting array index.
-    size_t i = _annotations.size()-1;
-    while (true) {
-        MaPLBufferAnnotation annotation = _annotations[i];
+    // The annotations are kept so that the line numbers can still be located if the bytecode is re-encoded later.
+    for (const MaPLBufferAnnotation &annotation : _annotations) {
         if (annotation.type == MaPLBufferAnnotationType_DebugLine) {
             MaPLLineNumber zeroLine = 0;
             overwriteBytes(&zeroLine, sizeof(zeroLine), annotation.byteLocation);
+        }
+    }
+    _annotations.erase(std::remove_if(_annotations.begin(), _annotations.end(), [](const MaPLBufferAnnotation &annotation) {
+        return annotation.type == MaPLBufferAnnotationType_DebugLineTableEntry ||
+               annotation.type == MaPLBufferAnnotationType_DebugVariableStart ||
+               annotation.type == MaPLBufferAnnotationType_DebugVariableEnd;
+    }), _annotations.end());
+}
+
+struct MaPLPeepholeRule {
+    // The lowest optimization level at which this rule is applied.
+    uint8_t optimizationLevel;
+    // Attempts to apply the rule at the annotation with the given index. Returns true if the buffer was modified.
+    bool (MaPLBuffer::*apply)(size_t annotationIndex);
+};
+
+size_t MaPLBuffer::applyPeepholeOptimizations(uint8_t optimizationLevel) {
+    // Every rule is anchored to an annotation, since annotations are the only reliable indicator of where instructions begin.
+    static const MaPLPeepholeRule rules[] = {
+        { 1, &MaPLBuffer::removeEmptyCursorMove },
+        { 1, &MaPLBuffer::threadCursorMove },
+        { 1, &MaPLBuffer::removeUnreachableBytes },
+        { 1, &MaPLBuffer::removeSelfAssignment },
+    };
+    size_t initialByteCount = _bytes.size();
+    bool didModify = true;
+    while (didModify) {
+        didModify = false;
+        for (const MaPLPeepholeRule &rule : rules) {
+            if (rule.optimizationLevel > optimizationLevel) {
+                continue;
+            }
+            // Rules can remove annotations, so the annotation count is re-checked on every iteration.
+            for (size_t i = 0; i < _annotations.size(); i++) {
+                if ((this->*rule.apply)(i)) {
+                    didModify = true;
+                }
+            }
+        }
+    }
+    return initialByteCount - _bytes.size();
+}
+
+bool MaPLBuffer::removeEmptyCursorMove(size_t annotationIndex) {
+    // "MaPLInstruction_cursor_move_forward 0" has no effect. Typically the result of "continue" at the end of a loop.
+    MaPLBufferAnnotation annotation = _annotations[annotationIndex];
+    if (annotation.type != MaPLBufferAnnotationType_ForwardCursorMove ||
+        cursorMoveDestination(annotation) != annotation.byteLocation+sizeof(MaPLBytecodeLength)) {
+        return false;
+    }
+    removeBytes(annotation.byteLocation-sizeof(MaPLInstruction), sizeof(MaPLInstruction)+sizeof(MaPLBytecodeLength));
+    return true;
+}
+
+bool MaPLBuffer::threadCursorMove(size_t annotationIndex) {
+    // A cursor move whose destination is an unconditional cursor move can skip directly to the final destination.
+    MaPLBufferAnnotation annotation = _annotations[annotationIndex];
+    if (annotation.type != MaPLBufferAnnotationType_ForwardCursorMove &&
+        annotation.type != MaPLBufferAnnotationType_ConditionalCursorMove &&
+        annotation.type != MaPLBufferAnnotationType_SwitchCursorMove) {
+        return false;
+    }
+    size_t operandEnd = annotation.byteLocation+sizeof(MaPLBytecodeLength);
+    size_t destination = cursorMoveDestination(annotation);
+    size_t nextOperandLocation = destination+sizeof(MaPLInstruction);
+    if (nextOperandLocation == annotation.byteLocation) {
+        return false;
+    }
+    for (const MaPLBufferAnnotation &nextAnnotation : _annotations) {
+        if (nextAnnotation.byteLocation != nextOperandLocation) {
+            continue;
+        }
+        size_t finalDestination = cursorMoveDestination(nextAnnotation);
+        if (nextAnnotation.type == MaPLBufferAnnotationType_ForwardCursorMove) {
+            MaPLBytecodeLength cursorMove = (MaPLBytecodeLength)(finalDestination-operandEnd);
+            overwriteBytes(&cursorMove, sizeof(cursorMove), annotation.byteLocation);
+            return true;
+        }
+        if (nextAnnotation.type == MaPLBufferAnnotationType_BackwardCursorMove &&
+            annotation.type == MaPLBufferAnnotationType_ForwardCursorMove) {
+            // Conditionals can only move forward, but an unconditional move can be turned around.
+            MaPLInstruction cursorInstruction = MaPLInstruction_cursor_move_back;
+            overwriteBytes(&cursorInstruction, sizeof(cursorInstruction), annotation.byteLocation-sizeof(MaPLInstruction));
+            MaPLBytecodeLength cursorMove = (MaPLBytecodeLength)(operandEnd-finalDestination);
+            overwriteBytes(&cursorMove, sizeof(cursorMove), annotation.byteLocation);
+            _annotations[annotationIndex].type = MaPLBufferAnnotationType_BackwardCursorMove;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MaPLBuffer::removeUnreachableBytes(size_t annotationIndex) {
+    // Bytes following an unconditional cursor move can't execute unless some other cursor move lands on them.
+    MaPLBufferAnnotation annotation = _annotations[annotationIndex];
+    if (annotation.type != MaPLBufferAnnotationType_ForwardCursorMove &&
+        annotation.type != MaPLBufferAnnotationType_BackwardCursorMove) {
+        return false;
+    }
+    size_t unreachableStart = annotation.byteLocation+sizeof(MaPLBytecodeLength);
+    size_t unreachableEnd = _bytes.size();
+    for (const MaPLBufferAnnotation &otherAnnotation : _annotations) {
+        size_t reachableLocation;
+        if (otherAnnotation.type == MaPLBufferAnnotationType_EndOfDependencies) {
+            // Execution flows out of the dependencies and into the start of this file.
+            reachableLocation = otherAnnotation.byteLocation;
+        } else if (otherAnnotation.type == MaPLBufferAnnotationType_ForwardCursorMove ||
+                   otherAnnotation.type == MaPLBufferAnnotationType_BackwardCursorMove ||
+                   otherAnnotation.type == MaPLBufferAnnotationType_ConditionalCursorMove ||
+                   otherAnnotation.type == MaPLBufferAnnotationType_ConditionalBackwardCursorMove ||
+                   otherAnnotation.type == MaPLBufferAnnotationType_SwitchCursorMove) {
+            reachableLocation = cursorMoveDestination(otherAnnotation);
+        } else {
+            continue;
+        }
+        if (reachableLocation >= unreachableStart && reachableLocation < unreachableEnd) {
+            unreachableEnd = reachableLocation;
+        }
+    }
+    if (unreachableEnd == unreachableStart) {
+        return false;
+    }
+    for (const MaPLBufferAnnotation &otherAnnotation : _annotations) {
+        // Variable declarations are used to calculate memory offsets when this bytecode is concatenated onto another script.
+        if ((otherAnnotation.type == MaPLBufferAnnotationType_PrimitiveVariableAddressDeclaration ||
+             otherAnnotation.type == MaPLBufferAnnotationType_AllocatedVariableIndexDeclaration) &&
+            otherAnnotation.byteLocation >= unreachableStart &&
+            otherAnnotation.byteLocation < unreachableEnd) {
+            return false;
+        }
+    }
+    removeBytes(unreachableStart, unreachableEnd-unreachableStart);
+    return true;
+}
+
+bool MaPLBuffer::removeSelfAssignment(size_t annotationIndex) {
+    // Assigning a variable to itself (for example "x = x") has no effect.
+    MaPLBufferAnnotation annotation = _annotations[annotationIndex];
+    if (annotation.type != MaPLBufferAnnotationType_PrimitiveVariableAddressReference &&
+        annotation.type != MaPLBufferAnnotationType_AllocatedVariableIndexReference) {
+        return false;
+    }
+    // Variable references always immediately follow the instruction that uses them.
+    size_t assignLocation = annotation.byteLocation-sizeof(MaPLInstruction);
+    size_t variableLocation = annotation.byteLocation+sizeof(MaPLMemoryAddress);
+    size_t variableAddressLocation = variableLocation+sizeof(MaPLInstruction);
+    if (variableAddressLocation+sizeof(MaPLMemoryAddress) > _bytes.size() ||
+        !hasAnnotation(annotation.type, variableAddressLocation) ||
+        memcmp(&_bytes[annotation.byteLocation], &_bytes[variableAddressLocation], sizeof(MaPLMemoryAddress)) != 0) {
+        return false;
+    }
+    static const MaPLPrimitiveType assignableTypes[] = {
+        MaPLPrimitiveType_Char,
+        MaPLPrimitiveType_Int32,
+        MaPLPrimitiveType_Int64,
+        MaPLPrimitiveType_UInt32,
+        MaPLPrimitiveType_UInt64,
+        MaPLPrimitiveType_Float32,
+        MaPLPrimitiveType_Float64,
+        MaPLPrimitiveType_Boolean,
+        MaPLPrimitiveType_String,
+        MaPLPrimitiveType_Pointer,
+    };
+    for (MaPLPrimitiveType type : assignableTypes) {
+        if (_bytes[assignLocation] == assignmentInstructionForPrimitive(type) &&
+            _bytes[variableLocation] == variableInstructionForPrimitive(type)) {
+            removeBytes(assignLocation, variableAddressLocation+sizeof(MaPLMemoryAddress)-assignLocation);
+            return true;
+        }
+    }
+    return false;
+}
+
+void MaPLBuffer::removeBytes(size_t location, size_t byteCount) {
+    size_t removedEnd = location+byteCount;
+    
+    // Shorten any cursor moves that travel across the removed bytes.
+    for (const MaPLBufferAnnotation &annotation : _annotations) {
+        size_t operandEnd = annotation.byteLocation+sizeof(MaPLBytecodeLength);
+        size_t destination;
+        switch (annotation.type) {
+            case MaPLBufferAnnotationType_ForwardCursorMove: // Intentional fallthrough.
+            case MaPLBufferAnnotationType_ConditionalCursorMove: // Intentional fallthrough.
+            case MaPLBufferAnnotationType_SwitchCursorMove:
+                destination = cursorMoveDestination(annotation);
+                if (location < operandEnd || removedEnd > destination) {
+                    continue;
+                }
+                break;
+            case MaPLBufferAnnotationType_BackwardCursorMove:
+                destination = cursorMoveDestination(annotation);
+                if (location < destination || removedEnd > annotation.byteLocation-sizeof(MaPLInstruction)) {
+                    continue;
+                }
+                break;
+            case MaPLBufferAnnotationType_ConditionalBackwardCursorMove:
+                // The conditional is between the instruction and the cursor move, so it's also spanned by the move.
+                destination = cursorMoveDestination(annotation);
+                if (location < destination || removedEnd > annotation.byteLocation) {
+                    continue;
+                }
+                break;
+            default: continue;
+        }
+        MaPLBytecodeLength cursorMove = *((MaPLBytecodeLength *)(&_bytes[annotation.byteLocation]));
+        cursorMove -= byteCount;
+        overwriteBytes(&cursorMove, sizeof(cursorMove), annotation.byteLocation);
+    }
+    
+    // Drop the annotations for the removed bytes, and move all subsequent annotations to match.
+    size_t i = 0;
+    while (i < _annotations.size()) {
+        MaPLBufferAnnotation &annotation = _annotations[i];
+        if (annotation.byteLocation >= location && annotation.byteLocation < removedEnd) {
+            if (annotation.type == MaPLBufferAnnotationType_DebugVariableStart ||
+                annotation.type == MaPLBufferAnnotationType_DebugVariableEnd) {
+                // A variable's scope can outlive the removed bytes, so the marker is kept at the edge of the removed range.
+                annotation.byteLocation = location;
+                i++;
+                continue;
+            }
             _annotations.erase(_annotations.begin()+i);
+            continue;
         }
-        if (i == 0) {
-            break;
+        if (annotation.byteLocation >= removedEnd) {
+            annotation.byteLocation -= byteCount;
         }
-        i--;
+        i++;
+    }
+    
+    _bytes.erase(_bytes.begin()+location, _bytes.begin()+removedEnd);
+}
+
+void MaPLBuffer::insertBytes(size_t location, size_t byteCount) {
+    // Lengthen any cursor moves that travel across the inserted bytes.
+    for (const MaPLBufferAnnotation &annotation : _annotations) {
+        size_t operandEnd = annotation.byteLocation+sizeof(MaPLBytecodeLength);
+        size_t destination;
+        switch (annotation.type) {
+            case MaPLBufferAnnotationType_ForwardCursorMove: // Intentional fallthrough.
+            case MaPLBufferAnnotationType_ConditionalCursorMove: // Intentional fallthrough.
+            case MaPLBufferAnnotationType_SwitchCursorMove:
+                destination = cursorMoveDestination(annotation);
+                if (location < operandEnd || location > destination) {
+                    continue;
+                }
+                break;
+            case MaPLBufferAnnotationType_BackwardCursorMove:
+                destination = cursorMoveDestination(annotation);
+                if (location <= destination || location > annotation.byteLocation-sizeof(MaPLInstruction)) {
+                    continue;
+                }
+                break;
+            case MaPLBufferAnnotationType_ConditionalBackwardCursorMove:
+                destination = cursorMoveDestination(annotation);
+                if (location <= destination || location > annotation.byteLocation) {
+                    continue;
+                }
+                break;
+            default: continue;
+        }
+        MaPLBytecodeLength cursorMove = *((MaPLBytecodeLength *)(&_bytes[annotation.byteLocation]));
+        cursorMove += byteCount;
+        overwriteBytes(&cursorMove, sizeof(cursorMove), annotation.byteLocation);
+    }
+    
+    for (MaPLBufferAnnotation &annotation : _annotations) {
+        if (annotation.byteLocation >= location) {
+            annotation.byteLocation += byteCount;
+        }
+    }
+    
+    _bytes.insert(_bytes.begin()+location, byteCount, 0);
+}
+
+size_t MaPLBuffer::cursorMoveDestination(const MaPLBufferAnnotation &annotation) {
+    // Cursor moves are measured from the end of the MaPLBytecodeLength.
+    size_t operandEnd = annotation.byteLocation+sizeof(MaPLBytecodeLength);
+    MaPLBytecodeLength cursorMove = *((MaPLBytecodeLength *)(&_bytes[annotation.byteLocation]));
+    if (annotation.type == MaPLBufferAnnotationType_BackwardCursorMove ||
+        annotation.type == MaPLBufferAnnotationType_ConditionalBackwardCursorMove) {
+        return operandEnd-cursorMove;
+    }
+    return operandEnd+cursorMove;
+}
+
+bool MaPLBuffer::hasAnnotation(MaPLBufferAnnotationType annotationType, size_t location) {
+    for (const MaPLBufferAnnotation &annotation : _annotations) {
+        if (annotation.type == annotationType && annotation.byteLocation == location) {
+            return true;
+        }
+    }
+    return false;
+}
+
+struct MaPLCompactOperand {
+    // The location and byte size of the operand in the fixed-width bytecode.
+    size_t location;
+    size_t fixedByteCount;
+    // The byte size of the operand once it's encoded as a varint.
+    size_t compactByteCount;
+    // The value that is encoded. Unused for cursor moves, which are recalculated from their destination.
+    uint64_t value;
+    bool isCursorMove;
+    bool isBackwardCursorMove;
+    // Cursor moves in switch tables are recalculated like any other, but keep their fixed width so the table can be indexed.
+    bool isFixedWidth;
+    size_t destination;
+};
+
+static size_t compactLocation(const std::vector<MaPLCompactOperand> &operands, const std::vector<size_t> &bytesRemovedBefore, size_t location) {
+    // Every operand that starts before this location also ends before it, so their savings all apply.
+    auto nextOperand = std::lower_bound(operands.begin(), operands.end(), location, [](const MaPLCompactOperand &operand, size_t location) {
+        return operand.location < location;
+    });
+    return location - bytesRemovedBefore[nextOperand - operands.begin()];
+}
+
+size_t MaPLBuffer::applyCompactEncoding() {
+    std::vector<MaPLCompactOperand> operands;
+    for (const MaPLBufferAnnotation &annotation : _annotations) {
+        MaPLCompactOperand operand = { annotation.byteLocation, 0, 0, 0, false, false, false, 0 };
+        switch (annotation.type) {
+            case MaPLBufferAnnotationType_PrimitiveVariableAddressDeclaration: // Intentional fallthrough.
+            case MaPLBufferAnnotationType_AllocatedVariableIndexDeclaration: // Intentional fallthrough.
+            case MaPLBufferAnnotationType_PrimitiveVariableAddressReference: // Intentional fallthrough.
+            case MaPLBufferAnnotationType_AllocatedVariableIndexReference:
+                operand.fixedByteCount = sizeof(MaPLMemoryAddress);
+                operand.value = *((MaPLMemoryAddress *)(&_bytes[annotation.byteLocation]));
+                break;
+            case MaPLBufferAnnotationType_FunctionSymbol:
+                operand.fixedByteCount = sizeof(MaPLSymbol);
+                operand.value = *((MaPLSymbol *)(&_bytes[annotation.byteLocation]));
+                break;
+            case MaPLBufferAnnotationType_DebugLine:
+                operand.fixedByteCount = sizeof(MaPLLineNumber);
+                operand.value = *((MaPLLineNumber *)(&_bytes[annotation.byteLocation]));
+                break;
+            case MaPLBufferAnnotationType_IntegerLiteral: {
+                // Signed values are zigzag encoded so that small negative numbers also have a small encoding.
+                MaPLInstruction instruction = _bytes[annotation.byteLocation-sizeof(MaPLInstruction)];
+                if (instruction == MaPLInstruction_int32_literal) {
+                    int32_t literal = *((int32_t *)(&_bytes[annotation.byteLocation]));
+                    operand.fixedByteCount = sizeof(int32_t);
+                    operand.value = (uint32_t)(((uint32_t)literal << 1) ^ (uint32_t)(literal >> 31));
+                } else if (instruction == MaPLInstruction_int64_literal) {
+                    int64_t literal = *((int64_t *)(&_bytes[annotation.byteLocation]));
+                    operand.fixedByteCount = sizeof(int64_t);
+                    operand.value = ((uint64_t)literal << 1) ^ (uint64_t)(literal >> 63);
+                } else if (instruction == MaPLInstruction_uint32_literal) {
+                    operand.fixedByteCount = sizeof(uint32_t);
+                    operand.value = *((uint32_t *)(&_bytes[annotation.byteLocation]));
+                } else {
+                    operand.fixedByteCount = sizeof(uint64_t);
+                    operand.value = *((uint64_t *)(&_bytes[annotation.byteLocation]));
+                }
+                break;
+            }
+            case MaPLBufferAnnotationType_ForwardCursorMove: // Intentional fallthrough.
+            case MaPLBufferAnnotationType_BackwardCursorMove: // Intentional fallthrough.
+            case MaPLBufferAnnotationType_ConditionalCursorMove: // Intentional fallthrough.
+            case MaPLBufferAnnotationType_ConditionalBackwardCursorMove:
+                operand.fixedByteCount = sizeof(MaPLBytecodeLength);
+                operand.isCursorMove = true;
+                operand.isBackwardCursorMove = annotation.type == MaPLBufferAnnotationType_BackwardCursorMove ||
+                                               annotation.type == MaPLBufferAnnotationType_ConditionalBackwardCursorMove;
+                operand.destination = cursorMoveDestination(annotation);
+                // The distance of a cursor move can only shrink, so its current distance is an upper bound on its size.
+                operand.value = *((MaPLBytecodeLength *)(&_bytes[annotation.byteLocation]));
+                break;
+            case MaPLBufferAnnotationType_SwitchCursorMove:
+                operand.fixedByteCount = sizeof(MaPLBytecodeLength);
+                operand.isCursorMove = true;
+                operand.isFixedWidth = true;
+                operand.destination = cursorMoveDestination(annotation);
+                operand.value = *((MaPLBytecodeLength *)(&_bytes[annotation.byteLocation]));
+                break;
+            default:
+                continue;
+        }
+        operand.compactByteCount = operand.isFixedWidth ? operand.fixedByteCount : unsignedVarintByteCount(operand.value);
+        operands.push_back(operand);
+    }
+    std::sort(operands.begin(), operands.end(), [](const MaPLCompactOperand &a, const MaPLCompactOperand &b) {
+        return a.location < b.location;
+    });
+    operands.erase(std::unique(operands.begin(), operands.end(), [](const MaPLCompactOperand &a, const MaPLCompactOperand &b) {
+        return a.location == b.location;
+    }), operands.end());
+    
+    // Shrinking any operand can shorten the distance of the cursor moves that span it, which might allow those cursor moves
+    // to shrink too. Repeat until the sizes settle. Sizes never grow, so this always terminates.
+    std::vector<size_t> bytesRemovedBefore(operands.size()+1, 0);
+    bool didShrink = true;
+    while (didShrink) {
+        didShrink = false;
+        for (size_t i = 0; i < operands.size(); i++) {
+            bytesRemovedBefore[i+1] = bytesRemovedBefore[i] + operands[i].fixedByteCount - operands[i].compactByteCount;
+        }
+        for (MaPLCompactOperand &operand : operands) {
+            if (!operand.isCursorMove) {
+                continue;
+            }
+            size_t operandEnd = compactLocation(operands, bytesRemovedBefore, operand.location) + operand.compactByteCount;
+            size_t destination = compactLocation(operands, bytesRemovedBefore, operand.destination);
+            operand.value = operand.isBackwardCursorMove ? operandEnd - destination : destination - operandEnd;
+            if (operand.isFixedWidth) {
+                continue;
+            }
+            size_t compactByteCount = unsignedVarintByteCount(operand.value);
+            if (compactByteCount < operand.compactByteCount) {
+                operand.compactByteCount = compactByteCount;
+                didShrink = true;
+            }
+        }
+    }
+    
+    // Rewrite the bytes. Cursor moves that ended up with room to spare are padded to the size the layout was calculated with.
+    std::vector<uint8_t> compactBytes;
+    compactBytes.reserve(_bytes.size());
+    size_t copiedLocation = 0;
+    for (const MaPLCompactOperand &operand : operands) {
+        compactBytes.insert(compactBytes.end(), _bytes.begin()+copiedLocation, _bytes.begin()+operand.location);
+        if (operand.isFixedWidth) {
+            MaPLBytecodeLength cursorMove = (MaPLBytecodeLength)operand.value;
+            const uint8_t *cursorMoveBytes = (const uint8_t *)&cursorMove;
+            compactBytes.insert(compactBytes.end(), cursorMoveBytes, cursorMoveBytes+sizeof(cursorMove));
+        } else {
+            appendUnsignedVarint(compactBytes, operand.value, operand.compactByteCount);
+        }
+        copiedLocation = operand.location + operand.fixedByteCount;
+    }
+    compactBytes.insert(compactBytes.end(), _bytes.begin()+copiedLocation, _bytes.end());
+    
+    for (MaPLBufferAnnotation &annotation : _annotations) {
+        annotation.byteLocation = compactLocation(operands, bytesRemovedBefore, annotation.byteLocation);
+    }
+    size_t removedByteCount = _bytes.size() - compactBytes.size();
+    _bytes = compactBytes;
+    return removedByteCount;
+}
+
+void MaPLBuffer::poolStringLiterals() {
+    // Resizing a string never adds or removes annotations, so the indices remain valid throughout.
+    for (size_t i = 0; i < _annotations.size(); i++) {
+        if (_annotations[i].type != MaPLBufferAnnotationType_StringLiteral) {
+            continue;
+        }
+        size_t location = _annotations[i].byteLocation;
+        std::string string((const char *)(&_bytes[location]));
+        size_t stringByteCount = string.length()+1;
+        if (stringByteCount > sizeof(int32_t)) {
+            removeBytes(location+sizeof(int32_t), stringByteCount-sizeof(int32_t));
+        } else if (stringByteCount < sizeof(int32_t)) {
+            insertBytes(location+stringByteCount, sizeof(int32_t)-stringByteCount);
+        }
+        int32_t placeholder = 0;
+        overwriteBytes(&placeholder, sizeof(placeholder), location);
+        _annotations[i].text = string;
+    }
+}
+
+void MaPLBuffer::resolvePooledStrings(const std::map<std::string, uint32_t> &stringPoolOffsets, uint32_t bufferOffset) {
+    for (const MaPLBufferAnnotation &annotation : _annotations) {
+        if (annotation.type == MaPLBufferAnnotationType_StringLiteral) {
+            int32_t relativeOffset = (int32_t)((int64_t)stringPoolOffsets.at(annotation.text) - (int64_t)bufferOffset);
+            overwriteBytes(&relativeOffset, sizeof(relativeOffset), annotation.byteLocation);
+        }
+    }
+}
+
+std::vector<MaPLDebugLineEntry> MaPLBuffer::getDebugLineTable() {
+    std::vector<MaPLDebugLineEntry> lineTable;
+    for (const MaPLBufferAnnotation &annotation : _annotations) {
+        if (annotation.type == MaPLBufferAnnotationType_DebugLineTableEntry) {
+            // The text is formatted as "<line>:<column>".
+            size_t separator = annotation.text.find(':');
+            lineTable.push_back({ (MaPLBytecodeLength)annotation.byteLocation,
+                                  (MaPLLineNumber)std::stoul(annotation.text.substr(0, separator)),
+                                  (MaPLLineNumber)std::stoul(annotation.text.substr(separator+1)) });
+        }
+    }
+    std::stable_sort(lineTable.begin(), lineTable.end(), [](const MaPLDebugLineEntry &a, const MaPLDebugLineEntry &b) {
+        return a.bytecodePosition < b.bytecodePosition;
+    });
+    
+    // Statements that compile to no bytes share a location with the statement that follows them. Only the last one is kept.
+    std::vector<MaPLDebugLineEntry> uniqueLineTable;
+    for (const MaPLDebugLineEntry &entry : lineTable) {
+        if (uniqueLineTable.size() && uniqueLineTable.back().bytecodePosition == entry.bytecodePosition) {
+            uniqueLineTable.back() = entry;
+        } else {
+            uniqueLineTable.push_back(entry);
+        }
+    }
+    return uniqueLineTable;
+}
+
+/**
+ * @return The @c MaPLDataType that the runtime uses for values of @c type. The runtime's enum isn't visible to the compiler.
+ */
+static uint8_t debugDataTypeForPrimitive(MaPLPrimitiveType type) {
+    switch (type) {
+        case MaPLPrimitiveType_Char: return 2;
+        case MaPLPrimitiveType_Int32: return 3;
+        case MaPLPrimitiveType_Int64: return 4;
+        case MaPLPrimitiveType_UInt32: return 5;
+        case MaPLPrimitiveType_UInt64: return 6;
+        case MaPLPrimitiveType_Float32: return 7;
+        case MaPLPrimitiveType_Float64: return 8;
+        case MaPLPrimitiveType_String: return 9;
+        case MaPLPrimitiveType_Boolean: return 10;
+        case MaPLPrimitiveType_Pointer: return 11;
+        default: return 0;
+    }
+}
+
+std::vector<uint8_t> MaPLBuffer::getDebugVariableTable() {
+    // Pair each start marker with the next end marker that has the same text. Declarations with the same text (like copies of
+    // an unrolled loop) are always in scope one after another, so at most one of them is open at a time.
+    std::vector<std::pair<MaPLDebugVariableEntry, std::string>> variables;
+    std::unordered_map<std::string, size_t> openVariables;
+    for (const MaPLBufferAnnotation &annotation : _annotations) {
+        if (annotation.type == MaPLBufferAnnotationType_DebugVariableStart) {
+            // The text is formatted as "<memory address>:<primitive type>:<name>".
+            size_t typeSeparator = annotation.text.find(':');
+            size_t nameSeparator = annotation.text.find(':', typeSeparator+1);
+            MaPLDebugVariableEntry entry{};
+            entry.startPosition = (MaPLBytecodeLength)annotation.byteLocation;
+            entry.endPosition = (MaPLBytecodeLength)_bytes.size();
+            entry.memoryAddress = (MaPLMemoryAddress)std::stoul(annotation.text.substr(0, typeSeparator));
+            entry.dataType = debugDataTypeForPrimitive((MaPLPrimitiveType)std::stoul(annotation.text.substr(typeSeparator+1, nameSeparator-typeSeparator-1)));
+            openVariables[annotation.text] = variables.size();
+            variables.push_back({ entry, annotation.text.substr(nameSeparator+1) });
+        } else if (annotation.type == MaPLBufferAnnotationType_DebugVariableEnd) {
+            auto openVariable = openVariables.find(annotation.text);
+            if (openVariable != openVariables.end()) {
+                variables[openVariable->second].first.endPosition = (MaPLBytecodeLength)annotation.byteLocation;
+                openVariables.erase(openVariable);
+            }
+        }
+    }
+    
+    // Scopes that were removed entirely (for example, as unreachable code) leave behind empty ranges.
+    variables.erase(std::remove_if(variables.begin(), variables.end(), [](const std::pair<MaPLDebugVariableEntry, std::string> &variable) {
+        return variable.first.startPosition >= variable.first.endPosition;
+    }), variables.end());
+    std::stable_sort(variables.begin(), variables.end(), [](const std::pair<MaPLDebugVariableEntry, std::string> &a,
+                                                            const std::pair<MaPLDebugVariableEntry, std::string> &b) {
+        return a.first.startPosition < b.first.startPosition;
+    });
+    
+    uint32_t variableCount = (uint32_t)variables.size();
+    std::vector<uint8_t> table(sizeof(variableCount) + sizeof(MaPLDebugVariableEntry) * variables.size());
+    memcpy(&table[0], &variableCount, sizeof(variableCount));
+    for (size_t i = 0; i < variables.size(); i++) {
+        MaPLDebugVariableEntry entry = variables[i].first;
+        entry.nameOffset = (uint32_t)table.size();
+        table.insert(table.end(), variables[i].second.begin(), variables[i].second.end());
+        table.push_back(0);
+        memcpy(&table[sizeof(variableCount) + sizeof(MaPLDebugVariableEntry) * i], &entry, sizeof(entry));
     }
+    return table;
 }
@@ -21,13 +21,24 @@ class MaPLVariableStack;
 enum MaPLBufferAnnotationType {
     MaPLBufferAnnotationType_Break,
     MaPLBufferAnnotationType_Continue,
+    MaPLBufferAnnotationType_ForwardCursorMove,
+    MaPLBufferAnnotationType_BackwardCursorMove,
+    MaPLBufferAnnotationType_ConditionalCursorMove,
+    MaPLBufferAnnotationType_ConditionalBackwardCursorMove,
+    MaPLBufferAnnotationType_SwitchCursorMove,
     MaPLBufferAnnotationType_PrimitiveVariableAddressDeclaration,
     MaPLBufferAnnotationType_AllocatedVariableIndexDeclaration,
     MaPLBufferAnnotationType_PrimitiveVariableAddressReference,
     MaPLBufferAnnotationType_AllocatedVariableIndexReference,
     MaPLBufferAnnotationType_FunctionSymbol,
     MaPLBufferAnnotationType_DebugLine,
+    MaPLBufferAnnotationType_IntegerLiteral,
+    MaPLBufferAnnotationType_StringLiteral,
+    MaPLBufferAnnotationType_DebugLineTableEntry,
     MaPLBufferAnnotationType_EndOfDependencies,
+    MaPLBufferAnnotationType_StringAllocation,
+    MaPLBufferAnnotationType_DebugVariableStart,
+    MaPLBufferAnnotationType_DebugVariableEnd,
 };
 
 struct MaPLBufferAnnotation {
@@ -53,7 +64,7 @@ public:
     void appendBytes(const void *bytes, size_t byteSize);
     
     /**
-     * Prepends new bytes onto the start of the buffer.
+     * Prepends new bytes onto the start of the buffer. All annotations are moved to match.
      *
      * @param bytes The new bytes that will be prepended onto the start of the buffer.
      * @param byteSize The number of bytes that should be prepended from the @c bytes parameter.
@@ -107,6 +118,11 @@ public:
      */
     void appendString(std::string string, MaPLFile *file, antlr4::Token *errToken);
     
+    /**
+     * Appends the bytes from a string whose escape sequences were already resolved via @c resolveEscapeSequences().
+     */
+    void appendResolvedString(const std::string &string);
+    
     /**
      * @return The bytes stored in this buffer.
      */
@@ -123,7 +139,23 @@ public:
     void addAnnotation(MaPLBufferAnnotationType annotationType, const std::string &text = "");
     
     /**
-     * Resolves all matching control flow ("Break" or "Continue") annotations. Resolved annotatinons are removed from this buffer.
+     * Adds a @c MaPLBufferAnnotationType_DebugLineTableEntry annotation to the end of this buffer, marking the start of a statement.
+     *
+     * @param token The first token of the statement, whose line and column identify the statement in the debug line table.
+     */
+    void addDebugLineTableEntry(antlr4::Token *token);
+    
+    /**
+     * Adds a @c MaPLBufferAnnotationType_DebugVariableStart or @c MaPLBufferAnnotationType_DebugVariableEnd annotation to the end of
+     * this buffer, marking where a variable comes into or goes out of scope in the debug variable table.
+     *
+     * @param isStart @c true if the variable is declared at this location, @c false if its scope ends here.
+     */
+    void addDebugVariableTableMarker(bool isStart, const std::string &variableName, MaPLPrimitiveType type, MaPLMemoryAddress memoryAddress);
+    
+    /**
+     * Resolves all matching control flow ("Break" or "Continue") annotations. Resolved annotatinons are replaced with
+     * cursor move annotations that describe the resulting jump.
      *
      * @param type The type of annotations that will be resolved.
      * @param jumpToEnd If the resolution of this @c type of annotation will move the cursor to the end or beginning of the buffer.
@@ -146,11 +178,56 @@ public:
     void resolveSymbolsWithTable(const std::map<std::string, MaPLSymbol> &symbolTable);
     
     /**
-     * Assigns a value of 0 to all debug lines. This is useful in the case where bytecode from multiple files are concatenated,
-     * and the line numbers from the previous file are no longer meaningful.
+     * Assigns a value of 0 to all debug lines, and removes all debug line table entries and debug variable markers. This is useful in the case where bytecode
+     * from multiple files are concatenated, and the line numbers from the previous file are no longer meaningful.
      */
     void zeroDebugLines();
     
+    /**
+     * Repeatedly applies local rewrites to the bytecode until no more rewrites are possible. Rewrites never change the behavior
+     * of the bytecode, and all annotations (including cursor moves) are kept consistent with the rewritten bytes.
+     *
+     * @param optimizationLevel Rewrite rules are applied only if their level is less than or equal to this value.
+     * @return The number of bytes that were removed from the buffer.
+     */
+    size_t applyPeepholeOptimizations(uint8_t optimizationLevel);
+    
+    /**
+     * Rewrites the bytecode so that every memory address, symbol, cursor move, line number, and integer literal is stored as an LEB128
+     * varint instead of at its full width. Cursor moves in switch tables keep their full width so that the table can be indexed.
+     * Cursor moves are recalculated to account for the bytes removed between them and their destinations. This must be the last
+     * step before the bytecode is output, since no other part of the compiler understands varints.
+     *
+     * @return The number of bytes that were removed from the buffer.
+     */
+    size_t applyCompactEncoding();
+    
+    /**
+     * Replaces every string literal with a 4-byte placeholder for the offset of that string within a string pool that is
+     * stored outside of the bytecode. Each string literal annotation is kept, and its text is set to the string that it
+     * now refers to. Cursor moves are recalculated to account for the change in size. Must be applied before @c applyCompactEncoding.
+     */
+    void poolStringLiterals();
+    
+    /**
+     * @return The location, line and column of each statement marked by a @c MaPLBufferAnnotationType_DebugLineTableEntry annotation, sorted by location.
+     */
+    std::vector<MaPLDebugLineEntry> getDebugLineTable();
+    
+    /**
+     * @return A debug variable table (see @c MaPLDebugVariableEntry) with an entry for each pair of debug variable markers. A variable
+     *         that is never marked as going out of scope is in scope until the end of the bytecode.
+     */
+    std::vector<uint8_t> getDebugVariableTable();
+    
+    /**
+     * Writes the offsets of pooled strings into the placeholders created by @c poolStringLiterals.
+     *
+     * @param stringPoolOffsets A mapping of each pooled string to its location within the enclosing bundle.
+     * @param bufferOffset The location of this buffer within the enclosing bundle.
+     */
+    void resolvePooledStrings(const std::map<std::string, uint32_t> &stringPoolOffsets, uint32_t bufferOffset);
+    
     MaPLMemoryAddress calculatePrimitiveMemoryAddressOffset(MaPLVariableStack *variableStack,
                                                             MaPLMemoryAddress endOfDependencies);
     
@@ -159,6 +236,15 @@ public:
     
 private:
     
+    bool removeEmptyCursorMove(size_t annotationIndex);
+    bool threadCursorMove(size_t annotationIndex);
+    bool removeUnreachableBytes(size_t annotationIndex);
+    bool removeSelfAssignment(size_t annotationIndex);
+    void removeBytes(size_t location, size_t byteCount);
+    void insertBytes(size_t location, size_t byteCount);
+    size_t cursorMoveDestination(const MaPLBufferAnnotation &annotation);
+    bool hasAnnotation(MaPLBufferAnnotationType annotationType, size_t location);
+    
     MaPLMemoryAddress calculateMemoryAddressOffset(MaPLBufferAnnotationType annotationType,
                                                    MaPLMemoryAddress endOfDependencies);
     
@@ -167,4 +253,11 @@ private:
     std::vector<MaPLBufferAnnotation> _annotations;
 };
 
+/**
+ * Replaces each escape sequence in @c string (like "\n") with the character that it represents.
+ *
+ * @return @c false if @c string contains an invalid escape sequence, in which case an error is logged to @c file.
+ */
+bool resolveEscapeSequences(std::string &string, MaPLFile *file, antlr4::Token *errToken);
+
 #endif /* MaPLBuffer_h */
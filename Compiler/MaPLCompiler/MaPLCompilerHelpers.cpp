@@ -5,7 +5,10 @@
 //  Created by Brad Bambara on 2/14/22.
 //
 
+#include <algorithm>
+#include <limits>
 #include <set>
+#include <sstream>
 #include <vector>
 
 #include "MaPLCompiler.h"
@@ -15,31 +18,341 @@
 #include "MaPLBuffer.h"
 
 MaPLCompileResult compileMaPL(const std::vector<std::filesystem::path> &scriptPaths, const MaPLCompileOptions &options) {
+    MaPLCompileSession session(options);
+    return session.compile(scriptPaths);
+}
+
+MaPLCompileResult compileMaPLSources(const std::map<std::filesystem::path, std::string> &scriptSources,
+                                     const MaPLImportResolver &importResolver,
+                                     const MaPLCompileOptions &options) {
+    MaPLCompileSession session(options, importResolver);
+    return session.compileSources(scriptSources);
+}
+
+MaPLCompileSession::MaPLCompileSession(const MaPLCompileOptions &options) :
+    _options(options),
+    _fileCache(new MaPLFileCache())
+{
+    _fileCache->setProfileParser(options.profileParser);
+}
+
+MaPLCompileSession::MaPLCompileSession(const MaPLCompileOptions &options, const MaPLImportResolver &importResolver) :
+    _options(options),
+    _fileCache(new MaPLFileCache())
+{
+    _fileCache->setImportResolver(importResolver);
+    _fileCache->setProfileParser(options.profileParser);
+}
+
+MaPLCompileSession::~MaPLCompileSession() {
+    delete _fileCache;
+}
+
+MaPLCompileResult MaPLCompileSession::compileSources(const std::map<std::filesystem::path, std::string> &scriptSources) {
+    std::vector<std::filesystem::path> scriptPaths;
+    for (const auto&[path, sourceText] : scriptSources) {
+        _fileCache->setSourceForNormalizedPath(path.lexically_normal(), sourceText);
+        scriptPaths.push_back(path);
+    }
+    return compile(scriptPaths);
+}
+
+static void finishBytecode(MaPLBuffer &buffer, MaPLFile *file, const MaPLCompileOptions &options, bool poolStrings) {
+    if (poolStrings) {
+        buffer.poolStringLiterals();
+    }
+    if (options.compactEncoding) {
+        buffer.applyCompactEncoding();
+    }
+    
+    // Prepend the amount of memory that the script requires.
+    MaPLMemoryAddress prependedAddresses[] = {
+        file->getVariableStack()->getMaximumPrimitiveMemoryUsed(),
+        file->getVariableStack()->getMaximumAllocatedMemoryUsed()
+    };
+    if (options.compactEncoding) {
+        std::vector<uint8_t> compactAddresses;
+        for (MaPLMemoryAddress address : prependedAddresses) {
+            appendUnsignedVarint(compactAddresses, address, unsignedVarintByteCount(address));
+        }
+        buffer.prependBytes(compactAddresses.data(), compactAddresses.size());
+    } else {
+        buffer.prependBytes(prependedAddresses, sizeof(prependedAddresses));
+    }
+    
+    // Prepend a byte of flags. The lowest bit indicates big vs little endian (equals 1 if little endian).
+    uint16_t endianShort = 1;
+    uint8_t flagsByte = *(uint8_t *)&endianShort;
+    if (options.compactEncoding) {
+        flagsByte |= MAPL_BYTECODE_FLAG_COMPACT_ENCODING;
+    }
+    if (poolStrings) {
+        flagsByte |= MAPL_BYTECODE_FLAG_POOLED_STRINGS;
+    }
+    buffer.prependBytes(&flagsByte, sizeof(flagsByte));
+}
+
+/**
+ * @return The line that the bytecode at @c location was compiled from, or 0 if it wasn't compiled from any line of the script.
+ */
+static MaPLLineNumber lineForLocation(const std::vector<MaPLDebugLineEntry> &lineTable, size_t location) {
+    auto nextEntry = std::upper_bound(lineTable.begin(), lineTable.end(), location, [](size_t location, const MaPLDebugLineEntry &entry) {
+        return location < entry.bytecodePosition;
+    });
+    return nextEntry == lineTable.begin() ? 0 : (nextEntry-1)->lineNumber;
+}
+
+/**
+ * @return A JSON object that describes the cost of running the finished bytecode in @c buffer (see @c MaPLCompileResult::costReports).
+ */
+static std::string costReportForBuffer(MaPLBuffer &buffer, MaPLFile *file, const MaPLCompileOptions &options) {
+    const std::vector<uint8_t> &bytes = buffer.getBytes();
+    std::vector<MaPLBufferAnnotation> annotations = buffer.getAnnotations();
+    std::vector<MaPLDebugLineEntry> lineTable = buffer.getDebugLineTable();
+    
+    // Each statement's bytes run until the start of the next statement.
+    std::map<MaPLLineNumber, size_t> bytesPerLine;
+    size_t statementStart = 0;
+    MaPLLineNumber statementLine = 0;
+    for (const MaPLDebugLineEntry &entry : lineTable) {
+        bytesPerLine[statementLine] += entry.bytecodePosition - statementStart;
+        statementStart = entry.bytecodePosition;
+        statementLine = entry.lineNumber;
+    }
+    bytesPerLine[statementLine] += bytes.size() - statementStart;
+    
+    // Every loop ends in a backward cursor move, which spans the entire loop.
+    std::vector<std::pair<size_t, size_t>> loopRanges;
+    for (const MaPLBufferAnnotation &annotation : annotations) {
+        if (annotation.type != MaPLBufferAnnotationType_BackwardCursorMove &&
+            annotation.type != MaPLBufferAnnotationType_ConditionalBackwardCursorMove) {
+            continue;
+        }
+        uint64_t cursorMove = 0;
+        size_t operandEnd = annotation.byteLocation;
+        if (options.compactEncoding) {
+            for (size_t shift = 0; operandEnd < bytes.size(); shift += 7) {
+                uint8_t byte = bytes[operandEnd++];
+                cursorMove |= (uint64_t)(byte & 0x7F) << shift;
+                if (!(byte & 0x80)) {
+                    break;
+                }
+            }
+        } else {
+            cursorMove = *((MaPLBytecodeLength *)(&bytes[operandEnd]));
+            operandEnd += sizeof(MaPLBytecodeLength);
+        }
+        loopRanges.push_back({ operandEnd - cursorMove, operandEnd });
+    }
+    
+    std::map<std::string, size_t> callSitesPerSymbol;
+    std::vector<std::string> hostCalls;
+    std::map<MaPLLineNumber, size_t> stringAllocationsPerLine;
+    for (const MaPLBufferAnnotation &annotation : annotations) {
+        if (annotation.type == MaPLBufferAnnotationType_StringAllocation) {
+            stringAllocationsPerLine[lineForLocation(lineTable, annotation.byteLocation)]++;
+        } else if (annotation.type == MaPLBufferAnnotationType_FunctionSymbol) {
+            size_t loopDepth = 0;
+            for (const auto&[loopStart, loopEnd] : loopRanges) {
+                if (annotation.byteLocation >= loopStart && annotation.byteLocation < loopEnd) {
+                    loopDepth++;
+                }
+            }
+            callSitesPerSymbol[annotation.text]++;
+            hostCalls.push_back("{ \"symbol\": \""+annotation.text+"\", \"line\": "+std::to_string(lineForLocation(lineTable, annotation.byteLocation))+", \"loopDepth\": "+std::to_string(loopDepth)+" }");
+        }
+    }
+    
+    // Symbol descriptors are made of identifiers, so no characters need to be escaped.
+    std::vector<std::string> bytesPerLineMembers;
+    for (const auto&[line, byteCount] : bytesPerLine) {
+        bytesPerLineMembers.push_back("\""+std::to_string(line)+"\": "+std::to_string(byteCount));
+    }
+    std::vector<std::string> callSitesPerSymbolMembers;
+    for (const auto&[symbol, callSiteCount] : callSitesPerSymbol) {
+        callSitesPerSymbolMembers.push_back("\""+symbol+"\": "+std::to_string(callSiteCount));
+    }
+    std::vector<std::string> stringAllocationsPerLineMembers;
+    for (const auto&[line, allocationCount] : stringAllocationsPerLine) {
+        stringAllocationsPerLineMembers.push_back("\""+std::to_string(line)+"\": "+std::to_string(allocationCount));
+    }
+    auto jsonList = [](const std::vector<std::string> &elements, const std::string &open, const std::string &close) {
+        std::string list = open;
+        for (size_t i = 0; i < elements.size(); i++) {
+            list += (i == 0 ? "\n    " : ",\n    ")+elements[i];
+        }
+        return list + (elements.empty() ? "" : "\n  ") + close;
+    };
+    std::string report = "{\n";
+    report += "  \"bytecodeSize\": "+std::to_string(bytes.size())+",\n";
+    report += "  \"primitiveMemorySize\": "+std::to_string(file->getVariableStack()->getMaximumPrimitiveMemoryUsed())+",\n";
+    report += "  \"allocatedMemorySize\": "+std::to_string(file->getVariableStack()->getMaximumAllocatedMemoryUsed())+",\n";
+    report += "  \"bytesPerLine\": "+jsonList(bytesPerLineMembers, "{", "}")+",\n";
+    report += "  \"hostCallSitesPerSymbol\": "+jsonList(callSitesPerSymbolMembers, "{", "}")+",\n";
+    report += "  \"hostCalls\": "+jsonList(hostCalls, "[", "]")+",\n";
+    report += "  \"stringAllocationsPerLine\": "+jsonList(stringAllocationsPerLineMembers, "{", "}")+"\n";
+    report += "}\n";
+    return report;
+}
+
+/**
+ * @return An error message for each persisted symbol value that is shared by more than one descriptor.
+ */
+static std::vector<std::string> errorsForPersistedSymbols(const std::map<std::string, MaPLSymbol> &persistedSymbols) {
+    std::vector<std::string> errorMessages;
+    std::map<MaPLSymbol, std::string> descriptorsBySymbol;
+    for (const auto&[descriptor, symbol] : persistedSymbols) {
+        if (descriptorsBySymbol.count(symbol)) {
+            errorMessages.push_back("Persisted symbols '"+descriptorsBySymbol.at(symbol)+"' and '"+descriptor+"' share the value "+std::to_string(symbol)+". Every persisted symbol must have a unique value.");
+            continue;
+        }
+        descriptorsBySymbol[symbol] = descriptor;
+    }
+    return errorMessages;
+}
+
+static size_t pageAlignedLocation(size_t location) {
+    return (location + MAPL_BUNDLE_PAGE_SIZE - 1) / MAPL_BUNDLE_PAGE_SIZE * MAPL_BUNDLE_PAGE_SIZE;
+}
+
+static std::vector<uint8_t> bundleForBuffers(std::vector<std::pair<std::filesystem::path, MaPLBuffer>> &buffers,
+                                             std::vector<std::string> &errorMessages) {
+    // Scripts are named relative to the deepest directory that contains all of them.
+    std::filesystem::path bundleRoot = buffers.size() ? buffers[0].first.parent_path() : std::filesystem::path();
+    for (const auto&[path, buffer] : buffers) {
+        while (*path.lexically_relative(bundleRoot).begin() == "..") {
+            bundleRoot = bundleRoot.parent_path();
+        }
+    }
+    std::map<std::string, size_t> bufferIndicesByName;
+    for (size_t i = 0; i < buffers.size(); i++) {
+        bufferIndicesByName[buffers[i].first.lexically_relative(bundleRoot).generic_string()] = i;
+    }
+    
+    // Names and string literals are deduplicated into a single pool.
+    uint32_t stringPoolOffset = (uint32_t)(sizeof(MaPLBundleHeader) + sizeof(MaPLBundleEntry) * buffers.size());
+    std::vector<uint8_t> stringPool;
+    std::map<std::string, uint32_t> stringPoolOffsets;
+    auto addToStringPool = [&](const std::string &string) {
+        if (stringPoolOffsets.count(string)) {
+            return;
+        }
+        stringPoolOffsets[string] = stringPoolOffset + (uint32_t)stringPool.size();
+        stringPool.insert(stringPool.end(), string.c_str(), string.c_str()+string.length()+1);
+    };
+    for (const auto&[name, bufferIndex] : bufferIndicesByName) {
+        addToStringPool(name);
+    }
+    for (auto &[path, buffer] : buffers) {
+        for (const MaPLBufferAnnotation &annotation : buffer.getAnnotations()) {
+            if (annotation.type == MaPLBufferAnnotationType_StringLiteral) {
+                addToStringPool(annotation.text);
+            }
+        }
+    }
+    
+    // Lay out each script at the start of a page, so that scripts can be mapped and paged in independently.
+    MaPLBundleHeader header;
+    memcpy(header.magic, MAPL_BUNDLE_MAGIC, sizeof(header.magic));
+    header.version = MAPL_BUNDLE_VERSION;
+    header.scriptCount = (uint32_t)buffers.size();
+    header.stringPoolOffset = stringPoolOffset;
+    header.stringPoolLength = (uint32_t)stringPool.size();
+    std::vector<MaPLBundleEntry> entries;
+    size_t scriptOffset = pageAlignedLocation(stringPoolOffset + stringPool.size());
+    for (const auto&[name, bufferIndex] : bufferIndicesByName) {
+        MaPLBuffer &buffer = buffers[bufferIndex].second;
+        entries.push_back({ stringPoolOffsets[name] - stringPoolOffset, (uint32_t)scriptOffset, (uint32_t)buffer.getByteCount() });
+        scriptOffset = pageAlignedLocation(scriptOffset + buffer.getByteCount());
+    }
+    if (scriptOffset > INT32_MAX) {
+        errorMessages.push_back("The bundle is "+std::to_string(scriptOffset)+" bytes, which exceeds the maximum bundle size of "+std::to_string(INT32_MAX)+" bytes. Split the scripts into multiple bundles.");
+        return std::vector<uint8_t>();
+    }
+    
+    std::vector<uint8_t> bundle(scriptOffset, 0);
+    memcpy(bundle.data(), &header, sizeof(header));
+    memcpy(bundle.data()+sizeof(header), entries.data(), sizeof(MaPLBundleEntry) * entries.size());
+    memcpy(bundle.data()+stringPoolOffset, stringPool.data(), stringPool.size());
+    size_t entryIndex = 0;
+    for (const auto&[name, bufferIndex] : bufferIndicesByName) {
+        MaPLBuffer &buffer = buffers[bufferIndex].second;
+        buffer.resolvePooledStrings(stringPoolOffsets, entries[entryIndex].scriptOffset);
+        std::vector<uint8_t> bytes = buffer.getBytes();
+        memcpy(bundle.data()+entries[entryIndex].scriptOffset, bytes.data(), bytes.size());
+        entryIndex++;
+    }
+    return bundle;
+}
+
+MaPLCompileResult MaPLCompileSession::compile(const std::vector<std::filesystem::path> &scriptPaths) {
     MaPLCompileResult compileResult;
-    MaPLFileCache fileCache;
     std::vector<MaPLFile *> files;
     
+    // Hosts would be unable to tell apart APIs that share a symbol value.
+    compileResult.errorMessages = errorsForPersistedSymbols(_options.persistedSymbols);
+    
+    // Discard anything compiled by a previous call that is now out of date.
+    _fileCache->invalidateModifiedFiles();
+    
+    // Cost reports attribute bytes to lines via the same annotations as the debug line table.
+    MaPLCompileOptions fileOptions = _options;
+    fileOptions.debugLineTable = _options.debugLineTable || _options.costReport;
+    
     // Create a file for each path.
     for (const std::filesystem::path &path : scriptPaths) {
         if (!path.is_absolute()) {
             compileResult.errorMessages.push_back("Path '"+path.string()+"' must be specified as an absolute path.");
             continue;
         }
-        MaPLFile *file = fileCache.fileForNormalizedPath(path.lexically_normal());
-        file->setOptions(options);
+        MaPLFile *file = _fileCache->fileForNormalizedPath(path.lexically_normal(), fileOptions);
+        file->setOptions(fileOptions);
         file->compileIfNeeded();
         files.push_back(file);
     }
     
+    // Linked dependencies are executed separately from the files that link against them, so they must also be output.
+    if (_options.linkDependencies) {
+        for (size_t i = 0; i < files.size(); i++) {
+            MaPLFile *linkedDependency = files[i]->getLinkedDependency();
+            if (!linkedDependency) {
+                continue;
+            }
+            compileResult.linkedDependencies[files[i]->getNormalizedFilePath()] = linkedDependency->getNormalizedFilePath();
+            if (std::find(files.begin(), files.end(), linkedDependency) == files.end()) {
+                files.push_back(linkedDependency);
+            }
+        }
+    }
+    
     // Check for errors, not just in the listed files, but in all included dependent files.
-    for (const auto&[path, file] : fileCache.getFiles()) {
-        std::vector<std::string> errors = file->getErrors();
-        compileResult.errorMessages.insert(compileResult.errorMessages.end(), errors.begin(), errors.end());
+    // The cache may hold files from previous compilations, so only check the files that are relevant to this one.
+    // A script that's both a root and a dependency is compiled once for each, so report its errors only once.
+    std::set<std::filesystem::path> checkedPaths;
+    for (MaPLFile *file : files) {
+        std::vector<MaPLFile *> fileAndDependencies = flattenedDependencies(file);
+        fileAndDependencies.push_back(file);
+        for (MaPLFile *checkedFile : fileAndDependencies) {
+            if (!checkedPaths.insert(checkedFile->getNormalizedFilePath()).second) {
+                continue;
+            }
+            std::vector<std::string> errors = checkedFile->getErrors();
+            compileResult.errorMessages.insert(compileResult.errorMessages.end(), errors.begin(), errors.end());
+            std::vector<std::string> warnings = checkedFile->getWarnings();
+            compileResult.warningMessages.insert(compileResult.warningMessages.end(), warnings.begin(), warnings.end());
+            if (_options.profileParser) {
+                compileResult.parserProfiles[checkedFile->getNormalizedFilePath()] = checkedFile->getParserProfile();
+            }
+        }
     }
     
     size_t byteLimitation = sizeof(MaPLMemoryAddress) < sizeof(MaPLBytecodeLength) ? sizeof(MaPLMemoryAddress) : sizeof(MaPLBytecodeLength);
     size_t maxByteCount = (size_t)pow(2, byteLimitation*8);
     for (MaPLFile *file : files) {
+        if (!file->getBytecode()) {
+            // Files that failed to parse have already logged an error.
+            continue;
+        }
         size_t fileByteCount = file->getBytecode()->getByteCount();
         if (fileByteCount > maxByteCount) {
             compileResult.errorMessages.push_back("Compiled bytecode for file '"+file->getNormalizedFilePath().string()+"' is "+std::to_string(fileByteCount)+" bytes, which exceeds the length that can be described by MaPL's "+std::to_string(byteLimitation)+"-byte addressing system (max of "+std::to_string(maxByteCount)+" bytes). The compiler and runtime must be updated if scripts of this length are required.");
@@ -47,40 +360,140 @@ MaPLCompileResult compileMaPL(const std::vector<std::filesystem::path> &scriptPa
     }
     
     if (compileResult.errorMessages.size()) {
+        compileResult.linkedDependencies.clear();
         return compileResult;
     }
     
     // Generate the symbol table.
-    std::map<std::string, MaPLSymbol> symbolTable = symbolTableForFiles(files);
-    compileResult.symbolTable = "#ifndef "+options.symbolsPrefix+"_h\n#define "+options.symbolsPrefix+"_h\nenum "+options.symbolsPrefix+" {\n";
+    std::map<std::string, MaPLSymbol> symbolTable = symbolTableForFiles(files, _options.persistedSymbols, compileResult.errorMessages);
+    if (compileResult.errorMessages.size()) {
+        compileResult.linkedDependencies.clear();
+        return compileResult;
+    }
+    compileResult.persistedSymbols = _options.persistedSymbols;
+    compileResult.persistedSymbols.insert(symbolTable.begin(), symbolTable.end());
+    compileResult.symbolTable = "#ifndef "+_options.symbolsPrefix+"_h\n#define "+_options.symbolsPrefix+"_h\nenum "+_options.symbolsPrefix+" {\n";
     for (const auto&[descriptor, symbol] : symbolTable) {
-        compileResult.symbolTable += "    "+options.symbolsPrefix+"_"+descriptor+" = "+std::to_string(symbol)+",\n";
+        compileResult.symbolTable += "    "+_options.symbolsPrefix+"_"+descriptor+" = "+std::to_string(symbol)+",\n";
     }
-    compileResult.symbolTable += "};\n#endif /* "+options.symbolsPrefix+"_h */\n";
+    compileResult.symbolTable += "};\n#endif /* "+_options.symbolsPrefix+"_h */\n";
     
     // Put the finishing touches on the bytecode and add each one to the result.
+    // Work on a copy so that the file's bytecode stays reusable by dependent files in later compilations.
+    std::vector<std::pair<std::filesystem::path, MaPLBuffer>> bundledBuffers;
     for (MaPLFile *file : files) {
-        MaPLBuffer *buffer = file->getBytecode();
-        buffer->resolveSymbolsWithTable(symbolTable);
-        
-        // Prepend the amount of memory that the script requires.
-        MaPLMemoryAddress prependedAddresses[] = {
-            file->getVariableStack()->getMaximumPrimitiveMemoryUsed(),
-            file->getVariableStack()->getMaximumAllocatedMemoryUsed()
-        };
-        buffer->prependBytes(prependedAddresses, sizeof(prependedAddresses));
-        
-        // Prepend a byte that indicates big vs little endian (equals 1 if little endian).
-        uint16_t endianShort = 1;
-        uint8_t endianByte = *(uint8_t *)&endianShort;
-        buffer->prependBytes(&endianByte, sizeof(endianByte));
-        
-        compileResult.compiledFiles[file->getNormalizedFilePath()] = buffer->getBytes();
+        MaPLBuffer buffer = *file->getBytecode();
+        if (_options.optimizationLevel > 0) {
+            compileResult.peepholeBytesSaved[file->getNormalizedFilePath()] = buffer.applyPeepholeOptimizations(_options.optimizationLevel);
+        }
+        buffer.resolveSymbolsWithTable(symbolTable);
+        if (_options.bundleScripts) {
+            MaPLBuffer bundledBuffer = buffer;
+            finishBytecode(bundledBuffer, file, _options, true);
+            bundledBuffers.push_back({ file->getNormalizedFilePath(), bundledBuffer });
+        }
+        finishBytecode(buffer, file, _options, false);
+        compileResult.compiledFiles[file->getNormalizedFilePath()] = buffer.getBytes();
+        if (_options.debugLineTable) {
+            std::vector<MaPLDebugLineEntry> lineTable = buffer.getDebugLineTable();
+            const uint8_t *lineTableBytes = (const uint8_t *)lineTable.data();
+            compileResult.debugLineTables[file->getNormalizedFilePath()] = std::vector<uint8_t>(lineTableBytes, lineTableBytes + sizeof(MaPLDebugLineEntry) * lineTable.size());
+            compileResult.debugVariableTables[file->getNormalizedFilePath()] = buffer.getDebugVariableTable();
+        }
+        if (_options.costReport) {
+            compileResult.costReports[file->getNormalizedFilePath()] = costReportForBuffer(buffer, file, _options);
+        }
+    }
+    
+    if (_options.bundleScripts) {
+        compileResult.bundle = bundleForBuffers(bundledBuffers, compileResult.errorMessages);
+        if (compileResult.errorMessages.size()) {
+            compileResult.compiledFiles.clear();
+            compileResult.linkedDependencies.clear();
+            compileResult.peepholeBytesSaved.clear();
+            compileResult.debugLineTables.clear();
+            compileResult.debugVariableTables.clear();
+            compileResult.costReports.clear();
+        }
     }
     
     return compileResult;
 }
 
+bool parseMaPLExecutionProfile(const std::string &profileText,
+                               const std::filesystem::path &profileDirectory,
+                               std::map<std::filesystem::path, MaPLScriptProfile> &profiles) {
+    // Parse everything before adding any counts, so that a malformed profile doesn't leave partial counts behind.
+    std::vector<std::pair<std::filesystem::path, MaPLScriptProfile>> parsedProfiles;
+    std::istringstream profileStream(profileText);
+    std::string line;
+    while (std::getline(profileStream, line)) {
+        std::istringstream lineStream(line);
+        std::string recordType;
+        if (!(lineStream >> recordType)) {
+            continue;
+        }
+        if (recordType == "script") {
+            std::string scriptName;
+            std::getline(lineStream >> std::ws, scriptName);
+            if (scriptName.empty()) {
+                return false;
+            }
+            parsedProfiles.push_back({ (profileDirectory / scriptName).lexically_normal(), MaPLScriptProfile() });
+            continue;
+        }
+        // Every count belongs to the most recent script.
+        if (parsedProfiles.empty()) {
+            return false;
+        }
+        MaPLScriptProfile &profile = parsedProfiles.back().second;
+        uint32_t lineNumber, columnNumber;
+        if (recordType == "branch") {
+            uint64_t takenCount, notTakenCount;
+            if (!(lineStream >> lineNumber >> columnNumber >> takenCount >> notTakenCount)) {
+                return false;
+            }
+            std::pair<uint64_t, uint64_t> &counts = profile.branchCounts[{ (MaPLLineNumber)lineNumber, (MaPLLineNumber)columnNumber }];
+            counts.first += takenCount;
+            counts.second += notTakenCount;
+        } else if (recordType == "call") {
+            uint64_t callCount;
+            if (!(lineStream >> lineNumber >> columnNumber >> callCount)) {
+                return false;
+            }
+            profile.callCounts[{ (MaPLLineNumber)lineNumber, (MaPLLineNumber)columnNumber }] += callCount;
+        } else {
+            return false;
+        }
+    }
+    
+    for (const auto&[scriptPath, parsedProfile] : parsedProfiles) {
+        MaPLScriptProfile &profile = profiles[scriptPath];
+        for (const auto&[location, counts] : parsedProfile.branchCounts) {
+            profile.branchCounts[location].first += counts.first;
+            profile.branchCounts[location].second += counts.second;
+        }
+        for (const auto&[location, callCount] : parsedProfile.callCounts) {
+            profile.callCounts[location] += callCount;
+        }
+    }
+    return true;
+}
+
+MaPLSourceLocation sourceLocationForToken(antlr4::Token *token) {
+    if (!token) {
+        return { 0, 0 };
+    }
+    return { token->getLine(), token->getCharPositionInLine() };
+}
+
+bool MaPLSourceLocation::operator< (const MaPLSourceLocation &otherLocation) const {
+    if (line != otherLocation.line) {
+        return line < otherLocation.line;
+    }
+    return column < otherLocation.column;
+}
+
 bool isAmbiguousNumericType(MaPLPrimitiveType type) {
     switch (type) {
         case MaPLPrimitiveType_Float_AmbiguousSize: // Intentional fallthrough.
@@ -166,6 +579,27 @@ MaPLMemoryAddress byteSizeOfType(MaPLPrimitiveType type) {
     }
 }
 
+size_t unsignedVarintByteCount(uint64_t value) {
+    size_t byteCount = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        byteCount++;
+    }
+    return byteCount;
+}
+
+void appendUnsignedVarint(std::vector<uint8_t> &bytes, uint64_t value, size_t byteCount) {
+    for (size_t i = 0; i < byteCount; i++) {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        if (i+1 < byteCount) {
+            // The high bit signals that more bytes follow.
+            byte |= 0x80;
+        }
+        bytes.push_back(byte);
+    }
+}
+
 std::string descriptorForPrimitive(MaPLPrimitiveType type) {
     switch (type) {
         case MaPLPrimitiveType_Char: return "char";
@@ -333,6 +767,17 @@ MaPLInstruction greaterThanOrEqualInstructionForPrimitive(MaPLPrimitiveType type
     }
 }
 
+MaPLInstruction compareLiteralCursorMoveBackInstructionForPrimitive(MaPLPrimitiveType type) {
+    switch (type) {
+        case MaPLPrimitiveType_Char: return MaPLInstruction_char_compare_literal_cursor_move_back;
+        case MaPLPrimitiveType_Int32: return MaPLInstruction_int32_compare_literal_cursor_move_back;
+        case MaPLPrimitiveType_Int64: return MaPLInstruction_int64_compare_literal_cursor_move_back;
+        case MaPLPrimitiveType_UInt32: return MaPLInstruction_uint32_compare_literal_cursor_move_back;
+        case MaPLPrimitiveType_UInt64: return MaPLInstruction_uint64_compare_literal_cursor_move_back;
+        default: return MaPLInstruction_error;
+    }
+}
+
 MaPLInstruction assignmentInstructionForPrimitive(MaPLPrimitiveType type) {
     switch (type) {
         case MaPLPrimitiveType_Char: return MaPLInstruction_char_assign;
@@ -1073,6 +1518,129 @@ MaPLLiteral castLiteralToType(const MaPLLiteral &literal, const MaPLType &castTy
     return { { MaPLPrimitiveType_TypeError } };
 }
 
+static std::string shortestRoundTripString(double value, bool isFloat32) {
+    // This must match appendMetadataFloat() in the runtime. The runtime skips the search for some whole numbers,
+    // but the search produces the same text for them.
+    char buffer[32];
+    int minPrecision = 1;
+    int maxPrecision = isFloat32 ? 9 : 17;
+    while (minPrecision < maxPrecision) {
+        int precision = (minPrecision+maxPrecision)/2;
+        snprintf(buffer, sizeof(buffer), "%.*g", precision, value);
+        bool roundTrips = isFloat32 ? strtof(buffer, NULL) == (float)value : strtod(buffer, NULL) == value;
+        if (roundTrips) {
+            maxPrecision = precision;
+        } else {
+            minPrecision = precision+1;
+        }
+    }
+    snprintf(buffer, sizeof(buffer), "%.*g", minPrecision, value);
+    return buffer;
+}
+
+std::string runtimeStringForLiteral(const MaPLLiteral &literal, bool typedMetadata) {
+    if (typedMetadata) {
+        // These formats must match appendMetadataSection() in the runtime.
+        switch (literal.type.primitiveType) {
+            case MaPLPrimitiveType_UInt64:
+                return std::to_string(literal.uInt64Value);
+            case MaPLPrimitiveType_Float32:
+                return shortestRoundTripString((double)literal.float32Value, true);
+            case MaPLPrimitiveType_Float64:
+                return shortestRoundTripString(literal.float64Value, false);
+            default: break;
+        }
+    }
+    // These formats must match MAPL_INSTRUCTION_STRING_TYPECAST in the runtime.
+    char buffer[24];
+    switch (literal.type.primitiveType) {
+        case MaPLPrimitiveType_Char:
+            snprintf(buffer, sizeof(buffer), "%hhu", literal.charValue);
+            return buffer;
+        case MaPLPrimitiveType_Int32:
+            snprintf(buffer, sizeof(buffer), "%d", literal.int32Value);
+            return buffer;
+        case MaPLPrimitiveType_Int64:
+            snprintf(buffer, sizeof(buffer), "%lld", (long long)literal.int64Value);
+            return buffer;
+        case MaPLPrimitiveType_UInt32:
+            snprintf(buffer, sizeof(buffer), "%u", literal.uInt32Value);
+            return buffer;
+        case MaPLPrimitiveType_UInt64:
+            // The runtime formats unsigned 64-bit values as signed.
+            snprintf(buffer, sizeof(buffer), "%lld", (long long)literal.uInt64Value);
+            return buffer;
+        case MaPLPrimitiveType_Float32:
+            snprintf(buffer, sizeof(buffer), "%g", (double)literal.float32Value);
+            return buffer;
+        case MaPLPrimitiveType_Float64:
+            snprintf(buffer, sizeof(buffer), "%g", literal.float64Value);
+            return buffer;
+        case MaPLPrimitiveType_Boolean:
+            return literal.booleanValue ? "true" : "false";
+        case MaPLPrimitiveType_Pointer:
+            // NULL is the only possible literal pointer.
+            return "0x0000000000000000";
+        case MaPLPrimitiveType_String:
+            return literal.stringValue;
+        default:
+            return "";
+    }
+}
+
+uint64_t switchValueForLiteral(const MaPLLiteral &literal) {
+    switch (literal.type.primitiveType) {
+        case MaPLPrimitiveType_Char: return literal.charValue;
+        case MaPLPrimitiveType_Int32: return (uint64_t)(int64_t)literal.int32Value;
+        case MaPLPrimitiveType_Int64: return (uint64_t)literal.int64Value;
+        case MaPLPrimitiveType_UInt32: return literal.uInt32Value;
+        case MaPLPrimitiveType_UInt64: return literal.uInt64Value;
+        default: return 0;
+    }
+}
+
+uint32_t switchHashForString(const std::string &string) {
+    uint32_t hash = MAPL_SWITCH_HASH_OFFSET_BASIS;
+    for (char character : string) {
+        hash = (hash ^ (uint8_t)character) * MAPL_SWITCH_HASH_PRIME;
+    }
+    return hash;
+}
+
+MaPLLiteral literalForIntegralValue(MaPLPrimitiveType type, uint64_t value) {
+    MaPLLiteral literal{ { type } };
+    switch (type) {
+        case MaPLPrimitiveType_Char: literal.charValue = (uint8_t)value; break;
+        case MaPLPrimitiveType_Int32: literal.int32Value = (int32_t)value; break;
+        case MaPLPrimitiveType_Int64: literal.int64Value = (int64_t)value; break;
+        case MaPLPrimitiveType_UInt32: literal.uInt32Value = (uint32_t)value; break;
+        case MaPLPrimitiveType_UInt64: literal.uInt64Value = value; break;
+        default: return { { MaPLPrimitiveType_Uninitialized } };
+    }
+    return literal;
+}
+
+bool isLiteralInRangeOfType(const MaPLLiteral &literal, MaPLPrimitiveType type) {
+    uint64_t maxValue = 0;
+    int64_t minValue = 0;
+    switch (type) {
+        case MaPLPrimitiveType_Char: maxValue = UINT8_MAX; break;
+        case MaPLPrimitiveType_Int32: maxValue = INT32_MAX; minValue = INT32_MIN; break;
+        case MaPLPrimitiveType_Int64: maxValue = INT64_MAX; minValue = INT64_MIN; break;
+        case MaPLPrimitiveType_UInt32: maxValue = UINT32_MAX; break;
+        case MaPLPrimitiveType_UInt64: maxValue = UINT64_MAX; break;
+        default: return true;
+    }
+    switch (literal.type.primitiveType) {
+        case MaPLPrimitiveType_SignedInt_AmbiguousSize:
+            return literal.int64Value >= minValue;
+        case MaPLPrimitiveType_Int_AmbiguousSizeAndSign:
+            return literal.uInt64Value <= maxValue;
+        default:
+            return true;
+    }
+}
+
 uint8_t bitShiftForLiteral(const MaPLLiteral &literal) {
     // Convert this literal to an unsigned int.
     uint64_t unsignedValue;
@@ -1178,18 +1746,35 @@ std::vector<MaPLFile *> flattenedDependencies(MaPLFile *file) {
     return outputList;
 }
 
-std::map<std::string, MaPLSymbol> symbolTableForFiles(const std::vector<MaPLFile *> files) {
+std::map<std::string, MaPLSymbol> symbolTableForFiles(const std::vector<MaPLFile *> files,
+                                                      const std::map<std::string, MaPLSymbol> &persistedSymbols,
+                                                      std::vector<std::string> &errorMessages) {
     // Populate the symbol table.
     std::map<std::string, MaPLSymbol> symbolTable;
     for (MaPLFile *file : files) {
         file->getAPI()->collateSymbolsInAPI(symbolTable);
     }
     
+    // Persisted values are never reassigned, even if their descriptor no longer exists, so new IDs start after all of them.
+    // This is wider than MaPLSymbol so that running out of values is detected rather than wrapping around.
+    uint32_t UUID = 1;
+    for (const auto&[descriptor, symbol] : persistedSymbols) {
+        if (symbol >= UUID) {
+            UUID = (uint32_t)symbol+1;
+        }
+    }
+    
     // The table is now full of a sorted list of descriptors. Assign a unique ID to each.
-    MaPLSymbol UUID = 1;
     for (const auto&[descriptor, symbol] : symbolTable) {
-        symbolTable[descriptor] = UUID;
-        UUID++;
+        if (persistedSymbols.count(descriptor)) {
+            symbolTable[descriptor] = persistedSymbols.at(descriptor);
+        } else if (UUID > std::numeric_limits<MaPLSymbol>::max()) {
+            errorMessages.push_back("Unable to assign a symbol value to '"+descriptor+"' because every value up to "+std::to_string(std::numeric_limits<MaPLSymbol>::max())+" is already in use. Remove unused descriptors from the persisted symbols to free up values.");
+            return std::map<std::string, MaPLSymbol>();
+        } else {
+            symbolTable[descriptor] = (MaPLSymbol)UUID;
+            UUID++;
+        }
     }
     return symbolTable;
 }
@@ -80,6 +80,23 @@ struct MaPLLiteral {
     std::string stringValue;
 };
 
+/**
+ * Describes a position within a script. Unlike an ANTLR token, this remains valid after the script's parse tree is freed.
+ */
+struct MaPLSourceLocation {
+    // The line number, starting at 1. A line of 0 indicates that the location is unknown.
+    size_t line;
+    // The offset of the character within its line, starting at 0.
+    size_t column;
+    
+    bool operator< (const MaPLSourceLocation &otherLocation) const;
+};
+
+/**
+ * @return The location of @c token within its script, or an unknown location if @c token is NULL.
+ */
+MaPLSourceLocation sourceLocationForToken(antlr4::Token *token);
+
 /**
  * @return @c true if the primitive type is an ambiguous numeric type.
  */
@@ -125,6 +142,17 @@ bool assignOperatorIsCompatibleWithType(MaPLFile *file, size_t operatorType, MaP
  */
 MaPLMemoryAddress byteSizeOfType(MaPLPrimitiveType type);
 
+/**
+ * @return The minimum number of bytes needed to store @c value as an unsigned LEB128 varint.
+ */
+size_t unsignedVarintByteCount(uint64_t value);
+
+/**
+ * Appends @c value onto @c bytes as an unsigned LEB128 varint. If @c byteCount is larger than the minimum required, the varint is
+ * padded with continuation bytes so that it occupies exactly @c byteCount bytes.
+ */
+void appendUnsignedVarint(std::vector<uint8_t> &bytes, uint64_t value, size_t byteCount);
+
 /**
  * @return A human-readable string that describes the primitive.
  */
@@ -178,6 +206,11 @@ MaPLInstruction greaterThanInstructionForPrimitive(MaPLPrimitiveType type);
  */
 MaPLInstruction greaterThanOrEqualInstructionForPrimitive(MaPLPrimitiveType type);
 
+/**
+ * @return The instruction byte that moves the cursor back if a variable of @c type compares true to a literal.
+ */
+MaPLInstruction compareLiteralCursorMoveBackInstructionForPrimitive(MaPLPrimitiveType type);
+
 /**
  * @return The instruction byte that indicates an assignment for the corresponding primitive type.
  */
@@ -279,9 +312,16 @@ MaPLInstruction ternaryConditionalInstructionForPrimitive(MaPLPrimitiveType type
 std::vector<MaPLFile *> flattenedDependencies(MaPLFile *file);
 
 /**
- * @return A mapping of all symbols names to symbol values for APIs declared within @c files.
+ * @param persistedSymbols Symbol values assigned by previous compilations. These descriptors keep their values, and newly
+ *                         encountered descriptors are assigned values that are higher than any persisted value.
+ *
+ * @param errorMessages Receives an error if there are more descriptors than symbol values.
+ *
+ * @return A mapping of all symbols names to symbol values for APIs declared within @c files, or an empty mapping on error.
  */
-std::map<std::string, MaPLSymbol> symbolTableForFiles(const std::vector<MaPLFile *> files);
+std::map<std::string, MaPLSymbol> symbolTableForFiles(const std::vector<MaPLFile *> files,
+                                                      const std::map<std::string, MaPLSymbol> &persistedSymbols,
+                                                      std::vector<std::string> &errorMessages);
 
 /**
  * @return @c true if @c node is within the scope of a "for", "while", or "do while" loop.
@@ -321,6 +361,34 @@ bool typeNameMatchesPrimitiveType(const std::string &typeName);
  */
 MaPLLiteral castLiteralToType(const MaPLLiteral &literal, const MaPLType &castType, MaPLFile *file, antlr4::Token *token);
 
+/**
+ * @return The text that the runtime produces when it typecasts @c literal to a string, or an empty string if @c literal has an ambiguous type.
+ * This differs from @c castLiteralToType() in how floating point values are formatted. Escape sequences in string literals are left unresolved.
+ * If @c typedMetadata is true, the text instead matches the runtime's formatting of @c MaPLInstruction_metadata_typed sections.
+ */
+std::string runtimeStringForLiteral(const MaPLLiteral &literal, bool typedMetadata);
+
+/**
+ * @return The value of an integral @c literal, widened to 64 bits the same way the runtime widens the value of a switch.
+ */
+uint64_t switchValueForLiteral(const MaPLLiteral &literal);
+
+/**
+ * @return The hash that the runtime calculates for @c string when it's the value of a switch.
+ */
+uint32_t switchHashForString(const std::string &string);
+
+/**
+ * @return A literal of the integral @c type whose value is the low bits of @c value. The inverse of @c switchValueForLiteral.
+ */
+MaPLLiteral literalForIntegralValue(MaPLPrimitiveType type, uint64_t value);
+
+/**
+ * @return False if @c literal is an ambiguous integer whose value is outside the range of the integral @c type, which means
+ * that casting it would log an error. True for all other literals.
+ */
+bool isLiteralInRangeOfType(const MaPLLiteral &literal, MaPLPrimitiveType type);
+
 /**
  * @return An integer representing the log2 of the literal value. Returns @c 0 if the literal value is not a power of 2.
  */
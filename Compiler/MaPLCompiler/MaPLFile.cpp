@@ -6,9 +6,8 @@
 //
 
 #include "MaPLFile.h"
-#include <fstream>
-#include <sstream>
 #include <stdint.h>
+#include <algorithm>
 
 #include "antlr4-runtime.h"
 #include "MaPLLexer.h"
@@ -25,34 +24,84 @@ MaPLFile::MaPLFile(const std::filesystem::path &normalizedFilePath, MaPLFileCach
     _tokenStream(NULL),
     _parser(NULL),
     _program(NULL),
+    _isParsed(false),
     _bytecode(NULL),
-    _variableStack(new MaPLVariableStack())
+    _variableStack(new MaPLVariableStack()),
+    _linkedDependency(NULL),
+    _rawScriptHash(0),
+    _hoistedVariableCount(0)
 {
 }
 
 MaPLFile::~MaPLFile() {
     delete _bytecode;
     delete _variableStack;
-    delete _inputStream;
-    delete _lexer;
-    delete _tokenStream;
+    freeParseTree();
+}
+
+void MaPLFile::freeParseTree() {
     delete _parser;
+    delete _tokenStream;
+    delete _lexer;
+    delete _inputStream;
     // _program doesn't need to be deleted because it's managed by _parser's ParseTreeTracker.
+    _parser = NULL;
+    _tokenStream = NULL;
+    _lexer = NULL;
+    _inputStream = NULL;
+    _program = NULL;
+    _constantVariables.clear();
+    _deadStores.clear();
+}
+
+bool MaPLFile::readRawScript(std::string &rawScriptText) {
+    return _fileCache->readSourceForNormalizedPath(_normalizedFilePath, rawScriptText);
+}
+
+/**
+ * @return A line for each decision the parser made, listing the grammar rule it belongs to, how many times it was made,
+ * the nanoseconds spent making it, the deepest lookahead used, and how often SLL prediction fell back to LL.
+ */
+std::string parserProfileReport(MaPLParser *parser) {
+    antlr4::atn::ParseInfo parseInfo(parser->getInterpreter<antlr4::atn::ProfilingATNSimulator>());
+    std::vector<antlr4::atn::DecisionInfo> decisions = parseInfo.getDecisionInfo();
+    std::sort(decisions.begin(), decisions.end(), [](const antlr4::atn::DecisionInfo &a, const antlr4::atn::DecisionInfo &b) {
+        return a.timeInPrediction > b.timeInPrediction;
+    });
+    std::string report = "rule\tdecision\tinvocations\ttimeInPrediction\tSLLMaxLook\tLLFallback\tLLMaxLook\tambiguities\n";
+    for (const antlr4::atn::DecisionInfo &decision : decisions) {
+        if (decision.invocations == 0) {
+            continue;
+        }
+        size_t ruleIndex = parser->getATN().decisionToState[decision.decision]->ruleIndex;
+        report += parser->getRuleNames()[ruleIndex]+"\t"+
+                  std::to_string(decision.decision)+"\t"+
+                  std::to_string(decision.invocations)+"\t"+
+                  std::to_string(decision.timeInPrediction)+"\t"+
+                  std::to_string(decision.SLL_MaxLook)+"\t"+
+                  std::to_string(decision.LL_Fallback)+"\t"+
+                  std::to_string(decision.LL_MaxLook)+"\t"+
+                  std::to_string(decision.ambiguities.size())+"\n";
+    }
+    return report;
 }
 
 bool MaPLFile::parseRawScript() {
-    if (_program) {
+    if (_isParsed) {
         return true;
     }
-    // Read the raw script from the file system.
-    std::ifstream inputStream(_normalizedFilePath);
-    if (!inputStream) {
+    // Read the raw script. If it comes from the file system, the modification time is
+    // recorded before reading so that any concurrent modification is detected later.
+    if (_fileCache->isSourceInFilesystem(_normalizedFilePath)) {
+        std::error_code errorCode;
+        _lastWriteTime = std::filesystem::last_write_time(_normalizedFilePath, errorCode);
+    }
+    std::string rawScriptText;
+    if (!readRawScript(rawScriptText)) {
         logError(NULL, "Unable to read script file.");
         return false;
     }
-    std::stringstream stringBuffer;
-    stringBuffer << inputStream.rdbuf();
-    std::string rawScriptText = stringBuffer.str();
+    _rawScriptHash = std::hash<std::string>{}(rawScriptText);
     
     // Parse the program with ANTLR.
     _inputStream = new antlr4::ANTLRInputStream(rawScriptText);
@@ -63,9 +112,27 @@ bool MaPLFile::parseRawScript() {
     _lexer->getErrorListenerDispatch().removeErrorListeners();
     _parser->getErrorListenerDispatch().removeErrorListeners();
     _lexer->addErrorListener(this);
-    _parser->addErrorListener(this);
+    if (_fileCache->shouldProfileParser()) {
+        _parser->setProfile(true);
+    }
     
-    _program = _parser->program();
+    // Most scripts parse correctly with the much faster SLL prediction mode. Bail out at the first syntax error
+    // and only fall back to full LL prediction if SLL fails, so that syntax errors are reported as they would be by LL.
+    _parser->getInterpreter<antlr4::atn::ParserATNSimulator>()->setPredictionMode(antlr4::atn::PredictionMode::SLL);
+    _parser->setErrorHandler(std::make_shared<antlr4::BailErrorStrategy>());
+    try {
+        _program = _parser->program();
+    } catch (antlr4::ParseCancellationException &exception) {
+        _parser->reset();
+        _parser->addErrorListener(this);
+        _parser->setErrorHandler(std::make_shared<antlr4::DefaultErrorStrategy>());
+        _parser->getInterpreter<antlr4::atn::ParserATNSimulator>()->setPredictionMode(antlr4::atn::PredictionMode::LL);
+        _program = _parser->program();
+    }
+    if (_fileCache->shouldProfileParser()) {
+        _parserProfile = parserProfileReport(_parser);
+    }
+    _isParsed = true;
     
     // Iterate over any API imports and add the corresponding files to the file cache.
     for(MaPLParser::StatementContext *statement : _program->statement()) {
@@ -84,7 +151,7 @@ bool MaPLFile::parseRawScript() {
         }
         importPath = importPath.lexically_normal();
         
-        MaPLFile *dependencyFile = _fileCache->fileForNormalizedPath(importPath);
+        MaPLFile *dependencyFile = _fileCache->fileForNormalizedPath(importPath, optionsForDependencies());
         if (!dependencyFile) {
             logError(apiImport->start, "Unable to resolve path for import statement: "+importString);
             continue;
@@ -107,6 +174,36 @@ MaPLBuffer *MaPLFile::getBytecode() {
     return _bytecode;
 }
 
+MaPLFile *MaPLFile::getLinkedDependency() {
+    return _linkedDependency;
+}
+
+MaPLFile *MaPLFile::findLinkableDependency(const std::vector<MaPLFile *> &flattenedDependencyList) {
+    // A dependency is only linkable if it accounts for every other dependency. Its bytecode then
+    // leaves the variable tables in exactly the state that this file would have seen if inlined.
+    for (MaPLFile *dependency : _dependencies) {
+        std::vector<MaPLFile *> linkedList = flattenedDependencies(dependency);
+        linkedList.push_back(dependency);
+        if (linkedList == flattenedDependencyList) {
+            return dependency;
+        }
+    }
+    return NULL;
+}
+
+MaPLCompileOptions MaPLFile::optionsForDependencies() {
+    if (_options.linkDependencies) {
+        // Linked dependencies are output alongside this file, so they should be compiled with the same options.
+        return _options;
+    }
+    // Concatenated dependencies become part of this file's bytecode, so their variables must be laid out (and
+    // their code optimized) the same way. Debug information is still only emitted for this file's own statements.
+    MaPLCompileOptions dependencyOptions = _options;
+    dependencyOptions.includeDebugBytes = false;
+    dependencyOptions.debugLineTable = false;
+    return dependencyOptions;
+}
+
 void MaPLFile::compileIfNeeded() {
     if (_bytecode) {
         return;
@@ -115,11 +212,27 @@ void MaPLFile::compileIfNeeded() {
         return;
     }
     
-    _bytecode = new MaPLBuffer(this);
-    
     // Flatten the dependency graph into a list of de-duplicated files.
-    for(MaPLFile *file : flattenedDependencies(this)) {
+    std::vector<MaPLFile *> dependencies = flattenedDependencies(this);
+    if (_options.linkDependencies && dependencies.size() > 0) {
+        _linkedDependency = findLinkableDependency(dependencies);
+        if (!_linkedDependency) {
+            // Copying the dependencies into this script instead isn't possible, because they're compiled to be linked.
+            logError(NULL, "Scripts compiled with linked dependencies must have one import that accounts for all of their other dependencies, but the imports of this script are independent of each other. Move these imports into a single script, and import that script instead.");
+            return;
+        }
+    }
+    
+    _bytecode = new MaPLBuffer(this);
+    MaPLCompileOptions dependencyOptions = optionsForDependencies();
+    for(MaPLFile *file : dependencies) {
+        file->setOptions(dependencyOptions);
         file->compileIfNeeded();
+        _api.assimilate(file->getAPI());
+        if (_linkedDependency) {
+            // Bytecode from linked dependencies executes separately, skip concatenation.
+            continue;
+        }
         
         // Concatenate all preceding bytecode and variables from dependencies.
         MaPLBuffer *dependencyBytecode = file->getBytecode();
@@ -134,7 +247,13 @@ void MaPLFile::compileIfNeeded() {
                 _variableStack->appendVariableStack(dependencyStack, primitiveOffset, allocatedOffset);
             }
         }
-        _api.assimilate(file->getAPI());
+    }
+    if (_linkedDependency) {
+        // This file's variables are laid out after the entirety of the linked dependency's tables.
+        MaPLVariableStack *dependencyStack = _linkedDependency->getVariableStack();
+        if (dependencyStack) {
+            _variableStack->inheritVariableStack(dependencyStack);
+        }
     }
     _variableStack->flagAllVariablesAsDependency();
     _api.flagAllContentsAsDependency();
@@ -145,11 +264,52 @@ void MaPLFile::compileIfNeeded() {
     _api.performErrorChecking();
     _api.findInheritanceCyclesAndDiamonds();
     if(_errors.size() > 0) {
+        freeParseTree();
         return;
     }
     
+    // Constant propagation requires knowing up front which variables are ever written after their declaration.
+    if (_options.propagateConstants) {
+        findReassignedVariables(_program, _reassignedVariableNames);
+    }
+    
+    // Dead store elimination requires knowing up front which variables are ever read. Debuggers can inspect any variable, so keep them all.
+    if (_options.eliminateDeadStores && !_options.includeDebugBytes) {
+        findDeadStores();
+    }
+    
     // Compile the bytecode from this file.
     compileChildNodes(_program, { MaPLPrimitiveType_Uninitialized }, _bytecode);
+    
+    // Everything that outlives compilation (bytecode, API, variables, and errors) refers to source locations rather than
+    // tokens, so the parse tree can be freed now instead of being held until the file cache is destroyed.
+    freeParseTree();
+}
+
+bool MaPLFile::hasChangedSource() {
+    if (!_isParsed) {
+        return true;
+    }
+    std::string rawScriptText;
+    if (!_fileCache->isSourceInFilesystem(_normalizedFilePath)) {
+        // Sources held in memory only change when new text is supplied or resolved, so reading them is cheap.
+        return !readRawScript(rawScriptText) || std::hash<std::string>{}(rawScriptText) != _rawScriptHash;
+    }
+    std::error_code errorCode;
+    std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(_normalizedFilePath, errorCode);
+    if (errorCode) {
+        return true;
+    }
+    if (writeTime == _lastWriteTime) {
+        return false;
+    }
+    
+    // The file was touched, but its contents may be identical. Compare hashes to avoid a needless recompile.
+    if (!readRawScript(rawScriptText) || std::hash<std::string>{}(rawScriptText) != _rawScriptHash) {
+        return true;
+    }
+    _lastWriteTime = writeTime;
+    return false;
 }
 
 MaPLVariableStack *MaPLFile::getVariableStack() {
@@ -164,13 +324,23 @@ std::filesystem::path MaPLFile::getNormalizedFilePath() {
     return _normalizedFilePath;
 }
 
+std::string MaPLFile::getParserProfile() {
+    return _parserProfile;
+}
+
 std::vector<std::string> MaPLFile::getErrors() {
     getBytecode();
     return _errors;
 }
 
+std::vector<std::string> MaPLFile::getWarnings() {
+    getBytecode();
+    return _warnings;
+}
+
 void MaPLFile::setOptions(const MaPLCompileOptions &options) {
     _options = options;
+    _variableStack->setAlignsPrimitiveVariables(options.optimizationLevel > 0);
 }
 
 void MaPLFile::compileChildNodes(antlr4::ParserRuleContext *node, const MaPLType &expectedType, MaPLBuffer *currentBuffer) {
@@ -189,6 +359,9 @@ void MaPLFile::compileNode(antlr4::ParserRuleContext *node, const MaPLType &expe
             break;
         case MaPLParser::RuleImperativeStatement: {
             MaPLParser::ImperativeStatementContext *statement = (MaPLParser::ImperativeStatementContext *)node;
+            if (_options.debugLineTable) {
+                currentBuffer->addDebugLineTableEntry(statement->start);
+            }
             if (_options.includeDebugBytes) {
                 MaPLLineNumber tokenLine = (MaPLLineNumber)statement->start->getLine();
                 currentBuffer->appendInstruction(MaPLInstruction_debug_line);
@@ -222,6 +395,10 @@ void MaPLFile::compileNode(antlr4::ParserRuleContext *node, const MaPLType &expe
                         break;
                     default: break;
                 }
+            } else if (_deadStores.count(statement)) {
+                // The value stored by this statement is never read. It's still compiled to report any errors, but the bytecode is discarded.
+                MaPLBuffer discardedBuffer(this);
+                compileChildNodes(node, expectedType, &discardedBuffer);
             } else {
                 compileChildNodes(node, expectedType, currentBuffer);
             }
@@ -229,60 +406,57 @@ void MaPLFile::compileNode(antlr4::ParserRuleContext *node, const MaPLType &expe
             break;
         case MaPLParser::RuleMetadataStatement: {
             MaPLParser::MetadataStatementContext *metadataStatement = (MaPLParser::MetadataStatementContext *)node;
+            if (_options.debugLineTable) {
+                currentBuffer->addDebugLineTableEntry(metadataStatement->start);
+            }
             
             // Metadata contains one or more printable sections (literal strings or expressions).
             // Due to complexities with getting the lexer to correctly understand this syntax,
             // literal strings are not captured as tokens directly, but rather inferred by the gaps
-            // between the other 'metadata tokens'. Do a first pass to count all non-empty strings.
-            MaPLParameterCount sections = 0;
+            // between the other 'metadata tokens'. Do a first pass to gather all non-empty sections,
+            // folding constant expressions into the surrounding literal text.
+            std::vector<MaPLMetadataSection> sections;
             antlr4::Token *previousToken = NULL;
-            for (antlr4::Token *token : metadataStatement->metadataTokens) {
-                if (previousToken) {
-                    if (token->getType() == MaPLParser::SCOPE_CLOSE) {
-                        // This is an expression, which always requires a section.
-                        sections++;
-                    } else {
-                        // This is a literal string, which requires a section only when length > 0.
-                        size_t textStartIndex = previousToken->getStopIndex();
-                        size_t textEndIndex = token->getStartIndex();
-                        sections += (textEndIndex - textStartIndex) > 1 ? 1 : 0;
-                    }
-                }
-                previousToken = token;
-            }
-            if (sections == 0) {
-                break;
-            }
-            currentBuffer->appendInstruction(MaPLInstruction_metadata);
-            currentBuffer->appendBytes(&sections, sizeof(MaPLParameterCount));
-            
-            previousToken = NULL;
             size_t expressionIndex = 0;
             for (antlr4::Token *token : metadataStatement->metadataTokens) {
                 if (previousToken) {
                     if (token->getType() == MaPLParser::SCOPE_CLOSE) {
-                        MaPLParser::ExpressionContext *expression = metadataStatement->expression(expressionIndex);
+                        appendMetadataSections(metadataStatement->expression(expressionIndex), sections);
                         expressionIndex++;
-                        
-                        // This is an expression, append it and cast to string if needed.
-                        MaPLType expressionType = dataTypeForExpression(expression);
-                        if (expressionType.primitiveType != MaPLPrimitiveType_String) {
-                            currentBuffer->appendInstruction(MaPLInstruction_string_typecast);
-                        }
-                        compileNode(expression, expressionType, currentBuffer);
                     } else {
                         // This is a literal string, which requires a section only when length > 0.
                         size_t textStartIndex = previousToken->getStopIndex();
                         size_t textEndIndex = token->getStartIndex();
                         if ((textEndIndex - textStartIndex) > 1) {
                             std::string metadataText = token->getInputStream()->getText(antlr4::misc::Interval(textStartIndex+1, textEndIndex-1));
-                            currentBuffer->appendInstruction(MaPLInstruction_string_literal);
-                            currentBuffer->appendString(metadataText, this, previousToken);
+                            if (resolveEscapeSequences(metadataText, this, previousToken)) {
+                                appendMetadataText(metadataText, sections);
+                            }
                         }
                     }
                 }
                 previousToken = token;
             }
+            if (sections.size() == 0) {
+                break;
+            }
+            MaPLParameterCount sectionCount = (MaPLParameterCount)sections.size();
+            currentBuffer->appendInstruction(_options.typedMetadata ? MaPLInstruction_metadata_typed : MaPLInstruction_metadata);
+            currentBuffer->appendBytes(&sectionCount, sizeof(MaPLParameterCount));
+            for (const MaPLMetadataSection &section : sections) {
+                if (section.expression) {
+                    // This is an expression, append it and cast to string if needed. Typed metadata is formatted by the runtime instead.
+                    MaPLType expressionType = dataTypeForExpression(section.expression);
+                    if (expressionType.primitiveType != MaPLPrimitiveType_String && !_options.typedMetadata) {
+                        currentBuffer->appendInstruction(MaPLInstruction_string_typecast);
+                    }
+                    compileNode(section.expression, expressionType, currentBuffer);
+                } else {
+                    currentBuffer->appendInstruction(MaPLInstruction_string_literal);
+                    currentBuffer->addAnnotation(MaPLBufferAnnotationType_StringLiteral);
+                    currentBuffer->appendResolvedString(section.text);
+                }
+            }
         }
             break;
         case MaPLParser::RuleVariableDeclaration: {
@@ -301,7 +475,8 @@ void MaPLFile::compileNode(antlr4::ParserRuleContext *node, const MaPLType &expe
             confirmTypesExist(variableType, this, typeContext->start);
             
             // Claim a spot in memory for this variable.
-            MaPLVariable variable{ variableType, this, identifier->start };
+            MaPLVariable variable{ variableType, this, sourceLocationForToken(identifier->start) };
+            variable.isUnread = _unreadVariableNames.count(variableName) > 0;
             _variableStack->declareVariable(variableName, variable);
             
             // Assign the value to this variable if needed.
@@ -311,12 +486,31 @@ void MaPLFile::compileNode(antlr4::ParserRuleContext *node, const MaPLType &expe
                 currentBuffer->addAnnotation(variableType.primitiveType == MaPLPrimitiveType_String ? MaPLBufferAnnotationType_AllocatedVariableIndexDeclaration : MaPLBufferAnnotationType_PrimitiveVariableAddressDeclaration);
                 variable.memoryAddress = _variableStack->getVariable(variableName).memoryAddress;
                 currentBuffer->appendBytes(&(variable.memoryAddress), sizeof(variable.memoryAddress));
+                size_t previousErrorCount = _errors.size();
                 compileNode(expression, variable.type, currentBuffer);
                 
+                // If this variable always holds the value it was initialized with, remember that value so reads can be folded.
+                if (_options.propagateConstants &&
+                    _errors.size() == previousErrorCount &&
+                    variable.type.primitiveType != MaPLPrimitiveType_Pointer &&
+                    _reassignedVariableNames.count(variableName) == 0) {
+                    MaPLLiteral literal = constantValueForExpression(expression);
+                    if (isAmbiguousNumericType(literal.type.primitiveType)) {
+                        literal = castLiteralToType(literal, variable.type, this, expression->start);
+                    }
+                    if (literal.type.primitiveType == variable.type.primitiveType) {
+                        _constantVariables[sourceLocationForToken(identifier->start)] = literal;
+                    }
+                }
+                
                 if (_options.includeDebugBytes) {
                     compileDebugVariableUpdate(variableName, variable, currentBuffer);
                 }
             }
+            if (_options.debugLineTable && !variable.isUnread) {
+                variable.memoryAddress = _variableStack->getVariable(variableName).memoryAddress;
+                currentBuffer->addDebugVariableTableMarker(true, variableName, variable.type.primitiveType, variable.memoryAddress);
+            }
         }
             break;
         case MaPLParser::RuleAssignStatement: {
@@ -787,6 +981,13 @@ void MaPLFile::compileNode(antlr4::ParserRuleContext *node, const MaPLType &expe
                 break;
             }
             
+            // Algebraic simplification: Integer arithmetic with constant operands can often be rewritten as cheaper arithmetic.
+            if (_options.optimizationLevel > 0 &&
+                isIntegral(expectedType.primitiveType) &&
+                compileSimplifiedIntegralExpression(expression, expectedType, currentBuffer)) {
+                break;
+            }
+            
             if (expression->keyToken || rightShift) {
                 size_t tokenType;
                 if (rightShift) {
@@ -1110,36 +1311,21 @@ void MaPLFile::compileNode(antlr4::ParserRuleContext *node, const MaPLType &expe
                 break;
             }
             
-            // "While" loops are represented in bytecode as follows:
-            // ┌ MaPLInstruction_conditional - Signals the start of the loop.
-            // | ExpressionContext - The boolean expression at the top of the loop.
-            // └ MaPLBytecodeLength - If the boolean expression is false, this is how many bytes to skip forward to exit the loop.
-            //   ScopeContext - The contents of the loop.
-            // ┌ MaPLInstruction_cursor_move_back - Signals the end of the loop.
-            // └ MaPLBytecodeLength - The size of the backward move required to return to the top of the loop.
+            // Hidden variables for any hoisted expressions are scoped to the loop.
+            _variableStack->push();
+            std::vector<std::string> hoistedTexts = hoistLoopInvariants(loopExpression, loop, loop->scope(), currentBuffer);
+            
             MaPLBuffer scopeBuffer(this);
             compileNode(loop->scope(), { MaPLPrimitiveType_Uninitialized }, &scopeBuffer);
             
             // If the conditional is always true, this is an infinite while loop.
             bool infiniteLoop = expressionLiteral.type.primitiveType == MaPLPrimitiveType_Boolean && expressionLiteral.booleanValue;
-            MaPLBuffer loopBuffer(this);
-            if (!infiniteLoop) {
-                // This is not an infinite loop, so the conditional must be checked on each iteration.
-                loopBuffer.appendInstruction(MaPLInstruction_conditional);
-                compileNode(loopExpression, { MaPLPrimitiveType_Boolean }, &loopBuffer);
-                // Scope size must also include the MaPLInstruction_cursor_move_back.
-                MaPLBytecodeLength scopeSize = scopeBuffer.getByteCount() + sizeof(MaPLInstruction) + sizeof(MaPLBytecodeLength);
-                loopBuffer.appendBytes(&scopeSize, sizeof(scopeSize));
-            }
-            loopBuffer.appendBuffer(&scopeBuffer, 0, 0, 0);
-            loopBuffer.appendInstruction(MaPLInstruction_cursor_move_back);
-            MaPLBytecodeLength byteDistanceToLoopTop = loopBuffer.getByteCount() + sizeof(MaPLBytecodeLength);
-            loopBuffer.appendBytes(&byteDistanceToLoopTop, sizeof(byteDistanceToLoopTop));
-            
-            loopBuffer.resolveControlFlowAnnotations(MaPLBufferAnnotationType_Break, true);
-            loopBuffer.resolveControlFlowAnnotations(MaPLBufferAnnotationType_Continue, false);
+            compileLoop(infiniteLoop ? NULL : loopExpression, false, &scopeBuffer, currentBuffer);
             
-            currentBuffer->appendBuffer(&loopBuffer, 0, 0, 0);
+            for (const std::string &hoistedText : hoistedTexts) {
+                _hoistedExpressions.erase(hoistedText);
+            }
+            _variableStack->pop();
         }
             break;
         case MaPLParser::RuleForLoop: {
@@ -1151,13 +1337,8 @@ void MaPLFile::compileNode(antlr4::ParserRuleContext *node, const MaPLType &expe
             
             // "For" loops are represented in bytecode as follows:
             //   ImperativeStatementContext - The first imperative statement at the top of the loop (typically variable declaration).
-            // ┌ MaPLInstruction_conditional - The conditional at the top of the loop.
-            // | ExpressionContext - The boolean expression at the top of the loop.
-            // └ MaPLBytecodeLength - If the boolean expression is false, this is how many bytes to skip forward to exit the loop.
-            //   ScopeContext - The contents of the loop.
-            //   ImperativeStatementContext - The last imperative statement at the top of the loop (typically variable increment).
-            // ┌ MaPLInstruction_cursor_move_back - Signals the end of the loop.
-            // └ MaPLBytecodeLength - The size of the backward move required to return to the top of the loop.
+            //   Loop - The same as a "while" loop (see compileLoop), where the scope is followed by the last imperative
+            //          statement at the top of the loop (typically variable increment).
             MaPLParser::ForLoopControlStatementsContext *controlStatements = loop->forLoopControlStatements();
             if (controlStatements->firstStatement) {
                 compileNode(controlStatements->firstStatement, { MaPLPrimitiveType_Uninitialized }, currentBuffer);
@@ -1178,10 +1359,27 @@ void MaPLFile::compileNode(antlr4::ParserRuleContext *node, const MaPLType &expe
                 if (_options.includeDebugBytes) {
                     compileDebugPopFromTopStackFrame(currentBuffer);
                 }
+                if (_options.debugLineTable) {
+                    addDebugVariableTableEnds(currentBuffer);
+                }
                 _variableStack->pop();
                 break;
             }
             
+            // Loops with a trip count that's known at compile time can skip checking their conditional before the first iteration,
+            // and can be unrolled (debug bytes would report stale values of the loop variable). A profile can shrink or grow the
+            // budget for unrolling based on how often the loop ran.
+            std::vector<uint64_t> inductionValues;
+            bool hasKnownTripCount = _options.optimizationLevel >= 1 && inductionValuesForLoop(loop, inductionValues);
+            size_t unrollBudget = unrollBudgetForLoop(loop);
+            bool isUnrollable = hasKnownTripCount &&
+                                _options.optimizationLevel >= 2 &&
+                                unrollBudget > 0 &&
+                                !_options.includeDebugBytes;
+            
+            std::vector<std::string> hoistedTexts = hoistLoopInvariants(loopExpression, loop, loop->scope(), currentBuffer);
+            
+            size_t previousErrorCount = _errors.size();
             MaPLBuffer scopeBuffer(this);
             compileNode(loop->scope(), { MaPLPrimitiveType_Uninitialized }, &scopeBuffer);
             scopeBuffer.resolveControlFlowAnnotations(MaPLBufferAnnotationType_Continue, true);
@@ -1189,28 +1387,42 @@ void MaPLFile::compileNode(antlr4::ParserRuleContext *node, const MaPLType &expe
                 compileNode(controlStatements->lastStatement, { MaPLPrimitiveType_Uninitialized }, &scopeBuffer);
             }
             
-            // If the conditional is always true, this is an infinite for loop.
-            bool infiniteLoop = expressionLiteral.type.primitiveType == MaPLPrimitiveType_Boolean && expressionLiteral.booleanValue;
-            MaPLBuffer loopBuffer(this);
-            if (!infiniteLoop) {
-                loopBuffer.appendInstruction(MaPLInstruction_conditional);
-                compileNode(loopExpression, { MaPLPrimitiveType_Boolean }, &loopBuffer);
-                // Scope size must also include the MaPLInstruction_cursor_move_back.
-                MaPLBytecodeLength scopeSize = scopeBuffer.getByteCount() + sizeof(MaPLInstruction) + sizeof(MaPLBytecodeLength);
-                loopBuffer.appendBytes(&scopeSize, sizeof(scopeSize));
+            MaPLBuffer *iterationsBuffer = &scopeBuffer;
+            MaPLBuffer unrolledScopeBuffer(this);
+            bool isFullyUnrolled = false;
+            if (isUnrollable && _errors.size() == previousErrorCount) {
+                isFullyUnrolled = compileFullyUnrolledLoop(loop, inductionValues, scopeBuffer.getByteCount(), unrollBudget, currentBuffer);
+                if (!isFullyUnrolled) {
+                    // Partially unroll by the largest factor that evenly divides the trip count, so that the conditional and
+                    // the cursor move back to the top of the loop are only evaluated once for every few iterations.
+                    for (size_t unrollFactor = 8; unrollFactor > 1; unrollFactor--) {
+                        if (inductionValues.size() % unrollFactor == 0 &&
+                            unrollFactor*scopeBuffer.getByteCount() <= unrollBudget) {
+                            for (size_t i = 0; i < unrollFactor; i++) {
+                                unrolledScopeBuffer.appendBuffer(&scopeBuffer, 0, 0, 0);
+                            }
+                            iterationsBuffer = &unrolledScopeBuffer;
+                            break;
+                        }
+                    }
+                }
             }
-            loopBuffer.appendBuffer(&scopeBuffer, 0, 0, 0);
-            loopBuffer.appendInstruction(MaPLInstruction_cursor_move_back);
-            MaPLBytecodeLength byteDistanceToLoopTop = loopBuffer.getByteCount() + sizeof(MaPLBytecodeLength);
-            loopBuffer.appendBytes(&byteDistanceToLoopTop, sizeof(byteDistanceToLoopTop));
-            
-            loopBuffer.resolveControlFlowAnnotations(MaPLBufferAnnotationType_Break, true);
             
-            currentBuffer->appendBuffer(&loopBuffer, 0, 0, 0);
+            if (!isFullyUnrolled) {
+                // If the conditional is always true, this is an infinite for loop.
+                bool infiniteLoop = expressionLiteral.type.primitiveType == MaPLPrimitiveType_Boolean && expressionLiteral.booleanValue;
+                compileLoop(infiniteLoop ? NULL : loopExpression, hasKnownTripCount && !inductionValues.empty(), iterationsBuffer, currentBuffer);
+            }
             
+            for (const std::string &hoistedText : hoistedTexts) {
+                _hoistedExpressions.erase(hoistedText);
+            }
             if (_options.includeDebugBytes) {
                 compileDebugPopFromTopStackFrame(currentBuffer);
             }
+            if (_options.debugLineTable) {
+                addDebugVariableTableEnds(currentBuffer);
+            }
             _variableStack->pop();
         }
             break;
@@ -1241,13 +1453,18 @@ void MaPLFile::compileNode(antlr4::ParserRuleContext *node, const MaPLType &expe
             // If the conditional is always true, this is an infinite "do while" loop.
             bool infiniteLoop = expressionLiteral.type.primitiveType == MaPLPrimitiveType_Boolean && expressionLiteral.booleanValue;
             if (!infiniteLoop) {
+                if (_options.debugLineTable) {
+                    loopBuffer.addDebugLineTableEntry(loopExpression->start);
+                }
                 loopBuffer.appendInstruction(MaPLInstruction_conditional);
                 compileNode(loopExpression, { MaPLPrimitiveType_Boolean }, &loopBuffer);
                 // This is already at the end of the loop, and just needs to skip the MaPLInstruction_cursor_move_back that makes the loop repeat.
                 MaPLBytecodeLength cursorMoveSize = sizeof(MaPLInstruction) + sizeof(MaPLBytecodeLength);
+                loopBuffer.addAnnotation(MaPLBufferAnnotationType_ConditionalCursorMove);
                 loopBuffer.appendBytes(&cursorMoveSize, sizeof(cursorMoveSize));
             }
             loopBuffer.appendInstruction(MaPLInstruction_cursor_move_back);
+            loopBuffer.addAnnotation(MaPLBufferAnnotationType_BackwardCursorMove);
             MaPLBytecodeLength loopSize = loopBuffer.getByteCount() + sizeof(MaPLBytecodeLength);
             loopBuffer.appendBytes(&loopSize, sizeof(loopSize));
             
@@ -1259,6 +1476,10 @@ void MaPLFile::compileNode(antlr4::ParserRuleContext *node, const MaPLType &expe
         case MaPLParser::RuleConditional: {
             MaPLParser::ConditionalContext *conditional = (MaPLParser::ConditionalContext *)node;
             MaPLParser::ExpressionContext *conditionalExpression = conditional->expression();
+            if (_options.debugLineTable) {
+                // Branches are recorded in execution profiles by their line number.
+                currentBuffer->addDebugLineTableEntry(conditional->start);
+            }
             
             MaPLLiteral expressionLiteral = constantValueForExpression(conditionalExpression);
             if (expressionLiteral.type.primitiveType == MaPLPrimitiveType_Boolean) {
@@ -1273,7 +1494,8 @@ void MaPLFile::compileNode(antlr4::ParserRuleContext *node, const MaPLType &expe
                         compileChildNodes(conditionalElse, { MaPLPrimitiveType_Uninitialized }, currentBuffer);
                     }
                 }
-            } else {
+            } else if (!compileSwitchIfPossible(conditional, currentBuffer) &&
+                       !compileProfiledChainIfPossible(conditional, currentBuffer)) {
                 // The expression evaluated by this conditional is not compile-time constant. Compile it normally.
                 // Conditionals are represented in bytecode as follows:
                 // ┌ MaPLInstruction_conditional - Signals the start of a conditional.
@@ -1284,24 +1506,36 @@ void MaPLFile::compileNode(antlr4::ParserRuleContext *node, const MaPLType &expe
                 // └ MaPLBytecodeLength - After the conditional content, how far to skip past all subsequent "else" bytes (omitted if there's no "else").
                 //   ConditionalElseContext - The "else" portion of the conditional (omitted if there's no "else").
                 currentBuffer->appendInstruction(MaPLInstruction_conditional);
-                compileNode(conditionalExpression, { MaPLPrimitiveType_Boolean }, currentBuffer);
+                MaPLParser::ConditionalElseContext *conditionalElse = conditional->conditionalElse();
+                
+                // The scope ends with a cursor move past the "else", but reaching the "else" costs nothing extra. If the profile shows that the
+                // conditional is usually true, the expression is inverted (where that's free) and the scope is swapped with the "else".
+                bool isInverted = false;
+                if (conditionalElse && isConditionalUsuallyTrue(conditional)) {
+                    isInverted = compileInvertedConditionIfPossible(conditionalExpression, currentBuffer);
+                } else {
+                    compileNode(conditionalExpression, { MaPLPrimitiveType_Boolean }, currentBuffer);
+                }
                 
-                MaPLBuffer scopeBuffer(this);
-                compileNode(conditional->scope(), { MaPLPrimitiveType_Uninitialized }, &scopeBuffer);
+                MaPLBuffer thenBuffer(this);
+                compileNode(conditional->scope(), { MaPLPrimitiveType_Uninitialized }, &thenBuffer);
                 
-                MaPLParser::ConditionalElseContext *conditionalElse = conditional->conditionalElse();
-                MaPLBuffer elseBuffer(this);
+                MaPLBuffer otherwiseBuffer(this);
                 if (conditionalElse) {
-                    compileChildNodes(conditionalElse, { MaPLPrimitiveType_Uninitialized }, &elseBuffer);
+                    compileChildNodes(conditionalElse, { MaPLPrimitiveType_Uninitialized }, &otherwiseBuffer);
                 }
+                MaPLBuffer &scopeBuffer = isInverted ? otherwiseBuffer : thenBuffer;
+                MaPLBuffer &elseBuffer = isInverted ? thenBuffer : otherwiseBuffer;
                 
                 MaPLBytecodeLength elseBufferSize = (MaPLBytecodeLength)elseBuffer.getByteCount();
                 if (elseBufferSize > 0) {
                     scopeBuffer.appendInstruction(MaPLInstruction_cursor_move_forward);
+                    scopeBuffer.addAnnotation(MaPLBufferAnnotationType_ForwardCursorMove);
                     scopeBuffer.appendBytes(&elseBufferSize, sizeof(elseBufferSize));
                 }
                 
                 MaPLBytecodeLength scopeSize = (MaPLBytecodeLength)scopeBuffer.getByteCount();
+                currentBuffer->addAnnotation(MaPLBufferAnnotationType_ConditionalCursorMove);
                 currentBuffer->appendBytes(&scopeSize, sizeof(scopeSize));
                 
                 currentBuffer->appendBuffer(&scopeBuffer, 0, 0, 0);
@@ -1315,6 +1549,9 @@ void MaPLFile::compileNode(antlr4::ParserRuleContext *node, const MaPLType &expe
             if (_options.includeDebugBytes) {
                 compileDebugPopFromTopStackFrame(currentBuffer);
             }
+            if (_options.debugLineTable) {
+                addDebugVariableTableEnds(currentBuffer);
+            }
             _variableStack->pop();
             break;
         default:
@@ -1325,6 +1562,17 @@ void MaPLFile::compileNode(antlr4::ParserRuleContext *node, const MaPLType &expe
 MaPLType MaPLFile::compileObjectExpression(MaPLParser::ObjectExpressionContext *expression,
                                            MaPLParser::ObjectExpressionContext *invokedOnExpression,
                                            MaPLBuffer *currentBuffer) {
+    if (!invokedOnExpression && _hoistedExpressions.size() > 0 && !isTerminalImperativeObjectExpression(expression)) {
+        // If this expression was hoisted out of an enclosing loop, read the hidden variable instead of reevaluating it.
+        auto hoistedExpression = _hoistedExpressions.find(expression->getText());
+        if (hoistedExpression != _hoistedExpressions.end()) {
+            MaPLVariable variable = _variableStack->getVariable(hoistedExpression->second);
+            currentBuffer->appendInstruction(variableInstructionForPrimitive(variable.type.primitiveType));
+            currentBuffer->addAnnotation(variable.type.primitiveType == MaPLPrimitiveType_String ? MaPLBufferAnnotationType_AllocatedVariableIndexReference : MaPLBufferAnnotationType_PrimitiveVariableAddressReference);
+            currentBuffer->appendBytes(&(variable.memoryAddress), sizeof(variable.memoryAddress));
+            return variable.type;
+        }
+    }
     // TODO: Object expressions don't currently contain null coalescing or ternary conditional. This should be fixed.
     if (expression->keyToken) {
         switch (expression->keyToken->getType()) {
@@ -1521,16 +1769,31 @@ void MaPLFile::compileDebugVariableUpdate(const std::string &variableName,
     currentBuffer->appendInstruction(MaPLInstruction_debug_update_variable);
     currentBuffer->appendString(variableName, this, NULL);
     currentBuffer->appendInstruction(variableInstructionForPrimitive(variable.type.primitiveType));
+    currentBuffer->addAnnotation(variable.type.primitiveType == MaPLPrimitiveType_String ? MaPLBufferAnnotationType_AllocatedVariableIndexReference : MaPLBufferAnnotationType_PrimitiveVariableAddressReference);
     currentBuffer->appendBytes(&(variable.memoryAddress), sizeof(variable.memoryAddress));
 }
 
 void MaPLFile::compileDebugPopFromTopStackFrame(MaPLBuffer *currentBuffer) {
     for (const auto&[variableName, variable] : _variableStack->getTopStackFrame()) {
+        if (variableName[0] == '$') {
+            // Hidden variables are never reported to the debugger.
+            continue;
+        }
         currentBuffer->appendInstruction(MaPLInstruction_debug_delete_variable);
         currentBuffer->appendString(variableName, this, NULL);
     }
 }
 
+void MaPLFile::addDebugVariableTableEnds(MaPLBuffer *currentBuffer) {
+    for (const auto&[variableName, variable] : _variableStack->getTopStackFrame()) {
+        if (variableName[0] == '$' || variable.isUnread) {
+            // Hidden and unread variables are never added to the debug variable table.
+            continue;
+        }
+        currentBuffer->addDebugVariableTableMarker(false, variableName, variable.type.primitiveType, variable.memoryAddress);
+    }
+}
+
 MaPLPrimitiveType MaPLFile::logTypeReconciliationError(MaPLPrimitiveType left,
                                                        MaPLPrimitiveType right,
                                                        antlr4::Token *errorToken) {
@@ -1540,8 +1803,8 @@ MaPLPrimitiveType MaPLFile::logTypeReconciliationError(MaPLPrimitiveType left,
     return MaPLPrimitiveType_TypeError;
 }
 
-void MaPLFile::logMissingTypeError(antlr4::Token *errorToken, const std::string &typeName) {
-    logError(errorToken, "Unable to find the type declaration for '"+typeName+"'.");
+void MaPLFile::logMissingTypeError(const MaPLSourceLocation &location, const std::string &typeName) {
+    logError(location, "Unable to find the type declaration for '"+typeName+"'.");
 }
 
 MaPLPrimitiveType MaPLFile::reconcileTypes(MaPLPrimitiveType left,
@@ -2255,103 +2518,1509 @@ MaPLLiteral MaPLFile::constantValueForExpression(MaPLParser::ExpressionContext *
             }
             case MaPLParser::LITERAL_NULL: return { { MaPLPrimitiveType_Pointer } };
         }
+    } else if (!_constantVariables.empty() && expression->objectExpression()) {
+        // Populated by constant propagation, and by loop unrolling for the loop variable of each iteration.
+        return constantValueForVariable(expression->objectExpression());
     }
     return { { MaPLPrimitiveType_Uninitialized } };
 }
 
-MaPLType MaPLFile::dataTypeForExpression(MaPLParser::ExpressionContext *expression) {
-    MaPLParser::BitwiseShiftRightContext *rightShift = expression->bitwiseShiftRight();
-    if (expression->keyToken || rightShift) {
-        size_t tokenType;
-        if (rightShift) {
-            tokenType = MaPLParser::BITWISE_SHIFT_RIGHT;
-        } else {
-            tokenType = expression->keyToken->getType();
+MaPLLiteral MaPLFile::constantValueForVariable(MaPLParser::ObjectExpressionContext *expression) {
+    // Only a bare variable name (not a function, subscript, or member access) can refer to a variable.
+    if (expression->keyToken) {
+        return { { MaPLPrimitiveType_Uninitialized } };
+    }
+    MaPLVariable variable = _variableStack->getVariable(expression->identifier()->getText());
+    if (variable.type.primitiveType == MaPLPrimitiveType_Uninitialized ||
+        variable.file != this ||
+        variable.declaredInDependency) {
+        // Variables from dependencies may be modified by code that this file can't see.
+        return { { MaPLPrimitiveType_Uninitialized } };
+    }
+    auto iterator = _constantVariables.find(variable.location);
+    if (iterator == _constantVariables.end()) {
+        return { { MaPLPrimitiveType_Uninitialized } };
+    }
+    return iterator->second;
+}
+
+void MaPLFile::appendMetadataText(const std::string &text, std::vector<MaPLMetadataSection> &sections) {
+    if (text.empty()) {
+        return;
+    }
+    // Adjacent literal text is merged so that the runtime makes a single callback for it.
+    if (sections.size() > 0 && !sections.back().expression) {
+        sections.back().text += text;
+    } else {
+        sections.push_back({ text, NULL });
+    }
+}
+
+void MaPLFile::appendMetadataSections(MaPLParser::ExpressionContext *expression, std::vector<MaPLMetadataSection> &sections) {
+    MaPLType expressionType = dataTypeForExpression(expression);
+    if (isConcreteType(expressionType.primitiveType)) {
+        // Constant expressions are formatted at compile time, exactly as the runtime would have formatted them.
+        MaPLLiteral literal = constantValueForExpression(expression);
+        if (literal.type.primitiveType == MaPLPrimitiveType_Uninitialized &&
+            expression->keyToken &&
+            expression->keyToken->getType() == MaPLParser::PAREN_OPEN) {
+            // Casting an ambiguous literal only clarifies the type of the literal (the same as when compiling typecasts).
+            MaPLType castType = typeForTypeContext(expression->type());
+            MaPLType castExpressionType = dataTypeForExpression(expression->expression(0));
+            if (isAmbiguousNumericType(castExpressionType.primitiveType) && _api.isAssignable(castExpressionType, castType)) {
+                literal = constantValueForExpression(expression->expression(0));
+            }
         }
-        switch (tokenType) {
-            case MaPLParser::PAREN_OPEN: {
-                // This is a typecast, return the type that is specified in the cast.
-                MaPLParser::TypeContext *typeContext = expression->type();
-                MaPLType type = typeForTypeContext(typeContext);
-                if (type.primitiveType == MaPLPrimitiveType_TypeError) {
-                    // Break down to the bottom of this function to log a generic error.
-                    break;
-                }
-                return type;
+        if (literal.type.primitiveType != MaPLPrimitiveType_Uninitialized) {
+            if (isAmbiguousNumericType(literal.type.primitiveType)) {
+                literal = castLiteralToType(literal, expressionType, this, expression->start);
             }
-            case MaPLParser::PAREN_CLOSE:
-                // This is a nested expression, return type of the child expression.
-                return dataTypeForExpression(expression->expression(0));
-            case MaPLParser::LOGICAL_AND: // Intentional fallthrough.
-            case MaPLParser::LOGICAL_OR: // Intentional fallthrough.
-            case MaPLParser::LOGICAL_EQUALITY: // Intentional fallthrough.
-            case MaPLParser::LOGICAL_INEQUALITY: // Intentional fallthrough.
-            case MaPLParser::LESS_THAN: // Intentional fallthrough.
-            case MaPLParser::LESS_THAN_EQUAL: // Intentional fallthrough.
-            case MaPLParser::GREATER_THAN: // Intentional fallthrough.
-            case MaPLParser::GREATER_THAN_EQUAL: // Intentional fallthrough.
-            case MaPLParser::LOGICAL_NEGATION: // Intentional fallthrough.
-            case MaPLParser::LITERAL_TRUE: // Intentional fallthrough.
-            case MaPLParser::LITERAL_FALSE:
-                return { MaPLPrimitiveType_Boolean };
-            case MaPLParser::SUBTRACT: {
-                std::vector<MaPLParser::ExpressionContext *> childExpressions = expression->expression();
-                if (childExpressions.size() == 1) {
-                    // There's only one operand, so this is numeric negation instead of subtraction.
-                    MaPLType type = dataTypeForExpression(childExpressions[0]);
-                    if (isConcreteUnsignedInt(type.primitiveType)) {
-                        logError(expression->keyToken, "Unsigned integers cannot be negated.");
-                        return { MaPLPrimitiveType_TypeError };
-                    }
-                    if (type.primitiveType == MaPLPrimitiveType_Int_AmbiguousSizeAndSign) {
-                        // If the datatype is ambiguous, but it's being negated, it must be a signed int.
-                        return { MaPLPrimitiveType_SignedInt_AmbiguousSize };
-                    }
-                    if (isNumeric(type.primitiveType)) {
-                        return type;
-                    }
-                    logError(expression->keyToken, "Numeric negation can only be applied to numeric data types.");
-                    return { MaPLPrimitiveType_TypeError };
+            if (literal.type.primitiveType == MaPLPrimitiveType_String) {
+                std::string text = literal.stringValue;
+                if (resolveEscapeSequences(text, this, expression->start)) {
+                    appendMetadataText(text, sections);
                 }
+                return;
             }
-                // Intentional fallthrough handles the binary subtraction operator.
-            case MaPLParser::MOD: // Intentional fallthrough.
-            case MaPLParser::MULTIPLY: // Intentional fallthrough.
-            case MaPLParser::DIVIDE: {
-                std::vector<MaPLParser::ExpressionContext *> childExpressions = expression->expression();
-                MaPLType type1 = dataTypeForExpression(childExpressions[0]);
-                MaPLType type2 = dataTypeForExpression(childExpressions[1]);
-                if (isNumeric(type1.primitiveType) && isNumeric(type2.primitiveType)) {
-                    return { reconcileTypes(type1.primitiveType, type2.primitiveType, expression->keyToken) };
-                }
-                logNonNumericOperandsError(expression->keyToken);
-                return { MaPLPrimitiveType_TypeError };
+            if (isConcreteType(literal.type.primitiveType)) {
+                appendMetadataText(runtimeStringForLiteral(literal, _options.typedMetadata), sections);
+                return;
             }
-            case MaPLParser::ADD: {
-                std::vector<MaPLParser::ExpressionContext *> childExpressions = expression->expression();
-                MaPLType type1 = dataTypeForExpression(childExpressions[0]);
-                MaPLType type2 = dataTypeForExpression(childExpressions[1]);
-                // Plus operator could be numeric add or string concatenation.
-                if (type1.primitiveType == MaPLPrimitiveType_String &&
-                    type2.primitiveType == MaPLPrimitiveType_String) {
-                    return { MaPLPrimitiveType_String };
-                } else if (isNumeric(type1.primitiveType) && isNumeric(type2.primitiveType)) {
-                    return { reconcileTypes(type1.primitiveType, type2.primitiveType, expression->keyToken) };
-                }
-                logError(expression->keyToken, "Both operands must be either string (concatenation) or numeric (addition).");
-                return { MaPLPrimitiveType_TypeError };
+        }
+        
+        // Printing a string concatenation is equivalent to printing each of its operands in turn,
+        // which avoids allocating the concatenated string at runtime.
+        if (expressionType.primitiveType == MaPLPrimitiveType_String && expression->keyToken) {
+            switch (expression->keyToken->getType()) {
+                case MaPLParser::ADD:
+                    appendMetadataSections(expression->expression(0), sections);
+                    appendMetadataSections(expression->expression(1), sections);
+                    return;
+                case MaPLParser::PAREN_CLOSE: // Nested expression.
+                    appendMetadataSections(expression->expression(0), sections);
+                    return;
+                default: break;
             }
-            case MaPLParser::BITWISE_AND: // Intentional fallthrough.
-            case MaPLParser::BITWISE_XOR: // Intentional fallthrough.
-            case MaPLParser::BITWISE_OR: // Intentional fallthrough.
-            case MaPLParser::BITWISE_SHIFT_LEFT: // Intentional fallthrough.
-            case MaPLParser::BITWISE_SHIFT_RIGHT: {
-                std::vector<MaPLParser::ExpressionContext *> childExpressions = expression->expression();
-                MaPLType type1 = dataTypeForExpression(childExpressions[0]);
-                MaPLType type2 = dataTypeForExpression(childExpressions[1]);
-                if (isIntegral(type1.primitiveType) && isIntegral(type2.primitiveType)) {
-                    return { reconcileTypes(type1.primitiveType, type2.primitiveType, expression->keyToken) };
-                }
+        }
+    }
+    sections.push_back({ "", expression });
+}
+
+MaPLParser::ExpressionContext *MaPLFile::switchVariableForExpression(MaPLParser::ExpressionContext *expression, MaPLLiteral &outLiteral) {
+    if (!expression->keyToken || expression->keyToken->getType() != MaPLParser::LOGICAL_EQUALITY) {
+        return NULL;
+    }
+    for (size_t i = 0; i < 2; i++) {
+        MaPLParser::ExpressionContext *variableExpression = expression->expression(i);
+        MaPLParser::ObjectExpressionContext *objectExpression = variableExpression->objectExpression();
+        // Only a bare variable name is guaranteed to produce the same value (without side effects) in each conditional.
+        if (variableExpression->keyToken || !objectExpression || objectExpression->keyToken) {
+            continue;
+        }
+        MaPLType variableType = _variableStack->getVariable(objectExpression->identifier()->getText()).type;
+        bool isString = variableType.primitiveType == MaPLPrimitiveType_String;
+        if (!isString && !(isIntegral(variableType.primitiveType) && isConcreteType(variableType.primitiveType))) {
+            continue;
+        }
+        MaPLParser::ExpressionContext *constantExpression = expression->expression(1-i);
+        MaPLLiteral literal = constantValueForExpression(constantExpression);
+        if (literal.type.primitiveType == MaPLPrimitiveType_SignedInt_AmbiguousSize ||
+            literal.type.primitiveType == MaPLPrimitiveType_Int_AmbiguousSizeAndSign) {
+            // Literals outside the range of the variable's type are left to the conditional, which reports the error.
+            if (!isLiteralInRangeOfType(literal, variableType.primitiveType)) {
+                continue;
+            }
+            literal = castLiteralToType(literal, variableType, this, constantExpression->start);
+        }
+        if (literal.type.primitiveType != variableType.primitiveType) {
+            continue;
+        }
+        if (isString) {
+            // Strings with escape sequences are left to the conditional, which reports any invalid ones.
+            if (literal.stringValue.find('\\') != std::string::npos) {
+                continue;
+            }
+        }
+        outLiteral = literal;
+        return variableExpression;
+    }
+    return NULL;
+}
+
+MaPLParser::ExpressionContext *MaPLFile::gatherSwitchCases(MaPLParser::ConditionalContext *conditional,
+                                                           std::vector<MaPLSwitchCase> &outCases,
+                                                           antlr4::ParserRuleContext *&outDefaultNode) {
+    // Gather the leading run of conditionals that compare the same variable to distinct constants. The rest of the
+    // chain (starting at the first conditional that doesn't fit) is compiled normally, and runs if no case matches.
+    std::unordered_set<uint64_t> keys;
+    MaPLParser::ExpressionContext *variableExpression = NULL;
+    outDefaultNode = NULL;
+    MaPLParser::ConditionalContext *caseConditional = conditional;
+    while (caseConditional) {
+        MaPLLiteral literal;
+        MaPLParser::ExpressionContext *caseVariableExpression = switchVariableForExpression(caseConditional->expression(), literal);
+        if (!caseVariableExpression ||
+            (variableExpression && caseVariableExpression->getText() != variableExpression->getText())) {
+            outDefaultNode = caseConditional;
+            break;
+        }
+        uint64_t key = literal.type.primitiveType == MaPLPrimitiveType_String ? switchHashForString(literal.stringValue) : switchValueForLiteral(literal);
+        if (keys.count(key)) {
+            // A repeated value can never match. A repeated hash is left to the conditional to avoid ambiguity at runtime.
+            outDefaultNode = caseConditional;
+            break;
+        }
+        keys.insert(key);
+        variableExpression = caseVariableExpression;
+        outCases.push_back({ literal, key, caseConditional->scope(), caseConditional });
+        
+        MaPLParser::ConditionalElseContext *conditionalElse = caseConditional->conditionalElse();
+        caseConditional = NULL;
+        if (conditionalElse) {
+            caseConditional = conditionalElse->conditional();
+            if (!caseConditional) {
+                outDefaultNode = conditionalElse->scope();
+            }
+        }
+    }
+    return variableExpression;
+}
+
+bool MaPLFile::compileSwitchIfPossible(MaPLParser::ConditionalContext *conditional, MaPLBuffer *currentBuffer) {
+    if (_options.optimizationLevel == 0) {
+        return false;
+    }
+    
+    std::vector<MaPLSwitchCase> cases;
+    antlr4::ParserRuleContext *defaultNode;
+    MaPLParser::ExpressionContext *variableExpression = gatherSwitchCases(conditional, cases, defaultNode);
+    if (cases.size() < 4 || cases.size() > UINT16_MAX) {
+        return false;
+    }
+    MaPLType variableType = dataTypeForExpression(variableExpression);
+    bool isString = variableType.primitiveType == MaPLPrimitiveType_String;
+    
+    // Compile each case, followed by the default.
+    std::vector<MaPLBuffer> caseBuffers(cases.size(), MaPLBuffer(this));
+    for (size_t i = 0; i < cases.size(); i++) {
+        if (isString) {
+            // String cases start with the string that the hash is confirmed against.
+            caseBuffers[i].appendInstruction(MaPLInstruction_string_literal);
+            caseBuffers[i].addAnnotation(MaPLBufferAnnotationType_StringLiteral);
+            caseBuffers[i].appendResolvedString(cases[i].literal.stringValue);
+        }
+        compileNode(cases[i].scope, { MaPLPrimitiveType_Uninitialized }, &caseBuffers[i]);
+    }
+    MaPLBuffer defaultBuffer(this);
+    if (defaultNode) {
+        compileNode(defaultNode, { MaPLPrimitiveType_Uninitialized }, &defaultBuffer);
+    }
+    
+    // Each case skips past all subsequent cases when it's done.
+    MaPLBytecodeLength remainingSize = (MaPLBytecodeLength)defaultBuffer.getByteCount();
+    for (size_t i = cases.size(); i > 0; i--) {
+        MaPLBuffer &caseBuffer = caseBuffers[i-1];
+        if (remainingSize > 0) {
+            caseBuffer.appendInstruction(MaPLInstruction_cursor_move_forward);
+            caseBuffer.addAnnotation(MaPLBufferAnnotationType_ForwardCursorMove);
+            caseBuffer.appendBytes(&remainingSize, sizeof(remainingSize));
+        }
+        remainingSize += (MaPLBytecodeLength)caseBuffer.getByteCount();
+    }
+    
+    // Choose the kind of table. Values are ordered as their own type, which for signed values means flipping the sign bit.
+    std::vector<size_t> tableOrder(cases.size());
+    for (size_t i = 0; i < cases.size(); i++) {
+        tableOrder[i] = i;
+    }
+    uint64_t signFlip = isConcreteSignedInt(variableType.primitiveType) ? (uint64_t)1 << 63 : 0;
+    std::sort(tableOrder.begin(), tableOrder.end(), [&](size_t a, size_t b) {
+        return (cases[a].key ^ signFlip) < (cases[b].key ^ signFlip);
+    });
+    uint64_t firstKey = cases[tableOrder.front()].key;
+    uint64_t keyRange = (cases[tableOrder.back()].key ^ signFlip) - (firstKey ^ signFlip);
+    MaPLInstruction instruction;
+    size_t tableSize;
+    MaPLSwitchCaseCount caseCount;
+    if (isString) {
+        instruction = MaPLInstruction_switch_hash_table;
+        caseCount = (MaPLSwitchCaseCount)cases.size();
+        tableSize = sizeof(MaPLBytecodeLength) + caseCount*(sizeof(uint32_t)+sizeof(MaPLBytecodeLength));
+    } else if (keyRange < cases.size()*2 && keyRange < UINT16_MAX) {
+        // Dense values are looked up by index. Missing values in the range jump to the default.
+        instruction = MaPLInstruction_switch_jump_table;
+        caseCount = (MaPLSwitchCaseCount)(keyRange+1);
+        tableSize = sizeof(MaPLBytecodeLength)*(1+caseCount);
+    } else {
+        instruction = MaPLInstruction_switch_sorted_table;
+        caseCount = (MaPLSwitchCaseCount)cases.size();
+        tableSize = sizeof(MaPLBytecodeLength) + caseCount*(sizeof(uint64_t)+sizeof(MaPLBytecodeLength));
+    }
+    
+    // Find where each case starts, measured from the start of the table.
+    std::vector<size_t> caseLocations;
+    size_t caseLocation = tableSize;
+    for (MaPLBuffer &caseBuffer : caseBuffers) {
+        caseLocations.push_back(caseLocation);
+        caseLocation += caseBuffer.getByteCount();
+    }
+    size_t defaultLocation = caseLocation;
+    
+    currentBuffer->appendInstruction(instruction);
+    compileNode(variableExpression, variableType, currentBuffer);
+    if (instruction == MaPLInstruction_switch_jump_table) {
+        currentBuffer->appendBytes(&firstKey, sizeof(firstKey));
+    }
+    currentBuffer->appendBytes(&caseCount, sizeof(caseCount));
+    size_t tableLocation = 0;
+    auto appendCursorMove = [&](size_t destination) {
+        tableLocation += sizeof(MaPLBytecodeLength);
+        MaPLBytecodeLength cursorMove = (MaPLBytecodeLength)(destination-tableLocation);
+        currentBuffer->addAnnotation(MaPLBufferAnnotationType_SwitchCursorMove);
+        currentBuffer->appendBytes(&cursorMove, sizeof(cursorMove));
+    };
+    appendCursorMove(defaultLocation);
+    if (instruction == MaPLInstruction_switch_jump_table) {
+        size_t orderIndex = 0;
+        for (uint64_t i = 0; i < caseCount; i++) {
+            size_t caseIndex = tableOrder[orderIndex];
+            if (((cases[caseIndex].key ^ signFlip) - (firstKey ^ signFlip)) == i) {
+                appendCursorMove(caseLocations[caseIndex]);
+                orderIndex++;
+            } else {
+                appendCursorMove(defaultLocation);
+            }
+        }
+    } else {
+        for (size_t caseIndex : tableOrder) {
+            if (isString) {
+                uint32_t hash = (uint32_t)cases[caseIndex].key;
+                currentBuffer->appendBytes(&hash, sizeof(hash));
+                tableLocation += sizeof(hash);
+            } else {
+                currentBuffer->appendBytes(&(cases[caseIndex].key), sizeof(uint64_t));
+                tableLocation += sizeof(uint64_t);
+            }
+            appendCursorMove(caseLocations[caseIndex]);
+        }
+    }
+    for (MaPLBuffer &caseBuffer : caseBuffers) {
+        currentBuffer->appendBuffer(&caseBuffer, 0, 0, 0);
+    }
+    currentBuffer->appendBuffer(&defaultBuffer, 0, 0, 0);
+    return true;
+}
+
+// Matches the location that the debug line table records for a statement starting at this token.
+static MaPLProfileLocation profileLocationForToken(antlr4::Token *token) {
+    MaPLSourceLocation location = sourceLocationForToken(token);
+    return { (MaPLLineNumber)location.line, (MaPLLineNumber)location.column };
+}
+
+bool MaPLFile::compileProfiledChainIfPossible(MaPLParser::ConditionalContext *conditional, MaPLBuffer *currentBuffer) {
+    const MaPLScriptProfile *profile = getScriptProfile();
+    if (!profile) {
+        return false;
+    }
+    std::vector<MaPLSwitchCase> cases;
+    antlr4::ParserRuleContext *defaultNode;
+    gatherSwitchCases(conditional, cases, defaultNode);
+    if (cases.size() < 2) {
+        return false;
+    }
+    
+    // At most one case can match, and comparing a variable to a constant has no side effects, so the cases can be tested in any
+    // order. Test them in order of how often they matched, so that the most frequent cases evaluate the fewest conditionals.
+    std::vector<uint64_t> matchCounts;
+    std::vector<size_t> caseOrder;
+    for (const MaPLSwitchCase &switchCase : cases) {
+        auto counts = profile->branchCounts.find(profileLocationForToken(switchCase.conditional->start));
+        matchCounts.push_back(counts == profile->branchCounts.end() ? 0 : counts->second.first);
+        caseOrder.push_back(caseOrder.size());
+    }
+    std::stable_sort(caseOrder.begin(), caseOrder.end(), [&matchCounts](size_t a, size_t b) {
+        return matchCounts[a] > matchCounts[b];
+    });
+    if (std::is_sorted(caseOrder.begin(), caseOrder.end())) {
+        return false;
+    }
+    
+    // Compile each case, followed by the default.
+    std::vector<MaPLBuffer> conditionBuffers(cases.size(), MaPLBuffer(this));
+    std::vector<MaPLBuffer> caseBuffers(cases.size(), MaPLBuffer(this));
+    for (size_t i = 0; i < cases.size(); i++) {
+        compileNode(cases[i].conditional->expression(), { MaPLPrimitiveType_Boolean }, &conditionBuffers[i]);
+        compileNode(cases[i].scope, { MaPLPrimitiveType_Uninitialized }, &caseBuffers[i]);
+    }
+    MaPLBuffer chainBuffer(this);
+    if (defaultNode) {
+        compileNode(defaultNode, { MaPLPrimitiveType_Uninitialized }, &chainBuffer);
+    }
+    
+    // Starting from the default, wrap each case around the rest of the chain. Each one is laid out like any other conditional.
+    for (size_t i = caseOrder.size(); i > 0; i--) {
+        size_t caseIndex = caseOrder[i-1];
+        MaPLBuffer &caseBuffer = caseBuffers[caseIndex];
+        MaPLBytecodeLength remainingSize = (MaPLBytecodeLength)chainBuffer.getByteCount();
+        if (remainingSize > 0) {
+            caseBuffer.appendInstruction(MaPLInstruction_cursor_move_forward);
+            caseBuffer.addAnnotation(MaPLBufferAnnotationType_ForwardCursorMove);
+            caseBuffer.appendBytes(&remainingSize, sizeof(remainingSize));
+        }
+        
+        MaPLBuffer conditionalBuffer(this);
+        if (_options.debugLineTable) {
+            conditionalBuffer.addDebugLineTableEntry(cases[caseIndex].conditional->start);
+        }
+        conditionalBuffer.appendInstruction(MaPLInstruction_conditional);
+        conditionalBuffer.appendBuffer(&conditionBuffers[caseIndex], 0, 0, 0);
+        MaPLBytecodeLength scopeSize = (MaPLBytecodeLength)caseBuffer.getByteCount();
+        conditionalBuffer.addAnnotation(MaPLBufferAnnotationType_ConditionalCursorMove);
+        conditionalBuffer.appendBytes(&scopeSize, sizeof(scopeSize));
+        conditionalBuffer.appendBuffer(&caseBuffer, 0, 0, 0);
+        conditionalBuffer.appendBuffer(&chainBuffer, 0, 0, 0);
+        chainBuffer = conditionalBuffer;
+    }
+    currentBuffer->appendBuffer(&chainBuffer, 0, 0, 0);
+    return true;
+}
+
+/**
+ * @return @c true if @c outInstruction was set to the comparison that produces the opposite result of @c instruction for every pair of operands.
+ */
+static bool negatedComparisonInstruction(MaPLInstruction instruction, MaPLInstruction &outInstruction) {
+    // Floating point comparisons can't be negated by flipping the operator, because every ordered comparison against NaN is false.
+    const MaPLPrimitiveType integralTypes[] = {
+        MaPLPrimitiveType_Char,
+        MaPLPrimitiveType_Int32,
+        MaPLPrimitiveType_Int64,
+        MaPLPrimitiveType_UInt32,
+        MaPLPrimitiveType_UInt64,
+    };
+    const MaPLPrimitiveType equatableTypes[] = {
+        MaPLPrimitiveType_Float32,
+        MaPLPrimitiveType_Float64,
+        MaPLPrimitiveType_String,
+        MaPLPrimitiveType_Boolean,
+        MaPLPrimitiveType_Pointer,
+    };
+    std::vector<std::pair<MaPLInstruction, MaPLInstruction>> negatedPairs;
+    for (MaPLPrimitiveType type : integralTypes) {
+        negatedPairs.push_back({ equalityInstructionForPrimitive(type), inequalityInstructionForPrimitive(type) });
+        negatedPairs.push_back({ lessThanInstructionForPrimitive(type), greaterThanOrEqualInstructionForPrimitive(type) });
+        negatedPairs.push_back({ lessThanOrEqualInstructionForPrimitive(type), greaterThanInstructionForPrimitive(type) });
+    }
+    for (MaPLPrimitiveType type : equatableTypes) {
+        negatedPairs.push_back({ equalityInstructionForPrimitive(type), inequalityInstructionForPrimitive(type) });
+    }
+    for (const auto&[firstInstruction, secondInstruction] : negatedPairs) {
+        if (instruction == firstInstruction) {
+            outInstruction = secondInstruction;
+            return true;
+        }
+        if (instruction == secondInstruction) {
+            outInstruction = firstInstruction;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MaPLFile::compileInvertedConditionIfPossible(MaPLParser::ExpressionContext *expression, MaPLBuffer *currentBuffer) {
+    if (expression->keyToken && expression->keyToken->getType() == MaPLParser::LOGICAL_NEGATION) {
+        // The inverse of a logical negation is its operand, which is one instruction shorter.
+        compileNode(expression->expression(0), { MaPLPrimitiveType_Boolean }, currentBuffer);
+        return true;
+    }
+    
+    // Comparisons start with the comparison instruction, which can be swapped for its opposite without changing the size of the bytecode.
+    MaPLBuffer conditionBuffer(this);
+    compileNode(expression, { MaPLPrimitiveType_Boolean }, &conditionBuffer);
+    MaPLInstruction negatedInstruction;
+    bool isInverted = conditionBuffer.getByteCount() > 0 &&
+                      negatedComparisonInstruction(conditionBuffer.getBytes()[0], negatedInstruction);
+    if (isInverted) {
+        conditionBuffer.overwriteBytes(&negatedInstruction, sizeof(negatedInstruction), 0);
+    }
+    currentBuffer->appendBuffer(&conditionBuffer, 0, 0, 0);
+    return isInverted;
+}
+
+const MaPLScriptProfile *MaPLFile::getScriptProfile() {
+    auto profile = _options.scriptProfiles.find(_normalizedFilePath);
+    if (profile == _options.scriptProfiles.end()) {
+        return NULL;
+    }
+    return &(profile->second);
+}
+
+bool MaPLFile::isConditionalUsuallyTrue(MaPLParser::ConditionalContext *conditional) {
+    const MaPLScriptProfile *profile = getScriptProfile();
+    if (!profile) {
+        return false;
+    }
+    auto counts = profile->branchCounts.find(profileLocationForToken(conditional->start));
+    return counts != profile->branchCounts.end() && counts->second.first > counts->second.second;
+}
+
+size_t MaPLFile::unrollBudgetForLoop(antlr4::ParserRuleContext *loop) {
+    const MaPLScriptProfile *profile = getScriptProfile();
+    if (!profile) {
+        return _options.unrollBudget;
+    }
+    // A loop that ran recorded at least one branch (its own conditional) or host call somewhere between its first and last tokens.
+    MaPLProfileLocation firstLocation = profileLocationForToken(loop->start);
+    MaPLProfileLocation lastLocation = profileLocationForToken(loop->stop);
+    auto branchCounts = profile->branchCounts.lower_bound(firstLocation);
+    bool hasRun = branchCounts != profile->branchCounts.end() && branchCounts->first <= lastLocation;
+    uint64_t loopCallCount = 0;
+    uint64_t scriptCallCount = 0;
+    for (const auto&[location, callCount] : profile->callCounts) {
+        scriptCallCount += callCount;
+        if (firstLocation <= location && location <= lastLocation) {
+            loopCallCount += callCount;
+            hasRun = true;
+        }
+    }
+    
+    // A loop that never ran isn't worth the extra bytecode. Host calls dominate the cost of running a script, so a loop that
+    // made at least half of the script's calls is where removing per-iteration overhead pays off most, and gets twice the budget.
+    if (!hasRun) {
+        return 0;
+    }
+    if (loopCallCount && loopCallCount*2 >= scriptCallCount) {
+        return 2*(size_t)_options.unrollBudget;
+    }
+    return _options.unrollBudget;
+}
+
+void MaPLFile::compileLoop(MaPLParser::ExpressionContext *loopExpression,
+                           bool isEnteredUnconditionally,
+                           MaPLBuffer *scopeBuffer,
+                           MaPLBuffer *currentBuffer) {
+    MaPLBuffer loopBuffer(this);
+    if (!loopExpression || _options.optimizationLevel == 0) {
+        // Loops are represented in bytecode as follows:
+        // ┌ MaPLInstruction_conditional - Signals the start of the loop. Omitted for infinite loops.
+        // | ExpressionContext - The boolean expression at the top of the loop.
+        // └ MaPLBytecodeLength - If the boolean expression is false, this is how many bytes to skip forward to exit the loop.
+        //   ScopeContext - The contents of the loop.
+        // ┌ MaPLInstruction_cursor_move_back - Signals the end of the loop.
+        // └ MaPLBytecodeLength - The size of the backward move required to return to the top of the loop.
+        if (loopExpression) {
+            if (_options.debugLineTable) {
+                loopBuffer.addDebugLineTableEntry(loopExpression->start);
+            }
+            loopBuffer.appendInstruction(MaPLInstruction_conditional);
+            compileNode(loopExpression, { MaPLPrimitiveType_Boolean }, &loopBuffer);
+            // Scope size must also include the MaPLInstruction_cursor_move_back.
+            MaPLBytecodeLength scopeSize = scopeBuffer->getByteCount() + sizeof(MaPLInstruction) + sizeof(MaPLBytecodeLength);
+            loopBuffer.addAnnotation(MaPLBufferAnnotationType_ConditionalCursorMove);
+            loopBuffer.appendBytes(&scopeSize, sizeof(scopeSize));
+        }
+        loopBuffer.appendBuffer(scopeBuffer, 0, 0, 0);
+        loopBuffer.appendInstruction(MaPLInstruction_cursor_move_back);
+        loopBuffer.addAnnotation(MaPLBufferAnnotationType_BackwardCursorMove);
+        MaPLBytecodeLength byteDistanceToLoopTop = loopBuffer.getByteCount() + sizeof(MaPLBytecodeLength);
+        loopBuffer.appendBytes(&byteDistanceToLoopTop, sizeof(byteDistanceToLoopTop));
+        loopBuffer.resolveControlFlowAnnotations(MaPLBufferAnnotationType_Continue, false);
+    } else {
+        // Optimized loops are rotated so that each iteration ends in a single instruction, rather than a cursor move back to a
+        // conditional at the top. The conditional is duplicated to skip the loop entirely if it's false on entry:
+        // ┌ MaPLInstruction_conditional - Omitted if the conditional is known to be true on entry.
+        // | ExpressionContext - The boolean expression, evaluated once before the first iteration.
+        // └ MaPLBytecodeLength - If the boolean expression is false, this is how many bytes to skip forward to exit the loop.
+        //   ScopeContext - The contents of the loop.
+        // ┌ MaPLInstruction_conditional_cursor_move_back - Or a typed compare_literal_cursor_move_back instruction.
+        // | ExpressionContext - The boolean expression (or the operands of the typed comparison).
+        // └ MaPLBytecodeLength - If the boolean expression is true, the size of the backward move to the top of the scope.
+        MaPLBuffer conditionBuffer(this);
+        compileNode(loopExpression, { MaPLPrimitiveType_Boolean }, &conditionBuffer);
+        
+        MaPLBuffer branchBuffer(this);
+        if (_options.debugLineTable) {
+            // Branches are recorded in execution profiles by their line number.
+            branchBuffer.addDebugLineTableEntry(loopExpression->start);
+        }
+        if (!compileLiteralComparisonBranch(loopExpression, &branchBuffer)) {
+            branchBuffer.appendInstruction(MaPLInstruction_conditional_cursor_move_back);
+            branchBuffer.appendBuffer(&conditionBuffer, 0, 0, 0);
+        }
+        branchBuffer.addAnnotation(MaPLBufferAnnotationType_ConditionalBackwardCursorMove);
+        MaPLBytecodeLength byteDistanceToScopeTop = scopeBuffer->getByteCount() + branchBuffer.getByteCount() + sizeof(MaPLBytecodeLength);
+        branchBuffer.appendBytes(&byteDistanceToScopeTop, sizeof(byteDistanceToScopeTop));
+        
+        if (!isEnteredUnconditionally) {
+            if (_options.debugLineTable) {
+                loopBuffer.addDebugLineTableEntry(loopExpression->start);
+            }
+            loopBuffer.appendInstruction(MaPLInstruction_conditional);
+            loopBuffer.appendBuffer(&conditionBuffer, 0, 0, 0);
+            MaPLBytecodeLength loopSize = scopeBuffer->getByteCount() + branchBuffer.getByteCount();
+            loopBuffer.addAnnotation(MaPLBufferAnnotationType_ConditionalCursorMove);
+            loopBuffer.appendBytes(&loopSize, sizeof(loopSize));
+        }
+        // "Continue" skips to the conditional at the bottom of the loop, rather than returning to the top.
+        scopeBuffer->resolveControlFlowAnnotations(MaPLBufferAnnotationType_Continue, true);
+        loopBuffer.appendBuffer(scopeBuffer, 0, 0, 0);
+        loopBuffer.appendBuffer(&branchBuffer, 0, 0, 0);
+    }
+    loopBuffer.resolveControlFlowAnnotations(MaPLBufferAnnotationType_Break, true);
+    
+    currentBuffer->appendBuffer(&loopBuffer, 0, 0, 0);
+}
+
+bool MaPLFile::compileLiteralComparisonBranch(MaPLParser::ExpressionContext *expression, MaPLBuffer *currentBuffer) {
+    // The typed instructions store their literal at full width, so they can't be used when literals are stored as varints.
+    if (_options.compactEncoding || !expression->keyToken) {
+        return false;
+    }
+    size_t comparison = expression->keyToken->getType();
+    for (size_t i = 0; i < 2; i++) {
+        MaPLParser::ExpressionContext *variableExpression = expression->expression(i);
+        MaPLParser::ObjectExpressionContext *objectExpression = variableExpression->objectExpression();
+        if (variableExpression->keyToken || !objectExpression || objectExpression->keyToken) {
+            continue;
+        }
+        MaPLVariable variable = _variableStack->getVariable(objectExpression->identifier()->getText());
+        MaPLPrimitiveType type = variable.type.primitiveType;
+        uint64_t value;
+        if (!isIntegral(type) || !isConcreteType(type) ||
+            !integralValueForExpression(expression->expression(1-i), type, value)) {
+            continue;
+        }
+        
+        // The variable is always on the left, so comparisons written with the variable on the right are mirrored.
+        bool isMirrored = i == 1;
+        MaPLInstruction comparisonInstruction;
+        switch (comparison) {
+            case MaPLParser::LOGICAL_EQUALITY:
+                comparisonInstruction = equalityInstructionForPrimitive(type);
+                break;
+            case MaPLParser::LOGICAL_INEQUALITY:
+                comparisonInstruction = inequalityInstructionForPrimitive(type);
+                break;
+            case MaPLParser::LESS_THAN:
+                comparisonInstruction = isMirrored ? greaterThanInstructionForPrimitive(type) : lessThanInstructionForPrimitive(type);
+                break;
+            case MaPLParser::LESS_THAN_EQUAL:
+                comparisonInstruction = isMirrored ? greaterThanOrEqualInstructionForPrimitive(type) : lessThanOrEqualInstructionForPrimitive(type);
+                break;
+            case MaPLParser::GREATER_THAN:
+                comparisonInstruction = isMirrored ? lessThanInstructionForPrimitive(type) : greaterThanInstructionForPrimitive(type);
+                break;
+            case MaPLParser::GREATER_THAN_EQUAL:
+                comparisonInstruction = isMirrored ? lessThanOrEqualInstructionForPrimitive(type) : greaterThanOrEqualInstructionForPrimitive(type);
+                break;
+            default:
+                return false;
+        }
+        currentBuffer->appendInstruction(compareLiteralCursorMoveBackInstructionForPrimitive(type));
+        currentBuffer->appendInstruction(comparisonInstruction);
+        currentBuffer->addAnnotation(MaPLBufferAnnotationType_PrimitiveVariableAddressReference);
+        currentBuffer->appendBytes(&(variable.memoryAddress), sizeof(variable.memoryAddress));
+        MaPLLiteral literal = literalForIntegralValue(type, value);
+        switch (type) {
+            case MaPLPrimitiveType_Char:
+                currentBuffer->appendBytes(&(literal.charValue), sizeof(literal.charValue));
+                break;
+            case MaPLPrimitiveType_Int32:
+                currentBuffer->appendBytes(&(literal.int32Value), sizeof(literal.int32Value));
+                break;
+            case MaPLPrimitiveType_Int64:
+                currentBuffer->appendBytes(&(literal.int64Value), sizeof(literal.int64Value));
+                break;
+            case MaPLPrimitiveType_UInt32:
+                currentBuffer->appendBytes(&(literal.uInt32Value), sizeof(literal.uInt32Value));
+                break;
+            default:
+                currentBuffer->appendBytes(&(literal.uInt64Value), sizeof(literal.uInt64Value));
+                break;
+        }
+        return true;
+    }
+    return false;
+}
+
+bool MaPLFile::integralValueForExpression(MaPLParser::ExpressionContext *expression, MaPLPrimitiveType type, uint64_t &outValue) {
+    MaPLLiteral literal = constantValueForExpression(expression);
+    if (!isLiteralInRangeOfType(literal, type)) {
+        return false;
+    }
+    if (literal.type.primitiveType == MaPLPrimitiveType_SignedInt_AmbiguousSize ||
+        literal.type.primitiveType == MaPLPrimitiveType_Int_AmbiguousSizeAndSign) {
+        literal = castLiteralToType(literal, { type }, this, expression->start);
+    }
+    if (literal.type.primitiveType != type) {
+        return false;
+    }
+    outValue = switchValueForLiteral(literal);
+    return true;
+}
+
+bool MaPLFile::inductionValuesForLoop(MaPLParser::ForLoopContext *loop, std::vector<uint64_t> &outValues) {
+    // The trip count is only known for loops shaped like "for int32 i = 0; i < 4; i++", where the comparison is against a
+    // constant, "i" is stepped by a constant ("i++", "i--", "i += 2", or "i -= 2"), and the body of the loop never assigns "i".
+    MaPLParser::ForLoopControlStatementsContext *controlStatements = loop->forLoopControlStatements();
+    MaPLParser::ExpressionContext *loopExpression = controlStatements->expression();
+    if (!controlStatements->firstStatement || !loopExpression || !controlStatements->lastStatement) {
+        return false;
+    }
+    MaPLParser::VariableDeclarationContext *declaration = controlStatements->firstStatement->variableDeclaration();
+    if (!declaration || !declaration->expression()) {
+        return false;
+    }
+    std::string variableName = declaration->identifier()->getText();
+    MaPLPrimitiveType type = _variableStack->getVariable(variableName).type.primitiveType;
+    uint64_t value;
+    if (!isIntegral(type) || !isConcreteType(type) ||
+        !integralValueForExpression(declaration->expression(), type, value)) {
+        return false;
+    }
+    auto isInductionVariable = [&](MaPLParser::ObjectExpressionContext *expression) {
+        return expression && !expression->keyToken && expression->identifier()->getText() == variableName;
+    };
+    
+    // Find how much the variable changes on each iteration.
+    uint64_t step;
+    MaPLParser::UnaryStatementContext *unaryStatement = controlStatements->lastStatement->unaryStatement();
+    MaPLParser::AssignStatementContext *assignStatement = controlStatements->lastStatement->assignStatement();
+    if (unaryStatement && isInductionVariable(unaryStatement->objectExpression())) {
+        step = unaryStatement->keyToken->getType() == MaPLParser::INCREMENT ? 1 : -1;
+    } else if (assignStatement && isInductionVariable(assignStatement->objectExpression()) &&
+               (assignStatement->keyToken->getType() == MaPLParser::ADD_ASSIGN ||
+                assignStatement->keyToken->getType() == MaPLParser::SUBTRACT_ASSIGN) &&
+               integralValueForExpression(assignStatement->expression(), type, step)) {
+        if (assignStatement->keyToken->getType() == MaPLParser::SUBTRACT_ASSIGN) {
+            step = -step;
+        }
+    } else {
+        return false;
+    }
+    
+    // Find the constant that the variable is compared to.
+    if (!loopExpression->keyToken) {
+        return false;
+    }
+    size_t comparison = loopExpression->keyToken->getType();
+    switch (comparison) {
+        case MaPLParser::LESS_THAN: // Intentional fallthrough.
+        case MaPLParser::LESS_THAN_EQUAL: // Intentional fallthrough.
+        case MaPLParser::GREATER_THAN: // Intentional fallthrough.
+        case MaPLParser::GREATER_THAN_EQUAL: // Intentional fallthrough.
+        case MaPLParser::LOGICAL_INEQUALITY:
+            break;
+        default:
+            return false;
+    }
+    MaPLParser::ExpressionContext *leftExpression = loopExpression->expression(0);
+    MaPLParser::ExpressionContext *rightExpression = loopExpression->expression(1);
+    uint64_t limit;
+    bool isVariableOnLeft;
+    if (!leftExpression->keyToken && isInductionVariable(leftExpression->objectExpression()) &&
+        integralValueForExpression(rightExpression, type, limit)) {
+        isVariableOnLeft = true;
+    } else if (!rightExpression->keyToken && isInductionVariable(rightExpression->objectExpression()) &&
+               integralValueForExpression(leftExpression, type, limit)) {
+        isVariableOnLeft = false;
+    } else {
+        return false;
+    }
+    
+    std::unordered_set<std::string> reassignedVariables;
+    findReassignedVariables(loop->scope(), reassignedVariables);
+    if (reassignedVariables.count(variableName)) {
+        return false;
+    }
+    
+    // Step through the loop the same way the runtime would. Values wrap around at the width of the variable's type, and
+    // signed values are compared by flipping their sign bit. Loops that run too long to be worth unrolling are abandoned.
+    const size_t maximumTripCount = 65536;
+    uint64_t bitCount = byteSizeOfType(type)*8;
+    uint64_t mask = bitCount == 64 ? UINT64_MAX : ((uint64_t)1 << bitCount)-1;
+    uint64_t signFlip = isConcreteSignedInt(type) ? (uint64_t)1 << (bitCount-1) : 0;
+    uint64_t orderedLimit = (limit & mask) ^ signFlip;
+    outValues.clear();
+    value &= mask;
+    while (true) {
+        uint64_t orderedValue = value ^ signFlip;
+        uint64_t left = isVariableOnLeft ? orderedValue : orderedLimit;
+        uint64_t right = isVariableOnLeft ? orderedLimit : orderedValue;
+        bool isConditionTrue;
+        switch (comparison) {
+            case MaPLParser::LESS_THAN: isConditionTrue = left < right; break;
+            case MaPLParser::LESS_THAN_EQUAL: isConditionTrue = left <= right; break;
+            case MaPLParser::GREATER_THAN: isConditionTrue = left > right; break;
+            case MaPLParser::GREATER_THAN_EQUAL: isConditionTrue = left >= right; break;
+            default: isConditionTrue = left != right; break;
+        }
+        if (!isConditionTrue) {
+            return true;
+        }
+        if (outValues.size() == maximumTripCount) {
+            return false;
+        }
+        outValues.push_back(value);
+        value = (value + step) & mask;
+    }
+}
+
+bool MaPLFile::compileFullyUnrolledLoop(MaPLParser::ForLoopContext *loop,
+                                        const std::vector<uint64_t> &inductionValues,
+                                        size_t iterationSize,
+                                        size_t unrollBudget,
+                                        MaPLBuffer *currentBuffer) {
+    if (inductionValues.size()*iterationSize > unrollBudget) {
+        return false;
+    }
+    
+    // Each iteration is compiled separately with the loop variable substituted by its value, so that expressions which
+    // use it can be folded. Each "continue" skips to the next iteration, and each "break" skips past all of them.
+    MaPLParser::VariableDeclarationContext *declaration = loop->forLoopControlStatements()->firstStatement->variableDeclaration();
+    MaPLVariable inductionVariable = _variableStack->getVariable(declaration->identifier()->getText());
+    size_t previousErrorCount = _errors.size();
+    MaPLBuffer unrolledBuffer(this);
+    for (uint64_t value : inductionValues) {
+        _constantVariables[inductionVariable.location] = literalForIntegralValue(inductionVariable.type.primitiveType, value);
+        MaPLBuffer iterationBuffer(this);
+        compileNode(loop->scope(), { MaPLPrimitiveType_Uninitialized }, &iterationBuffer);
+        iterationBuffer.resolveControlFlowAnnotations(MaPLBufferAnnotationType_Continue, true);
+        unrolledBuffer.appendBuffer(&iterationBuffer, 0, 0, 0);
+    }
+    _constantVariables.erase(inductionVariable.location);
+    
+    if (_errors.size() > previousErrorCount || unrolledBuffer.getByteCount() > unrollBudget) {
+        // Folding a particular value can log an error (such as a constant that overflows its type) that the loop never
+        // encounters at runtime, and larger literals can push the loop over budget. Either way, keep the loop instead.
+        _errors.resize(previousErrorCount);
+        return false;
+    }
+    unrolledBuffer.resolveControlFlowAnnotations(MaPLBufferAnnotationType_Break, true);
+    currentBuffer->appendBuffer(&unrolledBuffer, 0, 0, 0);
+    return true;
+}
+
+void MaPLFile::findReassignedVariables(antlr4::ParserRuleContext *node, std::unordered_set<std::string> &variableNames) {
+    MaPLParser::ObjectExpressionContext *assignedExpression = NULL;
+    switch (node->getRuleIndex()) {
+        case MaPLParser::RuleAssignStatement:
+            assignedExpression = ((MaPLParser::AssignStatementContext *)node)->objectExpression();
+            break;
+        case MaPLParser::RuleUnaryStatement:
+            assignedExpression = ((MaPLParser::UnaryStatementContext *)node)->objectExpression();
+            break;
+        default: break;
+    }
+    if (assignedExpression && !assignedExpression->keyToken) {
+        // Variables are tracked by name regardless of scope. This is conservative when a name is shadowed.
+        variableNames.insert(assignedExpression->identifier()->getText());
+    }
+    for (antlr4::tree::ParseTree *child : node->children) {
+        antlr4::ParserRuleContext *ruleContext = dynamic_cast<antlr4::ParserRuleContext *>(child);
+        if (ruleContext) {
+            findReassignedVariables(ruleContext, variableNames);
+        }
+    }
+}
+
+/**
+ * Appends the operands of a chain of additions and subtractions (or multiplications, if @c tokenType is @c MULTIPLY) to @c terms,
+ * looking through parentheses. Integer arithmetic wraps, so the operands of these chains can be regrouped without changing the result.
+ */
+static void appendArithmeticTerms(MaPLParser::ExpressionContext *expression,
+                                  size_t tokenType,
+                                  bool isNegated,
+                                  std::vector<MaPLArithmeticTerm> &terms) {
+    if (expression->keyToken) {
+        size_t expressionTokenType = expression->keyToken->getType();
+        std::vector<MaPLParser::ExpressionContext *> childExpressions = expression->expression();
+        if (expressionTokenType == MaPLParser::PAREN_CLOSE) {
+            appendArithmeticTerms(childExpressions[0], tokenType, isNegated, terms);
+            return;
+        }
+        if (tokenType == MaPLParser::MULTIPLY && expressionTokenType == MaPLParser::MULTIPLY) {
+            appendArithmeticTerms(childExpressions[0], tokenType, false, terms);
+            appendArithmeticTerms(childExpressions[1], tokenType, false, terms);
+            return;
+        }
+        if (tokenType == MaPLParser::ADD && childExpressions.size() == 2 &&
+            (expressionTokenType == MaPLParser::ADD || expressionTokenType == MaPLParser::SUBTRACT)) {
+            appendArithmeticTerms(childExpressions[0], tokenType, isNegated, terms);
+            appendArithmeticTerms(childExpressions[1], tokenType, expressionTokenType == MaPLParser::SUBTRACT ? !isNegated : isNegated, terms);
+            return;
+        }
+    }
+    terms.push_back({ expression, isNegated });
+}
+
+bool MaPLFile::compileSimplifiedIntegralExpression(MaPLParser::ExpressionContext *expression,
+                                                   const MaPLType &expectedType,
+                                                   MaPLBuffer *currentBuffer) {
+    MaPLPrimitiveType type = expectedType.primitiveType;
+    size_t tokenType;
+    if (expression->bitwiseShiftRight()) {
+        tokenType = MaPLParser::BITWISE_SHIFT_RIGHT;
+    } else if (expression->keyToken) {
+        tokenType = expression->keyToken->getType();
+    } else {
+        return false;
+    }
+    std::vector<MaPLParser::ExpressionContext *> childExpressions = expression->expression();
+    if (childExpressions.size() != 2) {
+        return false;
+    }
+    
+    // Constants are compared after being wrapped to the width of the type, the same way the runtime would wrap them.
+    auto wrappedValue = [&](uint64_t value) {
+        return switchValueForLiteral(literalForIntegralValue(type, value));
+    };
+    uint64_t leftValue;
+    uint64_t rightValue;
+    bool isLeftConstant = integralValueForExpression(childExpressions[0], type, leftValue);
+    bool isRightConstant = integralValueForExpression(childExpressions[1], type, rightValue);
+    switch (tokenType) {
+        case MaPLParser::ADD: // Intentional fallthrough.
+        case MaPLParser::SUBTRACT: {
+            // Sum all of the constants in the chain into a single constant. For example, "x + 1 - y + 2" becomes "x - y + 3".
+            std::vector<MaPLArithmeticTerm> terms;
+            appendArithmeticTerms(expression, MaPLParser::ADD, false, terms);
+            std::vector<MaPLArithmeticTerm> variableTerms;
+            uint64_t constant = 0;
+            size_t constantCount = 0;
+            for (const MaPLArithmeticTerm &term : terms) {
+                uint64_t value;
+                if (integralValueForExpression(term.expression, type, value)) {
+                    constant += term.isNegated ? -value : value;
+                    constantCount++;
+                } else {
+                    variableTerms.push_back(term);
+                }
+            }
+            constant = wrappedValue(constant);
+            if (variableTerms.empty() || constantCount == 0 || (constantCount == 1 && constant != 0)) {
+                return false;
+            }
+            
+            // A chain that starts with a subtraction (like "0 - x") is subtracted from the constant. Otherwise the constant comes
+            // last, and is added or subtracted depending on which is smaller (so "x - 1 - 2" becomes "x - 3" rather than "x + -3").
+            bool leadsWithConstant = variableTerms[0].isNegated;
+            bool trailsWithConstant = !leadsWithConstant && constant != 0;
+            bool isConstantSubtracted = trailsWithConstant && wrappedValue(-constant) < constant;
+            
+            // Operators are prefixed, so the outermost operation (the last in the chain) is appended first.
+            if (trailsWithConstant) {
+                currentBuffer->appendInstruction(isConstantSubtracted ? subtractionInstructionForPrimitive(type) : additionInstructionForPrimitive(type));
+            }
+            for (size_t i = variableTerms.size()-1; i > 0; i--) {
+                currentBuffer->appendInstruction(variableTerms[i].isNegated ? subtractionInstructionForPrimitive(type) : additionInstructionForPrimitive(type));
+            }
+            if (leadsWithConstant) {
+                currentBuffer->appendInstruction(subtractionInstructionForPrimitive(type));
+                currentBuffer->appendLiteral(literalForIntegralValue(type, constant), this, NULL);
+            }
+            for (const MaPLArithmeticTerm &term : variableTerms) {
+                compileNode(term.expression, expectedType, currentBuffer);
+            }
+            if (trailsWithConstant) {
+                currentBuffer->appendLiteral(literalForIntegralValue(type, isConstantSubtracted ? -constant : constant), this, NULL);
+            }
+        }
+            return true;
+        case MaPLParser::MULTIPLY: {
+            // Multiply all of the constants in the chain into a single constant. For example, "x * 2 * y * 4" becomes "(x * y) << 3".
+            std::vector<MaPLArithmeticTerm> terms;
+            appendArithmeticTerms(expression, MaPLParser::MULTIPLY, false, terms);
+            std::vector<MaPLArithmeticTerm> variableTerms;
+            uint64_t constant = 1;
+            size_t constantCount = 0;
+            for (const MaPLArithmeticTerm &term : terms) {
+                uint64_t value;
+                if (integralValueForExpression(term.expression, type, value)) {
+                    constant *= value;
+                    constantCount++;
+                } else {
+                    variableTerms.push_back(term);
+                }
+            }
+            constant = wrappedValue(constant);
+            if (variableTerms.empty() || constantCount == 0 || (constantCount == 1 && constant != 1)) {
+                return false;
+            }
+            MaPLLiteral constantLiteral = literalForIntegralValue(type, constant);
+            uint8_t shift = bitShiftForLiteral(constantLiteral);
+            if (shift) {
+                currentBuffer->appendInstruction(bitwiseShiftLeftInstructionForPrimitive(type));
+            } else if (constant != 1) {
+                currentBuffer->appendInstruction(multiplicationInstructionForPrimitive(type));
+            }
+            for (size_t i = variableTerms.size()-1; i > 0; i--) {
+                currentBuffer->appendInstruction(multiplicationInstructionForPrimitive(type));
+            }
+            for (const MaPLArithmeticTerm &term : variableTerms) {
+                compileNode(term.expression, expectedType, currentBuffer);
+            }
+            if (shift) {
+                currentBuffer->appendLiteral(literalForIntegralValue(type, shift), this, NULL);
+            } else if (constant != 1) {
+                currentBuffer->appendLiteral(constantLiteral, this, NULL);
+            }
+        }
+            return true;
+        case MaPLParser::DIVIDE:
+            // Remove division by 1.
+            if (isRightConstant && rightValue == 1) {
+                compileNode(childExpressions[0], expectedType, currentBuffer);
+                return true;
+            }
+            return false;
+        case MaPLParser::MOD:
+            // Unsigned modulo by a power of 2 keeps only the low bits. For example, "x % 16" becomes "x & 15". This isn't
+            // true of signed integers, because the result of a signed modulo has the sign of the numerator.
+            if (isConcreteUnsignedInt(type) && isRightConstant && bitShiftForLiteral(literalForIntegralValue(type, rightValue))) {
+                currentBuffer->appendInstruction(bitwiseAndInstructionForPrimitive(type));
+                compileNode(childExpressions[0], expectedType, currentBuffer);
+                currentBuffer->appendLiteral(literalForIntegralValue(type, rightValue-1), this, NULL);
+                return true;
+            }
+            return false;
+        case MaPLParser::BITWISE_AND: // Intentional fallthrough.
+        case MaPLParser::BITWISE_OR: // Intentional fallthrough.
+        case MaPLParser::BITWISE_XOR: {
+            // Remove operations that leave the other operand unchanged, like "x | 0" and "x & 0xFF" for a char.
+            uint64_t identityValue = tokenType == MaPLParser::BITWISE_AND ? wrappedValue(UINT64_MAX) : 0;
+            if (isRightConstant && rightValue == identityValue) {
+                compileNode(childExpressions[0], expectedType, currentBuffer);
+                return true;
+            }
+            if (isLeftConstant && leftValue == identityValue) {
+                compileNode(childExpressions[1], expectedType, currentBuffer);
+                return true;
+            }
+        }
+            return false;
+        case MaPLParser::BITWISE_SHIFT_LEFT: // Intentional fallthrough.
+        case MaPLParser::BITWISE_SHIFT_RIGHT:
+            // Remove shifts by 0.
+            if (isRightConstant && rightValue == 0) {
+                compileNode(childExpressions[0], expectedType, currentBuffer);
+                return true;
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @return The name of the variable that @c statement declares or assigns, or an empty string if it doesn't store a value in a variable.
+ */
+static std::string storedVariableName(MaPLParser::ImperativeStatementContext *statement) {
+    if (statement->variableDeclaration()) {
+        return statement->variableDeclaration()->identifier()->getText();
+    }
+    MaPLParser::ObjectExpressionContext *assignedExpression = NULL;
+    if (statement->assignStatement()) {
+        assignedExpression = statement->assignStatement()->objectExpression();
+    } else if (statement->unaryStatement()) {
+        assignedExpression = statement->unaryStatement()->objectExpression();
+    }
+    if (!assignedExpression || assignedExpression->keyToken) {
+        return "";
+    }
+    return assignedExpression->identifier()->getText();
+}
+
+/**
+ * @return The statement if it's a plain assignment (not an operator-assign) of a value to a variable, otherwise NULL.
+ */
+static MaPLParser::AssignStatementContext *plainVariableAssignment(MaPLParser::StatementContext *statement) {
+    MaPLParser::ImperativeStatementContext *imperativeStatement = statement->imperativeStatement();
+    if (!imperativeStatement || !imperativeStatement->assignStatement()) {
+        return NULL;
+    }
+    MaPLParser::AssignStatementContext *assignment = imperativeStatement->assignStatement();
+    if (assignment->keyToken->getType() != MaPLParser::ASSIGN || assignment->objectExpression()->keyToken) {
+        return NULL;
+    }
+    return assignment;
+}
+
+/**
+ * @return @c true if anything within @c node refers to a variable named @c variableName.
+ */
+static bool containsVariableReference(antlr4::ParserRuleContext *node, const std::string &variableName) {
+    if (node->getRuleIndex() == MaPLParser::RuleObjectExpression) {
+        MaPLParser::ObjectExpressionContext *objectExpression = (MaPLParser::ObjectExpressionContext *)node;
+        if (!objectExpression->keyToken && objectExpression->identifier()->getText() == variableName) {
+            return true;
+        }
+    }
+    for (antlr4::tree::ParseTree *child : node->children) {
+        antlr4::ParserRuleContext *ruleContext = dynamic_cast<antlr4::ParserRuleContext *>(child);
+        if (ruleContext && containsVariableReference(ruleContext, variableName)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @return @c true if anything within @c node is a break, continue, or exit statement.
+ */
+static bool containsEarlyExit(antlr4::ParserRuleContext *node) {
+    if (node->getRuleIndex() == MaPLParser::RuleImperativeStatement && ((MaPLParser::ImperativeStatementContext *)node)->keyToken) {
+        return true;
+    }
+    for (antlr4::tree::ParseTree *child : node->children) {
+        antlr4::ParserRuleContext *ruleContext = dynamic_cast<antlr4::ParserRuleContext *>(child);
+        if (ruleContext && containsEarlyExit(ruleContext)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void MaPLFile::findDeadStores() {
+    MaPLVariableUsage usage;
+    findVariableUsage(_program, false, "", usage);
+    
+    // A variable can be removed entirely if it's declared within a scope, never read, and none of its stores call the host.
+    // Variables are tracked by name regardless of scope. This is conservative when the same name is declared in several scopes.
+    std::unordered_set<std::string> declaredNames;
+    for (MaPLParser::ImperativeStatementContext *statement : usage.stores) {
+        if (statement->variableDeclaration()) {
+            declaredNames.insert(storedVariableName(statement));
+        }
+    }
+    for (MaPLParser::ImperativeStatementContext *statement : usage.stores) {
+        std::string variableName = storedVariableName(statement);
+        if (!declaredNames.count(variableName) ||
+            usage.readNames.count(variableName) ||
+            usage.globalNames.count(variableName) ||
+            usage.hostCallingNames.count(variableName)) {
+            continue;
+        }
+        _unreadVariableNames.insert(variableName);
+        _deadStores.insert(statement);
+        if (statement->variableDeclaration()) {
+            logWarning(sourceLocationForToken(statement->start), "Variable '"+variableName+"' is never read, so its declaration was removed.");
+        } else {
+            logWarning(sourceLocationForToken(statement->start), "Variable '"+variableName+"' is never read, so this assignment was removed.");
+        }
+    }
+    
+    findOverwrittenStores(_program);
+}
+
+void MaPLFile::findVariableUsage(antlr4::ParserRuleContext *node,
+                                 bool isNested,
+                                 const std::string &assignedVariableName,
+                                 MaPLVariableUsage &usage) {
+    switch (node->getRuleIndex()) {
+        case MaPLParser::RuleImperativeStatement: {
+            MaPLParser::ImperativeStatementContext *statement = (MaPLParser::ImperativeStatementContext *)node;
+            std::string variableName = storedVariableName(statement);
+            if (variableName.empty()) {
+                break;
+            }
+            MaPLParser::ExpressionContext *expression = NULL;
+            if (statement->variableDeclaration()) {
+                expression = statement->variableDeclaration()->expression();
+                if (!isNested) {
+                    usage.globalNames.insert(variableName);
+                }
+            } else if (statement->assignStatement()) {
+                expression = statement->assignStatement()->expression();
+            }
+            // Assigning a global property is itself a call to the host.
+            if (_api.findGlobalProperty(variableName) || (expression && expressionCallsHost(expression))) {
+                usage.hostCallingNames.insert(variableName);
+            }
+            usage.stores.push_back(statement);
+            if (expression) {
+                // Reading a variable only to compute its own next value (as in "x = x + 1") doesn't make that value observable.
+                findVariableUsage(expression, isNested, variableName, usage);
+            }
+            return;
+        }
+        case MaPLParser::RuleObjectExpression: {
+            MaPLParser::ObjectExpressionContext *objectExpression = (MaPLParser::ObjectExpressionContext *)node;
+            if (!objectExpression->keyToken) {
+                std::string variableName = objectExpression->identifier()->getText();
+                if (variableName != assignedVariableName) {
+                    usage.readNames.insert(variableName);
+                }
+                return;
+            }
+        }
+            break;
+        case MaPLParser::RuleScope:
+        case MaPLParser::RuleForLoop:
+            isNested = true;
+            break;
+        default: break;
+    }
+    for (antlr4::tree::ParseTree *child : node->children) {
+        antlr4::ParserRuleContext *ruleContext = dynamic_cast<antlr4::ParserRuleContext *>(child);
+        if (ruleContext) {
+            findVariableUsage(ruleContext, isNested, assignedVariableName, usage);
+        }
+    }
+}
+
+void MaPLFile::findOverwrittenStores(antlr4::ParserRuleContext *node) {
+    std::vector<MaPLParser::StatementContext *> statements;
+    if (node->getRuleIndex() == MaPLParser::RuleProgram) {
+        statements = ((MaPLParser::ProgramContext *)node)->statement();
+    } else if (node->getRuleIndex() == MaPLParser::RuleScope) {
+        statements = ((MaPLParser::ScopeContext *)node)->statement();
+    }
+    
+    // An assignment is dead if a later statement in the same list assigns the variable again, and nothing in between can read it
+    // or leave the list early. Assignments in nested scopes are only overwritten by other statements within that scope.
+    for (size_t i = 0; i < statements.size(); i++) {
+        MaPLParser::AssignStatementContext *assignment = plainVariableAssignment(statements[i]);
+        if (!assignment || _deadStores.count(statements[i]->imperativeStatement())) {
+            continue;
+        }
+        std::string variableName = assignment->objectExpression()->identifier()->getText();
+        if (_api.findGlobalProperty(variableName) || expressionCallsHost(assignment->expression())) {
+            continue;
+        }
+        bool isOverwritten = false;
+        for (size_t j = i+1; j < statements.size(); j++) {
+            MaPLParser::AssignStatementContext *laterAssignment = plainVariableAssignment(statements[j]);
+            if (laterAssignment && laterAssignment->objectExpression()->identifier()->getText() == variableName) {
+                isOverwritten = !containsVariableReference(laterAssignment->expression(), variableName);
+                break;
+            }
+            if (containsVariableReference(statements[j], variableName) || containsEarlyExit(statements[j])) {
+                break;
+            }
+        }
+        if (isOverwritten) {
+            _deadStores.insert(statements[i]->imperativeStatement());
+            logWarning(sourceLocationForToken(statements[i]->start), "The value assigned to '"+variableName+"' is overwritten before it's read, so this assignment was removed.");
+        }
+    }
+    
+    for (antlr4::tree::ParseTree *child : node->children) {
+        antlr4::ParserRuleContext *ruleContext = dynamic_cast<antlr4::ParserRuleContext *>(child);
+        if (ruleContext) {
+            findOverwrittenStores(ruleContext);
+        }
+    }
+}
+
+bool MaPLFile::expressionCallsHost(antlr4::ParserRuleContext *node) {
+    if (node->getRuleIndex() == MaPLParser::RuleObjectExpression) {
+        // Functions, subscripts, and members are all provided by the host, as are global properties.
+        MaPLParser::ObjectExpressionContext *objectExpression = (MaPLParser::ObjectExpressionContext *)node;
+        if (objectExpression->keyToken || _api.findGlobalProperty(objectExpression->identifier()->getText())) {
+            return true;
+        }
+    }
+    for (antlr4::tree::ParseTree *child : node->children) {
+        antlr4::ParserRuleContext *ruleContext = dynamic_cast<antlr4::ParserRuleContext *>(child);
+        if (ruleContext && expressionCallsHost(ruleContext)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<std::string> MaPLFile::hoistLoopInvariants(MaPLParser::ExpressionContext *loopExpression,
+                                                       antlr4::ParserRuleContext *loop,
+                                                       MaPLParser::ScopeContext *loopScope,
+                                                       MaPLBuffer *currentBuffer) {
+    std::vector<std::string> hoistedTexts;
+    if (_options.invariantSymbols.empty() || !loopExpression) {
+        return hoistedTexts;
+    }
+    
+    // Any variable written within the loop can't be part of an invariant expression.
+    std::unordered_set<std::string> reassignedVariables;
+    findReassignedVariables(loop, reassignedVariables);
+    
+    // Type lookups during this search can log errors that are logged again when the loop is compiled normally.
+    size_t previousErrorCount = _errors.size();
+    std::vector<MaPLParser::ObjectExpressionContext *> hoistableExpressions;
+    findHoistableExpressions(loopExpression, reassignedVariables, hoistableExpressions);
+    if (_errors.size() > previousErrorCount) {
+        _errors.resize(previousErrorCount);
+        return hoistedTexts;
+    }
+    
+    std::string loopScopeText = loopScope->getText();
+    for (MaPLParser::ObjectExpressionContext *expression : hoistableExpressions) {
+        // Expressions are found in post-order, so a hoisted expression can be built from previously hoisted prefixes.
+        // Prefixes are only worth hoisting on their own if they're also used in the body of the loop.
+        std::string expressionText = expression->getText();
+        if (_hoistedExpressions.count(expressionText)) {
+            // Already hoisted by an enclosing loop, which assigns nothing that it depends on. Since no loop ever replaces
+            // another loop's hidden variable, each loop can safely forget its own hoisted expressions when it ends.
+            continue;
+        }
+        bool isPrefixOfHoistedExpression = false;
+        for (antlr4::tree::ParseTree *parent = expression->parent; parent != loopExpression; parent = parent->parent) {
+            if (std::find(hoistableExpressions.begin(), hoistableExpressions.end(), parent) != hoistableExpressions.end()) {
+                isPrefixOfHoistedExpression = true;
+                break;
+            }
+        }
+        if (isPrefixOfHoistedExpression && loopScopeText.find(expressionText) == std::string::npos) {
+            continue;
+        }
+        
+        // Hidden variable names start with a character that is not allowed in identifiers, so they can't collide.
+        std::string variableName = "$hoisted"+std::to_string(_hoistedVariableCount++);
+        MaPLType variableType = objectExpressionReturnType(expression, { MaPLPrimitiveType_Uninitialized });
+        MaPLVariable variable{ variableType, this, sourceLocationForToken(expression->start) };
+        _variableStack->declareVariable(variableName, variable);
+        variable = _variableStack->getVariable(variableName);
+        
+        currentBuffer->appendInstruction(assignmentInstructionForPrimitive(variableType.primitiveType));
+        currentBuffer->addAnnotation(variableType.primitiveType == MaPLPrimitiveType_String ? MaPLBufferAnnotationType_AllocatedVariableIndexDeclaration : MaPLBufferAnnotationType_PrimitiveVariableAddressDeclaration);
+        currentBuffer->appendBytes(&(variable.memoryAddress), sizeof(variable.memoryAddress));
+        compileObjectExpression(expression, NULL, currentBuffer);
+        
+        _hoistedExpressions[expressionText] = variableName;
+        hoistedTexts.push_back(expressionText);
+    }
+    return hoistedTexts;
+}
+
+void MaPLFile::findHoistableExpressions(MaPLParser::ExpressionContext *expression,
+                                        const std::unordered_set<std::string> &reassignedVariables,
+                                        std::vector<MaPLParser::ObjectExpressionContext *> &hoistableExpressions) {
+    MaPLParser::ObjectExpressionContext *objectExpression = expression->objectExpression();
+    if (objectExpression) {
+        findHoistableExpressions(objectExpression, reassignedVariables, hoistableExpressions);
+        return;
+    }
+    std::vector<MaPLParser::ExpressionContext *> childExpressions = expression->expression();
+    if (expression->keyToken) {
+        switch (expression->keyToken->getType()) {
+            case MaPLParser::LOGICAL_AND: // Intentional fallthrough.
+            case MaPLParser::LOGICAL_OR: // Intentional fallthrough.
+            case MaPLParser::TERNARY_CONDITIONAL: // Intentional fallthrough.
+            case MaPLParser::NULL_COALESCING:
+                // Only the first operand is guaranteed to be evaluated. Hoisting from the others could
+                // evaluate an expression that the script was relying on being skipped (like invoking on NULL).
+                childExpressions.resize(1);
+                break;
+            default: break;
+        }
+    }
+    for (MaPLParser::ExpressionContext *childExpression : childExpressions) {
+        findHoistableExpressions(childExpression, reassignedVariables, hoistableExpressions);
+    }
+}
+
+void MaPLFile::findHoistableExpressions(MaPLParser::ObjectExpressionContext *expression,
+                                        const std::unordered_set<std::string> &reassignedVariables,
+                                        std::vector<MaPLParser::ObjectExpressionContext *> &hoistableExpressions) {
+    std::vector<MaPLParser::ExpressionContext *> childExpressions;
+    if (expression->keyToken) {
+        switch (expression->keyToken->getType()) {
+            case MaPLParser::OBJECT_TO_MEMBER:
+                findHoistableExpressions(expression->objectExpression(0), reassignedVariables, hoistableExpressions);
+                childExpressions = expression->objectExpression(1)->expression();
+                break;
+            case MaPLParser::SUBSCRIPT_OPEN:
+                findHoistableExpressions(expression->objectExpression(0), reassignedVariables, hoistableExpressions);
+                childExpressions = expression->expression();
+                break;
+            case MaPLParser::PAREN_OPEN:
+                childExpressions = expression->expression();
+                break;
+            default: break;
+        }
+    }
+    for (MaPLParser::ExpressionContext *childExpression : childExpressions) {
+        findHoistableExpressions(childExpression, reassignedVariables, hoistableExpressions);
+    }
+    
+    // A reference to a variable is already as cheap as it can be.
+    if (!expression->keyToken &&
+        _variableStack->getVariable(expression->identifier()->getText()).type.primitiveType != MaPLPrimitiveType_Uninitialized) {
+        return;
+    }
+    if (!isInvariantObjectExpression(expression, { MaPLPrimitiveType_Uninitialized }, reassignedVariables)) {
+        return;
+    }
+    for (MaPLParser::ObjectExpressionContext *hoistableExpression : hoistableExpressions) {
+        if (hoistableExpression->getText() == expression->getText()) {
+            return;
+        }
+    }
+    hoistableExpressions.push_back(expression);
+}
+
+bool MaPLFile::isInvariantExpression(MaPLParser::ExpressionContext *expression,
+                                     const std::unordered_set<std::string> &reassignedVariables) {
+    MaPLParser::ObjectExpressionContext *objectExpression = expression->objectExpression();
+    if (objectExpression) {
+        return isInvariantObjectExpression(objectExpression, { MaPLPrimitiveType_Uninitialized }, reassignedVariables);
+    }
+    // Literals have no child expressions, and operators are invariant if all their operands are.
+    for (MaPLParser::ExpressionContext *childExpression : expression->expression()) {
+        if (!isInvariantExpression(childExpression, reassignedVariables)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MaPLFile::isInvariantObjectExpression(MaPLParser::ObjectExpressionContext *expression,
+                                           const MaPLType &invokedOnType,
+                                           const std::unordered_set<std::string> &reassignedVariables) {
+    antlr4::Token *keyToken = expression->keyToken;
+    if (keyToken) {
+        switch (keyToken->getType()) {
+            case MaPLParser::OBJECT_TO_MEMBER: {
+                std::vector<MaPLParser::ObjectExpressionContext *> childExpressions = expression->objectExpression();
+                if (!isInvariantObjectExpression(childExpressions[0], invokedOnType, reassignedVariables)) {
+                    return false;
+                }
+                MaPLType prefixType = objectExpressionReturnType(childExpressions[0], invokedOnType);
+                if (prefixType.primitiveType != MaPLPrimitiveType_Pointer) {
+                    return false;
+                }
+                return isInvariantObjectExpression(childExpressions[1], prefixType, reassignedVariables);
+            }
+            case MaPLParser::PAREN_OPEN: {
+                std::vector<MaPLType> parameterTypes;
+                for (MaPLParser::ExpressionContext *parameterExpression : expression->expression()) {
+                    if (!isInvariantExpression(parameterExpression, reassignedVariables)) {
+                        return false;
+                    }
+                    parameterTypes.push_back(dataTypeForExpression(parameterExpression));
+                }
+                std::string functionName = expression->identifier()->getText();
+                const MaPLFunctionAPI *functionAPI;
+                if (invokedOnType.primitiveType == MaPLPrimitiveType_Uninitialized) {
+                    functionAPI = _api.findGlobalFunction(functionName, parameterTypes, NULL);
+                } else {
+                    functionAPI = _api.findTypeFunction(invokedOnType.pointerType, functionName, parameterTypes, invokedOnType.generics, NULL);
+                }
+                return functionAPI && _options.invariantSymbols.count(functionAPI->symbolDescriptor()) > 0;
+            }
+            default:
+                // Subscripts have no symbol descriptor, so they can't be marked as invariant.
+                return false;
+        }
+    }
+    
+    std::string propertyOrVariableName = expression->identifier()->getText();
+    if (invokedOnType.primitiveType == MaPLPrimitiveType_Uninitialized) {
+        MaPLVariable variable = _variableStack->getVariable(propertyOrVariableName);
+        if (variable.type.primitiveType != MaPLPrimitiveType_Uninitialized) {
+            return reassignedVariables.count(propertyOrVariableName) == 0;
+        }
+    }
+    const MaPLPropertyAPI *propertyAPI;
+    if (invokedOnType.primitiveType == MaPLPrimitiveType_Uninitialized) {
+        propertyAPI = _api.findGlobalProperty(propertyOrVariableName);
+    } else {
+        propertyAPI = _api.findTypeProperty(invokedOnType.pointerType, propertyOrVariableName, NULL);
+    }
+    return propertyAPI && _options.invariantSymbols.count(propertyAPI->symbolDescriptor()) > 0;
+}
+
+MaPLType MaPLFile::dataTypeForExpression(MaPLParser::ExpressionContext *expression) {
+    MaPLParser::BitwiseShiftRightContext *rightShift = expression->bitwiseShiftRight();
+    if (expression->keyToken || rightShift) {
+        size_t tokenType;
+        if (rightShift) {
+            tokenType = MaPLParser::BITWISE_SHIFT_RIGHT;
+        } else {
+            tokenType = expression->keyToken->getType();
+        }
+        switch (tokenType) {
+            case MaPLParser::PAREN_OPEN: {
+                // This is a typecast, return the type that is specified in the cast.
+                MaPLParser::TypeContext *typeContext = expression->type();
+                MaPLType type = typeForTypeContext(typeContext);
+                if (type.primitiveType == MaPLPrimitiveType_TypeError) {
+                    // Break down to the bottom of this function to log a generic error.
+                    break;
+                }
+                return type;
+            }
+            case MaPLParser::PAREN_CLOSE:
+                // This is a nested expression, return type of the child expression.
+                return dataTypeForExpression(expression->expression(0));
+            case MaPLParser::LOGICAL_AND: // Intentional fallthrough.
+            case MaPLParser::LOGICAL_OR: // Intentional fallthrough.
+            case MaPLParser::LOGICAL_EQUALITY: // Intentional fallthrough.
+            case MaPLParser::LOGICAL_INEQUALITY: // Intentional fallthrough.
+            case MaPLParser::LESS_THAN: // Intentional fallthrough.
+            case MaPLParser::LESS_THAN_EQUAL: // Intentional fallthrough.
+            case MaPLParser::GREATER_THAN: // Intentional fallthrough.
+            case MaPLParser::GREATER_THAN_EQUAL: // Intentional fallthrough.
+            case MaPLParser::LOGICAL_NEGATION: // Intentional fallthrough.
+            case MaPLParser::LITERAL_TRUE: // Intentional fallthrough.
+            case MaPLParser::LITERAL_FALSE:
+                return { MaPLPrimitiveType_Boolean };
+            case MaPLParser::SUBTRACT: {
+                std::vector<MaPLParser::ExpressionContext *> childExpressions = expression->expression();
+                if (childExpressions.size() == 1) {
+                    // There's only one operand, so this is numeric negation instead of subtraction.
+                    MaPLType type = dataTypeForExpression(childExpressions[0]);
+                    if (isConcreteUnsignedInt(type.primitiveType)) {
+                        logError(expression->keyToken, "Unsigned integers cannot be negated.");
+                        return { MaPLPrimitiveType_TypeError };
+                    }
+                    if (type.primitiveType == MaPLPrimitiveType_Int_AmbiguousSizeAndSign) {
+                        // If the datatype is ambiguous, but it's being negated, it must be a signed int.
+                        return { MaPLPrimitiveType_SignedInt_AmbiguousSize };
+                    }
+                    if (isNumeric(type.primitiveType)) {
+                        return type;
+                    }
+                    logError(expression->keyToken, "Numeric negation can only be applied to numeric data types.");
+                    return { MaPLPrimitiveType_TypeError };
+                }
+            }
+                // Intentional fallthrough handles the binary subtraction operator.
+            case MaPLParser::MOD: // Intentional fallthrough.
+            case MaPLParser::MULTIPLY: // Intentional fallthrough.
+            case MaPLParser::DIVIDE: {
+                std::vector<MaPLParser::ExpressionContext *> childExpressions = expression->expression();
+                MaPLType type1 = dataTypeForExpression(childExpressions[0]);
+                MaPLType type2 = dataTypeForExpression(childExpressions[1]);
+                if (isNumeric(type1.primitiveType) && isNumeric(type2.primitiveType)) {
+                    return { reconcileTypes(type1.primitiveType, type2.primitiveType, expression->keyToken) };
+                }
+                logNonNumericOperandsError(expression->keyToken);
+                return { MaPLPrimitiveType_TypeError };
+            }
+            case MaPLParser::ADD: {
+                std::vector<MaPLParser::ExpressionContext *> childExpressions = expression->expression();
+                MaPLType type1 = dataTypeForExpression(childExpressions[0]);
+                MaPLType type2 = dataTypeForExpression(childExpressions[1]);
+                // Plus operator could be numeric add or string concatenation.
+                if (type1.primitiveType == MaPLPrimitiveType_String &&
+                    type2.primitiveType == MaPLPrimitiveType_String) {
+                    return { MaPLPrimitiveType_String };
+                } else if (isNumeric(type1.primitiveType) && isNumeric(type2.primitiveType)) {
+                    return { reconcileTypes(type1.primitiveType, type2.primitiveType, expression->keyToken) };
+                }
+                logError(expression->keyToken, "Both operands must be either string (concatenation) or numeric (addition).");
+                return { MaPLPrimitiveType_TypeError };
+            }
+            case MaPLParser::BITWISE_AND: // Intentional fallthrough.
+            case MaPLParser::BITWISE_XOR: // Intentional fallthrough.
+            case MaPLParser::BITWISE_OR: // Intentional fallthrough.
+            case MaPLParser::BITWISE_SHIFT_LEFT: // Intentional fallthrough.
+            case MaPLParser::BITWISE_SHIFT_RIGHT: {
+                std::vector<MaPLParser::ExpressionContext *> childExpressions = expression->expression();
+                MaPLType type1 = dataTypeForExpression(childExpressions[0]);
+                MaPLType type2 = dataTypeForExpression(childExpressions[1]);
+                if (isIntegral(type1.primitiveType) && isIntegral(type2.primitiveType)) {
+                    return { reconcileTypes(type1.primitiveType, type2.primitiveType, expression->keyToken) };
+                }
                 logError(expression->keyToken, "Both operands must be integers.");
                 return { MaPLPrimitiveType_TypeError };
             }
@@ -2513,7 +4182,7 @@ MaPLType MaPLFile::objectExpressionReturnType(MaPLParser::ObjectExpressionContex
 void MaPLFile::confirmTypesExist(const MaPLType &type, MaPLFile *file, antlr4::Token *token) {
     if (type.primitiveType == MaPLPrimitiveType_Pointer) {
         if (!_api.findType(type.pointerType)) {
-            logMissingTypeError(token, type.pointerType);
+            logMissingTypeError(sourceLocationForToken(token), type.pointerType);
         }
         for (const MaPLType &genericType : type.generics) {
             confirmTypesExist(genericType, file, token);
@@ -2528,7 +4197,8 @@ void MaPLFile::syntaxError(antlr4::Recognizer *recognizer,
                                     const std::string &msg,
                                     std::exception_ptr e) {
     // This method is overriding ANTLRErrorListener. Forward this call to the MaPL error logging function.
-    logError(offendingSymbol, msg);
+    // The offending symbol is NULL for lexer errors, so the position is taken from the arguments instead.
+    logError({ line, charPositionInLine }, msg);
 }
 
 void MaPLFile::logAmbiguousLiteralError(MaPLPrimitiveType type, antlr4::Token *token) {
@@ -2573,11 +4243,19 @@ void MaPLFile::logNotAssignableError(antlr4::Token *token) {
 }
 
 void MaPLFile::logError(antlr4::Token *token, const std::string &msg) {
+    logError(sourceLocationForToken(token), msg);
+}
+
+void MaPLFile::logError(const MaPLSourceLocation &location, const std::string &msg) {
     std::string loggedError;
-    if (token) {
-        loggedError = _normalizedFilePath.string()+":"+std::to_string(token->getLine())+":"+std::to_string(token->getCharPositionInLine())+": error: "+msg+"\n";
+    if (location.line > 0) {
+        loggedError = _normalizedFilePath.string()+":"+std::to_string(location.line)+":"+std::to_string(location.column)+": error: "+msg+"\n";
     } else {
         loggedError = _normalizedFilePath.string()+":1:1: error: "+msg+"\n";
     }
     _errors.push_back(loggedError);
 }
+
+void MaPLFile::logWarning(const MaPLSourceLocation &location, const std::string &msg) {
+    _warnings.push_back(_normalizedFilePath.string()+":"+std::to_string(location.line)+":"+std::to_string(location.column)+": warning: "+msg+"\n");
+}
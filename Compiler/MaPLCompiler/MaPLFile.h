@@ -11,7 +11,9 @@
 #include <stdio.h>
 #include <string>
 #include <filesystem>
+#include <map>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "MaPLAPI.h"
@@ -25,6 +27,54 @@ class MaPLLexer;
 class MaPLFileCache;
 class MaPLBuffer;
 
+/**
+ * Describes one section of a metadata statement, which the runtime passes to the host in a single callback.
+ */
+struct MaPLMetadataSection {
+    // The literal text of this section, with escape sequences already resolved. Unused if @c expression is not NULL.
+    std::string text;
+    // The expression which is evaluated to produce this section at runtime, or NULL if this section is literal text.
+    MaPLParser::ExpressionContext *expression;
+};
+
+/**
+ * Describes one conditional in a chain of "else if" conditionals that compare the same variable to different constants.
+ */
+struct MaPLSwitchCase {
+    // The constant that the variable is compared to, cast to the type of the variable. Escape sequences are already resolved.
+    MaPLLiteral literal;
+    // The value that the runtime looks up in the switch table: the widened value of an integer, or the hash of a string.
+    uint64_t key;
+    // The contents of the conditional.
+    MaPLParser::ScopeContext *scope;
+    // The conditional itself, whose expression compares the variable to the constant.
+    MaPLParser::ConditionalContext *conditional;
+};
+
+/**
+ * Describes one operand in a chain of integer additions and subtractions, or a chain of integer multiplications.
+ */
+struct MaPLArithmeticTerm {
+    // The operand.
+    MaPLParser::ExpressionContext *expression;
+    // True if the operand is subtracted from the chain rather than added to it. Always false for multiplications.
+    bool isNegated;
+};
+
+/**
+ * Describes how the variables in a file are read and written, which determines which stores can be eliminated.
+ */
+struct MaPLVariableUsage {
+    // Names of variables whose values are read, other than to compute a new value for the same variable.
+    std::unordered_set<std::string> readNames;
+    // Names of variables declared outside of any scope. Scripts that import this file can read these variables.
+    std::unordered_set<std::string> globalNames;
+    // Names of variables that are assigned the result of an expression that calls the host.
+    std::unordered_set<std::string> hostCallingNames;
+    // Every declaration and assignment of a variable, in the order they appear in the file.
+    std::vector<MaPLParser::ImperativeStatementContext *> stores;
+};
+
 /**
  * Represents a single MaPL file in from the filesystem.
  */
@@ -59,6 +109,11 @@ public:
      */
     std::vector<MaPLFile *> getDependencies();
     
+    /**
+     * @return The dependency whose bytecode this file is linked against, or NULL if all dependencies were copied into this file's bytecode.
+     */
+    MaPLFile *getLinkedDependency();
+    
     /**
      * @return The path in the filesystem that points to this file.
      */
@@ -69,16 +124,36 @@ public:
      */
     void logError(antlr4::Token *token, const std::string &msg);
     
+    /**
+     * Logs an error at @c location that is then retrievable via @c getErrors().
+     */
+    void logError(const MaPLSourceLocation &location, const std::string &msg);
+    
     /**
      * Logs an error that describes a missing type with the name @c typeName.
      */
-    void logMissingTypeError(antlr4::Token *errorToken, const std::string &typeName);
+    void logMissingTypeError(const MaPLSourceLocation &location, const std::string &typeName);
     
     /**
      * @return A list of all errors logged via @c logError().
      */
     std::vector<std::string> getErrors();
     
+    /**
+     * Logs a warning at @c location that is then retrievable via @c getWarnings().
+     */
+    void logWarning(const MaPLSourceLocation &location, const std::string &msg);
+    
+    /**
+     * @return A list of all warnings logged via @c logWarning().
+     */
+    std::vector<std::string> getWarnings();
+    
+    /**
+     * @return A report of the time spent in each parser decision, sorted from slowest to fastest. Empty unless parser profiling is enabled in the file cache.
+     */
+    std::string getParserProfile();
+    
     /**
      * Mutator for this file's options. To take effect, this must be assigned before compilation.
      */
@@ -89,9 +164,18 @@ public:
      */
     void compileIfNeeded();
     
+    /**
+     * @return @c true if the script's source has been modified since it was parsed, or if it has never been successfully parsed.
+     */
+    bool hasChangedSource();
+    
 private:
     
+    bool readRawScript(std::string &rawScriptText);
     bool parseRawScript();
+    void freeParseTree();
+    MaPLFile *findLinkableDependency(const std::vector<MaPLFile *> &flattenedDependencyList);
+    MaPLCompileOptions optionsForDependencies();
     void compileChildNodes(antlr4::ParserRuleContext *node, const MaPLType &expectedType, MaPLBuffer *currentBuffer);
     void compileNode(antlr4::ParserRuleContext *node, const MaPLType &expectedType, MaPLBuffer *currentBuffer);
     MaPLType compileObjectExpression(MaPLParser::ObjectExpressionContext *expression,
@@ -101,7 +185,59 @@ private:
                                     const MaPLVariable &variable,
                                     MaPLBuffer *currentBuffer);
     void compileDebugPopFromTopStackFrame(MaPLBuffer *currentBuffer);
+    void addDebugVariableTableEnds(MaPLBuffer *currentBuffer);
+    void appendMetadataText(const std::string &text, std::vector<MaPLMetadataSection> &sections);
+    void appendMetadataSections(MaPLParser::ExpressionContext *expression, std::vector<MaPLMetadataSection> &sections);
+    MaPLParser::ExpressionContext *gatherSwitchCases(MaPLParser::ConditionalContext *conditional,
+                                                     std::vector<MaPLSwitchCase> &outCases,
+                                                     antlr4::ParserRuleContext *&outDefaultNode);
+    bool compileSwitchIfPossible(MaPLParser::ConditionalContext *conditional, MaPLBuffer *currentBuffer);
+    bool compileProfiledChainIfPossible(MaPLParser::ConditionalContext *conditional, MaPLBuffer *currentBuffer);
+    bool compileInvertedConditionIfPossible(MaPLParser::ExpressionContext *expression, MaPLBuffer *currentBuffer);
+    const MaPLScriptProfile *getScriptProfile();
+    bool isConditionalUsuallyTrue(MaPLParser::ConditionalContext *conditional);
+    size_t unrollBudgetForLoop(antlr4::ParserRuleContext *loop);
+    MaPLParser::ExpressionContext *switchVariableForExpression(MaPLParser::ExpressionContext *expression, MaPLLiteral &outLiteral);
+    bool integralValueForExpression(MaPLParser::ExpressionContext *expression, MaPLPrimitiveType type, uint64_t &outValue);
+    bool inductionValuesForLoop(MaPLParser::ForLoopContext *loop, std::vector<uint64_t> &outValues);
+    bool compileFullyUnrolledLoop(MaPLParser::ForLoopContext *loop,
+                                  const std::vector<uint64_t> &inductionValues,
+                                  size_t iterationSize,
+                                  size_t unrollBudget,
+                                  MaPLBuffer *currentBuffer);
+    void compileLoop(MaPLParser::ExpressionContext *loopExpression,
+                     bool isEnteredUnconditionally,
+                     MaPLBuffer *scopeBuffer,
+                     MaPLBuffer *currentBuffer);
+    bool compileLiteralComparisonBranch(MaPLParser::ExpressionContext *expression, MaPLBuffer *currentBuffer);
+    bool compileSimplifiedIntegralExpression(MaPLParser::ExpressionContext *expression,
+                                             const MaPLType &expectedType,
+                                             MaPLBuffer *currentBuffer);
+    void findReassignedVariables(antlr4::ParserRuleContext *node, std::unordered_set<std::string> &variableNames);
+    void findDeadStores();
+    void findVariableUsage(antlr4::ParserRuleContext *node,
+                           bool isNested,
+                           const std::string &assignedVariableName,
+                           MaPLVariableUsage &usage);
+    void findOverwrittenStores(antlr4::ParserRuleContext *node);
+    bool expressionCallsHost(antlr4::ParserRuleContext *node);
+    std::vector<std::string> hoistLoopInvariants(MaPLParser::ExpressionContext *loopExpression,
+                                                 antlr4::ParserRuleContext *loop,
+                                                 MaPLParser::ScopeContext *loopScope,
+                                                 MaPLBuffer *currentBuffer);
+    void findHoistableExpressions(MaPLParser::ExpressionContext *expression,
+                                  const std::unordered_set<std::string> &reassignedVariables,
+                                  std::vector<MaPLParser::ObjectExpressionContext *> &hoistableExpressions);
+    void findHoistableExpressions(MaPLParser::ObjectExpressionContext *expression,
+                                  const std::unordered_set<std::string> &reassignedVariables,
+                                  std::vector<MaPLParser::ObjectExpressionContext *> &hoistableExpressions);
+    bool isInvariantExpression(MaPLParser::ExpressionContext *expression,
+                               const std::unordered_set<std::string> &reassignedVariables);
+    bool isInvariantObjectExpression(MaPLParser::ObjectExpressionContext *expression,
+                                     const MaPLType &invokedOnType,
+                                     const std::unordered_set<std::string> &reassignedVariables);
     MaPLLiteral constantValueForExpression(MaPLParser::ExpressionContext *expression);
+    MaPLLiteral constantValueForVariable(MaPLParser::ObjectExpressionContext *expression);
     MaPLType dataTypeForExpression(MaPLParser::ExpressionContext *expression);
     MaPLPrimitiveType reconcileTypes(MaPLPrimitiveType left,
                                      MaPLPrimitiveType right,
@@ -131,13 +267,25 @@ private:
     MaPLBuffer *_bytecode;
     MaPLVariableStack *_variableStack;
     std::vector<MaPLFile *> _dependencies;
+    MaPLFile *_linkedDependency;
     std::vector<std::string> _errors;
+    std::vector<std::string> _warnings;
+    std::filesystem::file_time_type _lastWriteTime;
+    size_t _rawScriptHash;
+    std::unordered_set<std::string> _reassignedVariableNames;
+    std::map<MaPLSourceLocation, MaPLLiteral> _constantVariables;
+    std::unordered_map<std::string, std::string> _hoistedExpressions;
+    std::unordered_set<std::string> _unreadVariableNames;
+    std::unordered_set<MaPLParser::ImperativeStatementContext *> _deadStores;
+    size_t _hoistedVariableCount;
+    std::string _parserProfile;
     
     antlr4::ANTLRInputStream *_inputStream;
     MaPLLexer *_lexer;
     antlr4::CommonTokenStream *_tokenStream;
     MaPLParser *_parser;
     MaPLParser::ProgramContext *_program;
+    bool _isParsed;
     
     MaPLAPI _api;
 };
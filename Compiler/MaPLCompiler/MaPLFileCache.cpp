@@ -6,6 +6,11 @@
 //
 
 #include "MaPLFileCache.h"
+
+#include <fstream>
+#include <sstream>
+#include <unordered_set>
+
 #include "MaPLFile.h"
 
 MaPLFileCache::~MaPLFileCache() {
@@ -14,16 +19,112 @@ MaPLFileCache::~MaPLFileCache() {
     }
 }
 
-MaPLFile *MaPLFileCache::fileForNormalizedPath(const std::filesystem::path &normalizedFilePath) {
+MaPLFile *MaPLFileCache::fileForNormalizedPath(const std::filesystem::path &normalizedFilePath, const MaPLCompileOptions &options) {
+    // Debug output is baked into the bytecode when the file is compiled, so it's part of the key.
+    std::string cacheKey = normalizedFilePath.string();
+    if (options.includeDebugBytes) {
+        cacheKey += "\n--debug";
+    }
+    if (options.debugLineTable) {
+        cacheKey += "\n--line-table";
+    }
+    
     // Attempt first to fetch the file from cache.
-    std::string pathString = normalizedFilePath.string();
-    if (!_files.count(pathString)) {
+    if (!_files.count(cacheKey)) {
         // No matching file found in cache, add a new one.
-        _files[pathString] = new MaPLFile(normalizedFilePath, this);
+        _files[cacheKey] = new MaPLFile(normalizedFilePath, this);
     }
-    return _files.at(pathString);
+    return _files.at(cacheKey);
 }
 
 std::unordered_map<std::string, MaPLFile *> MaPLFileCache::getFiles() {
     return _files;
 }
+
+void MaPLFileCache::setSourceForNormalizedPath(const std::filesystem::path &normalizedFilePath, const std::string &sourceText) {
+    _sources[normalizedFilePath.string()] = sourceText;
+}
+
+void MaPLFileCache::setImportResolver(const MaPLImportResolver &importResolver) {
+    _importResolver = importResolver;
+}
+
+void MaPLFileCache::setProfileParser(bool profileParser) {
+    _profileParser = profileParser;
+}
+
+bool MaPLFileCache::shouldProfileParser() {
+    return _profileParser;
+}
+
+bool MaPLFileCache::readSourceForNormalizedPath(const std::filesystem::path &normalizedFilePath, std::string &sourceText) {
+    std::string pathString = normalizedFilePath.string();
+    if (_sources.count(pathString)) {
+        sourceText = _sources.at(pathString);
+        return true;
+    }
+    if (_importResolver) {
+        if (!_resolvedSources.count(pathString)) {
+            std::string resolvedText;
+            if (!_importResolver(normalizedFilePath, resolvedText)) {
+                return false;
+            }
+            _resolvedSources[pathString] = resolvedText;
+        }
+        sourceText = _resolvedSources.at(pathString);
+        return true;
+    }
+    
+    std::ifstream inputStream(normalizedFilePath);
+    if (!inputStream) {
+        return false;
+    }
+    std::stringstream stringBuffer;
+    stringBuffer << inputStream.rdbuf();
+    sourceText = stringBuffer.str();
+    return true;
+}
+
+bool MaPLFileCache::isSourceInFilesystem(const std::filesystem::path &normalizedFilePath) {
+    return !_importResolver && !_sources.count(normalizedFilePath.string());
+}
+
+void MaPLFileCache::invalidateModifiedFiles() {
+    // Imports are resolved again, so that any file whose resolver now supplies different text is recompiled.
+    _resolvedSources.clear();
+    
+    std::unordered_set<MaPLFile *> invalidatedFiles;
+    for (const auto&[cacheKey, file] : _files) {
+        if (file->hasChangedSource()) {
+            invalidatedFiles.insert(file);
+        }
+    }
+    
+    // Any file that depends on an invalidated file has been compiled with out-of-date
+    // bytecode. Keep propagating the invalidation until no more dependents are found.
+    bool didInvalidateFile = invalidatedFiles.size() > 0;
+    while (didInvalidateFile) {
+        didInvalidateFile = false;
+        for (const auto&[cacheKey, file] : _files) {
+            if (invalidatedFiles.count(file)) {
+                continue;
+            }
+            for (MaPLFile *dependency : file->getDependencies()) {
+                if (invalidatedFiles.count(dependency)) {
+                    invalidatedFiles.insert(file);
+                    didInvalidateFile = true;
+                    break;
+                }
+            }
+        }
+    }
+    
+    for (auto iterator = _files.begin(); iterator != _files.end();) {
+        if (invalidatedFiles.count(iterator->second)) {
+            delete iterator->second;
+            iterator = _files.erase(iterator);
+        } else {
+            iterator++;
+        }
+    }
+}
@@ -10,8 +10,11 @@
 
 #include <stdio.h>
 #include <filesystem>
+#include <string>
 #include <unordered_map>
 
+#include "MaPLCompiler.h"
+
 class MaPLFile;
 
 /**
@@ -24,16 +27,64 @@ public:
     
     /**
      * @param normalizedFilePath The lexically normalized filesystem path to the MaPL script file.
+     * @param options The options that the file will be compiled with. A script that's compiled both with and without debug
+     *                output (for example as a root script, and as a dependency concatenated into another script) is cached once for each.
      *
      * @return The @c MaPLFile for the script at the given @c normalizedFilePath.
      */
-    MaPLFile *fileForNormalizedPath(const std::filesystem::path &normalizedFilePath);
+    MaPLFile *fileForNormalizedPath(const std::filesystem::path &normalizedFilePath, const MaPLCompileOptions &options);
     
     std::unordered_map<std::string, MaPLFile *> getFiles();
     
+    /**
+     * Supplies the source text of a script in place of reading it from the filesystem. If text was previously supplied
+     * for the same path, the new text replaces it.
+     */
+    void setSourceForNormalizedPath(const std::filesystem::path &normalizedFilePath, const std::string &sourceText);
+    
+    /**
+     * Assigns a resolver that supplies the source text of any script that was not supplied via @c setSourceForNormalizedPath.
+     * If no resolver is assigned, those scripts are read from the filesystem.
+     */
+    void setImportResolver(const MaPLImportResolver &importResolver);
+    
+    /**
+     * Enables ANTLR's profiling of every parser decision for files parsed after this is set. Profiling slows parsing.
+     */
+    void setProfileParser(bool profileParser);
+    
+    /**
+     * @return @c true if files should record a profile of their parser decisions, retrievable via @c MaPLFile::getParserProfile().
+     */
+    bool shouldProfileParser();
+    
+    /**
+     * Reads the source text of a script from the supplied sources, the import resolver, or the filesystem (in that order of precedence).
+     * Text returned by the import resolver is cached until the next call to @c invalidateModifiedFiles, so it's resolved only
+     * once per path in each compilation.
+     *
+     * @return @c true if the script's source text was written into @c sourceText.
+     */
+    bool readSourceForNormalizedPath(const std::filesystem::path &normalizedFilePath, std::string &sourceText);
+    
+    /**
+     * @return @c true if the source text for the script at @c normalizedFilePath is read from the filesystem.
+     */
+    bool isSourceInFilesystem(const std::filesystem::path &normalizedFilePath);
+    
+    /**
+     * Removes every file that has changed on disk (or whose import resolver now supplies different text) since it was
+     * compiled, along with every file that depends on it. Removed files are recreated and recompiled the next time they are requested.
+     */
+    void invalidateModifiedFiles();
+    
 private:
     
     std::unordered_map<std::string, MaPLFile *> _files;
+    std::unordered_map<std::string, std::string> _sources;
+    std::unordered_map<std::string, std::string> _resolvedSources;
+    MaPLImportResolver _importResolver;
+    bool _profileParser = false;
 };
 
 #endif /* MaPLFileCache_h */
@@ -9,6 +9,7 @@
 #include "MaPLFile.h"
 
 MaPLVariableStack::MaPLVariableStack() :
+    _alignsPrimitiveVariables(false),
     _maximumPrimitiveMemoryUsed(0),
     _maximumAllocatedMemoryUsed(0)
 {
@@ -19,10 +20,33 @@ MaPLVariableStack::MaPLVariableStack() :
 void MaPLVariableStack::push() {
     std::unordered_map<std::string, MaPLVariable> pushedFrame;
     _stack.push_back(pushedFrame);
+    
+    // Nested scopes start allocating where the enclosing scope left off. Popping the frame discards
+    // everything allocated inside of it, so sibling scopes reuse the same memory.
+    if (_frameMemory.empty()) {
+        _frameMemory.push_back(MaPLVariableFrameMemory());
+    } else {
+        _frameMemory.push_back(_frameMemory.back());
+    }
 }
 
 void MaPLVariableStack::pop() {
     _stack.pop_back();
+    _frameMemory.pop_back();
+}
+
+void MaPLVariableStack::setAlignsPrimitiveVariables(bool alignsPrimitiveVariables) {
+    _alignsPrimitiveVariables = alignsPrimitiveVariables;
+}
+
+MaPLMemoryAddress MaPLVariableStack::alignedPrimitiveMemoryAddressOffset(MaPLMemoryAddress primitiveMemoryAddressOffset) {
+    if (!_alignsPrimitiveVariables) {
+        return primitiveMemoryAddressOffset;
+    }
+    // Round up to the largest primitive size so that relocated variables keep the alignment they had in
+    // the dependency. Rounding up (rather than down) guarantees relocated variables can't overlap this stack.
+    MaPLMemoryAddress largestAlignment = byteSizeOfType(MaPLPrimitiveType_Int64);
+    return (primitiveMemoryAddressOffset + largestAlignment - 1) & ~(largestAlignment - 1);
 }
 
 MaPLMemoryAddress MaPLVariableStack::getMaximumPrimitiveMemoryUsed() {
@@ -34,58 +58,35 @@ MaPLMemoryAddress MaPLVariableStack::getMaximumAllocatedMemoryUsed() {
 }
 
 bool MaPLVariableStack::declareVariable(const std::string &variableName, MaPLVariable variable) {
-    // Log an error if this variable was already declared elsewhere.
-    MaPLVariable existingVariable = getVariable(variableName);
-    if (existingVariable.type.primitiveType != MaPLPrimitiveType_Uninitialized) {
-        variable.file->logError(variable.token, "Variable '"+variableName+"' conflicts with a previously-declared variable of the same name.");
-        existingVariable.file->logError(existingVariable.token, "Variable '"+variableName+"' later comes into conflict with a variable of the same name.");
+    if (logConflictingVariable(variableName, variable)) {
         return false;
     }
     
     // Strings are a special case because they might need to allocate additional memory. This is unlike all other
     // MaPL types which are "POD" primitives that can be held in memory without needing to be freed later.
-    if (variable.type.primitiveType == MaPLPrimitiveType_String) {
-        // String memory addresses don't take into account the size of a string pointer. They're an index into a char* array.
-        // Calculate byte offset for this variable by summing the size of the existing allocated variables.
-        MaPLMemoryAddress currentOffset = 0;
-        for (const std::unordered_map<std::string, MaPLVariable> &frame : _stack) {
-            for (const auto&[name, variable] : frame) {
-                if (variable.type.primitiveType == MaPLPrimitiveType_String) {
-                    currentOffset++;
-                }
-            }
-        }
-        
-        // Calculate the highest memory usage for allocated variables.
-        variable.memoryAddress = currentOffset;
-        MaPLMemoryAddress currentMemoryUsed = currentOffset+1;
-        if (currentMemoryUsed > _maximumAllocatedMemoryUsed) {
-            _maximumAllocatedMemoryUsed = currentMemoryUsed;
-        }
-    } else {
-        // Primitive memory addresses must take into account the byte size of the primitive. They're in index into a byte array.
-        MaPLMemoryAddress variableSize = byteSizeOfType(variable.type.primitiveType);
+    MaPLMemoryAddress variableSize = 0;
+    if (variable.type.primitiveType != MaPLPrimitiveType_String) {
+        variableSize = byteSizeOfType(variable.type.primitiveType);
         if (!variableSize) {
-            variable.file->logError(variable.token, "Failure declaring variable '"+variableName+"' with ambiguous type.");
+            variable.file->logError(variable.location, "Failure declaring variable '"+variableName+"' with ambiguous type.");
             return false;
         }
-        
-        // Calculate byte offset for this variable by summing the size of the existing primitive variables.
-        MaPLMemoryAddress currentOffset = 0;
-        for (const std::unordered_map<std::string, MaPLVariable> &frame : _stack) {
-            for (const auto&[name, variable] : frame) {
-                if (variable.type.primitiveType != MaPLPrimitiveType_String) {
-                    currentOffset += byteSizeOfType(variable.type.primitiveType);
-                }
-            }
-        }
-        
-        // Calculate the highest memory usage for primitives.
-        variable.memoryAddress = currentOffset;
-        MaPLMemoryAddress currentMemoryUsed = currentOffset+variableSize;
-        if (currentMemoryUsed > _maximumPrimitiveMemoryUsed) {
-            _maximumPrimitiveMemoryUsed = currentMemoryUsed;
+    }
+    
+    if (variable.isUnread) {
+        // Nothing is ever stored for an unread variable, so it doesn't need any memory.
+        variable.memoryAddress = 0;
+    } else if (variable.type.primitiveType == MaPLPrimitiveType_String) {
+        // String memory addresses don't take into account the size of a string pointer. They're an index into a char* array.
+        MaPLVariableFrameMemory &memory = _frameMemory.back();
+        variable.memoryAddress = memory.allocatedMemoryUsed;
+        memory.allocatedMemoryUsed++;
+        if (memory.allocatedMemoryUsed > _maximumAllocatedMemoryUsed) {
+            _maximumAllocatedMemoryUsed = memory.allocatedMemoryUsed;
         }
+    } else {
+        // Primitive memory addresses must take into account the byte size of the primitive. They're in index into a byte array.
+        variable.memoryAddress = allocatePrimitiveMemory(variableSize);
     }
     
     // Insert the variable into the stack.
@@ -101,22 +102,75 @@ bool MaPLVariableStack::appendVariableStack(MaPLVariableStack *otherStack,
             continue;
         }
         MaPLMemoryAddress adjustedAddress = variable.memoryAddress;
-        if (!declareVariable(name, variable)) {
-            return false;
-        }
-        
-        // Redeclaring the variable will scramble its memory address because the global variables map
-        // is unordered. Calculate what the memory address should be and fix it after redeclaration.
         if (variable.type.primitiveType == MaPLPrimitiveType_String) {
             adjustedAddress += allocatedMemoryIndexOffset;
         } else {
             adjustedAddress += primitiveMemoryAddressOffset;
         }
+        
+        if (_alignsPrimitiveVariables) {
+            // The variable already has an address, so only reserve the memory it occupies.
+            MaPLVariable appendedVariable = variable;
+            appendedVariable.memoryAddress = adjustedAddress;
+            if (logConflictingVariable(name, appendedVariable)) {
+                return false;
+            }
+            _stack[_stack.size()-1][name] = appendedVariable;
+            reserveMemory(appendedVariable);
+            continue;
+        }
+        
+        // Redeclaring the variable will scramble its memory address because the global variables map
+        // is unordered. Calculate what the memory address should be and fix it after redeclaration.
+        if (!declareVariable(name, variable)) {
+            return false;
+        }
         _stack[_stack.size()-1][name].memoryAddress = adjustedAddress;
     }
+    if (_alignsPrimitiveVariables) {
+        // Nested scopes in the dependency may have used memory beyond its global variables. Variables declared after
+        // the dependency must start beyond that memory too, otherwise their addresses would be laid out differently
+        // when this file is itself imported, and the offset applied to its bytecode would also shift references to
+        // the dependency's variables.
+        MaPLVariableFrameMemory &memory = _frameMemory.back();
+        MaPLMemoryAddress primitiveMemoryUsed = otherStack->getMaximumPrimitiveMemoryUsed()+primitiveMemoryAddressOffset;
+        if (primitiveMemoryUsed > _maximumPrimitiveMemoryUsed) {
+            _maximumPrimitiveMemoryUsed = primitiveMemoryUsed;
+        }
+        if (primitiveMemoryUsed > memory.primitiveMemoryUsed) {
+            memory.primitiveMemoryUsed = primitiveMemoryUsed;
+        }
+        MaPLMemoryAddress allocatedMemoryUsed = otherStack->getMaximumAllocatedMemoryUsed()+allocatedMemoryIndexOffset;
+        if (allocatedMemoryUsed > _maximumAllocatedMemoryUsed) {
+            _maximumAllocatedMemoryUsed = allocatedMemoryUsed;
+        }
+        if (allocatedMemoryUsed > memory.allocatedMemoryUsed) {
+            memory.allocatedMemoryUsed = allocatedMemoryUsed;
+        }
+    }
     return true;
 }
 
+void MaPLVariableStack::inheritVariableStack(MaPLVariableStack *otherStack) {
+    MaPLVariableFrameMemory &memory = _frameMemory.back();
+    for (const auto&[name, variable] : otherStack->getGlobalVariables()) {
+        _stack[_stack.size()-1][name] = variable;
+        if (_alignsPrimitiveVariables) {
+            reserveMemory(variable);
+        } else if (variable.type.primitiveType == MaPLPrimitiveType_String) {
+            memory.allocatedMemoryUsed++;
+        } else {
+            memory.primitiveMemoryUsed += byteSizeOfType(variable.type.primitiveType);
+        }
+    }
+    if (otherStack->getMaximumPrimitiveMemoryUsed() > _maximumPrimitiveMemoryUsed) {
+        _maximumPrimitiveMemoryUsed = otherStack->getMaximumPrimitiveMemoryUsed();
+    }
+    if (otherStack->getMaximumAllocatedMemoryUsed() > _maximumAllocatedMemoryUsed) {
+        _maximumAllocatedMemoryUsed = otherStack->getMaximumAllocatedMemoryUsed();
+    }
+}
+
 MaPLVariable MaPLVariableStack::getVariable(const std::string &variableName) {
     for (const std::unordered_map<std::string, MaPLVariable> &frame : _stack) {
         if (frame.count(variableName)) {
@@ -141,3 +195,81 @@ void MaPLVariableStack::flagAllVariablesAsDependency() {
         }
     }
 }
+
+bool MaPLVariableStack::logConflictingVariable(const std::string &variableName, const MaPLVariable &variable) {
+    // Log an error if this variable was already declared elsewhere.
+    MaPLVariable existingVariable = getVariable(variableName);
+    if (existingVariable.type.primitiveType != MaPLPrimitiveType_Uninitialized) {
+        variable.file->logError(variable.location, "Variable '"+variableName+"' conflicts with a previously-declared variable of the same name.");
+        existingVariable.file->logError(existingVariable.location, "Variable '"+variableName+"' later comes into conflict with a variable of the same name.");
+        return true;
+    }
+    return false;
+}
+
+MaPLMemoryAddress MaPLVariableStack::allocatePrimitiveMemory(MaPLMemoryAddress byteSize) {
+    MaPLVariableFrameMemory &memory = _frameMemory.back();
+    MaPLMemoryAddress address = memory.primitiveMemoryUsed;
+    if (_alignsPrimitiveVariables) {
+        // Primitive sizes are all powers of 2, so the bucket for a size is its log2.
+        size_t sizeBucket = 0;
+        while ((MaPLMemoryAddress)(1 << sizeBucket) < byteSize) {
+            sizeBucket++;
+        }
+        
+        // Prefer filling a gap left behind by earlier padding. A gap that is larger than needed is split, and the
+        // unused remainder goes back into the smaller buckets (a 4-byte gap used for 1 byte leaves 1 and 2-byte gaps).
+        for (size_t gapBucket = sizeBucket; gapBucket < 3; gapBucket++) {
+            std::vector<MaPLMemoryAddress> &gaps = memory.primitiveGaps[gapBucket];
+            if (gaps.empty()) {
+                continue;
+            }
+            MaPLMemoryAddress gapAddress = gaps.back();
+            gaps.pop_back();
+            for (size_t remainderBucket = sizeBucket; remainderBucket < gapBucket; remainderBucket++) {
+                memory.primitiveGaps[remainderBucket].push_back(gapAddress + (1 << remainderBucket));
+            }
+            return gapAddress;
+        }
+        
+        // Pad up to the variable's natural alignment. The largest aligned gap that starts at an address is
+        // given by the address's lowest set bit, so the padding splits into at most one gap per bucket.
+        while (address % byteSize) {
+            MaPLMemoryAddress gapSize = address & -address;
+            size_t gapBucket = 0;
+            while ((MaPLMemoryAddress)(1 << gapBucket) < gapSize) {
+                gapBucket++;
+            }
+            memory.primitiveGaps[gapBucket].push_back(address);
+            address += gapSize;
+        }
+    }
+    
+    // Calculate the highest memory usage for primitives.
+    memory.primitiveMemoryUsed = address+byteSize;
+    if (memory.primitiveMemoryUsed > _maximumPrimitiveMemoryUsed) {
+        _maximumPrimitiveMemoryUsed = memory.primitiveMemoryUsed;
+    }
+    return address;
+}
+
+void MaPLVariableStack::reserveMemory(const MaPLVariable &variable) {
+    MaPLVariableFrameMemory &memory = _frameMemory.back();
+    if (variable.type.primitiveType == MaPLPrimitiveType_String) {
+        MaPLMemoryAddress endIndex = variable.memoryAddress+1;
+        if (endIndex > memory.allocatedMemoryUsed) {
+            memory.allocatedMemoryUsed = endIndex;
+        }
+        if (endIndex > _maximumAllocatedMemoryUsed) {
+            _maximumAllocatedMemoryUsed = endIndex;
+        }
+    } else {
+        MaPLMemoryAddress endAddress = variable.memoryAddress+byteSizeOfType(variable.type.primitiveType);
+        if (endAddress > memory.primitiveMemoryUsed) {
+            memory.primitiveMemoryUsed = endAddress;
+        }
+        if (endAddress > _maximumPrimitiveMemoryUsed) {
+            _maximumPrimitiveMemoryUsed = endAddress;
+        }
+    }
+}
@@ -23,12 +23,26 @@ struct MaPLVariable {
     MaPLType type;
     // The file in which this variable was declared.
     MaPLFile *file;
-    // The token which represents this variable declaration.
-    antlr4::Token *token;
+    // The location of this variable's declaration, used for logging errors.
+    MaPLSourceLocation location;
     // Specifies the location in the memory where this variable is stored.
     MaPLMemoryAddress memoryAddress;
     // Specifies if this variable was declared in a dependent file.
     bool declaredInDependency = false;
+    // Specifies if this variable is never read. Unread variables aren't given any memory.
+    bool isUnread = false;
+};
+
+/**
+ * Describes the memory that has been handed out to the variables of a single stack frame and all frames beneath it.
+ */
+struct MaPLVariableFrameMemory {
+    // The first byte of primitive memory that is not yet used by any variable.
+    MaPLMemoryAddress primitiveMemoryUsed = 0;
+    // The first index of allocated memory (strings) that is not yet used by any variable.
+    MaPLMemoryAddress allocatedMemoryUsed = 0;
+    // Naturally-aligned gaps that were skipped to align larger variables, bucketed by size (1, 2, and 4 bytes).
+    std::vector<MaPLMemoryAddress> primitiveGaps[3];
 };
 
 /**
@@ -49,6 +63,19 @@ public:
      */
     void pop();
     
+    /**
+     * When enabled, each primitive variable is placed at an address that is a multiple of its own size. Any padding
+     * skipped to satisfy this is handed out to later, smaller variables in the same scope. Otherwise variables are packed.
+     */
+    void setAlignsPrimitiveVariables(bool alignsPrimitiveVariables);
+    
+    /**
+     * Rounds the offset at which a dependency's primitive variables are relocated, so that the relocated variables keep their alignment.
+     *
+     * @return The offset to use instead of @c primitiveMemoryAddressOffset.
+     */
+    MaPLMemoryAddress alignedPrimitiveMemoryAddressOffset(MaPLMemoryAddress primitiveMemoryAddressOffset);
+    
     /**
      * @return The maximum number of bytes that this stack required to store all primitive variables, at any point during the parse tree traversal.
      */
@@ -60,7 +87,8 @@ public:
     MaPLMemoryAddress getMaximumAllocatedMemoryUsed();
 
     /**
-     * Inserts a new variable into the top stack frame. The variable will be assigned a new @c memoryAddress based on current contents of the stack.
+     * Inserts a new variable into the top stack frame. The variable will be assigned a new @c memoryAddress based on current contents of the stack,
+     * unless the variable is flagged as unread.
      *
      * @return @c true if declaration is successful.
      */
@@ -73,6 +101,12 @@ public:
                              MaPLMemoryAddress primitiveMemoryAddressOffset,
                              MaPLMemoryAddress allocatedMemoryIndexOffset);
     
+    /**
+     * Inserts all global variables from another stack into the top stack frame without changing their memory addresses.
+     * The memory usage of this stack is raised to match the other stack, so that subsequent declarations don't overlap it.
+     */
+    void inheritVariableStack(MaPLVariableStack *otherStack);
+    
     /**
      * @return The @c MaPLVariable with the given name. If the variable does not exist, its @c primitiveType will be @c MaPLPrimitiveType_TypeError.
      */
@@ -95,7 +129,13 @@ public:
     
 private:
     
+    bool logConflictingVariable(const std::string &variableName, const MaPLVariable &variable);
+    MaPLMemoryAddress allocatePrimitiveMemory(MaPLMemoryAddress byteSize);
+    void reserveMemory(const MaPLVariable &variable);
+    
     std::vector<std::unordered_map<std::string, MaPLVariable>> _stack;
+    std::vector<MaPLVariableFrameMemory> _frameMemory;
+    bool _alignsPrimitiveVariables;
     MaPLMemoryAddress _maximumPrimitiveMemoryUsed;
     MaPLMemoryAddress _maximumAllocatedMemoryUsed;
 };
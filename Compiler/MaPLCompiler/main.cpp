@@ -6,13 +6,18 @@
 //
 
 #include <stdio.h>
+#include <ctype.h>
 #include <fstream>
+#include <sstream>
 #include "MaPLCompiler.h"
 
 enum ArgumentExpectation {
     ArgumentExpectation_InputPath,
     ArgumentExpectation_OutputPath,
     ArgumentExpectation_SymbolTablePath,
+    ArgumentExpectation_BundlePath,
+    ArgumentExpectation_SymbolMapPath,
+    ArgumentExpectation_ProfilePath,
 };
 
 bool pathHasExtension(const std::filesystem::path &path, const std::string &extension) {
@@ -26,6 +31,19 @@ bool pathHasExtension(const std::filesystem::path &path, const std::string &exte
 void printUsage() {
     printf("Example usage: MaPLCompiler /path/to/file.mapl -o /path/to/output.maplb -s /path/to/symbol/table.h\n");
     printf("Specify the --debug flag to include debug info in the bytecode. This option increases bloat for bytecode size and runtime speed.\n");
+    printf("Specify the --link flag to link scripts against the bytecode of their imported scripts rather than copying it. Linked dependencies must be executed separately via 'executeMaPLDependency'.\n");
+    printf("Specify the --propagate-constants flag to substitute variables that are never reassigned with their constant initial values.\n");
+    printf("Specify the --eliminate-dead-stores flag to remove variables declared within scopes that are never read, and assignments that are overwritten before they're read. Each removal is reported as a warning.\n");
+    printf("Specify an optimization level with the -O flag (for example -O1) to apply peephole optimizations to the bytecode. The default is -O0.\n");
+    printf("Specify an unroll budget with the --unroll-budget flag (for example --unroll-budget=512) to limit how many bytes an unrolled loop may occupy at -O2 and higher. The default is 256, and 0 disables unrolling.\n");
+    printf("Specify the --compact flag to store addresses, symbols, cursor moves, and integer literals as variable-length integers. This option reduces bytecode size.\n");
+    printf("Specify the --line-table flag to write a table of line numbers alongside each '.maplb' file (with a '.mapldebug' extension), and a table of variables (with a '.mapldebugvars' extension). Unlike --debug, this option does not affect the bytecode.\n");
+    printf("Specify the --cost-report flag to write a JSON report of each script's static cost alongside each '.maplb' file (with a '.maplcost.json' extension). The report lists bytecode size per line, host call sites per symbol and their loop nesting depth, string allocations per line, and the size of the script's variable tables.\n");
+    printf("Specify the --typed-metadata flag to format values interpolated into metadata without allocating strings, and pass each metadata statement to the host in a single callback.\n");
+    printf("Specify the --profile-parser flag to print the time that the parser spends in each decision of the grammar, sorted from slowest to fastest.\n");
+    printf("Specify a symbol map path with the -m flag (for example -m /path/to/symbols.maplsymbols) to keep symbol values stable across compilations. Symbols are read from the file if it exists, and all assigned symbols are written back to it.\n");
+    printf("Specify an execution profile path with the -p flag (for example -p /path/to/profile.maplprofile) to lay out branches, order conditional chains, skip unrolling cold loops, and unroll loops that make most host calls further based on how the scripts behaved when the profile was recorded. The flag can be repeated to combine several profiles.\n");
+    printf("Specify a bundle path with the -b flag (for example -b /path/to/scripts.maplbundle) to also pack all compiled scripts into a single file that can be memory-mapped by the runtime.\n");
 }
 
 int main(int argc, const char ** argv) {
@@ -39,6 +57,9 @@ int main(int argc, const char ** argv) {
     std::vector<std::filesystem::path> scriptPaths;
     std::map<std::filesystem::path, std::filesystem::path> outputFileMap;
     std::filesystem::path symbolOutputPath;
+    std::filesystem::path bundleOutputPath;
+    std::filesystem::path symbolMapPath;
+    std::vector<std::filesystem::path> profilePaths;
     bool canTakeOutputFile = false;
     MaPLCompileOptions options{ false };
     ArgumentExpectation expectation = ArgumentExpectation_InputPath;
@@ -55,9 +76,63 @@ int main(int argc, const char ** argv) {
         } else if (arg == "-s") {
             expectation = ArgumentExpectation_SymbolTablePath;
             isFlag = true;
+        } else if (arg == "-b") {
+            expectation = ArgumentExpectation_BundlePath;
+            isFlag = true;
+        } else if (arg == "-m") {
+            expectation = ArgumentExpectation_SymbolMapPath;
+            isFlag = true;
+        } else if (arg == "-p") {
+            expectation = ArgumentExpectation_ProfilePath;
+            isFlag = true;
         } else if (arg == "--debug") {
             options.includeDebugBytes = true;
             isFlag = true;
+        } else if (arg == "--link") {
+            options.linkDependencies = true;
+            isFlag = true;
+        } else if (arg == "--propagate-constants") {
+            options.propagateConstants = true;
+            isFlag = true;
+        } else if (arg == "--eliminate-dead-stores") {
+            options.eliminateDeadStores = true;
+            isFlag = true;
+        } else if (arg == "--line-table") {
+            options.debugLineTable = true;
+            isFlag = true;
+        } else if (arg == "--cost-report") {
+            options.costReport = true;
+            isFlag = true;
+        } else if (arg == "--compact") {
+            options.compactEncoding = true;
+            isFlag = true;
+        } else if (arg == "--profile-parser") {
+            options.profileParser = true;
+            isFlag = true;
+        } else if (arg == "--typed-metadata") {
+            options.typedMetadata = true;
+            isFlag = true;
+        } else if (arg.rfind("--unroll-budget=", 0) == 0) {
+            std::string budgetString = arg.substr(sizeof("--unroll-budget=")-1);
+            uint32_t budget = 0;
+            bool isValidBudget = !budgetString.empty() && budgetString.length() <= 5;
+            for (char c : budgetString) {
+                if (!isdigit((unsigned char)c)) {
+                    isValidBudget = false;
+                    break;
+                }
+                budget = budget*10 + (c-'0');
+            }
+            if (!isValidBudget || budget > UINT16_MAX) {
+                printf("The unroll budget '%s' must be a whole number from 0 to %u.\n", budgetString.c_str(), UINT16_MAX);
+                printUsage();
+                return 1;
+            }
+            options.unrollBudget = (uint16_t)budget;
+            isFlag = true;
+        } else if (arg.length() == 3 && arg[0] == '-' && arg[1] == 'O' && isdigit(arg[2])) {
+            options.optimizationLevel = arg[2]-'0';
+            isFlag = true;
         }
         if (isFlag) {
             if (previousExpectation != ArgumentExpectation_InputPath) {
@@ -106,6 +181,31 @@ int main(int argc, const char ** argv) {
                 }
                 symbolOutputPath = argPath;
                 break;
+            case ArgumentExpectation_BundlePath:
+                if (!pathHasExtension(argPath, ".maplbundle")) {
+                    printf("The bundle path '%s' must have a '.maplbundle' file extension.\n", argv[i]);
+                    printUsage();
+                    return 1;
+                }
+                bundleOutputPath = argPath;
+                options.bundleScripts = true;
+                break;
+            case ArgumentExpectation_SymbolMapPath:
+                if (!pathHasExtension(argPath, ".maplsymbols")) {
+                    printf("The symbol map path '%s' must have a '.maplsymbols' file extension.\n", argv[i]);
+                    printUsage();
+                    return 1;
+                }
+                symbolMapPath = argPath;
+                break;
+            case ArgumentExpectation_ProfilePath:
+                if (!pathHasExtension(argPath, ".maplprofile")) {
+                    printf("The execution profile path '%s' must have a '.maplprofile' file extension.\n", argv[i]);
+                    printUsage();
+                    return 1;
+                }
+                profilePaths.push_back(argPath);
+                break;
         }
         if (expectation != ArgumentExpectation_InputPath) {
             canTakeOutputFile = false;
@@ -132,8 +232,65 @@ int main(int argc, const char ** argv) {
     options.symbolsPrefix = symbolOutputPath.filename().string();
     options.symbolsPrefix = options.symbolsPrefix.substr(0, options.symbolsPrefix.length()-2);
     
+    // Read the symbol values assigned by previous compilations. Each line is a symbol descriptor followed by its value.
+    if (!symbolMapPath.empty()) {
+        std::ifstream symbolMapInputStream(symbolMapPath);
+        std::string descriptor;
+        std::string symbolString;
+        while (symbolMapInputStream >> descriptor >> symbolString) {
+            if (options.persistedSymbols.count(descriptor)) {
+                printf("The symbol map '%s' lists the symbol '%s' more than once.\n", symbolMapPath.u8string().c_str(), descriptor.c_str());
+                return 1;
+            }
+            // Symbols are stored as MaPLSymbol in the bytecode, and 0 is never assigned.
+            uint32_t symbol = 0;
+            bool isValidSymbol = symbolString.length() <= 5;
+            for (char c : symbolString) {
+                if (!isdigit((unsigned char)c)) {
+                    isValidSymbol = false;
+                    break;
+                }
+                symbol = symbol*10 + (c-'0');
+            }
+            if (!isValidSymbol || symbol == 0 || symbol > UINT16_MAX) {
+                printf("The symbol map '%s' assigns '%s' to the symbol '%s', but symbol values must be from 1 to %u.\n", symbolMapPath.u8string().c_str(), symbolString.c_str(), descriptor.c_str(), UINT16_MAX);
+                return 1;
+            }
+            options.persistedSymbols[descriptor] = (MaPLSymbol)symbol;
+        }
+        if (symbolMapInputStream.is_open() && !symbolMapInputStream.eof()) {
+            printf("The symbol map '%s' is malformed.\n", symbolMapPath.u8string().c_str());
+            return 1;
+        }
+    }
+    
+    // Read the execution profiles. Script paths within each profile are relative to the profile's directory.
+    for (const std::filesystem::path &profilePath : profilePaths) {
+        std::ifstream profileInputStream(profilePath);
+        if (!profileInputStream) {
+            printf("Unable to read the execution profile '%s'.\n", profilePath.u8string().c_str());
+            return 1;
+        }
+        std::stringstream profileText;
+        profileText << profileInputStream.rdbuf();
+        if (!parseMaPLExecutionProfile(profileText.str(), profilePath.parent_path(), options.scriptProfiles)) {
+            printf("The execution profile '%s' is malformed.\n", profilePath.u8string().c_str());
+            return 1;
+        }
+    }
+    
     MaPLCompileResult result = compileMaPL(scriptPaths, options);
     
+    // Parser profiles are printed even if compilation fails, since syntax errors are often the slowest to parse.
+    for (const auto&[scriptPath, parserProfile] : result.parserProfiles) {
+        printf("Parser profile for '%s':\n%s", scriptPath.u8string().c_str(), parserProfile.c_str());
+    }
+    
+    // Warnings describe code that the compiler removed, which is worth knowing about even if compilation fails.
+    for (const std::string &warningString : result.warningMessages) {
+        fputs(warningString.c_str(), stderr);
+    }
+    
     // Check for errors and write to console.
     if (result.errorMessages.size()) {
         for (const std::string &errorString : result.errorMessages) {
@@ -154,6 +311,47 @@ int main(int argc, const char ** argv) {
         }
         std::ofstream bytecodeOutputStream(outputFileMap.at(scriptPath), std::ios::out | std::ios::binary);
         bytecodeOutputStream.write((char *)&(bytecode[0]), bytecode.size());
+        if (result.debugLineTables.count(scriptPath)) {
+            const std::vector<uint8_t> &lineTable = result.debugLineTables.at(scriptPath);
+            std::filesystem::path lineTablePath = outputFileMap.at(scriptPath);
+            std::ofstream lineTableOutputStream(lineTablePath.replace_extension(".mapldebug"), std::ios::out | std::ios::binary);
+            lineTableOutputStream.write((char *)lineTable.data(), lineTable.size());
+        }
+        if (result.debugVariableTables.count(scriptPath)) {
+            const std::vector<uint8_t> &variableTable = result.debugVariableTables.at(scriptPath);
+            std::filesystem::path variableTablePath = outputFileMap.at(scriptPath);
+            std::ofstream variableTableOutputStream(variableTablePath.replace_extension(".mapldebugvars"), std::ios::out | std::ios::binary);
+            variableTableOutputStream.write((char *)variableTable.data(), variableTable.size());
+        }
+        if (result.costReports.count(scriptPath)) {
+            std::filesystem::path costReportPath = outputFileMap.at(scriptPath);
+            std::ofstream costReportOutputStream(costReportPath.replace_extension(".maplcost.json"));
+            costReportOutputStream << result.costReports.at(scriptPath);
+        }
+    }
+    
+    // Write all assigned symbol values back to the symbol map.
+    if (!symbolMapPath.empty()) {
+        std::ofstream symbolMapOutputStream(symbolMapPath);
+        for (const auto&[descriptor, symbol] : result.persistedSymbols) {
+            symbolMapOutputStream << descriptor << " " << symbol << "\n";
+        }
+    }
+    
+    // Write the bundle to file.
+    if (!bundleOutputPath.empty()) {
+        std::ofstream bundleOutputStream(bundleOutputPath, std::ios::out | std::ios::binary);
+        bundleOutputStream.write((char *)&(result.bundle[0]), result.bundle.size());
+    }
+    
+    // Describe which scripts must be executed with a linked dependency.
+    for (const auto&[scriptPath, dependencyPath] : result.linkedDependencies) {
+        printf("'%s' is linked against '%s'.\n", scriptPath.u8string().c_str(), dependencyPath.u8string().c_str());
+    }
+    
+    // Describe how much bytecode was saved by peephole optimizations.
+    for (const auto&[scriptPath, bytesSaved] : result.peepholeBytesSaved) {
+        printf("Peephole optimizations removed %zu bytes from '%s'.\n", bytesSaved, scriptPath.u8string().c_str());
     }
     
     printf("All MaPL sources compiled successfully.\n");
@@ -581,9 +581,21 @@ MaPLArrayMap<Schema *> *schemasForPaths(const std::vector<std::filesystem::path>
         lexer->getErrorListenerDispatch().removeErrorListeners();
         parser->getErrorListenerDispatch().removeErrorListeners();
         lexer->addErrorListener(&errListener);
-        parser->addErrorListener(&errListener);
         
-        EaSLParser::SchemaContext *schemaContext = parser->schema();
+        // Attempt the faster SLL prediction mode first, and only fall back to full LL prediction if SLL
+        // fails. Errors are only reported by the LL pass so that they match what LL alone would report.
+        parser->getInterpreter<antlr4::atn::ParserATNSimulator>()->setPredictionMode(antlr4::atn::PredictionMode::SLL);
+        parser->setErrorHandler(std::make_shared<antlr4::BailErrorStrategy>());
+        EaSLParser::SchemaContext *schemaContext = NULL;
+        try {
+            schemaContext = parser->schema();
+        } catch (antlr4::ParseCancellationException &exception) {
+            parser->reset();
+            parser->addErrorListener(&errListener);
+            parser->setErrorHandler(std::make_shared<antlr4::DefaultErrorStrategy>());
+            parser->getInterpreter<antlr4::atn::ParserATNSimulator>()->setPredictionMode(antlr4::atn::PredictionMode::LL);
+            schemaContext = parser->schema();
+        }
         if (errListener._errorLogger->_hasLoggedError) {
             exit(1);
         }
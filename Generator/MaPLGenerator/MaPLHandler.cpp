@@ -9,6 +9,7 @@
 
 #include <fstream>
 #include <filesystem>
+#include <sstream>
 #include <stdlib.h>
 #include <string>
 #include <unordered_map>
@@ -27,7 +28,7 @@ struct MaPLStackFrame {
     std::filesystem::path path;
     std::unordered_map<std::string, void *> inParameters;
     std::unordered_map<std::string, void *> outParameters;
-    MaPLLineNumber currentLineNumber = 0;
+    std::vector<uint8_t> debugLineTable;
 };
 static std::ofstream *_outputStream = NULL;
 static std::vector<MaPLStackFrame> _stackFrames;
@@ -35,9 +36,23 @@ static MaPLArray<XmlFile *> *_xmlFiles;
 static MaPLArrayMap<Schema *> *_schemas;
 static const std::unordered_map<std::string, std::string> *_flags;
 static std::unordered_map<std::string, std::vector<uint8_t>> _bytecodeCache;
+static std::unordered_map<std::string, std::vector<uint8_t>> _debugLineTableCache;
+static std::unordered_map<std::string, MaPLExecutionProfile *> _executionProfiles;
 static std::unordered_set<std::string> _stringSet;
 static std::unordered_set<std::string> _spellcheckDictionary;
 
+// Metadata is written to the output file in large chunks. It's shared by all scripts, including those invoked from
+// within other scripts, so it must be flushed before anything else is written or the output file changes. Its capacity
+// is zero while no output file is open, so that metadata is passed straight to flushMetadata, which reports the error
+// at the line that wrote it.
+static void flushMetadata(const char* metadata, size_t length);
+static char _metadataStorage[1 << 16];
+static MaPLMetadataBuffer _metadataBuffer = { _metadataStorage, 0, 0, flushMetadata };
+
+MaPLLineNumber currentLineNumber(const MaPLStackFrame &frame) {
+    return findMaPLDebugLine(frame.debugLineTable.data(), frame.debugLineTable.size(), currentMaPLStatementPosition());
+}
+
 std::filesystem::path normalizedParamPath(const char *pathParam) {
     std::filesystem::path path = pathParam;
     if (path.is_relative()) {
@@ -78,7 +93,7 @@ static MaPLParameter invokeFunction(void *invokedOnPointer, MaPLSymbol functionS
             const std::string &argString = argv[0].stringValue;
             if (!_flags->count(argString)) {
                 MaPLStackFrame &frame = _stackFrames[_stackFrames.size()-1];
-                fprintf(stderr, "%s:%d: error: Attempted to reference missing flag '%s'. (Runtime)\n", frame.path.u8string().c_str(), frame.currentLineNumber, argv[0].stringValue);
+                fprintf(stderr, "%s:%d: error: Attempted to reference missing flag '%s'. (Runtime)\n", frame.path.u8string().c_str(), currentLineNumber(frame), argv[0].stringValue);
                 exit(1);
             }
             return MaPLStringByReference(_flags->at(argString).c_str());
@@ -90,7 +105,7 @@ static MaPLParameter invokeFunction(void *invokedOnPointer, MaPLSymbol functionS
         }
         case MaPLSymbols_GLOBAL_error_string: {
             MaPLStackFrame &frame = _stackFrames[_stackFrames.size()-1];
-            fprintf(stderr, "%s:%d: error: %s (Runtime)\n", frame.path.u8string().c_str(), frame.currentLineNumber, argv[0].stringValue);
+            fprintf(stderr, "%s:%d: error: %s (Runtime)\n", frame.path.u8string().c_str(), currentLineNumber(frame), argv[0].stringValue);
             exit(1);
         }
             break;
@@ -241,10 +256,12 @@ static MaPLParameter invokeFunction(void *invokedOnPointer, MaPLSymbol functionS
             return returnValue;
         }
         case MaPLSymbols_GLOBAL_outputToFile_string: {
+            flushMaPLMetadataBuffer(&_metadataBuffer);
             delete _outputStream;
             std::filesystem::path normalizedPath = normalizedParamPath(argv[0].stringValue);
             createDirectoriesIfNeeded(normalizedPath);
             _outputStream = new std::ofstream(normalizedPath, std::ios::out | std::ios::binary);
+            _metadataBuffer.capacity = sizeof(_metadataStorage);
             printf("Outputting to file: '%s'\n", normalizedPath.u8string().c_str());
             return MaPLVoid();
         }
@@ -263,9 +280,10 @@ static MaPLParameter invokeFunction(void *invokedOnPointer, MaPLSymbol functionS
         case MaPLSymbols_GLOBAL_writeToFile_VARIADIC: {
             MaPLStackFrame &frame = _stackFrames[_stackFrames.size()-1];
             if (!_outputStream) {
-                fprintf(stderr, "%s:%d: error: Attempted to write to file before any output file was specified. (Runtime)\n", frame.path.u8string().c_str(), frame.currentLineNumber);
+                fprintf(stderr, "%s:%d: error: Attempted to write to file before any output file was specified. (Runtime)\n", frame.path.u8string().c_str(), currentLineNumber(frame));
                 exit(1);
             }
+            flushMaPLMetadataBuffer(&_metadataBuffer);
             for (MaPLParameterCount i = 0; i < argc; i++) {
                 switch (argv[i].dataType) {
                     case MaPLDataType_char:
@@ -296,7 +314,7 @@ static MaPLParameter invokeFunction(void *invokedOnPointer, MaPLSymbol functionS
                         _outputStream->write((char *)&(argv[i].booleanValue), sizeof(argv[i].booleanValue));
                         break;
                     default:
-                        fprintf(stderr, "%s:%d: error: MaPL argument at index %d was invalid type. (Runtime)\n", frame.path.u8string().c_str(), frame.currentLineNumber, i);
+                        fprintf(stderr, "%s:%d: error: MaPL argument at index %d was invalid type. (Runtime)\n", frame.path.u8string().c_str(), currentLineNumber(frame), i);
                         exit(1);
                         break;
                 }
@@ -403,17 +421,13 @@ static void assignSubscript(void *invokedOnPointer, MaPLParameter index, MaPLPar
     }
 }
 
-static void metadata(const char* metadataString) {
+static void flushMetadata(const char* metadata, size_t length) {
     MaPLStackFrame &frame = _stackFrames[_stackFrames.size()-1];
     if (!_outputStream) {
-        fprintf(stderr, "%s:%d: error: Attempted to write metadata to file before any output file was specified. (Runtime)\n", frame.path.u8string().c_str(), frame.currentLineNumber);
+        fprintf(stderr, "%s:%d: error: Attempted to write metadata to file before any output file was specified. (Runtime)\n", frame.path.u8string().c_str(), currentLineNumber(frame));
         exit(1);
     }
-    *_outputStream << metadataString;
-}
-
-static void debugLine(MaPLLineNumber lineNumber) {
-    _stackFrames[_stackFrames.size()-1].currentLineNumber = lineNumber;
+    _outputStream->write(metadata, length);
 }
 
 static void error(MaPLRuntimeError error) {
@@ -439,15 +453,88 @@ static void error(MaPLRuntimeError error) {
             break;
     }
     MaPLStackFrame &frame = _stackFrames[_stackFrames.size()-1];
-    fprintf(stderr, "%s:%d: error: %s (Runtime)\n", frame.path.u8string().c_str(), frame.currentLineNumber, errString);
+    fprintf(stderr, "%s:%d: error: %s (Runtime)\n", frame.path.u8string().c_str(), currentLineNumber(frame), errString);
     exit(1);
 }
 
+MaPLCompileOptions generatorCompileOptions() {
+    // Line numbers are only needed to report errors, so they're kept in a separate table rather than slowing down the bytecode.
+    MaPLCompileOptions options{ false };
+    options.debugLineTable = true;
+    // Enables the peephole optimizer and loop unrolling. A profile passed via "maplProfile" additionally
+    // inverts conditionals, reorders conditional chains, and adjusts the unroll budget of each loop.
+    options.optimizationLevel = 2;
+    if (_flags->count("maplRecordProfile")) {
+        // Unrolled loops would be recorded as straight-line code, so profiles are recorded from the loops as written.
+        options.unrollBudget = 0;
+    }
+    // Schemas and XML are fully loaded before any script runs, and never change afterward. Marking these
+    // APIs as invariant allows loops like "i < schema.classes.count" to query the host only once.
+    options.invariantSymbols = {
+        "GLOBAL_schemas",
+        "GLOBAL_xmlFiles",
+        "GLOBAL_length_string",
+        "GLOBAL_hash_string",
+        "GLOBAL_toUpper_string",
+        "GLOBAL_toLower_string",
+        "Array_count",
+        "ArrayMap_contains_string",
+        "Schema_namespace",
+        "Schema_enums",
+        "Schema_classes",
+        "SchemaEnum_name",
+        "SchemaEnum_cases",
+        "SchemaEnum_annotations",
+        "SchemaEnumCase_name",
+        "SchemaEnumCase_annotations",
+        "SchemaClass_name",
+        "SchemaClass_namespace",
+        "SchemaClass_superclass",
+        "SchemaClass_descendantClasses",
+        "SchemaClass_attributes",
+        "SchemaClass_annotations",
+        "SchemaAttribute_name",
+        "SchemaAttribute_typeName",
+        "SchemaAttribute_typeNamespace",
+        "SchemaAttribute_typeIsUIDReference",
+        "SchemaAttribute_typeIsClass",
+        "SchemaAttribute_typeIsEnum",
+        "SchemaAttribute_isStringType",
+        "SchemaAttribute_annotations",
+        "SchemaAttribute_defaultValues",
+        "SchemaAttribute_minOccurrences",
+        "SchemaAttribute_maxOccurrences",
+        "XMLFile_rootNode",
+        "XMLFile_filePath",
+        "XMLNode_name",
+        "XMLNode_namespace",
+        "XMLNode_attributes",
+        "XMLNode_children",
+        "XMLNode_childrenBySequence",
+        "XMLAttribute_name",
+        "XMLAttribute_value",
+        "XMLAttribute_values",
+    };
+    // A profile recorded by a previous run (via the "maplRecordProfile" flag) optimizes the templates for the
+    // branches that they take most often.
+    if (_flags->count("maplProfile")) {
+        std::filesystem::path profilePath = std::filesystem::absolute(_flags->at("maplProfile")).lexically_normal();
+        std::ifstream profileInputStream(profilePath);
+        std::stringstream profileText;
+        profileText << profileInputStream.rdbuf();
+        if (!profileInputStream || !parseMaPLExecutionProfile(profileText.str(), profilePath.parent_path(), options.scriptProfiles)) {
+            fprintf(stderr, "Unable to read the MaPL execution profile '%s'.\n", profilePath.u8string().c_str());
+            exit(1);
+        }
+    }
+    return options;
+}
+
 void invokeScript(const std::filesystem::path &scriptPath) {
     if (!std::filesystem::exists(scriptPath)) {
         if (_stackFrames.size() > 0) {
             MaPLStackFrame &frame = _stackFrames[_stackFrames.size()-1];
-            fprintf(stderr, "%s:%d: error: Attempted to run script in non-existent file '%s'. (Runtime)\n", frame.path.u8string().c_str(), frame.currentLineNumber, scriptPath.u8string().c_str());
+            fprintf(stderr, "%s:%d: error: Attempted to run script in non-existent file '%s'. (Runtime)\n", frame.path.u8string().c_str(), currentLineNumber(frame), scriptPath.u8string().c_str());
         } else {
             fprintf(stderr, "Attempted to run script in non-existent file '%s'.\n", scriptPath.u8string().c_str());
         }
@@ -464,8 +551,9 @@ void invokeScript(const std::filesystem::path &scriptPath) {
     std::string pathString = scriptPath.string();
     std::vector<uint8_t> bytecode;
     if (_bytecodeCache.count(pathString) == 0) {
-        MaPLCompileOptions options{ true };
-        MaPLCompileResult result = compileMaPL({ scriptPath }, options);
+        // Scripts commonly share imports, so reuse one session to avoid recompiling them for each script.
+        static MaPLCompileSession compileSession(generatorCompileOptions());
+        MaPLCompileResult result = compileSession.compile({ scriptPath });
         
         if (result.errorMessages.size()) {
             for (const std::string &errorMessage : result.errorMessages) {
@@ -477,20 +565,28 @@ void invokeScript(const std::filesystem::path &scriptPath) {
         // There should be only one compiled file, grab the first one.
         bytecode = result.compiledFiles.begin()->second;
         _bytecodeCache[pathString] = bytecode;
+        _debugLineTableCache[pathString] = result.debugLineTables.begin()->second;
+        if (_flags->count("maplRecordProfile")) {
+            _executionProfiles[pathString] = createMaPLExecutionProfile((MaPLBytecodeLength)bytecode.size());
+        }
     } else {
         bytecode = _bytecodeCache.at(pathString);
     }
+    _stackFrames[_stackFrames.size()-1].debugLineTable = _debugLineTableCache.at(pathString);
     
     MaPLCallbacks callbacks{
         invokeFunction,
         invokeSubscript,
         assignProperty,
         assignSubscript,
-        metadata,
-        debugLine,
+        NULL,
+        NULL,
         NULL,
         NULL,
         error,
+        NULL,
+        &_metadataBuffer,
+        _executionProfiles.count(pathString) ? _executionProfiles.at(pathString) : NULL,
     };
     executeMaPLScript(&(bytecode[0]), bytecode.size(), &callbacks);
     
@@ -507,5 +603,28 @@ void invokeScript(const std::filesystem::path &scriptPath,
     invokeScript(scriptPath);
     delete _outputStream;
     _outputStream = NULL;
+    _metadataBuffer.capacity = 0;
     _stringSet.clear();
 }
+
+void writeExecutionProfile(const std::unordered_map<std::string, std::string> &flags) {
+    if (!flags.count("maplRecordProfile")) {
+        return;
+    }
+    // Scripts are named relative to the profile, so the profile can be moved or checked in alongside the templates.
+    std::filesystem::path profilePath = std::filesystem::absolute(flags.at("maplRecordProfile")).lexically_normal();
+    createDirectoriesIfNeeded(profilePath);
+    FILE *profileFile = fopen(profilePath.u8string().c_str(), "w");
+    if (!profileFile) {
+        fprintf(stderr, "Unable to write the MaPL execution profile '%s'.\n", profilePath.u8string().c_str());
+        exit(1);
+    }
+    for (const auto&[pathString, executionProfile] : _executionProfiles) {
+        const std::vector<uint8_t> &debugLineTable = _debugLineTableCache.at(pathString);
+        std::string scriptName = std::filesystem::path(pathString).lexically_relative(profilePath.parent_path()).generic_string();
+        writeMaPLExecutionProfile(executionProfile, debugLineTable.data(), debugLineTable.size(), scriptName.c_str(), profileFile);
+        freeMaPLExecutionProfile(executionProfile);
+    }
+    _executionProfiles.clear();
+    fclose(profileFile);
+}
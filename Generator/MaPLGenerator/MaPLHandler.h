@@ -20,4 +20,6 @@ void invokeScript(const std::filesystem::path &scriptPath,
                   MaPLArrayMap<Schema *> *schemas,
                   const std::unordered_map<std::string, std::string> &flags);
 
+void writeExecutionProfile(const std::unordered_map<std::string, std::string> &flags);
+
 #endif /* MaPLHandler_h */
@@ -80,6 +80,7 @@ int main(int argc, const char * argv[]) {
     for (const std::filesystem::path &scriptPath : scriptPaths) {
         invokeScript(scriptPath, xmlNodes, schemas, flags);
     }
+    writeExecutionProfile(flags);
     
     printf("\nMaPLGenerator completed successfully.\n");
     return 0;
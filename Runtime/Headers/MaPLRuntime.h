@@ -97,6 +97,45 @@ typedef enum {
     MaPLRuntimeError_incompatibleEndianness,
 } MaPLRuntimeError;
 
+/**
+ * Accumulates metadata so that the host receives it in large chunks rather than one callback per section.
+ */
+typedef struct {
+    /// Storage for pending metadata. Not null-terminated. If @c flush is NULL, this must be NULL or allocated with malloc,
+    /// because the runtime grows it with realloc, and the host is responsible for freeing it.
+    char *buffer;
+    
+    /// The byte length of @c buffer.
+    size_t capacity;
+    
+    /// The number of bytes of pending metadata at the start of @c buffer.
+    size_t length;
+    
+    /// Optional. Invoked with all pending metadata whenever @c buffer is full, and when each script finishes executing.
+    /// Metadata that is larger than @c capacity is passed directly to this callback without being copied. If NULL, @c buffer
+    /// grows to hold all metadata, which the host can read after the script finishes.
+    void (*flush)(const char* metadata, size_t length);
+} MaPLMetadataBuffer;
+
+/**
+ * Counts how often each branch and host call in a script executes. Created via @c createMaPLExecutionProfile, and written to a
+ * profile file via @c writeMaPLExecutionProfile, which the compiler uses to optimize the script for the paths taken most often.
+ */
+typedef struct {
+    /// Indexed by bytecode position. The number of times that the condition of the branch instruction at each position was true,
+    /// meaning that a conditional entered its scope or a loop repeated.
+    uint64_t *branchTakenCounts;
+    
+    /// Indexed by bytecode position. The number of times that the condition of the branch instruction at each position was false.
+    uint64_t *branchNotTakenCounts;
+    
+    /// Indexed by bytecode position. The number of times that the function or property invocation at each position called the host.
+    uint64_t *callCounts;
+    
+    /// The number of elements in each array, which is the byte length of the profiled script.
+    MaPLBytecodeLength length;
+} MaPLExecutionProfile;
+
 /**
  * A struct that holds all the function pointers that the MaPL runtime uses to interact with the host program. The error method will be invoked if required callbacks are NULL.
  */
@@ -123,6 +162,19 @@ typedef struct {
     
     /// Optional. Error callback is invoked when the script has encountered an error and cannot continue. If callback is NULL, script will fail silently.
     void (*error)(MaPLRuntimeError error);
+    
+    /// Optional. If non-NULL, metadata is passed to this callback instead of @c metadata. The text is not null-terminated, and
+    /// is only valid until the callback returns. Scripts compiled with the --typed-metadata flag pass each metadata statement
+    /// in a single invocation, formatted into a buffer that the runtime reuses for the rest of the script.
+    void (*metadataSink)(const char* metadata, size_t length);
+    
+    /// Optional. If non-NULL, metadata is accumulated in this buffer instead of being passed to @c metadata or @c metadataSink.
+    /// The same buffer can be shared by scripts that are executed from within another script's callbacks.
+    MaPLMetadataBuffer *metadataBuffer;
+    
+    /// Optional. If non-NULL, the runtime counts how often each branch and host call executes. Every script executed with these
+    /// callbacks must be the one that the profile was created for. Slows execution, so it's typically only set while recording a profile.
+    MaPLExecutionProfile *executionProfile;
 } MaPLCallbacks;
 
 /**
@@ -134,6 +186,126 @@ typedef struct {
  */
 void executeMaPLScript(const void* scriptBuffer, MaPLBytecodeLength bufferLength, const MaPLCallbacks *callbacks);
 
+/**
+ * The retained variable tables of a script that was executed via @c executeMaPLDependency.
+ */
+typedef struct MaPLDependency MaPLDependency;
+
+/**
+ * Executes a compiled MaPL script that other scripts are linked against (scripts compiled with the @c --link flag). The
+ * variables declared by this script are retained after execution so that any number of linked scripts can start from them.
+ *
+ * @param scriptBuffer An array of compiled bytes generated by the MaPL compiler.
+ * @param bufferLength The byte length of @c scriptBuffer.
+ * @param dependency The dependency that @c scriptBuffer itself is linked against. NULL if the script was not linked.
+ * @param callbacks A struct of callbacks that determines how the MaPL runtime should interact with the host program during script execution.
+ *
+ * @return The retained state of the script, which must be released with @c freeMaPLDependency. NULL if the script encountered an error.
+ */
+MaPLDependency *executeMaPLDependency(const void* scriptBuffer, MaPLBytecodeLength bufferLength, const MaPLDependency *dependency, const MaPLCallbacks *callbacks);
+
+/**
+ * Executes a compiled MaPL script that is linked against a dependency. Execution starts with a copy of the dependency's
+ * variables, so changes made by this script are not visible to other scripts linked against the same dependency.
+ *
+ * @param scriptBuffer An array of compiled bytes generated by the MaPL compiler.
+ * @param bufferLength The byte length of @c scriptBuffer.
+ * @param dependency The dependency that @c scriptBuffer was linked against at compile time.
+ * @param callbacks A struct of callbacks that determines how the MaPL runtime should interact with the host program during script execution.
+ */
+void executeMaPLLinkedScript(const void* scriptBuffer, MaPLBytecodeLength bufferLength, const MaPLDependency *dependency, const MaPLCallbacks *callbacks);
+
+/**
+ * Releases the variables retained by @c executeMaPLDependency.
+ */
+void freeMaPLDependency(MaPLDependency *dependency);
+
+/**
+ * Passes all pending metadata in @c metadataBuffer to its flush callback. Hosts that produce output of their own (besides
+ * metadata) call this from within a callback before doing so, so that pending metadata is output first.
+ */
+void flushMaPLMetadataBuffer(MaPLMetadataBuffer *metadataBuffer);
+
+/**
+ * Can only be called from within a callback. Identifies which statement of the innermost executing script invoked the callback.
+ *
+ * @return The position in the bytecode of the statement that is currently executing. Passed to @c findMaPLDebugLine, this allows the
+ *         host to report line numbers (including in the error callback) for scripts that were compiled without debug info.
+ */
+MaPLBytecodeLength currentMaPLStatementPosition(void);
+
+/**
+ * Finds the line number of a statement in a debug line table generated by the MaPL compiler.
+ *
+ * @param lineTable The debug line table that was generated alongside the script's bytecode.
+ * @param tableLength The byte length of @c lineTable.
+ * @param bytecodePosition A position within the script's bytecode, typically from @c currentMaPLStatementPosition.
+ *
+ * @return The line number of the statement at @c bytecodePosition. 0 if the statement has no line number (for example, if it was imported from another script).
+ */
+MaPLLineNumber findMaPLDebugLine(const void *lineTable, size_t tableLength, MaPLBytecodeLength bytecodePosition);
+
+/**
+ * Finds a variable that is in scope at a position in the bytecode, in a debug variable table generated by the MaPL compiler.
+ *
+ * @param variableTable The debug variable table that was generated alongside the script's bytecode.
+ * @param tableLength The byte length of @c variableTable.
+ * @param bytecodePosition A position within the script's bytecode, typically from @c currentMaPLStatementPosition.
+ * @param variableName The name of the variable.
+ *
+ * @return The table's entry for the variable, which can be passed to @c readMaPLDebugVariable. NULL if no variable with that name is in scope.
+ */
+const MaPLDebugVariableEntry *findMaPLDebugVariable(const void *variableTable, size_t tableLength, MaPLBytecodeLength bytecodePosition, const char *variableName);
+
+/**
+ * Can only be called from within a callback. Reads the value of a variable of the innermost executing script.
+ *
+ * @param variable An entry from the script's debug variable table, typically from @c findMaPLDebugVariable.
+ *
+ * @return The current value of the variable. Strings are owned by the script, and are only valid until the callback returns.
+ */
+MaPLParameter readMaPLDebugVariable(const MaPLDebugVariableEntry *variable);
+
+/**
+ * Creates a profile with all counts set to 0, which can be assigned to @c MaPLCallbacks::executionProfile.
+ *
+ * @param scriptLength The byte length of the script that will be profiled.
+ *
+ * @return The profile, which must be released with @c freeMaPLExecutionProfile.
+ */
+MaPLExecutionProfile *createMaPLExecutionProfile(MaPLBytecodeLength scriptLength);
+
+/**
+ * Releases a profile created by @c createMaPLExecutionProfile.
+ */
+void freeMaPLExecutionProfile(MaPLExecutionProfile *profile);
+
+/**
+ * Writes the counts in a profile to a text file that can be passed to the compiler. Counts are identified by the line and column of
+ * their statement, so the script must be compiled with a debug line table. Profiles of many scripts (or many runs of the same script)
+ * can be written to the same file, and the compiler sums the counts for each script.
+ *
+ * @param profile The profile that was recorded while executing the script.
+ * @param lineTable The debug line table that was generated alongside the script's bytecode.
+ * @param tableLength The byte length of @c lineTable.
+ * @param scriptName The path of the script. The compiler resolves relative paths against the directory that contains the profile file.
+ * @param file The file to write to.
+ */
+void writeMaPLExecutionProfile(const MaPLExecutionProfile *profile, const void *lineTable, size_t tableLength, const char *scriptName, FILE *file);
+
+/**
+ * Finds a script within a bundle generated by the MaPL compiler. The bundle is only read, never copied or modified,
+ * so it can be memory-mapped from disk and its scripts executed directly from the mapped pages.
+ *
+ * @param bundleBuffer The bytes of the bundle.
+ * @param bundleLength The byte length of @c bundleBuffer.
+ * @param scriptName The path of the script, relative to the deepest directory that contains all bundled scripts (for example "ui/menu.mapl").
+ * @param outScriptLength Receives the byte length of the script.
+ *
+ * @return The script's bytecode, which can be passed to any of the execute functions and remains valid for as long as @c bundleBuffer does. NULL if the bundle is malformed or doesn't contain the script.
+ */
+const void *findMaPLBundleScript(const void *bundleBuffer, size_t bundleLength, const char *scriptName, MaPLBytecodeLength *outScriptLength);
+
 #ifdef __cplusplus
 }
 #endif
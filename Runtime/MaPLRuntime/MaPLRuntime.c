@@ -22,14 +22,25 @@ typedef enum {
 typedef struct {
     const uint8_t* scriptBuffer;
     size_t cursorPosition;
+    size_t statementPosition;
     uint8_t *primitiveTable;
     const char **stringTable;
     const MaPLCallbacks *callbacks;
     bool isDeadCodepath;
+    bool isCompactEncoding;
+    bool isPooledStrings;
     MaPLExecutionState executionState;
     MaPLRuntimeError errorType;
+    // Typed metadata is formatted into this buffer, which is reused by every metadata statement in the script.
+    char *metadataBuffer;
+    size_t metadataLength;
+    size_t metadataCapacity;
 } MaPLExecutionContext;
 
+// The context of the innermost script that is currently executing on this thread. Scripts can be executed from within
+// the callbacks of other scripts, so each execution restores the previous context when it finishes.
+static _Thread_local const MaPLExecutionContext *activeContext = NULL;
+
 uint8_t evaluateChar(MaPLExecutionContext *context);
 int32_t evaluateInt32(MaPLExecutionContext *context);
 int64_t evaluateInt64(MaPLExecutionContext *context);
@@ -169,13 +180,39 @@ MaPLInstruction readInstruction(MaPLExecutionContext *context) {
     return instruction;
 }
 
+uint64_t readUnsignedVarint(MaPLExecutionContext *context) {
+    // LEB128: 7 bits of value per byte, least significant first. The high bit is set on every byte except the last.
+    uint64_t value = 0;
+    uint8_t shift = 0;
+    uint8_t byte;
+    do {
+        byte = context->scriptBuffer[context->cursorPosition];
+        context->cursorPosition++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return value;
+}
+
+int64_t readSignedVarint(MaPLExecutionContext *context) {
+    // Signed values are zigzag encoded, so the lowest bit holds the sign.
+    uint64_t value = readUnsignedVarint(context);
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
 MaPLMemoryAddress readMemoryAddress(MaPLExecutionContext *context) {
+    if (context->isCompactEncoding) {
+        return (MaPLMemoryAddress)readUnsignedVarint(context);
+    }
     MaPLMemoryAddress address = *((MaPLMemoryAddress *)(context->scriptBuffer+context->cursorPosition));
     context->cursorPosition += sizeof(MaPLMemoryAddress);
     return address;
 }
 
 MaPLBytecodeLength readCursorMove(MaPLExecutionContext *context) {
+    if (context->isCompactEncoding) {
+        return (MaPLBytecodeLength)readUnsignedVarint(context);
+    }
     MaPLBytecodeLength move = *((MaPLBytecodeLength *)(context->scriptBuffer+context->cursorPosition));
     context->cursorPosition += sizeof(MaPLBytecodeLength);
     return move;
@@ -188,6 +225,9 @@ MaPLParameterCount readParameterCount(MaPLExecutionContext *context) {
 }
 
 MaPLSymbol readSymbol(MaPLExecutionContext *context) {
+    if (context->isCompactEncoding) {
+        return (MaPLSymbol)readUnsignedVarint(context);
+    }
     MaPLSymbol symbol = *((MaPLSymbol *)(context->scriptBuffer+context->cursorPosition));
     context->cursorPosition += sizeof(MaPLSymbol);
     return symbol;
@@ -199,6 +239,16 @@ const char *readString(MaPLExecutionContext *context) {
     return string;
 }
 
+const char *readStringLiteral(MaPLExecutionContext *context) {
+    if (context->isPooledStrings) {
+        // The string is stored in the bundle's string pool, at an offset relative to the start of this script.
+        int32_t offset = *((int32_t *)(context->scriptBuffer+context->cursorPosition));
+        context->cursorPosition += sizeof(int32_t);
+        return (const char *)(context->scriptBuffer+offset);
+    }
+    return readString(context);
+}
+
 const char *concatenateStrings(const char *taggedString1, const char *taggedString2) {
     const char *untaggedString1 = untagString(taggedString1);
     const char *untaggedString2 = untagString(taggedString2);
@@ -241,6 +291,7 @@ MaPLParameter evaluateParameter(MaPLExecutionContext *context) {
 
 MaPLParameter evaluateFunctionInvocation(MaPLExecutionContext *context) {
     // This function assumes that we've already advanced past the initial "function_invocation" byte.
+    size_t invocationPosition = context->cursorPosition - sizeof(MaPLInstruction);
     void *invokedOnPointer = NULL;
     if (context->scriptBuffer[context->cursorPosition] == MaPLInstruction_no_op) {
         // This function is not invoked on another pointer, it's a global call.
@@ -282,6 +333,10 @@ MaPLParameter evaluateFunctionInvocation(MaPLExecutionContext *context) {
     }
     MaPLParameter returnValue = MaPLUninitialized();
     if (context->executionState == MaPLExecutionState_continue && !context->isDeadCodepath) {
+        MaPLExecutionProfile *profile = context->callbacks->executionProfile;
+        if (profile && invocationPosition < profile->length) {
+            profile->callCounts[invocationPosition]++;
+        }
         returnValue = context->callbacks->invokeFunction(invokedOnPointer,
                                                          symbol,
                                                          parameterList,
@@ -427,6 +482,9 @@ uint8_t evaluateChar(MaPLExecutionContext *context) {
 int32_t evaluateInt32(MaPLExecutionContext *context) {
     switch(readInstruction(context)) {
         case MAPL_INSTRUCTION_INT32_LITERAL: {
+            if (context->isCompactEncoding) {
+                return (int32_t)readSignedVarint(context);
+            }
             int32_t literal = *((int32_t *)(context->scriptBuffer+context->cursorPosition));
             context->cursorPosition += sizeof(int32_t);
             return literal;
@@ -520,6 +578,9 @@ int32_t evaluateInt32(MaPLExecutionContext *context) {
 int64_t evaluateInt64(MaPLExecutionContext *context) {
     switch(readInstruction(context)) {
         case MAPL_INSTRUCTION_INT64_LITERAL: {
+            if (context->isCompactEncoding) {
+                return (int64_t)readSignedVarint(context);
+            }
             int64_t literal = *((int64_t *)(context->scriptBuffer+context->cursorPosition));
             context->cursorPosition += sizeof(int64_t);
             return literal;
@@ -613,6 +674,9 @@ int64_t evaluateInt64(MaPLExecutionContext *context) {
 uint32_t evaluateUint32(MaPLExecutionContext *context) {
     switch(readInstruction(context)) {
         case MAPL_INSTRUCTION_UINT32_LITERAL: {
+            if (context->isCompactEncoding) {
+                return (uint32_t)readUnsignedVarint(context);
+            }
             uint32_t literal = *((uint32_t *)(context->scriptBuffer+context->cursorPosition));
             context->cursorPosition += sizeof(uint32_t);
             return literal;
@@ -704,6 +768,9 @@ uint32_t evaluateUint32(MaPLExecutionContext *context) {
 uint64_t evaluateUint64(MaPLExecutionContext *context) {
     switch(readInstruction(context)) {
         case MAPL_INSTRUCTION_UINT64_LITERAL: {
+            if (context->isCompactEncoding) {
+                return (uint64_t)readUnsignedVarint(context);
+            }
             uint64_t literal = *((uint64_t *)(context->scriptBuffer+context->cursorPosition));
             context->cursorPosition += sizeof(uint64_t);
             return literal;
@@ -1225,7 +1292,7 @@ void *evaluatePointer(MaPLExecutionContext *context) {
 const char *evaluateString(MaPLExecutionContext *context) {
     switch(readInstruction(context)) {
         case MAPL_INSTRUCTION_STRING_LITERAL: {
-            return readString(context);
+            return readStringLiteral(context);
         }
         case MAPL_INSTRUCTION_STRING_VARIABLE:
             return tagStringAsNotAllocated(context->stringTable[readMemoryAddress(context)]);
@@ -1350,6 +1417,467 @@ const char *evaluateString(MaPLExecutionContext *context) {
     return NULL;
 }
 
+void flushMaPLMetadataBuffer(MaPLMetadataBuffer *metadataBuffer) {
+    if (!metadataBuffer->flush || metadataBuffer->length == 0) {
+        return;
+    }
+    metadataBuffer->flush(metadataBuffer->buffer, metadataBuffer->length);
+    metadataBuffer->length = 0;
+}
+
+// Passes metadata to the host via whichever callback the host provided. The metadata must be null-terminated.
+void outputMetadata(MaPLExecutionContext *context, const char *metadata, size_t length) {
+    MaPLMetadataBuffer *metadataBuffer = context->callbacks->metadataBuffer;
+    if (metadataBuffer) {
+        if (metadataBuffer->length + length > metadataBuffer->capacity) {
+            if (metadataBuffer->flush) {
+                flushMaPLMetadataBuffer(metadataBuffer);
+                if (length > metadataBuffer->capacity) {
+                    metadataBuffer->flush(metadata, length);
+                    return;
+                }
+            } else {
+                size_t newCapacity = metadataBuffer->capacity ? metadataBuffer->capacity : 4096;
+                while (newCapacity < metadataBuffer->length + length) {
+                    newCapacity *= 2;
+                }
+                metadataBuffer->buffer = realloc(metadataBuffer->buffer, newCapacity);
+                metadataBuffer->capacity = newCapacity;
+            }
+        }
+        memcpy(metadataBuffer->buffer+metadataBuffer->length, metadata, length);
+        metadataBuffer->length += length;
+    } else if (context->callbacks->metadataSink) {
+        context->callbacks->metadataSink(metadata, length);
+    } else if (context->callbacks->metadata) {
+        context->callbacks->metadata(metadata);
+    }
+}
+
+void appendMetadata(MaPLExecutionContext *context, const char *text, size_t length) {
+    // Always leave room for a null terminator.
+    size_t requiredCapacity = context->metadataLength + length + 1;
+    if (requiredCapacity > context->metadataCapacity) {
+        size_t newCapacity = context->metadataCapacity ? context->metadataCapacity : 256;
+        while (newCapacity < requiredCapacity) {
+            newCapacity *= 2;
+        }
+        context->metadataBuffer = realloc(context->metadataBuffer, newCapacity);
+        context->metadataCapacity = newCapacity;
+    }
+    memcpy(context->metadataBuffer+context->metadataLength, text, length);
+    context->metadataLength += length;
+}
+
+void appendMetadataInteger(MaPLExecutionContext *context, uint64_t magnitude, bool isNegative) {
+    // Digits are written from least to most significant, ending at the end of the buffer.
+    char buffer[21];
+    char *start = buffer+sizeof(buffer);
+    do {
+        start--;
+        *start = '0' + (char)(magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+    if (isNegative) {
+        start--;
+        *start = '-';
+    }
+    appendMetadata(context, start, buffer+sizeof(buffer)-start);
+}
+
+bool metadataFloatRoundTrips(const char *formattedValue, double value, bool isFloat32) {
+    if (isFloat32) {
+        return strtof(formattedValue, NULL) == (float)value;
+    }
+    return strtod(formattedValue, NULL) == value;
+}
+
+void appendMetadataFloatBySearch(MaPLExecutionContext *context, double value, bool isFloat32) {
+    // Precisions that round-trip are contiguous (every precision above one that round-trips also does), so binary search.
+    // The longest %.17g output is 24 characters (sign, 17 digits, point, and a 4-character exponent), so this never truncates.
+    char buffer[64];
+    int minPrecision = 1;
+    int maxPrecision = isFloat32 ? 9 : 17;
+    while (minPrecision < maxPrecision) {
+        int precision = (minPrecision+maxPrecision)/2;
+        int length = snprintf(buffer, sizeof(buffer), "%.*g", precision, value);
+        if (length > 0 && (size_t)length < sizeof(buffer) && metadataFloatRoundTrips(buffer, value, isFloat32)) {
+            maxPrecision = precision;
+        } else {
+            minPrecision = precision+1;
+        }
+    }
+    int length = snprintf(buffer, sizeof(buffer), "%.*g", minPrecision, value);
+    if (length < 0) {
+        return;
+    }
+    appendMetadata(context, buffer, (size_t)length < sizeof(buffer) ? (size_t)length : sizeof(buffer)-1);
+}
+
+// Shortest float output uses Grisu3 (Loitsch, "Printing Floating-Point Numbers Quickly and Accurately with Integers").
+// Values are held as a 64-bit significand times a power of two, and scaled by a cached power of ten so that digits
+// can be generated with integer arithmetic.
+typedef struct {
+    uint64_t significand;
+    int exponent;
+} MaPLDiyFloat;
+
+typedef struct {
+    uint64_t significand;
+    int16_t binaryExponent;
+    int16_t decimalExponent;
+} MaPLCachedPowerOfTen;
+
+// Normalized powers of ten from 10^-348 to 10^340 in steps of 8, each rounded to the nearest 64-bit significand.
+static const MaPLCachedPowerOfTen cachedPowersOfTen[] = {
+    { 0xFA8FD5A0081C0288ULL, -1220, -348 },
+    { 0xBAAEE17FA23EBF76ULL, -1193, -340 },
+    { 0x8B16FB203055AC76ULL, -1166, -332 },
+    { 0xCF42894A5DCE35EAULL, -1140, -324 },
+    { 0x9A6BB0AA55653B2DULL, -1113, -316 },
+    { 0xE61ACF033D1A45DFULL, -1087, -308 },
+    { 0xAB70FE17C79AC6CAULL, -1060, -300 },
+    { 0xFF77B1FCBEBCDC4FULL, -1034, -292 },
+    { 0xBE5691EF416BD60CULL, -1007, -284 },
+    { 0x8DD01FAD907FFC3CULL, -980, -276 },
+    { 0xD3515C2831559A83ULL, -954, -268 },
+    { 0x9D71AC8FADA6C9B5ULL, -927, -260 },
+    { 0xEA9C227723EE8BCBULL, -901, -252 },
+    { 0xAECC49914078536DULL, -874, -244 },
+    { 0x823C12795DB6CE57ULL, -847, -236 },
+    { 0xC21094364DFB5637ULL, -821, -228 },
+    { 0x9096EA6F3848984FULL, -794, -220 },
+    { 0xD77485CB25823AC7ULL, -768, -212 },
+    { 0xA086CFCD97BF97F4ULL, -741, -204 },
+    { 0xEF340A98172AACE5ULL, -715, -196 },
+    { 0xB23867FB2A35B28EULL, -688, -188 },
+    { 0x84C8D4DFD2C63F3BULL, -661, -180 },
+    { 0xC5DD44271AD3CDBAULL, -635, -172 },
+    { 0x936B9FCEBB25C996ULL, -608, -164 },
+    { 0xDBAC6C247D62A584ULL, -582, -156 },
+    { 0xA3AB66580D5FDAF6ULL, -555, -148 },
+    { 0xF3E2F893DEC3F126ULL, -529, -140 },
+    { 0xB5B5ADA8AAFF80B8ULL, -502, -132 },
+    { 0x87625F056C7C4A8BULL, -475, -124 },
+    { 0xC9BCFF6034C13053ULL, -449, -116 },
+    { 0x964E858C91BA2655ULL, -422, -108 },
+    { 0xDFF9772470297EBDULL, -396, -100 },
+    { 0xA6DFBD9FB8E5B88FULL, -369, -92 },
+    { 0xF8A95FCF88747D94ULL, -343, -84 },
+    { 0xB94470938FA89BCFULL, -316, -76 },
+    { 0x8A08F0F8BF0F156BULL, -289, -68 },
+    { 0xCDB02555653131B6ULL, -263, -60 },
+    { 0x993FE2C6D07B7FACULL, -236, -52 },
+    { 0xE45C10C42A2B3B06ULL, -210, -44 },
+    { 0xAA242499697392D3ULL, -183, -36 },
+    { 0xFD87B5F28300CA0EULL, -157, -28 },
+    { 0xBCE5086492111AEBULL, -130, -20 },
+    { 0x8CBCCC096F5088CCULL, -103, -12 },
+    { 0xD1B71758E219652CULL, -77, -4 },
+    { 0x9C40000000000000ULL, -50, 4 },
+    { 0xE8D4A51000000000ULL, -24, 12 },
+    { 0xAD78EBC5AC620000ULL, 3, 20 },
+    { 0x813F3978F8940984ULL, 30, 28 },
+    { 0xC097CE7BC90715B3ULL, 56, 36 },
+    { 0x8F7E32CE7BEA5C70ULL, 83, 44 },
+    { 0xD5D238A4ABE98068ULL, 109, 52 },
+    { 0x9F4F2726179A2245ULL, 136, 60 },
+    { 0xED63A231D4C4FB27ULL, 162, 68 },
+    { 0xB0DE65388CC8ADA8ULL, 189, 76 },
+    { 0x83C7088E1AAB65DBULL, 216, 84 },
+    { 0xC45D1DF942711D9AULL, 242, 92 },
+    { 0x924D692CA61BE758ULL, 269, 100 },
+    { 0xDA01EE641A708DEAULL, 295, 108 },
+    { 0xA26DA3999AEF774AULL, 322, 116 },
+    { 0xF209787BB47D6B85ULL, 348, 124 },
+    { 0xB454E4A179DD1877ULL, 375, 132 },
+    { 0x865B86925B9BC5C2ULL, 402, 140 },
+    { 0xC83553C5C8965D3DULL, 428, 148 },
+    { 0x952AB45CFA97A0B3ULL, 455, 156 },
+    { 0xDE469FBD99A05FE3ULL, 481, 164 },
+    { 0xA59BC234DB398C25ULL, 508, 172 },
+    { 0xF6C69A72A3989F5CULL, 534, 180 },
+    { 0xB7DCBF5354E9BECEULL, 561, 188 },
+    { 0x88FCF317F22241E2ULL, 588, 196 },
+    { 0xCC20CE9BD35C78A5ULL, 614, 204 },
+    { 0x98165AF37B2153DFULL, 641, 212 },
+    { 0xE2A0B5DC971F303AULL, 667, 220 },
+    { 0xA8D9D1535CE3B396ULL, 694, 228 },
+    { 0xFB9B7CD9A4A7443CULL, 720, 236 },
+    { 0xBB764C4CA7A44410ULL, 747, 244 },
+    { 0x8BAB8EEFB6409C1AULL, 774, 252 },
+    { 0xD01FEF10A657842CULL, 800, 260 },
+    { 0x9B10A4E5E9913129ULL, 827, 268 },
+    { 0xE7109BFBA19C0C9DULL, 853, 276 },
+    { 0xAC2820D9623BF429ULL, 880, 284 },
+    { 0x80444B5E7AA7CF85ULL, 907, 292 },
+    { 0xBF21E44003ACDD2DULL, 933, 300 },
+    { 0x8E679C2F5E44FF8FULL, 960, 308 },
+    { 0xD433179D9C8CB841ULL, 986, 316 },
+    { 0x9E19DB92B4E31BA9ULL, 1013, 324 },
+    { 0xEB96BF6EBADF77D9ULL, 1039, 332 },
+    { 0xAF87023B9BF0EE6BULL, 1066, 340 },
+};
+
+MaPLDiyFloat multiplyDiyFloats(MaPLDiyFloat x, MaPLDiyFloat y) {
+    // Only the upper 64 bits of the 128-bit product are kept, rounded to nearest.
+    uint64_t a = x.significand >> 32;
+    uint64_t b = x.significand & 0xFFFFFFFF;
+    uint64_t c = y.significand >> 32;
+    uint64_t d = y.significand & 0xFFFFFFFF;
+    uint64_t ad = a*d;
+    uint64_t bc = b*c;
+    uint64_t middle = ((b*d) >> 32) + (ad & 0xFFFFFFFF) + (bc & 0xFFFFFFFF) + (1ULL << 31);
+    MaPLDiyFloat product = { a*c + (ad >> 32) + (bc >> 32) + (middle >> 32), x.exponent + y.exponent + 64 };
+    return product;
+}
+
+MaPLDiyFloat normalizeDiyFloat(MaPLDiyFloat value) {
+    while (!(value.significand & 0x8000000000000000ULL)) {
+        value.significand <<= 1;
+        value.exponent--;
+    }
+    return value;
+}
+
+bool roundWeedDigits(char *digits, int digitCount, uint64_t distanceTooHighW, uint64_t unsafeInterval, uint64_t rest, uint64_t tenKappa, uint64_t unit) {
+    // Move the last digit down toward the exact value while that stays inside the safe interval and gets closer.
+    uint64_t smallDistance = distanceTooHighW - unit;
+    uint64_t bigDistance = distanceTooHighW + unit;
+    while (rest < smallDistance &&
+           unsafeInterval - rest >= tenKappa &&
+           (rest + tenKappa < smallDistance || smallDistance - rest >= rest + tenKappa - smallDistance)) {
+        digits[digitCount-1]--;
+        rest += tenKappa;
+    }
+    // If the imprecision of the scaled value leaves another candidate that might be closer, the result isn't provable.
+    if (rest < bigDistance &&
+        unsafeInterval - rest >= tenKappa &&
+        (rest + tenKappa < bigDistance || bigDistance - rest > rest + tenKappa - bigDistance)) {
+        return false;
+    }
+    return 2*unit <= rest && rest <= unsafeInterval - 4*unit;
+}
+
+bool generateShortestDigits(MaPLDiyFloat low, MaPLDiyFloat value, MaPLDiyFloat high, char *digits, int *outDigitCount, int *outKappa) {
+    // The boundaries are widened by one unit to account for the error of the scaled values. Digits are generated
+    // from the upper boundary until the remainder falls inside that (unsafe) interval.
+    uint64_t unit = 1;
+    uint64_t tooHigh = high.significand + unit;
+    uint64_t unsafeInterval = tooHigh - (low.significand - unit);
+    int fractionBits = -value.exponent;
+    uint64_t one = 1ULL << fractionBits;
+    uint32_t integrals = (uint32_t)(tooHigh >> fractionBits);
+    uint64_t fractionals = tooHigh & (one - 1);
+    uint32_t divisor = 1;
+    int kappa = 1;
+    while (kappa < 10 && integrals / divisor >= 10) {
+        divisor *= 10;
+        kappa++;
+    }
+    int digitCount = 0;
+    while (kappa > 0) {
+        digits[digitCount++] = (char)('0' + integrals / divisor);
+        integrals %= divisor;
+        kappa--;
+        uint64_t rest = ((uint64_t)integrals << fractionBits) + fractionals;
+        if (rest < unsafeInterval) {
+            *outDigitCount = digitCount;
+            *outKappa = kappa;
+            return roundWeedDigits(digits, digitCount, tooHigh - value.significand, unsafeInterval, rest, (uint64_t)divisor << fractionBits, unit);
+        }
+        divisor /= 10;
+    }
+    for (;;) {
+        fractionals *= 10;
+        unit *= 10;
+        unsafeInterval *= 10;
+        digits[digitCount++] = (char)('0' + (fractionals >> fractionBits));
+        fractionals &= one - 1;
+        kappa--;
+        if (fractionals < unsafeInterval) {
+            *outDigitCount = digitCount;
+            *outKappa = kappa;
+            return roundWeedDigits(digits, digitCount, (tooHigh - value.significand) * unit, unsafeInterval, fractionals, one, unit);
+        }
+        if (digitCount == 17) {
+            return false;
+        }
+    }
+}
+
+bool shortestFloatDigits(double value, bool isFloat32, char *digits, int *outDigitCount, int *outDecimalExponent) {
+    // Decompose the positive, finite, nonzero value into its integer significand and binary exponent.
+    uint64_t significand;
+    int exponent;
+    bool isLowerBoundaryCloser;
+    if (isFloat32) {
+        float floatValue = (float)value;
+        uint32_t bits;
+        memcpy(&bits, &floatValue, sizeof(bits));
+        uint32_t biasedExponent = (bits >> 23) & 0xFF;
+        significand = bits & 0x7FFFFF;
+        exponent = biasedExponent ? (int)biasedExponent-150 : -149;
+        isLowerBoundaryCloser = significand == 0 && biasedExponent > 1;
+        if (biasedExponent) {
+            significand |= 0x800000;
+        }
+    } else {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        uint32_t biasedExponent = (uint32_t)(bits >> 52) & 0x7FF;
+        significand = bits & 0xFFFFFFFFFFFFFULL;
+        exponent = biasedExponent ? (int)biasedExponent-1075 : -1074;
+        isLowerBoundaryCloser = significand == 0 && biasedExponent > 1;
+        if (biasedExponent) {
+            significand |= 0x10000000000000ULL;
+        }
+    }
+    // Every value between the midpoints to the neighboring floats parses back to this value. At a power of two
+    // the float below is half as far away.
+    MaPLDiyFloat upper = { (significand << 1) + 1, exponent-1 };
+    upper = normalizeDiyFloat(upper);
+    MaPLDiyFloat lower = { (significand << 1) - 1, exponent-1 };
+    if (isLowerBoundaryCloser) {
+        lower.significand = (significand << 2) - 1;
+        lower.exponent = exponent-2;
+    }
+    lower.significand <<= lower.exponent - upper.exponent;
+    lower.exponent = upper.exponent;
+    MaPLDiyFloat normalized = { significand, exponent };
+    normalized = normalizeDiyFloat(normalized);
+    
+    // Scale by the cached power of ten that brings the binary exponent into [-60, -32].
+    int k = (int)ceil((-60 - (normalized.exponent + 64) + 63) * 0.30102999566398114);
+    const MaPLCachedPowerOfTen *cachedPower = &cachedPowersOfTen[(348 + k - 1) / 8 + 1];
+    MaPLDiyFloat power = { cachedPower->significand, cachedPower->binaryExponent };
+    int kappa;
+    if (!generateShortestDigits(multiplyDiyFloats(lower, power), multiplyDiyFloats(normalized, power), multiplyDiyFloats(upper, power), digits, outDigitCount, &kappa)) {
+        return false;
+    }
+    *outDecimalExponent = kappa - cachedPower->decimalExponent;
+    return true;
+}
+
+void appendMetadataFloat(MaPLExecutionContext *context, double value, bool isFloat32) {
+    // Floats are formatted as %g with the fewest significant digits that parse back to the same value. A whole number
+    // that is exactly representable and doesn't end in 0 is printed by %g as its plain digits.
+    double maxExactInteger = isFloat32 ? 16777216.0 : 9007199254740992.0;
+    if (value == floor(value) && fabs(value) < maxExactInteger && !(value == 0 && signbit(value))) {
+        uint64_t magnitude = (uint64_t)fabs(value);
+        if (magnitude % 10 != 0 || magnitude == 0) {
+            appendMetadataInteger(context, magnitude, value < 0);
+            return;
+        }
+    }
+    char digits[18];
+    int digitCount;
+    int decimalExponent;
+    if (!isfinite(value) || value == 0 || !shortestFloatDigits(fabs(value), isFloat32, digits, &digitCount, &decimalExponent)) {
+        // Grisu3 can't prove the shortest digits for about 0.5% of values. Those, and -0, inf and nan, go through printf.
+        appendMetadataFloatBySearch(context, value, isFloat32);
+        return;
+    }
+    while (digitCount > 1 && digits[digitCount-1] == '0') {
+        digitCount--;
+        decimalExponent++;
+    }
+    
+    // Lay out the digits as %.<digitCount>g would, with trailing zeros removed.
+    char buffer[32];
+    size_t length = 0;
+    if (value < 0) {
+        buffer[length++] = '-';
+    }
+    int scientificExponent = digitCount + decimalExponent - 1;
+    if (scientificExponent < -4 || scientificExponent >= digitCount) {
+        buffer[length++] = digits[0];
+        if (digitCount > 1) {
+            buffer[length++] = '.';
+            memcpy(buffer+length, digits+1, digitCount-1);
+            length += digitCount-1;
+        }
+        buffer[length++] = 'e';
+        buffer[length++] = scientificExponent < 0 ? '-' : '+';
+        int exponentMagnitude = abs(scientificExponent);
+        if (exponentMagnitude >= 100) {
+            buffer[length++] = (char)('0' + exponentMagnitude / 100);
+        }
+        buffer[length++] = (char)('0' + exponentMagnitude / 10 % 10);
+        buffer[length++] = (char)('0' + exponentMagnitude % 10);
+    } else if (scientificExponent < 0) {
+        memcpy(buffer+length, "0.0000", 1-scientificExponent);
+        length += 1-scientificExponent;
+        memcpy(buffer+length, digits, digitCount);
+        length += digitCount;
+    } else {
+        memcpy(buffer+length, digits, scientificExponent+1);
+        length += scientificExponent+1;
+        if (digitCount > scientificExponent+1) {
+            buffer[length++] = '.';
+            memcpy(buffer+length, digits+scientificExponent+1, digitCount-scientificExponent-1);
+            length += digitCount-scientificExponent-1;
+        }
+    }
+    appendMetadata(context, buffer, length);
+}
+
+void appendMetadataSection(MaPLExecutionContext *context) {
+    switch (typeForInstruction(context->scriptBuffer[context->cursorPosition])) {
+        case MaPLDataType_char:
+            appendMetadataInteger(context, evaluateChar(context), false);
+            break;
+        case MaPLDataType_int32: {
+            int32_t value = evaluateInt32(context);
+            appendMetadataInteger(context, value < 0 ? 0-(uint64_t)value : (uint64_t)value, value < 0);
+        }
+            break;
+        case MaPLDataType_int64: {
+            int64_t value = evaluateInt64(context);
+            appendMetadataInteger(context, value < 0 ? 0-(uint64_t)value : (uint64_t)value, value < 0);
+        }
+            break;
+        case MaPLDataType_uint32:
+            appendMetadataInteger(context, evaluateUint32(context), false);
+            break;
+        case MaPLDataType_uint64:
+            appendMetadataInteger(context, evaluateUint64(context), false);
+            break;
+        case MaPLDataType_float32:
+            appendMetadataFloat(context, evaluateFloat32(context), true);
+            break;
+        case MaPLDataType_float64:
+            appendMetadataFloat(context, evaluateFloat64(context), false);
+            break;
+        case MaPLDataType_boolean:
+            if (evaluateBool(context)) {
+                appendMetadata(context, "true", 4);
+            } else {
+                appendMetadata(context, "false", 5);
+            }
+            break;
+        case MaPLDataType_pointer: {
+            char buffer[24];
+            int length = snprintf(buffer, sizeof(buffer), "0x%#016lX", (uintptr_t)evaluatePointer(context));
+            appendMetadata(context, buffer, (size_t)length);
+        }
+            break;
+        case MaPLDataType_string: {
+            const char *taggedString = evaluateString(context);
+            const char *string = untagString(taggedString);
+            if (string) {
+                appendMetadata(context, string, strlen(string));
+            }
+            freeStringIfNeeded(taggedString);
+        }
+            break;
+        default:
+            context->executionState = MaPLExecutionState_error;
+            context->errorType = MaPLRuntimeError_malformedBytecode;
+            break;
+    }
+}
+
 MaPLParameter applyOperatorAssign(MaPLExecutionContext *context, MaPLInstruction operatorAssignInstruction, MaPLParameter *initialValue, MaPLParameter *incrementValue) {
     MaPLParameter result = MaPLUninitialized();
     if (verifyReturnValue(context, initialValue, incrementValue->dataType)) {
@@ -1547,6 +2075,69 @@ MaPLParameter applyOperatorAssign(MaPLExecutionContext *context, MaPLInstruction
     return result;
 }
 
+uint64_t evaluateSwitchValue(MaPLExecutionContext *context, bool *isSigned) {
+    *isSigned = false;
+    switch (typeForInstruction(context->scriptBuffer[context->cursorPosition])) {
+        case MaPLDataType_char:
+            return evaluateChar(context);
+        case MaPLDataType_int32:
+            *isSigned = true;
+            return (uint64_t)(int64_t)evaluateInt32(context);
+        case MaPLDataType_int64:
+            *isSigned = true;
+            return (uint64_t)evaluateInt64(context);
+        case MaPLDataType_uint32:
+            return evaluateUint32(context);
+        case MaPLDataType_uint64:
+            return evaluateUint64(context);
+        default:
+            context->executionState = MaPLExecutionState_error;
+            context->errorType = MaPLRuntimeError_malformedBytecode;
+            return 0;
+    }
+}
+
+void moveToSwitchCase(MaPLExecutionContext *context, size_t cursorMoveLocation) {
+    MaPLBytecodeLength move = *((MaPLBytecodeLength *)(context->scriptBuffer+cursorMoveLocation));
+    context->cursorPosition = cursorMoveLocation + sizeof(MaPLBytecodeLength) + move;
+}
+
+void recordBranch(MaPLExecutionContext *context, bool isTaken) {
+    // Branches are always statements, so they're identified by the position of the statement.
+    MaPLExecutionProfile *profile = context->callbacks->executionProfile;
+    if (!profile || context->statementPosition >= profile->length) {
+        return;
+    }
+    if (isTaken) {
+        profile->branchTakenCounts[context->statementPosition]++;
+    } else {
+        profile->branchNotTakenCounts[context->statementPosition]++;
+    }
+}
+
+void moveBackIfComparisonHolds(MaPLExecutionContext *context, MaPLInstruction comparison, int ordering) {
+    // Comparisons are grouped by operator, so the operator can be found from the range that the instruction falls in.
+    bool isComparisonTrue;
+    if (comparison <= MaPLInstruction_logical_equality_pointer) {
+        isComparisonTrue = ordering == 0;
+    } else if (comparison <= MaPLInstruction_logical_inequality_pointer) {
+        isComparisonTrue = ordering != 0;
+    } else if (comparison <= MaPLInstruction_logical_less_than_float64) {
+        isComparisonTrue = ordering < 0;
+    } else if (comparison <= MaPLInstruction_logical_less_than_equal_float64) {
+        isComparisonTrue = ordering <= 0;
+    } else if (comparison <= MaPLInstruction_logical_greater_than_float64) {
+        isComparisonTrue = ordering > 0;
+    } else {
+        isComparisonTrue = ordering >= 0;
+    }
+    MaPLBytecodeLength move = readCursorMove(context);
+    recordBranch(context, isComparisonTrue);
+    if (isComparisonTrue) {
+        context->cursorPosition -= move;
+    }
+}
+
 void evaluateStatement(MaPLExecutionContext *context) {
     switch(readInstruction(context)) {
         case MAPL_INSTRUCTION_UNUSED_RETURN_FUNCTION_INVOCATION: {
@@ -1737,6 +2328,7 @@ void evaluateStatement(MaPLExecutionContext *context) {
         case MAPL_INSTRUCTION_CONDITIONAL: {
             bool conditional = evaluateBool(context);
             MaPLBytecodeLength move = readCursorMove(context);
+            recordBranch(context, conditional);
             if (!conditional) {
                 context->cursorPosition += move;
             }
@@ -1752,6 +2344,55 @@ void evaluateStatement(MaPLExecutionContext *context) {
             context->cursorPosition -= move;
         }
             break;
+        case MAPL_INSTRUCTION_CONDITIONAL_CURSOR_MOVE_BACK: {
+            bool conditional = evaluateBool(context);
+            MaPLBytecodeLength move = readCursorMove(context);
+            recordBranch(context, conditional);
+            if (conditional) {
+                context->cursorPosition -= move;
+            }
+        }
+            break;
+        case MAPL_INSTRUCTION_CHAR_COMPARE_LITERAL_CURSOR_MOVE_BACK: {
+            MaPLInstruction comparison = readInstruction(context);
+            uint8_t variable = *((uint8_t *)(context->primitiveTable+readMemoryAddress(context)));
+            uint8_t literal = *((uint8_t *)(context->scriptBuffer+context->cursorPosition));
+            context->cursorPosition += sizeof(uint8_t);
+            moveBackIfComparisonHolds(context, comparison, (variable > literal) - (variable < literal));
+        }
+            break;
+        case MAPL_INSTRUCTION_INT32_COMPARE_LITERAL_CURSOR_MOVE_BACK: {
+            MaPLInstruction comparison = readInstruction(context);
+            int32_t variable = *((int32_t *)(context->primitiveTable+readMemoryAddress(context)));
+            int32_t literal = *((int32_t *)(context->scriptBuffer+context->cursorPosition));
+            context->cursorPosition += sizeof(int32_t);
+            moveBackIfComparisonHolds(context, comparison, (variable > literal) - (variable < literal));
+        }
+            break;
+        case MAPL_INSTRUCTION_INT64_COMPARE_LITERAL_CURSOR_MOVE_BACK: {
+            MaPLInstruction comparison = readInstruction(context);
+            int64_t variable = *((int64_t *)(context->primitiveTable+readMemoryAddress(context)));
+            int64_t literal = *((int64_t *)(context->scriptBuffer+context->cursorPosition));
+            context->cursorPosition += sizeof(int64_t);
+            moveBackIfComparisonHolds(context, comparison, (variable > literal) - (variable < literal));
+        }
+            break;
+        case MAPL_INSTRUCTION_UINT32_COMPARE_LITERAL_CURSOR_MOVE_BACK: {
+            MaPLInstruction comparison = readInstruction(context);
+            uint32_t variable = *((uint32_t *)(context->primitiveTable+readMemoryAddress(context)));
+            uint32_t literal = *((uint32_t *)(context->scriptBuffer+context->cursorPosition));
+            context->cursorPosition += sizeof(uint32_t);
+            moveBackIfComparisonHolds(context, comparison, (variable > literal) - (variable < literal));
+        }
+            break;
+        case MAPL_INSTRUCTION_UINT64_COMPARE_LITERAL_CURSOR_MOVE_BACK: {
+            MaPLInstruction comparison = readInstruction(context);
+            uint64_t variable = *((uint64_t *)(context->primitiveTable+readMemoryAddress(context)));
+            uint64_t literal = *((uint64_t *)(context->scriptBuffer+context->cursorPosition));
+            context->cursorPosition += sizeof(uint64_t);
+            moveBackIfComparisonHolds(context, comparison, (variable > literal) - (variable < literal));
+        }
+            break;
         case MAPL_INSTRUCTION_PROGRAM_EXIT:
             context->executionState = MaPLExecutionState_exit;
             break;
@@ -1759,16 +2400,124 @@ void evaluateStatement(MaPLExecutionContext *context) {
             MaPLParameterCount paramCount = readParameterCount(context);
             for (MaPLParameterCount i = 0; i < paramCount; i++) {
                 const char *metadataString = evaluateString(context);
-                if (context->callbacks->metadata) {
-                    context->callbacks->metadata(untagString(metadataString));
+                const char *untaggedString = untagString(metadataString);
+                if (untaggedString) {
+                    outputMetadata(context, untaggedString, strlen(untaggedString));
                 }
                 freeStringIfNeeded(metadataString);
             }
         }
             break;
+        case MAPL_INSTRUCTION_METADATA_TYPED: {
+            MaPLParameterCount paramCount = readParameterCount(context);
+            context->metadataLength = 0;
+            for (MaPLParameterCount i = 0; i < paramCount && context->executionState != MaPLExecutionState_error; i++) {
+                appendMetadataSection(context);
+            }
+            if (context->executionState == MaPLExecutionState_error || context->metadataLength == 0) {
+                break;
+            }
+            context->metadataBuffer[context->metadataLength] = 0;
+            outputMetadata(context, context->metadataBuffer, context->metadataLength);
+        }
+            break;
+        case MAPL_INSTRUCTION_SWITCH_JUMP_TABLE: {
+            bool isSigned;
+            uint64_t value = evaluateSwitchValue(context, &isSigned);
+            uint64_t firstValue = *((uint64_t *)(context->scriptBuffer+context->cursorPosition));
+            context->cursorPosition += sizeof(uint64_t);
+            MaPLSwitchCaseCount caseCount = *((MaPLSwitchCaseCount *)(context->scriptBuffer+context->cursorPosition));
+            context->cursorPosition += sizeof(MaPLSwitchCaseCount);
+            // Values below the first case wrap around to a large index, so a single comparison covers both bounds.
+            uint64_t index = value - firstValue;
+            size_t cursorMoveLocation = context->cursorPosition;
+            if (index < caseCount) {
+                cursorMoveLocation += sizeof(MaPLBytecodeLength) * (size_t)(index+1);
+            }
+            moveToSwitchCase(context, cursorMoveLocation);
+        }
+            break;
+        case MAPL_INSTRUCTION_SWITCH_SORTED_TABLE: {
+            bool isSigned;
+            uint64_t value = evaluateSwitchValue(context, &isSigned);
+            // Flipping the sign bit allows signed values to be compared as unsigned.
+            uint64_t orderedValue = isSigned ? value ^ ((uint64_t)1 << 63) : value;
+            MaPLSwitchCaseCount caseCount = *((MaPLSwitchCaseCount *)(context->scriptBuffer+context->cursorPosition));
+            context->cursorPosition += sizeof(MaPLSwitchCaseCount);
+            size_t defaultLocation = context->cursorPosition;
+            size_t tableLocation = defaultLocation + sizeof(MaPLBytecodeLength);
+            size_t entrySize = sizeof(uint64_t) + sizeof(MaPLBytecodeLength);
+            size_t cursorMoveLocation = defaultLocation;
+            size_t low = 0;
+            size_t high = caseCount;
+            while (low < high) {
+                size_t middle = (low+high)/2;
+                size_t entryLocation = tableLocation + middle*entrySize;
+                uint64_t entryValue = *((uint64_t *)(context->scriptBuffer+entryLocation));
+                uint64_t orderedEntryValue = isSigned ? entryValue ^ ((uint64_t)1 << 63) : entryValue;
+                if (orderedEntryValue == orderedValue) {
+                    cursorMoveLocation = entryLocation + sizeof(uint64_t);
+                    break;
+                }
+                if (orderedEntryValue < orderedValue) {
+                    low = middle+1;
+                } else {
+                    high = middle;
+                }
+            }
+            moveToSwitchCase(context, cursorMoveLocation);
+        }
+            break;
+        case MAPL_INSTRUCTION_SWITCH_HASH_TABLE: {
+            const char *taggedString = evaluateString(context);
+            const char *string = untagString(taggedString);
+            uint32_t hash = MAPL_SWITCH_HASH_OFFSET_BASIS;
+            for (const char *character = string; *character; character++) {
+                hash = (hash ^ (uint8_t)*character) * MAPL_SWITCH_HASH_PRIME;
+            }
+            MaPLSwitchCaseCount caseCount = *((MaPLSwitchCaseCount *)(context->scriptBuffer+context->cursorPosition));
+            context->cursorPosition += sizeof(MaPLSwitchCaseCount);
+            size_t defaultLocation = context->cursorPosition;
+            size_t tableLocation = defaultLocation + sizeof(MaPLBytecodeLength);
+            size_t entrySize = sizeof(uint32_t) + sizeof(MaPLBytecodeLength);
+            // Find the first entry whose hash isn't less than the value's hash.
+            size_t low = 0;
+            size_t high = caseCount;
+            while (low < high) {
+                size_t middle = (low+high)/2;
+                uint32_t entryHash = *((uint32_t *)(context->scriptBuffer+tableLocation+middle*entrySize));
+                if (entryHash < hash) {
+                    low = middle+1;
+                } else {
+                    high = middle;
+                }
+            }
+            bool foundCase = false;
+            for (size_t i = low; i < caseCount && !foundCase; i++) {
+                size_t entryLocation = tableLocation + i*entrySize;
+                if (*((uint32_t *)(context->scriptBuffer+entryLocation)) != hash) {
+                    break;
+                }
+                // Confirm the match against the string at the start of the case, which otherwise falls through into the case.
+                moveToSwitchCase(context, entryLocation + sizeof(uint32_t));
+                const char *caseString = evaluateString(context);
+                foundCase = !strcmp(string, untagString(caseString));
+                freeStringIfNeeded(caseString);
+            }
+            if (!foundCase) {
+                moveToSwitchCase(context, defaultLocation);
+            }
+            freeStringIfNeeded(taggedString);
+        }
+            break;
         case MAPL_INSTRUCTION_DEBUG_LINE: {
-            MaPLLineNumber lineNumber = *((MaPLLineNumber *)(context->scriptBuffer+context->cursorPosition));
-            context->cursorPosition += sizeof(MaPLLineNumber);
+            MaPLLineNumber lineNumber;
+            if (context->isCompactEncoding) {
+                lineNumber = (MaPLLineNumber)readUnsignedVarint(context);
+            } else {
+                lineNumber = *((MaPLLineNumber *)(context->scriptBuffer+context->cursorPosition));
+                context->cursorPosition += sizeof(MaPLLineNumber);
+            }
             if (context->callbacks->debugLine) {
                 context->callbacks->debugLine(lineNumber);
             }
@@ -1803,50 +2552,312 @@ void evaluateStatement(MaPLExecutionContext *context) {
     }
 }
 
-void executeMaPLScript(const void* scriptBuffer, MaPLBytecodeLength bufferLength, const MaPLCallbacks *callbacks) {
+struct MaPLDependency {
+    uint8_t *primitiveTable;
+    const char **stringTable;
+    MaPLMemoryAddress primitiveTableSize;
+    MaPLMemoryAddress stringTableSize;
+    bool hasExited;
+};
+
+void freeMaPLTables(MaPLDependency *tables) {
+    // Free any remaining allocated strings.
+    for(MaPLMemoryAddress i = 0; i < tables->stringTableSize; i++) {
+        freeStringIfNeeded(tables->stringTable[i]);
+    }
+    
+    // Both tables share a single allocation which starts at the primitive table.
+    free(tables->primitiveTable);
+    tables->primitiveTable = NULL;
+    tables->stringTable = NULL;
+}
+
+MaPLExecutionState executeMaPLScriptWithTables(const void* scriptBuffer,
+                                               MaPLBytecodeLength bufferLength,
+                                               const MaPLDependency *dependency,
+                                               const MaPLCallbacks *callbacks,
+                                               MaPLDependency *outTables) {
     static_assert(sizeof(float) == 4, "MaPL assumes that 'float' type is 32-bit.");
     static_assert(sizeof(double) == 8, "MaPL assumes that 'double' type is 64-bit.");
     
     MaPLExecutionContext context;
     context.scriptBuffer = (uint8_t *)scriptBuffer;
+    context.statementPosition = 0;
     context.callbacks = callbacks;
     context.isDeadCodepath = false;
     context.executionState = MaPLExecutionState_continue;
+    context.metadataBuffer = NULL;
+    context.metadataLength = 0;
+    context.metadataCapacity = 0;
+    outTables->primitiveTable = NULL;
+    outTables->stringTable = NULL;
+    outTables->primitiveTableSize = 0;
+    outTables->stringTableSize = 0;
+    outTables->hasExited = false;
 
-    // The first byte indicates big vs little endian (equals 1 if little endian).
+    // The first byte is a set of flags. The lowest bit indicates big vs little endian (equals 1 if little endian).
     // If these bytes don't match, then the script was compiled with a different
     // endianness and needs to be recompiled.
     uint16_t endianShort = 1;
     uint8_t endianByte = *(uint8_t *)&endianShort;
-    if (context.scriptBuffer[0] != endianByte) {
+    if ((context.scriptBuffer[0] & MAPL_BYTECODE_FLAG_LITTLE_ENDIAN) != endianByte) {
         if (context.callbacks->error) {
             context.callbacks->error(MaPLRuntimeError_incompatibleEndianness);
         }
-        return;
+        return MaPLExecutionState_error;
     }
     
+    context.isCompactEncoding = (context.scriptBuffer[0] & MAPL_BYTECODE_FLAG_COMPACT_ENCODING) != 0;
+    context.isPooledStrings = (context.scriptBuffer[0] & MAPL_BYTECODE_FLAG_POOLED_STRINGS) != 0;
+    context.cursorPosition = sizeof(uint8_t);
+    
     // The next bytes are always two instances of MaPLMemoryAddress that describe the table sizes.
-    // The entire script execution happens synchronously inside this function, so these tables can be stack allocated.
-    MaPLMemoryAddress primitiveTableSize = *((MaPLMemoryAddress *)(context.scriptBuffer+sizeof(uint8_t)));
-    MaPLMemoryAddress stringTableSize = *((MaPLMemoryAddress *)(context.scriptBuffer+sizeof(MaPLMemoryAddress)+sizeof(uint8_t)));
+    MaPLMemoryAddress primitiveTableSize = readMemoryAddress(&context);
+    MaPLMemoryAddress stringTableSize = readMemoryAddress(&context);
+    if (dependency &&
+        (dependency->primitiveTableSize > primitiveTableSize || dependency->stringTableSize > stringTableSize)) {
+        // A linked script's tables always begin with the full tables of the dependency it was compiled against.
+        if (context.callbacks->error) {
+            context.callbacks->error(MaPLRuntimeError_malformedBytecode);
+        }
+        return MaPLExecutionState_error;
+    }
     uint8_t *allocatedTables = (uint8_t *)malloc(primitiveTableSize + sizeof(char *) * stringTableSize);
     context.primitiveTable = allocatedTables;
     context.stringTable = (const char **)(allocatedTables+primitiveTableSize);
-    context.cursorPosition = sizeof(MaPLMemoryAddress)*2+sizeof(uint8_t);
     
     memset(context.stringTable, 0, sizeof(char *) * stringTableSize);
+    if (dependency) {
+        // Start from a snapshot of the dependency's variables. Strings remain owned by the
+        // dependency, so they're tagged as not allocated to ensure this script never frees them.
+        memcpy(context.primitiveTable, dependency->primitiveTable, dependency->primitiveTableSize);
+        for(MaPLMemoryAddress i = 0; i < dependency->stringTableSize; i++) {
+            context.stringTable[i] = tagStringAsNotAllocated(dependency->stringTable[i]);
+        }
+    }
     
+    const MaPLExecutionContext *previousContext = activeContext;
+    activeContext = &context;
     while (context.executionState == MaPLExecutionState_continue && context.cursorPosition < bufferLength) {
+        context.statementPosition = context.cursorPosition;
         evaluateStatement(&context);
     }
+    if (context.callbacks->metadataBuffer) {
+        flushMaPLMetadataBuffer(context.callbacks->metadataBuffer);
+    }
     if (context.executionState == MaPLExecutionState_error && context.callbacks->error) {
         context.callbacks->error(context.errorType);
     }
+    activeContext = previousContext;
+    free(context.metadataBuffer);
     
-    // Free any remaining allocated strings.
-    for(MaPLMemoryAddress i = 0; i < stringTableSize; i++) {
-        freeStringIfNeeded(context.stringTable[i]);
+    outTables->primitiveTable = context.primitiveTable;
+    outTables->stringTable = context.stringTable;
+    outTables->primitiveTableSize = primitiveTableSize;
+    outTables->stringTableSize = stringTableSize;
+    outTables->hasExited = context.executionState == MaPLExecutionState_exit;
+    return context.executionState;
+}
+
+void executeMaPLScript(const void* scriptBuffer, MaPLBytecodeLength bufferLength, const MaPLCallbacks *callbacks) {
+    executeMaPLLinkedScript(scriptBuffer, bufferLength, NULL, callbacks);
+}
+
+MaPLDependency *executeMaPLDependency(const void* scriptBuffer, MaPLBytecodeLength bufferLength, const MaPLDependency *dependency, const MaPLCallbacks *callbacks) {
+    MaPLDependency *tables = (MaPLDependency *)malloc(sizeof(MaPLDependency));
+    if (dependency && dependency->hasExited) {
+        // The script exited within the dependency, so none of the subsequent bytecode would have run.
+        *tables = (MaPLDependency){ NULL, NULL, 0, 0, true };
+        return tables;
+    }
+    MaPLExecutionState executionState = executeMaPLScriptWithTables(scriptBuffer, bufferLength, dependency, callbacks, tables);
+    if (executionState == MaPLExecutionState_error) {
+        freeMaPLTables(tables);
+        free(tables);
+        return NULL;
+    }
+    return tables;
+}
+
+void executeMaPLLinkedScript(const void* scriptBuffer, MaPLBytecodeLength bufferLength, const MaPLDependency *dependency, const MaPLCallbacks *callbacks) {
+    if (dependency && dependency->hasExited) {
+        // The script exited within the dependency, so none of the subsequent bytecode would have run.
+        return;
+    }
+    MaPLDependency tables;
+    executeMaPLScriptWithTables(scriptBuffer, bufferLength, dependency, callbacks, &tables);
+    freeMaPLTables(&tables);
+}
+
+void freeMaPLDependency(MaPLDependency *dependency) {
+    if (!dependency) {
+        return;
+    }
+    freeMaPLTables(dependency);
+    free(dependency);
+}
+
+MaPLBytecodeLength currentMaPLStatementPosition(void) {
+    if (!activeContext) {
+        return 0;
+    }
+    return (MaPLBytecodeLength)activeContext->statementPosition;
+}
+
+const MaPLDebugLineEntry *findDebugLineEntry(const void *lineTable, size_t tableLength, MaPLBytecodeLength bytecodePosition) {
+    // Find the last entry that starts at or before the position.
+    const MaPLDebugLineEntry *entries = (const MaPLDebugLineEntry *)lineTable;
+    size_t lowerBound = 0;
+    size_t upperBound = tableLength / sizeof(MaPLDebugLineEntry);
+    while (lowerBound < upperBound) {
+        size_t middle = lowerBound + (upperBound - lowerBound) / 2;
+        if (entries[middle].bytecodePosition <= bytecodePosition) {
+            lowerBound = middle + 1;
+        } else {
+            upperBound = middle;
+        }
+    }
+    if (lowerBound == 0) {
+        return NULL;
+    }
+    return entries + lowerBound - 1;
+}
+
+MaPLLineNumber findMaPLDebugLine(const void *lineTable, size_t tableLength, MaPLBytecodeLength bytecodePosition) {
+    const MaPLDebugLineEntry *entry = findDebugLineEntry(lineTable, tableLength, bytecodePosition);
+    return entry ? entry->lineNumber : 0;
+}
+
+const MaPLDebugVariableEntry *findMaPLDebugVariable(const void *variableTable, size_t tableLength, MaPLBytecodeLength bytecodePosition, const char *variableName) {
+    if (tableLength < sizeof(uint32_t)) {
+        return NULL;
+    }
+    uint32_t variableCount = *((const uint32_t *)variableTable);
+    const MaPLDebugVariableEntry *entries = (const MaPLDebugVariableEntry *)((const uint8_t *)variableTable + sizeof(uint32_t));
+    for (uint32_t i = 0; i < variableCount; i++) {
+        // Entries are sorted by start position, so no later entry can be in scope.
+        if (entries[i].startPosition > bytecodePosition) {
+            break;
+        }
+        if (bytecodePosition < entries[i].endPosition &&
+            !strcmp((const char *)variableTable + entries[i].nameOffset, variableName)) {
+            return entries + i;
+        }
+    }
+    return NULL;
+}
+
+MaPLParameter readMaPLDebugVariable(const MaPLDebugVariableEntry *variable) {
+    if (!activeContext || !variable) {
+        return MaPLUninitialized();
+    }
+    const uint8_t *address = activeContext->primitiveTable + variable->memoryAddress;
+    switch (variable->dataType) {
+        case MaPLDataType_char: return MaPLChar(*((const uint8_t *)address));
+        case MaPLDataType_int32: return MaPLInt32(*((const int32_t *)address));
+        case MaPLDataType_int64: return MaPLInt64(*((const int64_t *)address));
+        case MaPLDataType_uint32: return MaPLUint32(*((const uint32_t *)address));
+        case MaPLDataType_uint64: return MaPLUint64(*((const uint64_t *)address));
+        case MaPLDataType_float32: return MaPLFloat32(*((const float *)address));
+        case MaPLDataType_float64: return MaPLFloat64(*((const double *)address));
+        case MaPLDataType_boolean: return MaPLBool(*address != 0);
+        case MaPLDataType_pointer: return MaPLPointer(*((void *const *)address));
+        case MaPLDataType_string: {
+            const char *string = activeContext->stringTable[variable->memoryAddress];
+            return MaPLStringByReference(string ? untagString(string) : "");
+        }
+        default: return MaPLUninitialized();
+    }
+}
+
+MaPLExecutionProfile *createMaPLExecutionProfile(MaPLBytecodeLength scriptLength) {
+    MaPLExecutionProfile *profile = (MaPLExecutionProfile *)malloc(sizeof(MaPLExecutionProfile));
+    // All three arrays share a single allocation which starts at the taken counts.
+    uint64_t *counts = (uint64_t *)calloc(3 * (size_t)scriptLength + 1, sizeof(uint64_t));
+    profile->branchTakenCounts = counts;
+    profile->branchNotTakenCounts = counts + scriptLength;
+    profile->callCounts = counts + 2 * (size_t)scriptLength;
+    profile->length = scriptLength;
+    return profile;
+}
+
+void freeMaPLExecutionProfile(MaPLExecutionProfile *profile) {
+    if (!profile) {
+        return;
+    }
+    free(profile->branchTakenCounts);
+    free(profile);
+}
+
+void writeMaPLExecutionProfile(const MaPLExecutionProfile *profile, const void *lineTable, size_t tableLength, const char *scriptName, FILE *file) {
+    // Each line of the profile is one of:
+    //   script <name> - All subsequent lines describe this script.
+    //   branch <line number> <column number> <taken count> <not taken count> - The branch instruction of the statement at this location.
+    //   call <line number> <column number> <count> - Host function or property invocations within the statement at this location.
+    fprintf(file, "script %s\n", scriptName);
+    for (MaPLBytecodeLength position = 0; position < profile->length; position++) {
+        uint64_t takenCount = profile->branchTakenCounts[position];
+        uint64_t notTakenCount = profile->branchNotTakenCounts[position];
+        uint64_t callCount = profile->callCounts[position];
+        if (!takenCount && !notTakenCount && !callCount) {
+            continue;
+        }
+        // Bytecode imported from other scripts has no line number, and can't be attributed to this script.
+        const MaPLDebugLineEntry *entry = findDebugLineEntry(lineTable, tableLength, position);
+        if (!entry || !entry->lineNumber) {
+            continue;
+        }
+        if (takenCount || notTakenCount) {
+            fprintf(file, "branch %u %u %llu %llu\n", entry->lineNumber, entry->columnNumber, (unsigned long long)takenCount, (unsigned long long)notTakenCount);
+        }
+        if (callCount) {
+            fprintf(file, "call %u %u %llu\n", entry->lineNumber, entry->columnNumber, (unsigned long long)callCount);
+        }
+    }
+}
+
+const void *findMaPLBundleScript(const void *bundleBuffer, size_t bundleLength, const char *scriptName, MaPLBytecodeLength *outScriptLength) {
+    const uint8_t *bundleBytes = (const uint8_t *)bundleBuffer;
+    if (bundleLength < sizeof(MaPLBundleHeader)) {
+        return NULL;
+    }
+    const MaPLBundleHeader *header = (const MaPLBundleHeader *)bundleBytes;
+    if (memcmp(header->magic, MAPL_BUNDLE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != MAPL_BUNDLE_VERSION ||
+        header->scriptCount > (bundleLength - sizeof(MaPLBundleHeader)) / sizeof(MaPLBundleEntry) ||
+        header->stringPoolOffset > bundleLength ||
+        header->stringPoolLength == 0 ||
+        header->stringPoolLength > bundleLength - header->stringPoolOffset ||
+        bundleBytes[header->stringPoolOffset + header->stringPoolLength - 1] != 0) {
+        return NULL;
     }
     
-    free(allocatedTables);
+    // Entries are sorted by name, so the script can be found via binary search without reading the rest of the bundle.
+    const MaPLBundleEntry *entries = (const MaPLBundleEntry *)(bundleBytes + sizeof(MaPLBundleHeader));
+    const char *stringPool = (const char *)(bundleBytes + header->stringPoolOffset);
+    uint32_t lowerBound = 0;
+    uint32_t upperBound = header->scriptCount;
+    while (lowerBound < upperBound) {
+        uint32_t middle = lowerBound + (upperBound - lowerBound) / 2;
+        const MaPLBundleEntry *entry = entries + middle;
+        if (entry->nameOffset >= header->stringPoolLength) {
+            return NULL;
+        }
+        int comparison = strcmp(scriptName, stringPool + entry->nameOffset);
+        if (comparison == 0) {
+            if (entry->scriptOffset > bundleLength ||
+                entry->scriptLength > bundleLength - entry->scriptOffset ||
+                entry->scriptLength > (MaPLBytecodeLength)~0) {
+                return NULL;
+            }
+            *outScriptLength = (MaPLBytecodeLength)entry->scriptLength;
+            return bundleBytes + entry->scriptOffset;
+        }
+        if (comparison < 0) {
+            upperBound = middle;
+        } else {
+            lowerBound = middle + 1;
+        }
+    }
+    return NULL;
 }
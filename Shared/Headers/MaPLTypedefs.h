@@ -15,4 +15,21 @@ typedef uint16_t MaPLSymbol;
 typedef uint16_t MaPLLineNumber;
 typedef uint16_t MaPLBytecodeLength;
 
+// A debug variable table describes where each variable of a script is stored while it's in scope, so that a host can
+// inspect variables of scripts that were compiled without debug info. The table begins with a uint32_t count of entries,
+// followed by that many MaPLDebugVariableEntry sorted by startPosition, followed by the null-terminated variable names.
+// Each declaration of a variable gets its own entry, so a variable declared within a loop that is unrolled has one entry per copy.
+typedef struct {
+    // The position of the first statement after the variable is declared.
+    MaPLBytecodeLength startPosition;
+    // The position just past the end of the variable's scope.
+    MaPLBytecodeLength endPosition;
+    // The offset of the variable's name, measured from the start of the table.
+    uint32_t nameOffset;
+    // The variable's address (a MaPLMemoryAddress) in the primitive table, or its index in the string table if it's a string.
+    uint16_t memoryAddress;
+    // The variable's type, as a MaPLDataType.
+    uint8_t dataType;
+} MaPLDebugVariableEntry;
+
 #endif /* MaPLTypedefs_h */
@@ -12,6 +12,54 @@
 // Byte sizes for MaPL bytecode.
 typedef uint16_t MaPLMemoryAddress;
 typedef uint8_t MaPLInstruction;
+typedef uint16_t MaPLSwitchCaseCount;
+
+// String switches hash their values with 32-bit FNV-1a.
+#define MAPL_SWITCH_HASH_OFFSET_BASIS 2166136261u
+#define MAPL_SWITCH_HASH_PRIME 16777619u
+
+// The first byte of all bytecode is a set of flags that describe how the rest of the bytecode is encoded.
+// If little endian flag doesn't match the host, then the script needs to be recompiled.
+#define MAPL_BYTECODE_FLAG_LITTLE_ENDIAN 0x01
+// Memory addresses, symbols, cursor moves, line numbers and integer literals are stored as LEB128 varints
+// rather than at their full fixed width. Signed integer literals are zigzag encoded before being stored.
+#define MAPL_BYTECODE_FLAG_COMPACT_ENCODING 0x02
+// String literal operands are a 4-byte signed offset from the first byte of the bytecode to a null-terminated string
+// that is stored outside of the bytecode. Only scripts within a bundle are encoded this way, and their strings are
+// stored in the bundle's shared string pool.
+#define MAPL_BYTECODE_FLAG_POOLED_STRINGS 0x04
+
+// A bundle packs many compiled scripts into a single file that is meant to be memory-mapped and executed in place.
+// The bundle begins with a MaPLBundleHeader, followed by one MaPLBundleEntry per script (sorted by name), followed by
+// the string pool. Each script begins on a page boundary. All offsets are measured from the start of the bundle.
+#define MAPL_BUNDLE_MAGIC "MaPLBNDL"
+#define MAPL_BUNDLE_VERSION 1
+#define MAPL_BUNDLE_PAGE_SIZE 4096
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t scriptCount;
+    uint32_t stringPoolOffset;
+    uint32_t stringPoolLength;
+} MaPLBundleHeader;
+
+typedef struct {
+    // The offset of the script's name within the string pool. Names are null-terminated.
+    uint32_t nameOffset;
+    uint32_t scriptOffset;
+    uint32_t scriptLength;
+} MaPLBundleEntry;
+
+// A debug line table maps positions in the bytecode to line numbers in the script, so that debug info doesn't need to be
+// compiled into the bytecode itself. The table is an array of MaPLDebugLineEntry sorted by bytecodePosition. Each entry
+// marks the start of a statement, and every position up until the next entry belongs to that statement. The column number
+// is the offset of the statement's first character within its line, starting at 0, which tells apart statements that share a line.
+typedef struct {
+    MaPLBytecodeLength bytecodePosition;
+    MaPLLineNumber lineNumber;
+    MaPLLineNumber columnNumber;
+} MaPLDebugLineEntry;
 
 // Bytecodes are sorted by return type, this makes it so that switch statements
 // dealing with the same types have contiguous values.
@@ -260,6 +308,40 @@ typedef uint8_t MaPLInstruction;
 // ERROR CHECKING
 #define MAPL_INSTRUCTION_ERROR 205
 
+// TYPED METADATA
+// Like METADATA, but sections are expressions of any type rather than strings. The runtime formats them without
+// allocating, and concatenates every section into a single metadata callback.
+#define MAPL_INSTRUCTION_METADATA_TYPED 206
+
+// SWITCH
+// Jumps directly to one of several cases based on the value of an integral or string expression. Each instruction is
+// followed by the expression, then a MaPLSwitchCaseCount, then a table. Every cursor move in the table is measured
+// from the end of its own MaPLBytecodeLength, and the first one is the destination when no case matches. Tables are
+// indexed at fixed offsets, so their values and cursor moves stay fixed width even in compact bytecode.
+// JUMP_TABLE: Preceded by the uint64_t value of the first case. Case 'i' is the cursor move at index 'i+1'.
+// SORTED_TABLE: Each entry is a uint64_t value followed by a cursor move, sorted so that the values are in order for the expression's type.
+// HASH_TABLE: Each entry is a uint32_t hash followed by a cursor move, sorted by hash. Each case begins with a
+//   string literal that is compared to the value of the expression to confirm the match. Different strings can share
+//   a hash, so every entry with a matching hash is tried in order.
+// Integral values are widened to 64 bits (sign-extended for signed types) before they are compared.
+#define MAPL_INSTRUCTION_SWITCH_JUMP_TABLE 207
+#define MAPL_INSTRUCTION_SWITCH_SORTED_TABLE 208
+#define MAPL_INSTRUCTION_SWITCH_HASH_TABLE 209
+
+// LOOP BRANCHES
+// Optimized loops check their conditional at the bottom of the loop, so that each iteration ends with a single instruction
+// that either returns to the top of the loop or falls through to exit it. Cursor moves are measured like CURSOR_MOVE_BACK.
+// CONDITIONAL_CURSOR_MOVE_BACK: Followed by a boolean expression, then a cursor move that is taken if the expression is true.
+// <TYPE>_COMPARE_LITERAL_CURSOR_MOVE_BACK: Followed by a comparison instruction of the same type (such as LOGICAL_LESS_THAN_INT32),
+//   the memory address of a variable, a literal stored at the full width of the type, then a cursor move that is taken if
+//   the comparison of the variable (on the left) to the literal (on the right) is true.
+#define MAPL_INSTRUCTION_CONDITIONAL_CURSOR_MOVE_BACK 210
+#define MAPL_INSTRUCTION_CHAR_COMPARE_LITERAL_CURSOR_MOVE_BACK 211
+#define MAPL_INSTRUCTION_INT32_COMPARE_LITERAL_CURSOR_MOVE_BACK 212
+#define MAPL_INSTRUCTION_INT64_COMPARE_LITERAL_CURSOR_MOVE_BACK 213
+#define MAPL_INSTRUCTION_UINT32_COMPARE_LITERAL_CURSOR_MOVE_BACK 214
+#define MAPL_INSTRUCTION_UINT64_COMPARE_LITERAL_CURSOR_MOVE_BACK 215
+
 const MaPLInstruction MaPLInstruction_placeholder = MAPL_INSTRUCTION_PLACEHOLDER;
 const MaPLInstruction MaPLInstruction_int32_literal = MAPL_INSTRUCTION_INT32_LITERAL;
 const MaPLInstruction MaPLInstruction_int32_variable = MAPL_INSTRUCTION_INT32_VARIABLE;
@@ -466,5 +548,15 @@ const MaPLInstruction MaPLInstruction_debug_update_variable = MAPL_INSTRUCTION_D
 const MaPLInstruction MaPLInstruction_debug_delete_variable = MAPL_INSTRUCTION_DEBUG_DELETE_VARIABLE;
 const MaPLInstruction MaPLInstruction_no_op = MAPL_INSTRUCTION_NO_OP;
 const MaPLInstruction MaPLInstruction_error = MAPL_INSTRUCTION_ERROR;
+const MaPLInstruction MaPLInstruction_metadata_typed = MAPL_INSTRUCTION_METADATA_TYPED;
+const MaPLInstruction MaPLInstruction_switch_jump_table = MAPL_INSTRUCTION_SWITCH_JUMP_TABLE;
+const MaPLInstruction MaPLInstruction_switch_sorted_table = MAPL_INSTRUCTION_SWITCH_SORTED_TABLE;
+const MaPLInstruction MaPLInstruction_switch_hash_table = MAPL_INSTRUCTION_SWITCH_HASH_TABLE;
+const MaPLInstruction MaPLInstruction_conditional_cursor_move_back = MAPL_INSTRUCTION_CONDITIONAL_CURSOR_MOVE_BACK;
+const MaPLInstruction MaPLInstruction_char_compare_literal_cursor_move_back = MAPL_INSTRUCTION_CHAR_COMPARE_LITERAL_CURSOR_MOVE_BACK;
+const MaPLInstruction MaPLInstruction_int32_compare_literal_cursor_move_back = MAPL_INSTRUCTION_INT32_COMPARE_LITERAL_CURSOR_MOVE_BACK;
+const MaPLInstruction MaPLInstruction_int64_compare_literal_cursor_move_back = MAPL_INSTRUCTION_INT64_COMPARE_LITERAL_CURSOR_MOVE_BACK;
+const MaPLInstruction MaPLInstruction_uint32_compare_literal_cursor_move_back = MAPL_INSTRUCTION_UINT32_COMPARE_LITERAL_CURSOR_MOVE_BACK;
+const MaPLInstruction MaPLInstruction_uint64_compare_literal_cursor_move_back = MAPL_INSTRUCTION_UINT64_COMPARE_LITERAL_CURSOR_MOVE_BACK;
 
 #endif /* MaPLBytecodeConstants_h */
@@ -17,6 +17,8 @@ struct MaPLDecompilerContext {
     const u_int8_t* scriptBuffer;
     MaPLBytecodeLength cursorPosition = 0;
     uint32_t indent = 0;
+    bool isCompactEncoding = false;
+    bool isPooledStrings = false;
 };
 
 void evaluateStatement(MaPLDecompilerContext *context);
@@ -658,6 +660,36 @@ MaPLInstruction printInstruction(MaPLDecompilerContext *context) {
         case MaPLInstruction_error:
             instructionStr = "error";
             break;
+        case MaPLInstruction_metadata_typed:
+            instructionStr = "metadata_typed";
+            break;
+        case MaPLInstruction_switch_jump_table:
+            instructionStr = "switch_jump_table";
+            break;
+        case MaPLInstruction_switch_sorted_table:
+            instructionStr = "switch_sorted_table";
+            break;
+        case MaPLInstruction_switch_hash_table:
+            instructionStr = "switch_hash_table";
+            break;
+        case MaPLInstruction_conditional_cursor_move_back:
+            instructionStr = "conditional_cursor_move_back";
+            break;
+        case MaPLInstruction_char_compare_literal_cursor_move_back:
+            instructionStr = "char_compare_literal_cursor_move_back";
+            break;
+        case MaPLInstruction_int32_compare_literal_cursor_move_back:
+            instructionStr = "int32_compare_literal_cursor_move_back";
+            break;
+        case MaPLInstruction_int64_compare_literal_cursor_move_back:
+            instructionStr = "int64_compare_literal_cursor_move_back";
+            break;
+        case MaPLInstruction_uint32_compare_literal_cursor_move_back:
+            instructionStr = "uint32_compare_literal_cursor_move_back";
+            break;
+        case MaPLInstruction_uint64_compare_literal_cursor_move_back:
+            instructionStr = "uint64_compare_literal_cursor_move_back";
+            break;
         default:
             fputs("Error: Unrecognized bytecode instruction.\n", stderr);
             exit(1);
@@ -668,17 +700,52 @@ MaPLInstruction printInstruction(MaPLDecompilerContext *context) {
     return instruction;
 }
 
+u_int64_t peekInteger(MaPLDecompilerContext *context, MaPLBytecodeLength fixedByteCount, MaPLBytecodeLength *byteCount) {
+    const u_int8_t *bytes = context->scriptBuffer+context->cursorPosition;
+    if (context->isCompactEncoding) {
+        // Compact bytecode stores integers as LEB128 varints regardless of their type.
+        u_int64_t value = 0;
+        MaPLBytecodeLength i = 0;
+        do {
+            value |= (u_int64_t)(bytes[i] & 0x7F) << (7*i);
+        } while (bytes[i++] & 0x80);
+        *byteCount = i;
+        return value;
+    }
+    *byteCount = fixedByteCount;
+    switch (fixedByteCount) {
+        case sizeof(u_int8_t): return *((u_int8_t *)bytes);
+        case sizeof(u_int16_t): return *((u_int16_t *)bytes);
+        case sizeof(u_int32_t): return *((u_int32_t *)bytes);
+        default: return *((u_int64_t *)bytes);
+    }
+}
+
+int64_t peekSignedInteger(MaPLDecompilerContext *context, MaPLBytecodeLength fixedByteCount, MaPLBytecodeLength *byteCount) {
+    u_int64_t value = peekInteger(context, fixedByteCount, byteCount);
+    if (context->isCompactEncoding) {
+        // Signed integers are zigzag encoded.
+        return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+    }
+    if (fixedByteCount == sizeof(int32_t)) {
+        return (int32_t)value;
+    }
+    return (int64_t)value;
+}
+
 void printMemoryAddress(MaPLDecompilerContext *context) {
-    MaPLMemoryAddress address = *((MaPLMemoryAddress *)(context->scriptBuffer+context->cursorPosition));
-    printLineNumber(context, sizeof(MaPLMemoryAddress));
+    MaPLBytecodeLength byteCount;
+    MaPLMemoryAddress address = (MaPLMemoryAddress)peekInteger(context, sizeof(MaPLMemoryAddress), &byteCount);
+    printLineNumber(context, byteCount);
     printf("MEMORY ADDRESS=%u\n", address);
-    context->cursorPosition += sizeof(MaPLMemoryAddress);
+    context->cursorPosition += byteCount;
 }
 
 void printCursorMove(MaPLDecompilerContext *context, bool moveForward) {
-    MaPLBytecodeLength move = *((MaPLBytecodeLength *)(context->scriptBuffer+context->cursorPosition));
-    printLineNumber(context, sizeof(MaPLBytecodeLength));
-    context->cursorPosition += sizeof(MaPLBytecodeLength);
+    MaPLBytecodeLength byteCount;
+    MaPLBytecodeLength move = (MaPLBytecodeLength)peekInteger(context, sizeof(MaPLBytecodeLength), &byteCount);
+    printLineNumber(context, byteCount);
+    context->cursorPosition += byteCount;
     MaPLBytecodeLength destination = context->cursorPosition;
     if (moveForward) {
         destination += move;
@@ -688,11 +755,20 @@ void printCursorMove(MaPLDecompilerContext *context, bool moveForward) {
     printf("CURSOR MOVE %s=%u (TO %u)\n", moveForward ? "FORWARD" : "BACKWARD", move, destination);
 }
 
+void printSwitchCursorMove(MaPLDecompilerContext *context) {
+    // Switch tables are indexed at fixed offsets, so their cursor moves are never compact.
+    MaPLBytecodeLength move = *((MaPLBytecodeLength *)(context->scriptBuffer+context->cursorPosition));
+    printLineNumber(context, sizeof(MaPLBytecodeLength));
+    context->cursorPosition += sizeof(MaPLBytecodeLength);
+    printf("CURSOR MOVE FORWARD=%u (TO %u)\n", move, (MaPLBytecodeLength)(context->cursorPosition+move));
+}
+
 void printSymbol(MaPLDecompilerContext *context) {
-    MaPLSymbol symbol = *((MaPLSymbol *)(context->scriptBuffer+context->cursorPosition));
-    printLineNumber(context, sizeof(MaPLSymbol));
+    MaPLBytecodeLength byteCount;
+    MaPLSymbol symbol = (MaPLSymbol)peekInteger(context, sizeof(MaPLSymbol), &byteCount);
+    printLineNumber(context, byteCount);
     printf("SYMBOL=%u\n", symbol);
-    context->cursorPosition += sizeof(MaPLSymbol);
+    context->cursorPosition += byteCount;
 }
 
 MaPLParameterCount printParameterCount(MaPLDecompilerContext *context) {
@@ -711,6 +787,17 @@ void printString(MaPLDecompilerContext *context) {
     context->cursorPosition += stringLength;
 }
 
+void printStringLiteral(MaPLDecompilerContext *context) {
+    if (!context->isPooledStrings) {
+        printString(context);
+        return;
+    }
+    int32_t offset = *((int32_t *)(context->scriptBuffer+context->cursorPosition));
+    printLineNumber(context, sizeof(int32_t));
+    printf("LITERAL STRING=\"%s\" (POOLED AT %d)\n", (const char *)(context->scriptBuffer+offset), offset);
+    context->cursorPosition += sizeof(int32_t);
+}
+
 void evaluateFunctionInvocation(MaPLDecompilerContext *context) {
     // This function assumes that we've already advanced past the initial "function_invocation" byte.
     if (context->scriptBuffer[context->cursorPosition] == MaPLInstruction_no_op) {
@@ -758,31 +845,35 @@ void evaluateStatement(MaPLDecompilerContext *context) {
         }
             break;
         case MaPLInstruction_int32_literal: {
-            int32_t literal = *((int32_t *)(context->scriptBuffer+context->cursorPosition));
-            printLineNumber(context, sizeof(u_int32_t));
+            MaPLBytecodeLength byteCount;
+            int32_t literal = (int32_t)peekSignedInteger(context, sizeof(int32_t), &byteCount);
+            printLineNumber(context, byteCount);
             printf("LITERAL INT32=%d\n", literal);
-            context->cursorPosition += sizeof(int32_t);
+            context->cursorPosition += byteCount;
         }
             break;
         case MaPLInstruction_int64_literal: {
-            int64_t literal = *((int64_t *)(context->scriptBuffer+context->cursorPosition));
-            printLineNumber(context, sizeof(int64_t));
+            MaPLBytecodeLength byteCount;
+            int64_t literal = (int64_t)peekSignedInteger(context, sizeof(int64_t), &byteCount);
+            printLineNumber(context, byteCount);
             printf("LITERAL INT64=%lld\n", literal);
-            context->cursorPosition += sizeof(int64_t);
+            context->cursorPosition += byteCount;
         }
             break;
         case MaPLInstruction_uint32_literal: {
-            u_int32_t literal = *((u_int32_t *)(context->scriptBuffer+context->cursorPosition));
-            printLineNumber(context, sizeof(u_int32_t));
+            MaPLBytecodeLength byteCount;
+            u_int32_t literal = (u_int32_t)peekInteger(context, sizeof(u_int32_t), &byteCount);
+            printLineNumber(context, byteCount);
             printf("LITERAL UINT32=%u\n", literal);
-            context->cursorPosition += sizeof(u_int32_t);
+            context->cursorPosition += byteCount;
         }
             break;
         case MaPLInstruction_uint64_literal: {
-            u_int64_t literal = *((u_int64_t *)(context->scriptBuffer+context->cursorPosition));
-            printLineNumber(context, sizeof(u_int64_t));
+            MaPLBytecodeLength byteCount;
+            u_int64_t literal = (u_int64_t)peekInteger(context, sizeof(u_int64_t), &byteCount);
+            printLineNumber(context, byteCount);
             printf("LITERAL UINT64=%llu\n", literal);
-            context->cursorPosition += sizeof(u_int64_t);
+            context->cursorPosition += byteCount;
         }
             break;
         case MaPLInstruction_float32_literal: {
@@ -799,11 +890,14 @@ void evaluateStatement(MaPLDecompilerContext *context) {
             context->cursorPosition += sizeof(double);
         }
             break;
-        case MaPLInstruction_string_literal: // Intentional fallthrough.
+        case MaPLInstruction_string_literal:
+            printStringLiteral(context);
+            break;
         case MaPLInstruction_debug_delete_variable:
             printString(context);
             break;
-        case MaPLInstruction_metadata: {
+        case MaPLInstruction_metadata: // Intentional fallthrough.
+        case MaPLInstruction_metadata_typed: {
             MaPLParameterCount paramCount = printParameterCount(context);
             for (MaPLParameterCount i = 0; i < paramCount; i++) {
                 evaluateStatement(context);
@@ -811,10 +905,11 @@ void evaluateStatement(MaPLDecompilerContext *context) {
         }
             break;
         case MaPLInstruction_debug_line: {
-            MaPLLineNumber lineNumber = *((MaPLLineNumber *)(context->scriptBuffer+context->cursorPosition));
-            printLineNumber(context, sizeof(MaPLLineNumber));
+            MaPLBytecodeLength byteCount;
+            MaPLLineNumber lineNumber = (MaPLLineNumber)peekInteger(context, sizeof(MaPLLineNumber), &byteCount);
+            printLineNumber(context, byteCount);
             printf("LINE NUMBER=%u\n", lineNumber);
-            context->cursorPosition += sizeof(MaPLLineNumber);
+            context->cursorPosition += byteCount;
         }
             break;
         case MaPLInstruction_literal_true:
@@ -1073,12 +1168,90 @@ void evaluateStatement(MaPLDecompilerContext *context) {
             evaluateStatement(context);
             printCursorMove(context, true);
             break;
+        case MaPLInstruction_switch_jump_table: // Intentional fallthrough.
+        case MaPLInstruction_switch_sorted_table: // Intentional fallthrough.
+        case MaPLInstruction_switch_hash_table: {
+            evaluateStatement(context);
+            if (instruction == MaPLInstruction_switch_jump_table) {
+                u_int64_t firstValue = *((u_int64_t *)(context->scriptBuffer+context->cursorPosition));
+                printLineNumber(context, sizeof(u_int64_t));
+                printf("FIRST VALUE=%llu\n", (unsigned long long)firstValue);
+                context->cursorPosition += sizeof(u_int64_t);
+            }
+            MaPLSwitchCaseCount caseCount = *((MaPLSwitchCaseCount *)(context->scriptBuffer+context->cursorPosition));
+            printLineNumber(context, sizeof(MaPLSwitchCaseCount));
+            printf("CASE COUNT=%u\n", caseCount);
+            context->cursorPosition += sizeof(MaPLSwitchCaseCount);
+            printIndent(context);
+            printf("(DEFAULT)\n");
+            printSwitchCursorMove(context);
+            for (MaPLSwitchCaseCount i = 0; i < caseCount; i++) {
+                if (instruction == MaPLInstruction_switch_sorted_table) {
+                    u_int64_t value = *((u_int64_t *)(context->scriptBuffer+context->cursorPosition));
+                    printLineNumber(context, sizeof(u_int64_t));
+                    printf("CASE VALUE=%llu\n", (unsigned long long)value);
+                    context->cursorPosition += sizeof(u_int64_t);
+                } else if (instruction == MaPLInstruction_switch_hash_table) {
+                    u_int32_t hash = *((u_int32_t *)(context->scriptBuffer+context->cursorPosition));
+                    printLineNumber(context, sizeof(u_int32_t));
+                    printf("CASE HASH=%u\n", hash);
+                    context->cursorPosition += sizeof(u_int32_t);
+                }
+                printSwitchCursorMove(context);
+            }
+        }
+            break;
         case MaPLInstruction_cursor_move_forward:
             printCursorMove(context, true);
             break;
         case MaPLInstruction_cursor_move_back:
             printCursorMove(context, false);
             break;
+        case MaPLInstruction_conditional_cursor_move_back:
+            evaluateStatement(context);
+            printCursorMove(context, false);
+            break;
+        case MaPLInstruction_char_compare_literal_cursor_move_back: // Intentional fallthrough.
+        case MaPLInstruction_int32_compare_literal_cursor_move_back: // Intentional fallthrough.
+        case MaPLInstruction_int64_compare_literal_cursor_move_back: // Intentional fallthrough.
+        case MaPLInstruction_uint32_compare_literal_cursor_move_back: // Intentional fallthrough.
+        case MaPLInstruction_uint64_compare_literal_cursor_move_back: {
+            printInstruction(context);
+            printMemoryAddress(context);
+            // Literals in these instructions are always stored at full width.
+            const u_int8_t *literalBytes = context->scriptBuffer+context->cursorPosition;
+            MaPLBytecodeLength literalByteCount;
+            switch (instruction) {
+                case MaPLInstruction_char_compare_literal_cursor_move_back:
+                    literalByteCount = sizeof(u_int8_t);
+                    printLineNumber(context, literalByteCount);
+                    printf("LITERAL CHAR=%u\n", *((u_int8_t *)literalBytes));
+                    break;
+                case MaPLInstruction_int32_compare_literal_cursor_move_back:
+                    literalByteCount = sizeof(int32_t);
+                    printLineNumber(context, literalByteCount);
+                    printf("LITERAL INT32=%d\n", *((int32_t *)literalBytes));
+                    break;
+                case MaPLInstruction_int64_compare_literal_cursor_move_back:
+                    literalByteCount = sizeof(int64_t);
+                    printLineNumber(context, literalByteCount);
+                    printf("LITERAL INT64=%lld\n", (long long)*((int64_t *)literalBytes));
+                    break;
+                case MaPLInstruction_uint32_compare_literal_cursor_move_back:
+                    literalByteCount = sizeof(u_int32_t);
+                    printLineNumber(context, literalByteCount);
+                    printf("LITERAL UINT32=%u\n", *((u_int32_t *)literalBytes));
+                    break;
+                default:
+                    literalByteCount = sizeof(u_int64_t);
+                    printLineNumber(context, literalByteCount);
+                    printf("LITERAL UINT64=%llu\n", (unsigned long long)*((u_int64_t *)literalBytes));
+                    break;
+            }
+            context->cursorPosition += literalByteCount;
+            printCursorMove(context, false);
+        }
+            break;
         case MaPLInstruction_debug_update_variable:
             printString(context);
             evaluateStatement(context);
@@ -1094,10 +1267,18 @@ void printDecompilationOfBytecode(const u_int8_t *bytes, MaPLBytecodeLength leng
     MaPLDecompilerContext context;
     context.scriptBuffer = bytes;
 
-    u_int8_t endianByte = bytes[0];
+    u_int8_t flagsByte = bytes[0];
     printLineNumber(&context, sizeof(u_int8_t));
-    printf("ENDIAN=%s\n", endianByte ? "LITTLE" : "BIG");
+    printf("ENDIAN=%s\n", (flagsByte & MAPL_BYTECODE_FLAG_LITTLE_ENDIAN) ? "LITTLE" : "BIG");
     context.cursorPosition += sizeof(u_int8_t);
+    context.isCompactEncoding = (flagsByte & MAPL_BYTECODE_FLAG_COMPACT_ENCODING) != 0;
+    if (context.isCompactEncoding) {
+        printf("(COMPACT ENCODING)\n");
+    }
+    context.isPooledStrings = (flagsByte & MAPL_BYTECODE_FLAG_POOLED_STRINGS) != 0;
+    if (context.isPooledStrings) {
+        printf("(POOLED STRINGS)\n");
+    }
     
     printf("(PRIMITIVE STACK BYTE SIZE)\n");
     printMemoryAddress(&context);
@@ -5,11 +5,17 @@
 //  Created by Brad Bambara on 4/12/22.
 //
 
+#include <chrono>
 #include <filesystem>
 #include <fstream>
+#include <limits>
 #include <sstream>
 #include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
+#include "MaPLBytecodeConstants.h"
 #include "MaPLCompiler.h"
 #include "MaPLDecompiler.h"
 #include "MaPLRuntime.h"
@@ -19,6 +25,12 @@
 #define OUTPUT_EXPECTED_FILES 0
 // Determines if errors from intentionally erroneous scripts are printed to the console.
 #define PRINT_ERROR_OUTPUT 0
+// Compares the startup cost of loading thousands of individual bytecode files against loading a single memory-mapped bundle.
+#define RUN_BUNDLE_BENCHMARK 0
+// Measures how long the compiler spends resolving calls against an API with thousands of functions.
+#define RUN_API_LOOKUP_BENCHMARK 0
+// Compares formatting floats in typed metadata against formatting them through string typecasts.
+#define RUN_METADATA_FLOAT_BENCHMARK 0
 
 struct TestDirectoryContents {
     std::filesystem::path bytecodePath;
@@ -208,6 +220,14 @@ void metadata(const char* metadataString) {
     scriptCallbacksString += "Debug metadata: '"+std::string(metadataString)+"'\n";
 }
 
+std::string sinkMetadataString;
+size_t sinkMetadataCount = 0;
+
+void metadataSink(const char* metadata, size_t length) {
+    sinkMetadataString.append(metadata, length);
+    sinkMetadataCount++;
+}
+
 void debugLine(MaPLLineNumber lineNumber) {
     scriptCallbacksString += "Debug line: "+std::to_string(lineNumber)+"\n";
 }
@@ -233,9 +253,25 @@ bool pathHasExtension(const std::filesystem::path &path, const std::string &exte
     return pathExtension == extension;
 }
 
+std::map<std::filesystem::path, std::string> bundleNamesForFiles(const std::map<std::filesystem::path, std::vector<uint8_t>> &compiledFiles) {
+    // Bundled scripts are named by their path relative to the deepest directory that contains all of them.
+    std::filesystem::path bundleRoot = compiledFiles.size() ? compiledFiles.begin()->first.parent_path() : std::filesystem::path();
+    for (const auto&[path, bytecode] : compiledFiles) {
+        while (*path.lexically_relative(bundleRoot).begin() == "..") {
+            bundleRoot = bundleRoot.parent_path();
+        }
+    }
+    std::map<std::filesystem::path, std::string> bundleNames;
+    for (const auto&[path, bytecode] : compiledFiles) {
+        bundleNames[path] = path.lexically_relative(bundleRoot).generic_string();
+    }
+    return bundleNames;
+}
+
 MaPLCompileResult runTests(const std::vector<std::filesystem::path> &scriptsUnderTest,
                            const std::map<std::filesystem::path, TestDirectoryContents> &directoryMap,
-                           const MaPLCompileOptions &compileOptions) {
+                           const MaPLCompileOptions &compileOptions,
+                           bool compareBytecode = true) {
     MaPLCompileResult result = compileMaPL(scriptsUnderTest, compileOptions);
     
     if (result.errorMessages.size()) {
@@ -259,43 +295,46 @@ MaPLCompileResult runTests(const std::vector<std::filesystem::path> &scriptsUnde
     };
     
     // Compare the bytecode for each script against its expected bytecode.
+    std::map<std::filesystem::path, std::string> bundleNames = bundleNamesForFiles(result.compiledFiles);
     for (const auto&[path, bytecode] : result.compiledFiles) {
         TestDirectoryContents contents = directoryMap.at(path);
 #if OUTPUT_EXPECTED_FILES
         std::ofstream bytecodeOutputStream(contents.bytecodePath);
         bytecodeOutputStream.write((char *)(&bytecode[0]), bytecode.size());
 #else
-        // Compare the length of expected bytecode.
-        std::ifstream inputStream(contents.bytecodePath, std::ios::binary|std::ios::ate);
-        if (!inputStream) {
-            printf("Unable to find expected bytecode file '%s'.\n", contents.bytecodePath.c_str());
-            exit(1);
-        }
-        size_t length = inputStream.tellg();
-        if (length != bytecode.size()) {
-            printf("Compiled bytecode is a different length than expected bytecode '%s'.\n", contents.bytecodePath.c_str());
-            exit(1);
-        }
+        if (compareBytecode) {
+            // Compare the length of expected bytecode.
+            std::ifstream inputStream(contents.bytecodePath, std::ios::binary|std::ios::ate);
+            if (!inputStream) {
+                printf("Unable to find expected bytecode file '%s'.\n", contents.bytecodePath.c_str());
+                exit(1);
+            }
+            size_t length = inputStream.tellg();
+            if (length != bytecode.size()) {
+                printf("Compiled bytecode is a different length than expected bytecode '%s'.\n", contents.bytecodePath.c_str());
+                exit(1);
+            }
         
-        // Compare the contents of the expected bytecode.
-        inputStream.seekg(0, std::ios::beg);
-        u_int8_t expectedBytecode[length];
-        inputStream.read((char *)expectedBytecode, length);
-        if (memcmp(expectedBytecode, &bytecode[0], length)) {
-            printf("Compiled bytecode has different content than expected bytecode '%s'.\n", contents.bytecodePath.c_str());
-            for (size_t i = 0; i < length; i++) {
-                if (expectedBytecode[i] != bytecode[i]) {
-                    printf("Byte #%lu: Expected %u, got %u.\n", i, expectedBytecode[i], bytecode[i]);
+            // Compare the contents of the expected bytecode.
+            inputStream.seekg(0, std::ios::beg);
+            u_int8_t expectedBytecode[length];
+            inputStream.read((char *)expectedBytecode, length);
+            if (memcmp(expectedBytecode, &bytecode[0], length)) {
+                printf("Compiled bytecode has different content than expected bytecode '%s'.\n", contents.bytecodePath.c_str());
+                for (size_t i = 0; i < length; i++) {
+                    if (expectedBytecode[i] != bytecode[i]) {
+                        printf("Byte #%lu: Expected %u, got %u.\n", i, expectedBytecode[i], bytecode[i]);
+                    }
                 }
-            }
             
-            printf("\nExpected bytecode:\n");
-            printDecompilationOfBytecode(expectedBytecode, length);
+                printf("\nExpected bytecode:\n");
+                printDecompilationOfBytecode(expectedBytecode, length);
             
-            printf("\nGot bytecode:\n");
-            printDecompilationOfBytecode(&(bytecode[0]), length);
+                printf("\nGot bytecode:\n");
+                printDecompilationOfBytecode(&(bytecode[0]), length);
             
-            exit(1);
+                exit(1);
+            }
         }
 #endif
         
@@ -308,8 +347,19 @@ MaPLCompileResult runTests(const std::vector<std::filesystem::path> &scriptsUnde
         fakeIntSubscript = 0;
         fakeFloatSubscript = 0;
         
-        // Run the script.
-        executeMaPLScript(&bytecode[0], bytecode.size(), &testCallbacks);
+        // Run the script. Bundled scripts are run from within the bundle, which must behave identically.
+        if (compileOptions.bundleScripts) {
+            const std::string &bundleName = bundleNames.at(path);
+            MaPLBytecodeLength bundledLength;
+            const void *bundledBytecode = findMaPLBundleScript(&result.bundle[0], result.bundle.size(), bundleName.c_str(), &bundledLength);
+            if (!bundledBytecode) {
+                printf("Unable to find script '%s' in the compiled bundle.\n", bundleName.c_str());
+                exit(1);
+            }
+            executeMaPLScript(bundledBytecode, bundledLength, &testCallbacks);
+        } else {
+            executeMaPLScript(&bytecode[0], bytecode.size(), &testCallbacks);
+        }
         if (scriptEncounteredError) {
             std::string errorDescription;
             switch (encounteredError) {
@@ -376,6 +426,819 @@ MaPLCompileResult runTests(const std::vector<std::filesystem::path> &scriptsUnde
     return result;
 }
 
+void runMetadataOutputTest(const std::filesystem::path &testRootDirectory, bool typedMetadata, const std::string &expectedMetadata, size_t expectedCount) {
+    std::string scriptSource = "float32 f = 0.1;\n"
+                               "float64 d = 1.0/3.0;\n"
+                               "float64 million = 1000000.0;\n"
+                               "float64 whole = 123456.0;\n"
+                               "int64 negative = -9000000000;\n"
+                               "char c = (char)200;\n"
+                               "bool b = false;\n"
+                               "<?Typed ${f} ${d} ${million} ${whole} ${negative} ${c} ${b} ${(float64)0.25}?>\n";
+    MaPLCompileOptions options = { false, "TestSymbols" };
+    options.typedMetadata = typedMetadata;
+    MaPLCompileResult result = compileMaPLSources({ { testRootDirectory / "typedMetadata.mapl", scriptSource } }, MaPLImportResolver(), options);
+    if (result.errorMessages.size()) {
+        printf("Failed to compile typed metadata script.\n");
+        exit(1);
+    }
+    MaPLCallbacks sinkCallbacks = { invokeFunction, invokeSubscript, assignProperty, assignSubscript };
+    sinkCallbacks.metadataSink = metadataSink;
+    sinkMetadataString = "";
+    sinkMetadataCount = 0;
+    const std::vector<uint8_t> &bytecode = result.compiledFiles.begin()->second;
+    executeMaPLScript(&bytecode[0], bytecode.size(), &sinkCallbacks);
+    if (sinkMetadataString != expectedMetadata || sinkMetadataCount != expectedCount) {
+        printf("Expected metadata '%s' in %zu callbacks, but received '%s' in %zu callbacks.\n", expectedMetadata.c_str(), expectedCount, sinkMetadataString.c_str(), sinkMetadataCount);
+        exit(1);
+    }
+    
+    // A buffer that is smaller than some sections must still flush every byte in order.
+    char storage[8];
+    MaPLMetadataBuffer flushedBuffer = { storage, sizeof(storage), 0, metadataSink };
+    MaPLCallbacks bufferCallbacks = { invokeFunction, invokeSubscript, assignProperty, assignSubscript };
+    bufferCallbacks.metadataBuffer = &flushedBuffer;
+    sinkMetadataString = "";
+    executeMaPLScript(&bytecode[0], bytecode.size(), &bufferCallbacks);
+    if (sinkMetadataString != expectedMetadata) {
+        printf("Expected flushed metadata '%s', but received '%s'.\n", expectedMetadata.c_str(), sinkMetadataString.c_str());
+        exit(1);
+    }
+    
+    // Without a flush callback, the buffer grows to hold all of the metadata.
+    MaPLMetadataBuffer growableBuffer = { NULL, 0, 0, NULL };
+    bufferCallbacks.metadataBuffer = &growableBuffer;
+    executeMaPLScript(&bytecode[0], bytecode.size(), &bufferCallbacks);
+    std::string grownMetadata(growableBuffer.buffer, growableBuffer.length);
+    free(growableBuffer.buffer);
+    if (grownMetadata != expectedMetadata) {
+        printf("Expected buffered metadata '%s', but received '%s'.\n", expectedMetadata.c_str(), grownMetadata.c_str());
+        exit(1);
+    }
+}
+
+#if RUN_BUNDLE_BENCHMARK
+void runBundleBenchmark(const std::filesystem::path &benchmarkDirectory) {
+    const size_t scriptCount = 5000;
+    std::map<std::filesystem::path, std::string> scriptSources;
+    for (size_t i = 0; i < scriptCount; i++) {
+        std::string index = std::to_string(i);
+        scriptSources[benchmarkDirectory / ("script"+index+".mapl")] = "int32 index = "+index+";\nstring greeting = \"Hello from script "+index+"\";\nstring farewell = \"Goodbye\";\n";
+    }
+    MaPLCompileOptions bundleOptions = { false, "TestSymbols" };
+    bundleOptions.bundleScripts = true;
+    MaPLCompileResult result = compileMaPLSources(scriptSources, MaPLImportResolver(), bundleOptions);
+    if (result.errorMessages.size()) {
+        printf("Failed to compile benchmark scripts.\n");
+        exit(1);
+    }
+    
+    std::filesystem::create_directories(benchmarkDirectory);
+    for (const auto&[path, bytecode] : result.compiledFiles) {
+        std::ofstream bytecodeOutputStream(std::filesystem::path(path).replace_extension(".maplb"), std::ios::binary);
+        bytecodeOutputStream.write((char *)(&bytecode[0]), bytecode.size());
+    }
+    std::filesystem::path bundlePath = benchmarkDirectory / "scripts.maplbundle";
+    std::ofstream bundleOutputStream(bundlePath, std::ios::binary);
+    bundleOutputStream.write((char *)(&result.bundle[0]), result.bundle.size());
+    bundleOutputStream.close();
+    
+    MaPLCallbacks benchmarkCallbacks = { invokeFunction, invokeSubscript, assignProperty, assignSubscript };
+    std::map<std::filesystem::path, std::string> bundleNames = bundleNamesForFiles(result.compiledFiles);
+    
+    // Loose files are each opened, read into memory, and executed.
+    auto looseStart = std::chrono::steady_clock::now();
+    for (const auto&[path, bytecode] : result.compiledFiles) {
+        std::ifstream inputStream(std::filesystem::path(path).replace_extension(".maplb"), std::ios::binary|std::ios::ate);
+        std::vector<char> looseBytecode((size_t)inputStream.tellg());
+        inputStream.seekg(0, std::ios::beg);
+        inputStream.read(&looseBytecode[0], looseBytecode.size());
+        executeMaPLScript(&looseBytecode[0], looseBytecode.size(), &benchmarkCallbacks);
+    }
+    auto looseDuration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - looseStart);
+    
+    // The bundle is mapped once, and each script is executed directly from the mapped pages.
+    auto bundleStart = std::chrono::steady_clock::now();
+    int bundleFile = open(bundlePath.c_str(), O_RDONLY);
+    size_t bundleLength = result.bundle.size();
+    const void *mappedBundle = mmap(NULL, bundleLength, PROT_READ, MAP_PRIVATE, bundleFile, 0);
+    for (const auto&[path, bytecode] : result.compiledFiles) {
+        MaPLBytecodeLength scriptLength;
+        const void *script = findMaPLBundleScript(mappedBundle, bundleLength, bundleNames.at(path).c_str(), &scriptLength);
+        if (!script) {
+            printf("Unable to find script '%s' in the benchmark bundle.\n", bundleNames.at(path).c_str());
+            exit(1);
+        }
+        executeMaPLScript(script, scriptLength, &benchmarkCallbacks);
+    }
+    munmap((void *)mappedBundle, bundleLength);
+    close(bundleFile);
+    auto bundleDuration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - bundleStart);
+    
+    printf("Loaded and executed %zu loose files in %lld microseconds.\n", scriptCount, (long long)looseDuration.count());
+    printf("Loaded and executed %zu bundled scripts in %lld microseconds.\n", scriptCount, (long long)bundleDuration.count());
+    std::filesystem::remove_all(benchmarkDirectory);
+}
+#endif
+
+#if RUN_API_LOOKUP_BENCHMARK
+void runAPILookupBenchmark(const std::filesystem::path &benchmarkDirectory) {
+    const size_t functionCount = 1000;
+    const size_t compileCount = 20;
+    std::string scriptSource = "#type BenchmarkBase {\n";
+    for (size_t i = 0; i < functionCount; i++) {
+        std::string index = std::to_string(i);
+        scriptSource += "    int32 baseFunction"+index+"(int32 a);\n";
+        scriptSource += "    int32 baseFunction"+index+"(int32 a, float32 b);\n";
+    }
+    scriptSource += "}\n#type BenchmarkDerived : BenchmarkBase {\n";
+    for (size_t i = 0; i < functionCount; i++) {
+        scriptSource += "    int32 derivedFunction"+std::to_string(i)+"(string a);\n";
+    }
+    scriptSource += "}\n#global BenchmarkDerived benchmarkObject;\n";
+    for (size_t i = 0; i < functionCount; i++) {
+        std::string index = std::to_string(i);
+        scriptSource += "#global int32 globalFunction"+index+"(int32 a, ...);\n";
+    }
+    for (size_t i = 0; i < functionCount; i++) {
+        std::string index = std::to_string(i);
+        scriptSource += "int32 result"+index+" = benchmarkObject.baseFunction"+index+"(1, 2.0) + benchmarkObject.derivedFunction"+index+"(\"a\") + globalFunction"+index+"(1, (int32)2, (int32)3);\n";
+    }
+    std::map<std::filesystem::path, std::string> scriptSources = { { benchmarkDirectory / "script.mapl", scriptSource } };
+    
+    auto compileStart = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < compileCount; i++) {
+        MaPLCompileResult result = compileMaPLSources(scriptSources, MaPLImportResolver(), { false });
+        if (result.errorMessages.size()) {
+            printf("Failed to compile API lookup benchmark script.\n");
+            exit(1);
+        }
+    }
+    auto compileDuration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - compileStart);
+    printf("Compiled %zu calls against %zu API functions %zu times in %lld microseconds.\n", functionCount*3, functionCount*4, compileCount, (long long)compileDuration.count());
+}
+#endif
+
+#if RUN_METADATA_FLOAT_BENCHMARK
+void runMetadataFloatBenchmark(const std::filesystem::path &testRootDirectory) {
+    const size_t iterationCount = 200000;
+    std::string scriptSource = "float64 value = 0.1;\n"
+                               "for int32 i = 0; i < "+std::to_string(iterationCount)+"; i++ {\n"
+                               "    <?${value} ${(float32)value}?>\n"
+                               "    value = value * 1.0001 + 0.37;\n"
+                               "}\n";
+    MaPLCallbacks sinkCallbacks = { invokeFunction, invokeSubscript, assignProperty, assignSubscript };
+    sinkCallbacks.metadataSink = metadataSink;
+    for (bool typedMetadata : { false, true }) {
+        MaPLCompileOptions options = { false, "TestSymbols" };
+        options.typedMetadata = typedMetadata;
+        MaPLCompileResult result = compileMaPLSources({ { testRootDirectory / "metadataFloatBenchmark.mapl", scriptSource } }, MaPLImportResolver(), options);
+        if (result.errorMessages.size()) {
+            printf("Failed to compile metadata float benchmark script.\n");
+            exit(1);
+        }
+        const std::vector<uint8_t> &bytecode = result.compiledFiles.begin()->second;
+        sinkMetadataString = "";
+        auto start = std::chrono::steady_clock::now();
+        executeMaPLScript(&bytecode[0], bytecode.size(), &sinkCallbacks);
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        printf("Formatted %zu floats with %s in %lld microseconds.\n", iterationCount*2, typedMetadata ? "typed metadata" : "string typecasts", (long long)duration.count());
+    }
+}
+#endif
+
+MaPLDependency *executeLinkedDependencies(const MaPLCompileResult &result,
+                                          const std::filesystem::path &scriptPath,
+                                          const MaPLCallbacks *callbacks,
+                                          std::vector<MaPLDependency *> &executedDependencies) {
+    if (!result.linkedDependencies.count(scriptPath)) {
+        return NULL;
+    }
+    // Linked dependencies can themselves be linked, so the whole chain is executed starting from its root.
+    const std::filesystem::path &dependencyPath = result.linkedDependencies.at(scriptPath);
+    MaPLDependency *parentDependency = executeLinkedDependencies(result, dependencyPath, callbacks, executedDependencies);
+    const std::vector<uint8_t> &bytecode = result.compiledFiles.at(dependencyPath);
+    MaPLDependency *dependency = executeMaPLDependency(&bytecode[0], bytecode.size(), parentDependency, callbacks);
+    executedDependencies.push_back(dependency);
+    return dependency;
+}
+
+void runLinkedDependencyTest(const std::filesystem::path &testRootDirectory, const std::map<std::string, MaPLSymbol> &persistedSymbols) {
+    std::map<std::filesystem::path, std::string> scriptSources = {
+        { testRootDirectory / "linkCommon.mapl", "#import \"TestAPI.mapl\"\nint32 shared = 2;\nstring label = \"Linked\";\n" },
+        { testRootDirectory / "linkFirst.mapl", "#import \"linkCommon.mapl\"\nint32 first = shared + 1;\n" },
+        { testRootDirectory / "linkSecond.mapl", "#import \"linkCommon.mapl\"\nint32 second = shared * 10;\n" },
+    };
+    std::filesystem::path linkedPath = testRootDirectory / "linkedScript.mapl";
+    std::map<std::filesystem::path, std::string> linkedSources = scriptSources;
+    linkedSources[linkedPath] = "#import \"linkFirst.mapl\"\nprint(label, shared, first);\nfirst = 4;\nprint(first);\n";
+    
+    // The output of the linked script must match the output of the same script with its dependencies copied in.
+    // Symbols are persisted from the test scripts so that they match the values in TestSymbols.h.
+    MaPLCompileOptions options = { false, "TestSymbols" };
+    options.persistedSymbols = persistedSymbols;
+    MaPLCallbacks linkCallbacks = { invokeFunction, invokeSubscript, assignProperty, assignSubscript };
+    MaPLCompileResult copiedResult = compileMaPLSources(linkedSources, MaPLImportResolver(), options);
+    options.linkDependencies = true;
+    MaPLCompileResult linkedResult = compileMaPLSources(linkedSources, MaPLImportResolver(), options);
+    if (copiedResult.errorMessages.size() || linkedResult.errorMessages.size()) {
+        printf("Failed to compile linked dependency scripts.\n");
+        exit(1);
+    }
+    if (!linkedResult.linkedDependencies.count(linkedPath) || linkedResult.linkedDependencies.at(linkedPath) != testRootDirectory / "linkFirst.mapl") {
+        printf("Expected '%s' to be linked against 'linkFirst.mapl'.\n", linkedPath.c_str());
+        exit(1);
+    }
+    scriptPrintString.clear();
+    const std::vector<uint8_t> &copiedBytecode = copiedResult.compiledFiles.at(linkedPath);
+    executeMaPLScript(&copiedBytecode[0], copiedBytecode.size(), &linkCallbacks);
+    std::string expectedPrintString = scriptPrintString;
+    if (expectedPrintString.empty()) {
+        printf("Expected the linked dependency script to print output.\n");
+        exit(1);
+    }
+    
+    // Each linked script starts from a copy of its dependency's variables, so it can run repeatedly with the same output.
+    std::vector<MaPLDependency *> executedDependencies;
+    MaPLDependency *dependency = executeLinkedDependencies(linkedResult, linkedPath, &linkCallbacks, executedDependencies);
+    const std::vector<uint8_t> &linkedBytecode = linkedResult.compiledFiles.at(linkedPath);
+    for (size_t i = 0; i < 2; i++) {
+        scriptPrintString.clear();
+        executeMaPLLinkedScript(&linkedBytecode[0], linkedBytecode.size(), dependency, &linkCallbacks);
+        if (scriptPrintString != expectedPrintString) {
+            printf("Expected linked script output '%s', but received '%s'.\n", expectedPrintString.c_str(), scriptPrintString.c_str());
+            exit(1);
+        }
+    }
+    for (auto it = executedDependencies.rbegin(); it != executedDependencies.rend(); it++) {
+        freeMaPLDependency(*it);
+    }
+    
+    // A script with imports that are independent of each other can't be linked against either one.
+    std::filesystem::path independentPath = testRootDirectory / "independentImports.mapl";
+    std::map<std::filesystem::path, std::string> independentSources = scriptSources;
+    independentSources[independentPath] = "#import \"linkFirst.mapl\"\n#import \"linkSecond.mapl\"\nprint(first, second);\n";
+    MaPLCompileResult independentResult = compileMaPLSources(independentSources, MaPLImportResolver(), options);
+    if (independentResult.errorMessages.size() != 1 || independentResult.errorMessages[0].find("independent of each other") == std::string::npos) {
+        printf("Expected a single error for linking a script with independent imports.\n");
+        exit(1);
+    }
+}
+
+std::string printOutputOfBytecode(const std::vector<uint8_t> &bytecode) {
+    MaPLCallbacks printCallbacks = { invokeFunction, invokeSubscript, assignProperty, assignSubscript };
+    scriptPrintString.clear();
+    executeMaPLScript(&bytecode[0], bytecode.size(), &printCallbacks);
+    return scriptPrintString;
+}
+
+void runCompileSessionTest(const std::filesystem::path &sessionDirectory, const std::filesystem::path &apiPath, const std::map<std::string, MaPLSymbol> &persistedSymbols) {
+    std::filesystem::create_directories(sessionDirectory);
+    std::filesystem::path importedPath = sessionDirectory / "imported.mapl";
+    std::filesystem::path scriptPath = sessionDirectory / "script.mapl";
+    std::ofstream(importedPath) << "#import \""+apiPath.string()+"\"\nint32 value = 1;\n";
+    std::ofstream(scriptPath) << "#import \"imported.mapl\"\nprint(value);\n";
+    
+    // Symbols are persisted from the test scripts so that they match the values in TestSymbols.h.
+    MaPLCompileOptions options = { false, "TestSymbols" };
+    options.persistedSymbols = persistedSymbols;
+    MaPLCompileSession session(options);
+    MaPLCompileResult firstResult = session.compile({ scriptPath });
+    MaPLCompileResult unchangedResult = session.compile({ scriptPath });
+    if (firstResult.errorMessages.size() || unchangedResult.errorMessages.size()) {
+        printf("Failed to compile compile session scripts.\n");
+        exit(1);
+    }
+    if (printOutputOfBytecode(firstResult.compiledFiles.at(scriptPath)) != "(int32)1\n" ||
+        unchangedResult.compiledFiles.at(scriptPath) != firstResult.compiledFiles.at(scriptPath)) {
+        printf("Expected the compile session to reuse the unchanged script.\n");
+        exit(1);
+    }
+    
+    // Modifying the imported file must recompile the script that imports it. The modification time is
+    // advanced explicitly, since some filesystems don't record it with enough precision to tell the writes apart.
+    std::filesystem::file_time_type firstWriteTime = std::filesystem::last_write_time(importedPath);
+    std::ofstream(importedPath) << "#import \""+apiPath.string()+"\"\nint32 value = 2;\n";
+    std::filesystem::last_write_time(importedPath, firstWriteTime + std::chrono::seconds(1));
+    MaPLCompileResult modifiedResult = session.compile({ scriptPath });
+    if (modifiedResult.errorMessages.size() || printOutputOfBytecode(modifiedResult.compiledFiles.at(scriptPath)) != "(int32)2\n") {
+        printf("Expected the compile session to recompile a script when its import was modified.\n");
+        exit(1);
+    }
+
+    // A script compiled first as a dependency (without debug output) must still get its debug output when it's later compiled as a root.
+    MaPLCompileOptions debugOptions = options;
+    debugOptions.includeDebugBytes = true;
+    debugOptions.debugLineTable = true;
+    MaPLCompileResult freshDebugResult = MaPLCompileSession(debugOptions).compile({ importedPath });
+    MaPLCompileSession debugSession(debugOptions);
+    debugSession.compile({ scriptPath });
+    MaPLCompileResult dependencyFirstResult = debugSession.compile({ importedPath });
+    MaPLCompileResult combinedResult = MaPLCompileSession(debugOptions).compile({ scriptPath, importedPath });
+    if (freshDebugResult.errorMessages.size() || dependencyFirstResult.errorMessages.size() || combinedResult.errorMessages.size() ||
+        freshDebugResult.debugLineTables.at(importedPath).empty() ||
+        dependencyFirstResult.compiledFiles.at(importedPath) != freshDebugResult.compiledFiles.at(importedPath) ||
+        dependencyFirstResult.debugLineTables.at(importedPath) != freshDebugResult.debugLineTables.at(importedPath) ||
+        combinedResult.compiledFiles.at(importedPath) != freshDebugResult.compiledFiles.at(importedPath)) {
+        printf("Expected the compile session to emit debug output for a script that was previously compiled as a dependency.\n");
+        exit(1);
+    }
+    std::filesystem::remove_all(sessionDirectory);
+    
+    // Imports supplied by a resolver must also be recompiled when the resolver supplies different text.
+    std::map<std::filesystem::path, std::string> resolvedSources = {
+        { importedPath, "#import \""+apiPath.string()+"\"\nint32 value = 3;\n" },
+    };
+    MaPLImportResolver importResolver = [&resolvedSources](const std::filesystem::path &normalizedPath, std::string &sourceText) {
+        if (resolvedSources.count(normalizedPath)) {
+            sourceText = resolvedSources.at(normalizedPath);
+            return true;
+        }
+        std::ifstream inputStream(normalizedPath);
+        std::stringstream stringBuffer;
+        stringBuffer << inputStream.rdbuf();
+        sourceText = stringBuffer.str();
+        return (bool)inputStream;
+    };
+    MaPLCompileSession resolverSession(options, importResolver);
+    std::map<std::filesystem::path, std::string> scriptSources = { { scriptPath, "#import \"imported.mapl\"\nprint(value);\n" } };
+    MaPLCompileResult resolvedResult = resolverSession.compileSources(scriptSources);
+    resolvedSources[importedPath] = "#import \""+apiPath.string()+"\"\nint32 value = 4;\n";
+    MaPLCompileResult reresolvedResult = resolverSession.compileSources(scriptSources);
+    if (resolvedResult.errorMessages.size() || reresolvedResult.errorMessages.size()) {
+        printf("Failed to compile resolved compile session scripts.\n");
+        exit(1);
+    }
+    if (printOutputOfBytecode(resolvedResult.compiledFiles.at(scriptPath)) != "(int32)3\n" ||
+        printOutputOfBytecode(reresolvedResult.compiledFiles.at(scriptPath)) != "(int32)4\n") {
+        printf("Expected the compile session to recompile a script when its resolved import changed.\n");
+        exit(1);
+    }
+}
+
+void runLoopInvariantTest(const std::filesystem::path &testRootDirectory, const std::map<std::string, MaPLSymbol> &persistedSymbols) {
+    // Both loops share the same invariant conditional, which must be evaluated once for the outer loop and then reused.
+    std::filesystem::path scriptPath = testRootDirectory / "loopInvariant.mapl";
+    std::string scriptSource = "#import \"TestAPI.mapl\"\n"
+                               "for int32 i = 0; i < globalObject.intProperty; i++ {\n"
+                               "    for int32 j = 0; j < globalObject.intProperty; j++ {\n"
+                               "        print(i, j);\n"
+                               "    }\n"
+                               "    print(i < globalObject.intProperty);\n"
+                               "}\n";
+    MaPLCompileOptions options = { false, "TestSymbols" };
+    options.persistedSymbols = persistedSymbols;
+    MaPLCompileResult unhoistedResult = compileMaPLSources({ { scriptPath, scriptSource } }, MaPLImportResolver(), options);
+    options.invariantSymbols = { "GLOBAL_globalObject", "Object_intProperty" };
+    MaPLCompileResult hoistedResult = compileMaPLSources({ { scriptPath, scriptSource } }, MaPLImportResolver(), options);
+    if (unhoistedResult.errorMessages.size() || hoistedResult.errorMessages.size()) {
+        printf("Failed to compile loop invariant script.\n");
+        exit(1);
+    }
+    
+    std::string propertyInvocation = "symbol="+std::to_string(TestSymbols_Object_intProperty)+",";
+    std::vector<std::string> printStrings;
+    std::vector<size_t> invocationCounts;
+    for (const MaPLCompileResult *result : { &unhoistedResult, &hoistedResult }) {
+        scriptCallbacksString.clear();
+        fakeIntProperty = 3;
+        printStrings.push_back(printOutputOfBytecode(result->compiledFiles.at(scriptPath)));
+        size_t invocationCount = 0;
+        for (size_t position = scriptCallbacksString.find(propertyInvocation); position != std::string::npos; position = scriptCallbacksString.find(propertyInvocation, position+1)) {
+            invocationCount++;
+        }
+        invocationCounts.push_back(invocationCount);
+    }
+    fakeIntProperty = 0;
+    if (printStrings[0].empty() || printStrings[0] != printStrings[1]) {
+        printf("Hoisting loop invariants changed the output of the loop invariant script.\n");
+        exit(1);
+    }
+    if (invocationCounts[0] != 19 || invocationCounts[1] != 1) {
+        printf("Expected the invariant property to be read 19 times without hoisting and once with hoisting, but it was read %zu and %zu times.\n", invocationCounts[0], invocationCounts[1]);
+        exit(1);
+    }
+}
+
+void runPeepholeTest(const std::filesystem::path &testRootDirectory, const std::map<std::string, MaPLSymbol> &persistedSymbols) {
+    // Self-assignment, a "continue" at the end of a loop, and a loop that always breaks all leave wasteful patterns behind.
+    std::filesystem::path scriptPath = testRootDirectory / "peephole.mapl";
+    std::string scriptSource = "#import \"TestAPI.mapl\"\n"
+                               "int32 a = 2;\n"
+                               "a = a;\n"
+                               "for int32 i = 0; i < 3; i++ {\n"
+                               "    if i == 1 {\n"
+                               "        continue;\n"
+                               "    }\n"
+                               "    while true {\n"
+                               "        break;\n"
+                               "    }\n"
+                               "    print(i, a);\n"
+                               "    continue;\n"
+                               "}\n";
+    MaPLCompileOptions options = { false, "TestSymbols" };
+    options.persistedSymbols = persistedSymbols;
+    MaPLCompileResult unoptimizedResult = compileMaPLSources({ { scriptPath, scriptSource } }, MaPLImportResolver(), options);
+    options.optimizationLevel = 1;
+    MaPLCompileResult optimizedResult = compileMaPLSources({ { scriptPath, scriptSource } }, MaPLImportResolver(), options);
+    if (unoptimizedResult.errorMessages.size() || optimizedResult.errorMessages.size()) {
+        printf("Failed to compile peephole script.\n");
+        exit(1);
+    }
+    size_t bytesSaved = optimizedResult.peepholeBytesSaved.count(scriptPath) ? optimizedResult.peepholeBytesSaved.at(scriptPath) : 0;
+    if (bytesSaved == 0) {
+        printf("Expected the peephole optimizer to remove bytes from the peephole script.\n");
+        exit(1);
+    }
+    std::string expectedPrintString = printOutputOfBytecode(unoptimizedResult.compiledFiles.at(scriptPath));
+    if (expectedPrintString.empty() || printOutputOfBytecode(optimizedResult.compiledFiles.at(scriptPath)) != expectedPrintString) {
+        printf("The peephole optimizer changed the output of the peephole script.\n");
+        exit(1);
+    }
+}
+
+void runConstantPropagationTest(const std::filesystem::path &testRootDirectory, const std::map<std::string, MaPLSymbol> &persistedSymbols) {
+    std::filesystem::path scriptPath = testRootDirectory / "constantPropagation.mapl";
+    std::string scriptSource = "#import \"TestAPI.mapl\"\n"
+                               "int32 width = 4;\n"
+                               "int32 height = width * 3;\n"
+                               "string label = \"area\";\n"
+                               "int32 counter = 1;\n"
+                               "counter += width;\n"
+                               "if height > 10 {\n"
+                               "    print(label, width * height, counter);\n"
+                               "} else {\n"
+                               "    print(\"small\");\n"
+                               "}\n";
+    // The same script as it should look once every read of a never-reassigned variable is folded. The conditional
+    // becomes constant, so its dead branch is stripped. The reassigned counter must still be read from memory.
+    std::string foldedSource = "#import \"TestAPI.mapl\"\n"
+                               "int32 width = 4;\n"
+                               "int32 height = 12;\n"
+                               "string label = \"area\";\n"
+                               "int32 counter = 1;\n"
+                               "counter += 4;\n"
+                               "print(\"area\", (int32)48, counter);\n";
+    
+    // Symbols are persisted from the test scripts so that they match the values in TestSymbols.h.
+    MaPLCompileOptions options = { false, "TestSymbols" };
+    options.persistedSymbols = persistedSymbols;
+    MaPLCompileResult unpropagatedResult = compileMaPLSources({ { scriptPath, scriptSource } }, MaPLImportResolver(), options);
+    MaPLCompileResult foldedResult = compileMaPLSources({ { scriptPath, foldedSource } }, MaPLImportResolver(), options);
+    options.propagateConstants = true;
+    MaPLCompileResult propagatedResult = compileMaPLSources({ { scriptPath, scriptSource } }, MaPLImportResolver(), options);
+    if (unpropagatedResult.errorMessages.size() || foldedResult.errorMessages.size() || propagatedResult.errorMessages.size()) {
+        printf("Failed to compile constant propagation script.\n");
+        exit(1);
+    }
+    const std::vector<uint8_t> &propagatedBytecode = propagatedResult.compiledFiles.at(scriptPath);
+    const std::vector<uint8_t> &foldedBytecode = foldedResult.compiledFiles.at(scriptPath);
+    if (propagatedBytecode != foldedBytecode) {
+        printf("Constant propagation did not fold the script as expected.\n\nExpected bytecode:\n");
+        printDecompilationOfBytecode(&foldedBytecode[0], foldedBytecode.size());
+        printf("\nGot bytecode:\n");
+        printDecompilationOfBytecode(&propagatedBytecode[0], propagatedBytecode.size());
+        exit(1);
+    }
+    std::string expectedPrintString = printOutputOfBytecode(unpropagatedResult.compiledFiles.at(scriptPath));
+    if (expectedPrintString.empty() || printOutputOfBytecode(propagatedBytecode) != expectedPrintString) {
+        printf("Constant propagation changed the output of the script.\n");
+        exit(1);
+    }
+}
+
+void runDeadStoreTest(const std::filesystem::path &testRootDirectory, size_t expectedWarningCount) {
+    std::filesystem::path scriptPath = testRootDirectory / "deadStore" / "script.mapl";
+    MaPLCompileOptions options = { false, "TestSymbols" };
+    MaPLCompileResult keptResult = compileMaPL({ scriptPath }, options);
+    options.eliminateDeadStores = true;
+    MaPLCompileResult eliminatedResult = compileMaPL({ scriptPath }, options);
+    if (keptResult.errorMessages.size() || eliminatedResult.errorMessages.size()) {
+        printf("Failed to compile dead store script.\n");
+        exit(1);
+    }
+    if (keptResult.warningMessages.size() || eliminatedResult.warningMessages.size() != expectedWarningCount) {
+        printf("Expected %zu dead store warnings, but received %zu.\n", expectedWarningCount, eliminatedResult.warningMessages.size());
+        for (const std::string &warning : eliminatedResult.warningMessages) {
+            printf("%s", warning.c_str());
+        }
+        exit(1);
+    }
+    
+    // The bytecode begins with a byte of flags, followed by the primitive and allocated memory that the script requires.
+    MaPLMemoryAddress keptMemory[2];
+    MaPLMemoryAddress eliminatedMemory[2];
+    memcpy(keptMemory, &keptResult.compiledFiles.at(scriptPath)[1], sizeof(keptMemory));
+    memcpy(eliminatedMemory, &eliminatedResult.compiledFiles.at(scriptPath)[1], sizeof(eliminatedMemory));
+    if (eliminatedMemory[0] >= keptMemory[0] || eliminatedMemory[1] >= keptMemory[1]) {
+        printf("Dead store elimination did not reduce the memory required by the script.\n");
+        exit(1);
+    }
+}
+
+void runCostReportTest(const std::filesystem::path &testRootDirectory, bool compactEncoding) {
+    std::string scriptSource = "#global int32 count();\n"
+                               "#global void log(string message);\n"
+                               "string greeting = \"Hello \" + (string)count();\n"
+                               "for int32 i = 0; i < count(); i++ {\n"
+                               "    for int32 j = 0; j < 2; j++ { log(greeting); }\n"
+                               "}\n";
+    std::filesystem::path scriptPath = testRootDirectory / "costReport.mapl";
+    MaPLCompileOptions options = { false, "TestSymbols" };
+    options.costReport = true;
+    options.compactEncoding = compactEncoding;
+    MaPLCompileResult result = compileMaPLSources({ { scriptPath, scriptSource } }, MaPLImportResolver(), options);
+    if (result.errorMessages.size() || !result.costReports.count(scriptPath)) {
+        printf("Failed to compile cost report script.\n");
+        exit(1);
+    }
+    const std::string &report = result.costReports.at(scriptPath);
+    std::vector<std::string> expectedSubstrings = {
+        "\"bytecodeSize\": "+std::to_string(result.compiledFiles.at(scriptPath).size())+",",
+        "\"GLOBAL_count\": 2",
+        "\"GLOBAL_log_string\": 1",
+        "{ \"symbol\": \"GLOBAL_count\", \"line\": 3, \"loopDepth\": 0 }",
+        "{ \"symbol\": \"GLOBAL_count\", \"line\": 4, \"loopDepth\": 1 }",
+        "{ \"symbol\": \"GLOBAL_log_string\", \"line\": 5, \"loopDepth\": 2 }",
+        "\"stringAllocationsPerLine\": {\n    \"3\": 2\n  }",
+    };
+    for (const std::string &expectedSubstring : expectedSubstrings) {
+        if (report.find(expectedSubstring) == std::string::npos) {
+            printf("Expected the cost report to contain '%s', but received:\n%s", expectedSubstring.c_str(), report.c_str());
+            exit(1);
+        }
+    }
+}
+
+std::map<std::filesystem::path, MaPLScriptProfile> recordExecutionProfiles(const std::vector<std::filesystem::path> &scriptsUnderTest,
+                                                                          const MaPLCompileOptions &compileOptions) {
+    // Profiles identify statements by line and column, so they can only be recorded from scripts that have a line table.
+    MaPLCompileOptions lineTableOptions = compileOptions;
+    lineTableOptions.debugLineTable = true;
+    MaPLCompileResult result = compileMaPL(scriptsUnderTest, lineTableOptions);
+    if (result.errorMessages.size()) {
+        printf("Failed to compile MaPL scripts for execution profiles.\n");
+        exit(1);
+    }
+    
+    // Write the profiles in the same format as a host would, so the compiler's parsing of the format is also covered.
+    FILE *profileFile = tmpfile();
+    MaPLCallbacks profileCallbacks = {
+        invokeFunction,
+        invokeSubscript,
+        assignProperty,
+        assignSubscript,
+        metadata,
+        debugLine,
+        debugVariableUpdate,
+        debugVariableDelete,
+        error,
+    };
+    for (const auto&[path, bytecode] : result.compiledFiles) {
+        MaPLExecutionProfile *executionProfile = createMaPLExecutionProfile((MaPLBytecodeLength)bytecode.size());
+        profileCallbacks.executionProfile = executionProfile;
+        executeMaPLScript(&bytecode[0], bytecode.size(), &profileCallbacks);
+        const std::vector<uint8_t> &lineTable = result.debugLineTables.at(path);
+        writeMaPLExecutionProfile(executionProfile, &lineTable[0], lineTable.size(), path.c_str(), profileFile);
+        freeMaPLExecutionProfile(executionProfile);
+    }
+    std::string profileText((size_t)ftell(profileFile), '\0');
+    rewind(profileFile);
+    size_t readLength = fread(&profileText[0], 1, profileText.size(), profileFile);
+    fclose(profileFile);
+    
+    std::map<std::filesystem::path, MaPLScriptProfile> scriptProfiles;
+    if (readLength != profileText.size() || !parseMaPLExecutionProfile(profileText, std::filesystem::path(), scriptProfiles)) {
+        printf("Unable to parse the recorded execution profiles.\n");
+        exit(1);
+    }
+    return scriptProfiles;
+}
+
+void runExecutionProfileTest(const std::filesystem::path &testRootDirectory, const std::map<std::filesystem::path, MaPLScriptProfile> &scriptProfiles) {
+    std::filesystem::path scriptPath = testRootDirectory / "profile" / "script.mapl";
+    if (!scriptProfiles.count(scriptPath)) {
+        printf("No execution profile was recorded for '%s'.\n", scriptPath.c_str());
+        exit(1);
+    }
+    
+    // The conditional on line 8 is true for 15 of 20 iterations, and the print on line 17 is called twice. Line 13 holds two
+    // conditionals, each with their own print, which are told apart by column.
+    const MaPLScriptProfile &profile = scriptProfiles.at(scriptPath);
+    std::map<MaPLProfileLocation, std::pair<uint64_t, uint64_t>> expectedBranchCounts = {
+        { { 8, 4 }, { 15, 5 } },
+        { { 13, 4 }, { 3, 17 } },
+        { { 13, 36 }, { 2, 18 } },
+    };
+    for (const auto&[location, counts] : expectedBranchCounts) {
+        if (!profile.branchCounts.count(location) || profile.branchCounts.at(location) != counts) {
+            printf("Expected the execution profile to record %llu taken and %llu untaken branches at line %d, column %d.\n",
+                   (unsigned long long)counts.first, (unsigned long long)counts.second, location.first, location.second);
+            exit(1);
+        }
+    }
+    std::map<MaPLProfileLocation, uint64_t> expectedCallCounts = {
+        { { 13, 15 }, 3 },
+        { { 13, 48 }, 2 },
+        { { 17, 8 }, 2 },
+    };
+    for (const auto&[location, count] : expectedCallCounts) {
+        if (!profile.callCounts.count(location) || profile.callCounts.at(location) != count) {
+            printf("Expected the execution profile to record %llu calls at line %d, column %d.\n",
+                   (unsigned long long)count, location.first, location.second);
+            exit(1);
+        }
+    }
+    
+    // The example profile checked in alongside the script was recorded by a host from the script compiled with
+    // -O2 --line-table --unroll-budget=0, and must lead to the same optimizations as the profile recorded above.
+    std::filesystem::path recordedProfilePath = testRootDirectory / "profile" / "recorded.maplprofile";
+    std::ifstream recordedProfileStream(recordedProfilePath);
+    std::stringstream recordedProfileBuffer;
+    recordedProfileBuffer << recordedProfileStream.rdbuf();
+    std::map<std::filesystem::path, MaPLScriptProfile> recordedProfiles;
+    if (!recordedProfileStream || !parseMaPLExecutionProfile(recordedProfileBuffer.str(), recordedProfilePath.parent_path(), recordedProfiles)) {
+        printf("Unable to parse the example execution profile: '%s'.\n", recordedProfilePath.c_str());
+        exit(1);
+    }
+    
+    // Each unrolled copy of a loop's scope adds its statements to the line table again. The loop that never ran must not be
+    // unrolled, and the loop that made most of the host calls must be unrolled by a larger factor than without a profile.
+    MaPLCompileOptions options = { false, "TestSymbols" };
+    options.optimizationLevel = 2;
+    options.debugLineTable = true;
+    MaPLCompileResult unprofiledResult = compileMaPL({ scriptPath }, options);
+    auto statementCount = [&scriptPath](const MaPLCompileResult &result, MaPLLineNumber lineNumber) {
+        const std::vector<uint8_t> &lineTable = result.debugLineTables.at(scriptPath);
+        const MaPLDebugLineEntry *entries = (const MaPLDebugLineEntry *)&lineTable[0];
+        size_t count = 0;
+        for (size_t i = 0; i < lineTable.size() / sizeof(MaPLDebugLineEntry); i++) {
+            if (entries[i].lineNumber == lineNumber) {
+                count++;
+            }
+        }
+        return count;
+    };
+    std::vector<std::map<std::filesystem::path, MaPLScriptProfile>> profilesUnderTest = { scriptProfiles, recordedProfiles };
+    for (const std::map<std::filesystem::path, MaPLScriptProfile> &profiles : profilesUnderTest) {
+        options.scriptProfiles = profiles;
+        MaPLCompileResult profiledResult = compileMaPL({ scriptPath }, options);
+        if (unprofiledResult.errorMessages.size() || profiledResult.errorMessages.size()) {
+            printf("Failed to compile execution profile script.\n");
+            exit(1);
+        }
+        if (statementCount(unprofiledResult, 41) <= 1 || statementCount(profiledResult, 41) != 1) {
+            printf("Expected the loop that never ran to be unrolled only when compiled without an execution profile.\n");
+            exit(1);
+        }
+        if (statementCount(profiledResult, 47) <= statementCount(unprofiledResult, 47)) {
+            printf("Expected the loop that made most of the host calls to be unrolled further when compiled with an execution profile.\n");
+            exit(1);
+        }
+    }
+}
+
+// The state of a script at each call to invokeFunction, recorded by the callbacks of runDebugTableTest.
+struct DebugTableSnapshot {
+    MaPLLineNumber lineNumber;
+    std::map<std::string, std::string> variables;
+};
+std::vector<DebugTableSnapshot> debugTableSnapshots;
+const std::vector<uint8_t> *debugTableLineTable = NULL;
+const std::vector<uint8_t> *debugTableVariableTable = NULL;
+DebugTableSnapshot debugBytesState;
+
+MaPLParameter invokeFunctionWithDebugTables(void *invokedOnPointer, MaPLSymbol functionSymbol, const MaPLParameter *argv, MaPLParameterCount argc) {
+    // Look up every variable that is in scope at the current statement.
+    MaPLBytecodeLength position = currentMaPLStatementPosition();
+    DebugTableSnapshot snapshot{ findMaPLDebugLine(debugTableLineTable->data(), debugTableLineTable->size(), position) };
+    uint32_t variableCount = *((const uint32_t *)debugTableVariableTable->data());
+    const MaPLDebugVariableEntry *entries = (const MaPLDebugVariableEntry *)(debugTableVariableTable->data() + sizeof(uint32_t));
+    for (uint32_t i = 0; i < variableCount; i++) {
+        const char *variableName = (const char *)debugTableVariableTable->data() + entries[i].nameOffset;
+        const MaPLDebugVariableEntry *variable = findMaPLDebugVariable(debugTableVariableTable->data(), debugTableVariableTable->size(), position, variableName);
+        if (variable == entries + i) {
+            snapshot.variables[variableName] = parameterToString(readMaPLDebugVariable(variable));
+        }
+    }
+    debugTableSnapshots.push_back(snapshot);
+    return invokeFunction(invokedOnPointer, functionSymbol, argv, argc);
+}
+
+MaPLParameter invokeFunctionWithDebugBytes(void *invokedOnPointer, MaPLSymbol functionSymbol, const MaPLParameter *argv, MaPLParameterCount argc) {
+    debugTableSnapshots.push_back(debugBytesState);
+    return invokeFunction(invokedOnPointer, functionSymbol, argv, argc);
+}
+
+void debugLineWithDebugBytes(MaPLLineNumber lineNumber) {
+    debugBytesState.lineNumber = lineNumber;
+}
+
+void debugVariableUpdateWithDebugBytes(const char *variableName, MaPLParameter newValue) {
+    debugBytesState.variables[variableName] = parameterToString(newValue);
+}
+
+void debugVariableDeleteWithDebugBytes(const char *variableName) {
+    debugBytesState.variables.erase(variableName);
+}
+
+void runDebugTableTest(const std::vector<std::filesystem::path> &scriptsUnderTest, const MaPLCompileOptions &nonDebugOptions) {
+    // Scripts compiled with debug tables must report the same line and variable values at every host call as scripts
+    // compiled with debug bytes, which report them to the debug callbacks as they execute.
+    MaPLCompileOptions tableOptions = nonDebugOptions;
+    tableOptions.debugLineTable = true;
+    MaPLCompileOptions debugBytesOptions = nonDebugOptions;
+    debugBytesOptions.includeDebugBytes = true;
+    MaPLCompileResult tableResult = compileMaPL(scriptsUnderTest, tableOptions);
+    MaPLCompileResult debugBytesResult = compileMaPL(scriptsUnderTest, debugBytesOptions);
+    if (tableResult.errorMessages.size() || debugBytesResult.errorMessages.size()) {
+        printf("Failed to compile MaPL scripts for the debug table test.\n");
+        exit(1);
+    }
+    MaPLCallbacks tableCallbacks = {
+        invokeFunctionWithDebugTables,
+        invokeSubscript,
+        assignProperty,
+        assignSubscript,
+        metadata,
+        NULL,
+        NULL,
+        NULL,
+        error,
+    };
+    MaPLCallbacks debugBytesCallbacks = {
+        invokeFunctionWithDebugBytes,
+        invokeSubscript,
+        assignProperty,
+        assignSubscript,
+        metadata,
+        debugLineWithDebugBytes,
+        debugVariableUpdateWithDebugBytes,
+        debugVariableDeleteWithDebugBytes,
+        error,
+    };
+    auto resetTestVariables = []() {
+        scriptEncounteredError = false;
+        fakeIntProperty = 0;
+        fakeFloatProperty = 0;
+        fakeIntSubscript = 0;
+        fakeFloatSubscript = 0;
+    };
+    size_t comparedVariableCount = 0;
+    for (const std::filesystem::path &scriptPath : scriptsUnderTest) {
+        const std::vector<uint8_t> &tableBytecode = tableResult.compiledFiles.at(scriptPath);
+        debugTableLineTable = &tableResult.debugLineTables.at(scriptPath);
+        debugTableVariableTable = &tableResult.debugVariableTables.at(scriptPath);
+        debugTableSnapshots.clear();
+        resetTestVariables();
+        executeMaPLScript(&tableBytecode[0], tableBytecode.size(), &tableCallbacks);
+        std::vector<DebugTableSnapshot> tableSnapshots = debugTableSnapshots;
+        
+        const std::vector<uint8_t> &debugBytecode = debugBytesResult.compiledFiles.at(scriptPath);
+        debugBytesState = DebugTableSnapshot{ 0 };
+        debugTableSnapshots.clear();
+        resetTestVariables();
+        executeMaPLScript(&debugBytecode[0], debugBytecode.size(), &debugBytesCallbacks);
+        if (tableSnapshots.size() != debugTableSnapshots.size()) {
+            printf("Script '%s' made %zu host calls with debug tables, but %zu with debug bytes.\n", scriptPath.c_str(), tableSnapshots.size(), debugTableSnapshots.size());
+            exit(1);
+        }
+        
+        // Conditionals and loop conditions are in the line table, but don't report their line via debug bytes.
+        std::vector<std::string> scriptLines = { "" };
+        std::ifstream scriptStream(scriptPath);
+        for (std::string line; std::getline(scriptStream, line);) {
+            scriptLines.push_back(line.substr(std::min(line.find_first_not_of(" \t}"), line.size())));
+        }
+        auto isConditionLine = [&scriptLines](MaPLLineNumber lineNumber) {
+            const std::string &line = lineNumber < scriptLines.size() ? scriptLines[lineNumber] : scriptLines[0];
+            return line.rfind("if ", 0) == 0 || line.rfind("else if ", 0) == 0 || line.rfind("while ", 0) == 0 || line.rfind("for ", 0) == 0;
+        };
+        
+        // Variables that are never read aren't in the variable table, so only the variables in the table are compared.
+        for (size_t i = 0; i < tableSnapshots.size(); i++) {
+            if (tableSnapshots[i].lineNumber != debugTableSnapshots[i].lineNumber && !isConditionLine(tableSnapshots[i].lineNumber)) {
+                printf("Script '%s' reported line %u from its debug line table, but line %u from its debug bytes.\n", scriptPath.c_str(), tableSnapshots[i].lineNumber, debugTableSnapshots[i].lineNumber);
+                exit(1);
+            }
+            for (const auto&[variableName, value] : tableSnapshots[i].variables) {
+                auto expectedValue = debugTableSnapshots[i].variables.find(variableName);
+                if (expectedValue == debugTableSnapshots[i].variables.end() || expectedValue->second != value) {
+                    printf("Script '%s' reported %s = %s from its debug variable table on line %u, which differs from its debug bytes.\n", scriptPath.c_str(), variableName.c_str(), value.c_str(), tableSnapshots[i].lineNumber);
+                    exit(1);
+                }
+                comparedVariableCount++;
+            }
+        }
+    }
+    scriptCallbacksString.clear();
+    scriptPrintString.clear();
+    if (comparedVariableCount == 0) {
+        printf("No variables were found in any debug variable table.\n");
+        exit(1);
+    }
+}
+
 int main(int argc, const char * argv[]) {
     // Get the directory which contains all test scripts.
     if (argc != 3) {
@@ -432,6 +1295,119 @@ int main(int argc, const char * argv[]) {
     runTests(scriptsUnderTest, debugDirectoryMap, debugOptions);
     MaPLCompileResult result = runTests(scriptsUnderTest, nonDebugDirectoryMap, nonDebugOptions);
     
+    // Persisted symbols must keep their values, and new symbols must be assigned values that don't collide with them.
+    MaPLCompileOptions persistedSymbolOptions = nonDebugOptions;
+    MaPLSymbol maxPersistedSymbol = 0;
+    size_t symbolIndex = 0;
+    for (const auto&[descriptor, symbol] : result.persistedSymbols) {
+        // Persist every other symbol, so that the rest must be assigned new values.
+        if (symbolIndex % 2 == 0) {
+            persistedSymbolOptions.persistedSymbols[descriptor] = symbol+1000;
+            maxPersistedSymbol = symbol+1000;
+        }
+        symbolIndex++;
+    }
+    MaPLCompileResult persistedSymbolResult = compileMaPL(scriptsUnderTest, persistedSymbolOptions);
+    for (const auto&[descriptor, symbol] : persistedSymbolResult.persistedSymbols) {
+        bool isPersisted = persistedSymbolOptions.persistedSymbols.count(descriptor);
+        if ((isPersisted && symbol != persistedSymbolOptions.persistedSymbols.at(descriptor)) ||
+            (!isPersisted && symbol <= maxPersistedSymbol)) {
+            printf("Symbol '%s' was assigned an unstable value of %u.\n", descriptor.c_str(), symbol);
+            exit(1);
+        }
+    }
+    
+    // Persisted symbols that share a value can't be told apart by the host, so they must be rejected.
+    MaPLCompileOptions conflictingSymbolOptions = nonDebugOptions;
+    conflictingSymbolOptions.persistedSymbols = result.persistedSymbols;
+    conflictingSymbolOptions.persistedSymbols.begin()->second = std::next(result.persistedSymbols.begin())->second;
+    if (compileMaPL(scriptsUnderTest, conflictingSymbolOptions).errorMessages.size() != 1) {
+        printf("Expected a single error for persisted symbols that share a value.\n");
+        exit(1);
+    }
+
+    // New symbols can't be assigned once a persisted symbol holds the highest value, so they must be rejected rather than wrap around.
+    MaPLCompileOptions exhaustedSymbolOptions = nonDebugOptions;
+    exhaustedSymbolOptions.persistedSymbols[result.persistedSymbols.begin()->first] = std::numeric_limits<MaPLSymbol>::max();
+    MaPLCompileResult exhaustedSymbolResult = compileMaPL(scriptsUnderTest, exhaustedSymbolOptions);
+    if (exhaustedSymbolResult.errorMessages.size() != 1 || exhaustedSymbolResult.compiledFiles.size()) {
+        printf("Expected a single error when symbol values run out.\n");
+        exit(1);
+    }
+    MaPLCompileOptions bundleOptions = nonDebugOptions;
+    bundleOptions.bundleScripts = true;
+    runTests(scriptsUnderTest, nonDebugDirectoryMap, bundleOptions);
+    
+    // Line tables are kept outside of the bytecode, so the bytecode must match the non-debug bytecode exactly.
+    MaPLCompileOptions lineTableOptions = nonDebugOptions;
+    lineTableOptions.debugLineTable = true;
+    MaPLCompileResult lineTableResult = runTests(scriptsUnderTest, nonDebugDirectoryMap, lineTableOptions);
+    for (const auto&[path, lineTable] : lineTableResult.debugLineTables) {
+        if (lineTable.size() == 0 || findMaPLDebugLine(&lineTable[0], lineTable.size(), (MaPLBytecodeLength)~0) == 0) {
+            printf("Script '%s' did not produce a debug line table.\n", path.c_str());
+            exit(1);
+        }
+    }
+    runDebugTableTest(scriptsUnderTest, nonDebugOptions);
+    
+    // Parsing with a profiler attached must not affect the bytecode, and must report on every script.
+    MaPLCompileOptions profileOptions = nonDebugOptions;
+    profileOptions.profileParser = true;
+    MaPLCompileResult profileResult = runTests(scriptsUnderTest, nonDebugDirectoryMap, profileOptions);
+    for (const std::filesystem::path &scriptPath : scriptsUnderTest) {
+        if (!profileResult.parserProfiles.count(scriptPath) || profileResult.parserProfiles.at(scriptPath).empty()) {
+            printf("Script '%s' did not produce a parser profile.\n", scriptPath.c_str());
+            exit(1);
+        }
+    }
+    
+#if !OUTPUT_EXPECTED_FILES
+    // Optimizations such as switch tables, loop unrolling, rotated loops and dead store elimination change the bytecode, but must not change the behavior
+    // of any script, with or without compact encoding.
+    MaPLCompileOptions optimizedOptions = nonDebugOptions;
+    optimizedOptions.optimizationLevel = 2;
+    optimizedOptions.eliminateDeadStores = true;
+    runTests(scriptsUnderTest, nonDebugDirectoryMap, optimizedOptions, false);
+    MaPLCompileOptions optimizedCompactOptions = optimizedOptions;
+    optimizedCompactOptions.compactEncoding = true;
+    runTests(scriptsUnderTest, nonDebugDirectoryMap, optimizedCompactOptions, false);
+    
+    // Profiles invert conditionals, reorder conditional chains, and skip unrolling cold loops, none of which may change behavior.
+    std::map<std::filesystem::path, MaPLScriptProfile> scriptProfiles = recordExecutionProfiles(scriptsUnderTest, nonDebugOptions);
+    MaPLCompileOptions profiledOptions = optimizedOptions;
+    profiledOptions.scriptProfiles = scriptProfiles;
+    runTests(scriptsUnderTest, nonDebugDirectoryMap, profiledOptions, false);
+    runExecutionProfileTest(testRootDirectory, scriptProfiles);
+#endif
+    
+    // Typed metadata is formatted with the shortest round-trip representation of floats, and delivered in a single callback.
+    // Untyped metadata must keep the "%g" formatting of string typecasts. Both must be output identically via a metadata buffer.
+    runMetadataOutputTest(testRootDirectory, true, "Typed 0.1 0.3333333333333333 1e+06 123456 -9000000000 200 false 0.25", 1);
+    runMetadataOutputTest(testRootDirectory, false, "Typed 0.1 0.333333 1e+06 123456 -9000000000 200 false 0.25", 15);
+    
+    // Invariant host expressions must be evaluated once, no matter how deeply the loops that use them are nested.
+    runLoopInvariantTest(testRootDirectory, result.persistedSymbols);
+    
+    // Peephole optimizations must remove bytes without changing the script's behavior.
+    runPeepholeTest(testRootDirectory, result.persistedSymbols);
+    
+    // Propagated constants must fold reads of never-reassigned variables, without changing the script's behavior.
+    runConstantPropagationTest(testRootDirectory, result.persistedSymbols);
+    
+    // Unread variables in the dead store script must be removed from memory, and every removed store must be reported.
+    runDeadStoreTest(testRootDirectory, 8);
+    
+    // Compile sessions must reuse unchanged files, and recompile every file affected by a modification, whether
+    // it's read from the filesystem or supplied by an import resolver.
+    runCompileSessionTest((testRootDirectory / "../SessionTest").lexically_normal(), testRootDirectory / "TestAPI.mapl", result.persistedSymbols);
+    
+    // Linked scripts must behave the same as scripts with their dependencies copied in.
+    runLinkedDependencyTest(testRootDirectory, result.persistedSymbols);
+    
+    // Cost reports must find the same call sites and loops whether or not cursor moves are stored as varints.
+    runCostReportTest(testRootDirectory, false);
+    runCostReportTest(testRootDirectory, true);
+    
 #if OUTPUT_EXPECTED_FILES
     if (result.symbolTable.size() > 0) {
         std::ofstream symbolOutputStream(testRootDirectory / "../MaPLTester/TestSymbols.h");
@@ -472,5 +1448,15 @@ int main(int argc, const char * argv[]) {
     }
     printf("All error cases successfully logged errors.\n");
     
+#if RUN_BUNDLE_BENCHMARK
+    runBundleBenchmark((testRootDirectory / "../BundleBenchmark").lexically_normal());
+#endif
+#if RUN_API_LOOKUP_BENCHMARK
+    runAPILookupBenchmark(testRootDirectory);
+#endif
+#if RUN_METADATA_FLOAT_BENCHMARK
+    runMetadataFloatBenchmark(testRootDirectory);
+#endif
+    
     return 0;
 }